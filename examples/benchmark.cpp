@@ -0,0 +1,1043 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <boost/fusion/include/vector.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "GraphicsMatrices.h"
+#include "BatchTransform.h"
+#include "VectorArray.h"
+#include "Quaternion.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
+#include "PackedVector.h"
+#include "Skinning.h"
+#include "BVH.h"
+#include "BatchSolve.h"
+#include "SpatialGrid.h"
+#include "OcclusionBuffer.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+#include "MeshNormals.h"
+#include "StaticBatch.h"
+#include "TaskScheduler.h"
+
+namespace fusion = boost::fusion;
+
+// same vertex format as in simple.cpp, the transforms work directly on
+// the interleaved data. With a glp::VertexBuffer use the mapped buffer
+// instead of the std::vector.
+typedef fusion::vector<
+            Vector<float,3>,
+            Vector<float,3>,
+            Vector<float,4>
+        > PositionNormalColor;
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+template<class F>
+double seconds(F f, int repetitions)
+{
+    benchmark_clock::time_point start = benchmark_clock::now();
+    for(int i = 0; i<repetitions; ++i)
+        f();
+    std::chrono::duration<double> d = benchmark_clock::now()-start;
+    return d.count()/repetitions;
+}
+
+void report(const char *name, size_t items, double s, const char *unit)
+{
+    std::cout << name << ": " << items/s << ' ' << unit << "/s\n";
+}
+
+void report_per_ms(const char *name, size_t items, double s, const char *unit)
+{
+    std::cout << name << ": " << items/s/1000 << ' ' << unit << "/ms\n";
+}
+
+void benchmark_transform(size_t n)
+{
+    std::vector<PositionNormalColor> vertices(n);
+    for(size_t i = 0; i<n; ++i)
+    {
+        float f = float(i);
+        vertices[i] = PositionNormalColor(
+                        Vector<float,3>(f, 2*f, 3*f),
+                        Vector<float,3>(0, 0, 1),
+                        Vector<float,4>(1, 1, 1, 1));
+    }
+
+    Matrix<float,4,4> model = RotationMatrix(0.5f, 1.0f, 1.0f, 0.0f)
+                            * TranslationMatrix(1.0f, 2.0f, 3.0f);
+    Matrix<float,4,4> mvp = FrustumMatrix(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 100.0f) * model;
+    Matrix<float,4,4> viewport = ViewportMatrix(0.0f, 0.0f, 1024.0f, 768.0f);
+
+    StridedVectorArray<float,3> positions = AttributeArray<0>(vertices);
+    StridedVectorArray<float,3> normals = AttributeArray<1>(vertices);
+    std::vector<Vector<float,4> > clip(n);
+    StridedVectorArray<float,4> out = MakeStridedArray<4>(clip[0].raw(), n, sizeof(clip[0]));
+    const int reps = 10;
+
+    report("per vertex expression", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            clip[i] = mvp*Vector<float,4>(positions[i][0], positions[i][1], positions[i][2], 1);
+    }, reps), "vertices");
+
+    report("TransformPoints single thread", n, seconds([&]() {
+        TransformPoints(mvp, positions, out, n);
+    }, reps), "vertices");
+
+    report("TransformPoints", n, seconds([&]() {
+        TransformPoints(mvp, positions, out);
+    }, reps), "vertices");
+
+    report("TransformNormals in place", n, seconds([&]() {
+        TransformNormals(model, normals, normals);
+    }, reps), "vertices");
+
+    report("ProjectPoints with viewport", n, seconds([&]() {
+        ProjectPoints(mvp, viewport, positions, out);
+    }, reps), "vertices");
+}
+
+// particle integration, array of structs against the fused whole
+// array expression and the scatter into interleaved vertex data
+void benchmark_particles(size_t n)
+{
+    std::vector<Vector<float,3> > aos_pos(n), aos_vel(n, Vector<float,3>(1, 2, 3));
+    Vector<float,3> lo(-10, -10, -10), hi(10, 10, 10);
+    VectorArray<float,3> pos(n), vel(n, uninitialized);
+    VectorArray<float,3> lower(n, uninitialized), upper(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        vel.set(i, Vector<float,3>(1, 2, 3));
+        lower.set(i, lo);
+        upper.set(i, hi);
+    }
+    const float dt = 0.01f;
+    const int reps = 10;
+
+    report("particles array of structs", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            aos_pos[i] = min(max(aos_pos[i] + aos_vel[i]*dt, lo), hi);
+    }, reps), "particles");
+
+    report("particles VectorArray", n, seconds([&]() {
+        pos = min(max(pos + vel*dt, lower), upper);
+    }, reps), "particles");
+
+    std::vector<PositionNormalColor> vertices(n);
+    report("particles scatter to vertices", n, seconds([&]() {
+        AttributeArray<0>(vertices) = pos;
+        AttributeArray<1>(vertices) = normalize(vel);
+    }, reps), "particles");
+}
+
+// the generic path: gauss jordan elimination with partial pivoting
+template<class T, unsigned D>
+Matrix<T,D,D> gauss_jordan_inverse(Matrix<T,D,D> a)
+{
+    Matrix<T,D,D> res = Identity<T,D,D>();
+    for(unsigned j = 0; j<D; ++j)
+    {
+        unsigned p = j;
+        for(unsigned i = j+1; i<D; ++i)
+            if(std::abs(a(i,j)) > std::abs(a(p,j)))
+                p = i;
+        for(unsigned k = 0; k<D; ++k)
+        {
+            std::swap(a(j,k), a(p,k));
+            std::swap(res(j,k), res(p,k));
+        }
+        T inv = 1/a(j,j);
+        for(unsigned k = 0; k<D; ++k)
+        {
+            a(j,k) *= inv;
+            res(j,k) *= inv;
+        }
+        for(unsigned i = 0; i<D; ++i)
+        {
+            if(i == j)
+                continue;
+            T f = a(i,j);
+            for(unsigned k = 0; k<D; ++k)
+            {
+                a(i,k) -= f*a(j,k);
+                res(i,k) -= f*res(j,k);
+            }
+        }
+    }
+    return res;
+}
+
+void benchmark_inverse(size_t n)
+{
+    std::vector<Matrix<float,4,4> > matrices(n), out(n);
+    std::vector<Matrix<float,3,3> > normal(n);
+    for(size_t i = 0; i<n; ++i)
+        matrices[i] = TranslationMatrix(float(i), 1.0f, 2.0f)
+                    * RotationMatrix(0.001f*i, 1.0f, 2.0f, 3.0f);
+    const int reps = 10;
+
+    report("gauss jordan inverse", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = gauss_jordan_inverse(matrices[i]);
+    }, reps), "matrices");
+
+    report("Inverse", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = Inverse(matrices[i]);
+    }, reps), "matrices");
+
+    report("AffineInverse", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = AffineInverse(matrices[i]);
+    }, reps), "matrices");
+
+    report("RigidInverse", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = RigidInverse(matrices[i]);
+    }, reps), "matrices");
+
+    report("BatchInverse", n, seconds([&]() {
+        BatchInverse(matrices.data(), out.data(), n);
+    }, reps), "matrices");
+
+    report("BatchRigidInverse", n, seconds([&]() {
+        BatchRigidInverse(matrices.data(), out.data(), n);
+    }, reps), "matrices");
+
+    report("BatchNormalMatrix", n, seconds([&]() {
+        BatchNormalMatrix(matrices.data(), normal.data(), n);
+    }, reps), "matrices");
+}
+
+void benchmark_quaternion(size_t n)
+{
+    std::vector<Quaternion<float> > qa(n), qb(n), qout(n);
+    std::vector<Matrix<float,4,4> > ma(n), mb(n), mout(n);
+    VectorArray<float,4> a(n, uninitialized), b(n, uninitialized), out(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        qa[i] = RotationQuaternion(0.001f*i, 1.0f, 2.0f, 3.0f);
+        qb[i] = RotationQuaternion(0.002f*i, 3.0f, 2.0f, 1.0f);
+        ma[i] = RotationMatrix(qa[i]);
+        mb[i] = RotationMatrix(qb[i]);
+        a.set(i, qa[i]);
+        b.set(i, qb[i]);
+    }
+    const int reps = 10;
+
+    report("RotationMatrix(angle, axis)", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            mout[i] = RotationMatrix(0.001f*i, 1.0f, 2.0f, 3.0f);
+    }, reps), "matrices");
+
+    report("RotationMatrix(quaternion)", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            mout[i] = RotationMatrix(qa[i]);
+    }, reps), "matrices");
+
+    report("compose matrices", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            mout[i] = ma[i]*mb[i];
+    }, reps), "rotations");
+
+    report("compose quaternions", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            qout[i] = qa[i]*qb[i];
+    }, reps), "rotations");
+
+    report("slerp per quaternion", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            qout[i] = slerp(qa[i], qb[i], 0.3f);
+    }, reps), "quaternions");
+
+    report("slerp VectorArray", n, seconds([&]() {
+        out = slerp(a, b, 0.3f);
+    }, reps), "quaternions");
+
+    report("nlerp VectorArray", n, seconds([&]() {
+        out = nlerp(a, b, 0.3f);
+    }, reps), "quaternions");
+}
+
+void benchmark_culling(size_t n)
+{
+    struct Bounds {
+        Vector<float,3> center;
+        float radius;
+    };
+    std::vector<Bounds> objects(n);
+    VectorArray<float,3> centers(n, uninitialized), lo(n, uninitialized), hi(n, uninitialized);
+    VectorArray<float,1> radii(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        //a pseudo random scene around the camera
+        unsigned h = unsigned(i)*2654435761u;
+        Vector<float,3> c(float(h%1000)-500, float((h>>10)%200)-100, float((h>>20)%1000)-500);
+        float r = 1.0f + (h>>28);
+        objects[i].center = c;
+        objects[i].radius = r;
+        centers.set(i, c);
+        radii.set(i, Vector<float,1>(r));
+        lo.set(i, c-Vector<float,3>(r, r, r));
+        hi.set(i, c+Vector<float,3>(r, r, r));
+    }
+
+    Matrix<float,4,4> viewproj = FrustumMatrix(-1.0f, 1.0f, -0.75f, 0.75f, 1.0f, 400.0f)
+                               * RotationMatrix(0.5f, 0.0f, 1.0f, 0.0f);
+    Frustum<float> frustum(viewproj);
+    std::vector<unsigned> visible(n);
+    size_t count = 0;
+    const int reps = 10;
+
+    report_per_ms("intersects_sphere per object", n, seconds([&]() {
+        count = 0;
+        for(size_t i = 0; i<n; ++i)
+            if(frustum.intersects_sphere(objects[i].center, objects[i].radius))
+                visible[count++] = unsigned(i);
+    }, reps), "objects");
+
+    report_per_ms("CullSpheres single thread", n, seconds([&]() {
+        count = CullSpheres(frustum, centers, radii, visible.data(), n);
+    }, reps), "objects");
+
+    report_per_ms("CullSpheres", n, seconds([&]() {
+        count = CullSpheres(frustum, centers, radii, visible.data());
+    }, reps), "objects");
+
+    report_per_ms("CullBoxes", n, seconds([&]() {
+        count = CullBoxes(frustum, lo, hi, visible.data());
+    }, reps), "objects");
+
+    std::cout << "visible boxes: " << count << '/' << n << '\n';
+}
+
+void benchmark_hierarchy(size_t n)
+{
+    TransformHierarchy<float> scene;
+    for(size_t i = 0; i<n; ++i)
+    {
+        //about 8 children per node
+        unsigned parent = i == 0 ? TransformHierarchy<float>::none : unsigned((i-1)/8);
+        scene.add(parent, Vector<float,3>(1.0f, 0.0f, 0.0f),
+                  RotationQuaternion(0.1f, 0.0f, 1.0f, 0.0f));
+    }
+    scene.update();
+    std::vector<InstanceTransform<float>::type> instances(n);
+    const int reps = 10;
+
+    report("recompute all", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            scene.set_scale(unsigned(i), Vector<float,3>(1.0f, 1.0f, 1.0f));
+        scene.update();
+        scene.write_instances<0>(instances);
+    }, reps), "nodes");
+
+    //moving 5% of the leaves
+    size_t first_leaf = (n-1)/8+1;
+    report("5% leaves moved", n, seconds([&]() {
+        for(size_t i = first_leaf; i<n; i += 20)
+            scene.set_translation(unsigned(i), Vector<float,3>(2.0f, 0.0f, 0.0f));
+        scene.update();
+        scene.write_instances<0>(instances);
+    }, reps), "nodes");
+}
+
+typedef fusion::vector<
+            Vector<float,3>,
+            Vector<float,3>,
+            Vector<float,2>
+        > PositionNormalUV;
+
+//positions are padded to 8 bytes, the shader only reads xyz
+typedef fusion::vector<
+            Vector<Half,4>,
+            PackedNormal,
+            Vector<UNorm16,2>
+        > PackedPositionNormalUV;
+
+//uv sphere with the given number of rings and segments
+std::vector<PositionNormalUV> sphere_mesh(unsigned rings, unsigned segments, float radius)
+{
+    std::vector<PositionNormalUV> vertices;
+    for(unsigned r = 0; r<=rings; ++r)
+        for(unsigned s = 0; s<=segments; ++s)
+        {
+            float u = float(s)/segments, v = float(r)/rings;
+            float phi = 6.2831853f*u, theta = 3.1415927f*v;
+            Vector<float,3> n(std::sin(theta)*std::cos(phi), std::cos(theta), std::sin(theta)*std::sin(phi));
+            vertices.push_back(PositionNormalUV(radius*n, n, Vector<float,2>(u, v)));
+        }
+    return vertices;
+}
+
+//vertex memory and the largest error of each attribute after packing
+void report_quantization(const char *name, std::vector<PositionNormalUV> &mesh)
+{
+    size_t n = mesh.size();
+    std::vector<PackedPositionNormalUV> packed(n);
+    std::vector<PositionNormalUV> decoded(n);
+    Encode(AttributeArray<0>(mesh), MakeStridedArray<3>(&fusion::at_c<0>(packed[0])[0], n, sizeof(packed[0])));
+    EncodeNormals(AttributeArray<1>(mesh), AttributeArray<1>(packed));
+    Encode(AttributeArray<2>(mesh), AttributeArray<2>(packed));
+    Decode(MakeStridedArray<3>(&fusion::at_c<0>(packed[0])[0], n, sizeof(packed[0])), AttributeArray<0>(decoded));
+    DecodeNormals(AttributeArray<1>(packed), AttributeArray<1>(decoded));
+    Decode(AttributeArray<2>(packed), AttributeArray<2>(decoded));
+
+    float error[3] = {0, 0, 0};
+    for(size_t i = 0; i<n; ++i)
+    {
+        error[0] = std::max(error[0], norm(fusion::at_c<0>(mesh[i])-fusion::at_c<0>(decoded[i])));
+        error[1] = std::max(error[1], norm(fusion::at_c<1>(mesh[i])-fusion::at_c<1>(decoded[i])));
+        error[2] = std::max(error[2], norm(fusion::at_c<2>(mesh[i])-fusion::at_c<2>(decoded[i])));
+    }
+    size_t before = n*sizeof(PositionNormalUV), after = n*sizeof(PackedPositionNormalUV);
+    std::cout << name << ": " << n << " vertices, " << before << " -> " << after
+              << " bytes (" << 100*(before-after)/before << "% saved), max error position "
+              << error[0] << " normal " << error[1] << " uv " << error[2] << '\n';
+}
+
+void benchmark_packing(size_t n)
+{
+    std::vector<PositionNormalUV> small = sphere_mesh(16, 32, 1.0f);
+    std::vector<PositionNormalUV> large = sphere_mesh(256, 512, 50.0f);
+    report_quantization("small sphere", small);
+    report_quantization("large sphere", large);
+
+    std::vector<PositionNormalUV> vertices = sphere_mesh(unsigned(n/1024), 1023, 10.0f);
+    std::vector<PackedPositionNormalUV> packed(vertices.size());
+    StridedVectorArray<Half,3> positions = MakeStridedArray<3>(
+        &fusion::at_c<0>(packed[0])[0], packed.size(), sizeof(packed[0]));
+    const int reps = 10;
+
+    report("Encode Half positions", vertices.size(), seconds([&]() {
+        Encode(AttributeArray<0>(vertices), positions);
+    }, reps), "vertices");
+
+    report("Decode Half positions", vertices.size(), seconds([&]() {
+        Decode(positions, AttributeArray<0>(vertices));
+    }, reps), "vertices");
+
+    report("EncodeNormals", vertices.size(), seconds([&]() {
+        EncodeNormals(AttributeArray<1>(vertices), AttributeArray<1>(packed));
+    }, reps), "vertices");
+
+    report("Encode UNorm16 uvs", vertices.size(), seconds([&]() {
+        Encode(AttributeArray<2>(vertices), AttributeArray<2>(packed));
+    }, reps), "vertices");
+}
+
+void benchmark_skinning(size_t characters, unsigned bones)
+{
+    Skeleton<float> skeleton;
+    for(unsigned b = 0; b<bones; ++b)
+        skeleton.add(b == 0 ? Skeleton<float>::none : (b-1)/2,
+                     TranslationMatrix(0.0f, -float(b), 0.0f));
+    std::vector<Matrix<float,4,4> > local(characters*bones);
+    for(size_t i = 0; i<local.size(); ++i)
+        local[i] = TranslationMatrix(0.0f, 1.0f, 0.0f)*RotationMatrix(0.001f*i, 1.0f, 0.0f, 0.0f);
+    std::vector<Matrix<float,4,4> > global(bones), skin(characters*bones);
+    std::vector<float> palettes(characters*bones*PaletteBoneSize);
+    const int reps = 10;
+    std::cout << bones << " bones\n";
+
+    //what a per bone setUniformMatrix upload would be fed with
+    report("  4x4 matrices per bone", characters, seconds([&]() {
+        for(size_t c = 0; c<characters; ++c)
+            for(unsigned b = 0; b<bones; ++b)
+            {
+                unsigned p = skeleton.parent(b);
+                global[b] = p == Skeleton<float>::none ? local[c*bones+b]
+                                                       : Matrix<float,4,4>(global[p]*local[c*bones+b]);
+                skin[c*bones+b] = global[b]*skeleton.inverse_bind(b);
+            }
+    }, reps), "characters");
+
+    report("  BuildPalettes single thread", characters, seconds([&]() {
+        BuildPalettes(skeleton, local.data(), characters, palettes.data(), characters);
+    }, reps), "characters");
+
+    report("  BuildPalettes", characters, seconds([&]() {
+        BuildPalettes(skeleton, local.data(), characters, palettes.data());
+    }, reps), "characters");
+}
+
+void benchmark_cpu_skinning(size_t n, unsigned bones)
+{
+    std::vector<float> palette(bones*PaletteBoneSize);
+    for(unsigned b = 0; b<bones; ++b)
+        StorePaletteRows(Matrix<float,4,4>(RotationMatrix(0.1f*b, 0.0f, 1.0f, 0.0f)),
+                         &palette[b*PaletteBoneSize]);
+    std::vector<Vector<float,3> > positions(n, Vector<float,3>(1, 2, 3)), normals(n, Vector<float,3>(0, 0, 1));
+    std::vector<Vector<float,3> > positions_out(n), normals_out(n);
+    std::vector<Vector<unsigned char,4> > indices(n);
+    std::vector<Vector<UNorm8,4> > weights(n);
+    for(size_t i = 0; i<n; ++i)
+        for(unsigned k = 0; k<4; ++k)
+        {
+            indices[i][k] = (unsigned char)((i+k)%bones);
+            weights[i][k] = UNorm8(0.25f);
+        }
+    const int reps = 10;
+
+    report("SkinVertices", n, seconds([&]() {
+        SkinVertices(palette.data(),
+                     MakeStridedArray<4>(indices[0].raw(), n, sizeof(indices[0])),
+                     MakeStridedArray<4>(weights[0].raw(), n, sizeof(weights[0])),
+                     MakeStridedArray<3>(positions[0].raw(), n, sizeof(positions[0])),
+                     MakeStridedArray<3>(normals[0].raw(), n, sizeof(normals[0])),
+                     MakeStridedArray<3>(positions_out[0].raw(), n, sizeof(positions_out[0])),
+                     MakeStridedArray<3>(normals_out[0].raw(), n, sizeof(normals_out[0])));
+    }, reps), "vertices");
+}
+
+void benchmark_bvh(unsigned rings, unsigned segments)
+{
+    std::vector<PositionNormalUV> mesh = sphere_mesh(rings, segments, 10.0f);
+    std::vector<unsigned> indices;
+    for(unsigned r = 0; r<rings; ++r)
+        for(unsigned s = 0; s<segments; ++s)
+        {
+            unsigned i = r*(segments+1)+s;
+            unsigned quad[6] = { i, i+1, i+segments+1, i+1, i+segments+2, i+segments+1 };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+    size_t triangles = indices.size()/3;
+
+    BVH<float> bvh;
+    report("BVH build", triangles, seconds([&]() {
+        bvh.build(AttributeArray<0>(mesh), indices);
+    }, 3), "triangles");
+    report("BVH refit", triangles, seconds([&]() {
+        bvh.refit(AttributeArray<0>(mesh));
+    }, 3), "triangles");
+
+    //a coherent grid of camera rays with half of them missing the sphere
+    const unsigned width = 512;
+    std::vector<Ray<float> > rays(width*width);
+    std::vector<RayHit<float> > hits(rays.size());
+    for(unsigned y = 0; y<width; ++y)
+        for(unsigned x = 0; x<width; ++x)
+        {
+            Vector<float,3> d(float(x)/width-0.5f, float(y)/width-0.5f, 1.0f);
+            rays[y*width+x] = Ray<float>(Vector<float,3>(0.0f, 0.0f, -30.0f), d);
+        }
+
+    const size_t brute = 16;
+    report("brute force nearest hit", brute, seconds([&]() {
+        for(size_t r = 0; r<brute; ++r)
+        {
+            const Ray<float> &ray = rays[r*rays.size()/brute];
+            float t, u, v, best = ray.tmax;
+            for(size_t i = 0; i<triangles; ++i)
+                if(IntersectTriangle(ray.origin.raw(), ray.direction.raw(),
+                                     fusion::at_c<0>(mesh[indices[3*i]]).raw(),
+                                     fusion::at_c<0>(mesh[indices[3*i+1]]).raw(),
+                                     fusion::at_c<0>(mesh[indices[3*i+2]]).raw(), t, u, v) &&
+                   t >= 0 && t < best)
+                    best = t;
+            hits[r].t = best;
+        }
+    }, 1), "rays");
+
+    report("BVH nearest hit per ray", rays.size(), seconds([&]() {
+        for(size_t r = 0; r<rays.size(); ++r)
+            bvh.intersect(rays[r], hits[r]);
+    }, 3), "rays");
+    report("BVH nearest hit packets single thread", rays.size(), seconds([&]() {
+        bvh.intersect(rays.data(), hits.data(), rays.size(), rays.size());
+    }, 3), "rays");
+    report("BVH nearest hit packets", rays.size(), seconds([&]() {
+        bvh.intersect(rays.data(), hits.data(), rays.size());
+    }, 3), "rays");
+    size_t occluded = 0;
+    report("BVH any hit per ray", rays.size(), seconds([&]() {
+        occluded = 0;
+        for(size_t r = 0; r<rays.size(); ++r)
+            occluded += bvh.occluded(rays[r]);
+    }, 3), "rays");
+
+    std::cout << "BVH nodes: " << bvh.nodes().size() << ", depth: " << bvh.depth()
+              << ", rays hitting: " << occluded << '/' << rays.size() << '\n';
+}
+
+template<class Cells>
+void benchmark_spatial_grid(const char *name, size_t n)
+{
+    //particles in a box with about 8 per unit cell
+    std::vector<Vector<float,3> > positions(n);
+    float side = std::pow(float(n)/8.0f, 1.0f/3.0f);
+    unsigned h = 12345;
+    for(size_t i = 0; i<n; ++i)
+        for(unsigned k = 0; k<3; ++k)
+        {
+            h = h*1664525u + 1013904223u;
+            positions[i][k] = side*float(h>>8)/float(1<<24);
+        }
+    StridedVectorArray<const float,3> view(positions[0].raw(), n, sizeof(Vector<float,3>));
+
+    std::cout << name << '\n';
+    SpatialGrid<float,3,Cells> grid(1.0f);
+    report("build", n, seconds([&]() {
+        grid.build(view);
+    }, 3), "points");
+
+    //5% of the particles jitter, few of them change cells
+    std::vector<unsigned> moved;
+    for(size_t i = 0; i<n; i += 20)
+        moved.push_back(unsigned(i));
+    report("update 5%", moved.size(), seconds([&]() {
+        for(size_t m = 0; m<moved.size(); ++m)
+            positions[moved[m]][0] += (m&1) ? 0.01f : -0.01f;
+        grid.update(view, moved.data(), moved.size());
+    }, 3), "points");
+
+    const size_t queries = n/16;
+    size_t found = 0;
+    report("radius queries", queries, seconds([&]() {
+        found = 0;
+        for(size_t q = 0; q<queries; ++q)
+            grid.radius(positions[q*16], 1.0f, [&found](unsigned, float) { ++found; });
+    }, 3), "queries");
+    report("brute force radius queries", 16, seconds([&]() {
+        for(size_t q = 0; q<16; ++q)
+            for(size_t i = 0; i<n; ++i)
+                found += dot(positions[i]-positions[q], positions[i]-positions[q]) <= 1.0f;
+    }, 1), "queries");
+    std::vector<unsigned> nearest(8*queries);
+    report("8 nearest", queries, seconds([&]() {
+        grid.nearest(view.slice(0, queries), 8, nearest.data());
+    }, 3), "queries");
+    std::vector<size_t> offsets;
+    std::vector<unsigned> list;
+    report("all neighbour lists", n, seconds([&]() {
+        grid.neighbours(1.0f, offsets, list);
+    }, 1), "points");
+    std::cout << "average neighbours: " << double(list.size())/double(n)
+              << ", found: " << found << '\n';
+}
+
+template<unsigned D>
+void benchmark_solve(size_t n)
+{
+    std::vector<Matrix<float,D,D> > a(n), spd(n);
+    std::vector<Vector<float,D> > b(n), x(n);
+    VectorArray<float,D*D> sa(n, uninitialized), sspd(n, uninitialized);
+    VectorArray<float,D> sb(n, uninitialized), sx(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        unsigned h = unsigned(i)*2654435761u;
+        for(unsigned e = 0; e<D*D; ++e)
+        {
+            h = h*1664525u + 1013904223u;
+            a[i].raw()[e] = float(h>>8)/float(1<<24) - 0.5f;
+        }
+        for(unsigned d = 0; d<D; ++d)
+            b[i][d] = float(d+1);
+        spd[i] = Transpose(a[i])*a[i] + Matrix<float,D,D>(Identity<float,D,D>());
+        sa.set(i, MakeVector<D*D>(a[i].raw()));
+        sspd.set(i, MakeVector<D*D>(spd[i].raw()));
+        sb.set(i, b[i]);
+    }
+    std::cout << D << 'x' << D << " systems\n";
+    report("Solve", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            x[i] = Solve(a[i], b[i]);
+    }, 3), "systems");
+    report("Cholesky solve", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            x[i] = Cholesky(spd[i]).solve(b[i]);
+    }, 3), "systems");
+    report("QR solve", n, seconds([&]() {
+        for(size_t i = 0; i<n; ++i)
+            x[i] = QR(a[i]).solve(b[i]);
+    }, 3), "systems");
+    report("BatchSolveLU", n, seconds([&]() {
+        BatchSolveLU(sa, sb, sx);
+    }, 3), "systems");
+    report("BatchSolveCholesky", n, seconds([&]() {
+        BatchSolveCholesky(sspd, sb, sx);
+    }, 3), "systems");
+    report("BatchSolveQR", n, seconds([&]() {
+        BatchSolveQR(sa, sb, sx);
+    }, 3), "systems");
+}
+
+//a city of box buildings hiding small objects between them
+void benchmark_occlusion(unsigned buildings, size_t n)
+{
+    std::vector<Vector<float,3> > positions;
+    std::vector<unsigned> indices;
+    const unsigned faces[6][4] = { {0,1,3,2}, {4,6,7,5}, {0,4,5,1}, {2,3,7,6}, {0,2,6,4}, {1,5,7,3} };
+    unsigned h = 12345;
+    for(unsigned b = 0; b<buildings; ++b)
+    {
+        h = h*1664525u + 1013904223u;
+        float x = float(b%32)*20-320, z = -float(b/32)*20-10;
+        float height = 10.0f + float(h>>27);
+        unsigned base = unsigned(positions.size());
+        for(unsigned c = 0; c<8; ++c)
+            positions.push_back(Vector<float,3>(x + (c&1 ? 16.0f : 0.0f), c&2 ? height : 0.0f,
+                                                z - (c&4 ? 16.0f : 0.0f)));
+        for(unsigned f = 0; f<6; ++f)
+        {
+            const unsigned t[6] = { 0, 1, 2, 0, 2, 3 };
+            for(unsigned k = 0; k<6; ++k)
+                indices.push_back(base+faces[f][t[k]]);
+        }
+    }
+    StridedVectorArray<const float,3> view(positions[0].raw(), positions.size(), sizeof(Vector<float,3>));
+
+    VectorArray<float,3> lo(n, uninitialized), hi(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        h = h*1664525u + 1013904223u;
+        Vector<float,3> c(float(h%640)-320, float((h>>10)%4), -float((h>>14)%640));
+        lo.set(i, c-Vector<float,3>(1, 1, 1));
+        hi.set(i, c+Vector<float,3>(1, 1, 1));
+    }
+
+    Matrix<float,4,4> viewproj = FrustumMatrix(-1.0f, 1.0f, -0.5f, 0.5f, 1.0f, 1000.0f)
+                               * TranslationMatrix(0.0f, -5.0f, 0.0f);
+    OcclusionBuffer buffer(256, 128);
+    std::vector<unsigned> visible(n);
+    size_t count = 0;
+    const int reps = 10;
+
+    double raster = seconds([&]() {
+        buffer.clear();
+        buffer.rasterize(viewproj, view, indices);
+    }, reps);
+    double hiz = seconds([&]() {
+        buffer.build_hiz();
+    }, reps);
+    double cull = seconds([&]() {
+        count = CullOccludedBoxes(buffer, viewproj, lo, hi, visible.data());
+    }, reps);
+    std::cout << "OcclusionBuffer rasterize " << indices.size()/3 << " triangles: "
+              << raster*1000 << " ms/frame\n";
+    std::cout << "OcclusionBuffer build_hiz: " << hiz*1000 << " ms/frame\n";
+    report_per_ms("CullOccludedBoxes", n, cull, "objects");
+    std::cout << "unoccluded boxes: " << count << '/' << n << '\n';
+}
+
+//a grid mesh as a triangle soup, 6 vertices per quad
+void benchmark_weld(unsigned grid)
+{
+    std::vector<PositionNormalColor> soup;
+    soup.reserve(size_t(grid)*grid*6);
+    for(unsigned y = 0; y<grid; ++y)
+        for(unsigned x = 0; x<grid; ++x)
+        {
+            const unsigned corners[6][2] = { {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+            for(unsigned k = 0; k<6; ++k)
+            {
+                float u = float(x+corners[k][0]), v = float(y+corners[k][1]);
+                soup.push_back(PositionNormalColor(Vector<float,3>(u, std::sin(u*0.1f)*std::cos(v*0.1f), v),
+                                                   Vector<float,3>(0, 1, 0),
+                                                   Vector<float,4>(1, 1, 1, 1)));
+            }
+        }
+
+    VertexWelder welder;
+    std::vector<PositionNormalColor> vertices;
+    std::vector<unsigned> indices(soup.size());
+    report("VertexWelder weld", soup.size(), seconds([&]() {
+        welder.weld(soup);
+    }, 3), "vertices");
+    report("VertexWelder weld positions with epsilon", soup.size(), seconds([&]() {
+        welder.weld<0>(soup, 1e-4f);
+    }, 3), "vertices");
+    report("VertexWelder vertices and indices", soup.size(), seconds([&]() {
+        vertices.resize(welder.unique());
+        welder.vertices(soup, vertices.data());
+        welder.indices(indices.data());
+    }, 3), "vertices");
+    std::cout << "welded " << welder.size() << " to " << welder.unique()
+              << " vertices, ratio " << welder.ratio() << '\n';
+}
+
+void report_cache(const char *name, const std::vector<unsigned> &indices, size_t vertices)
+{
+    VertexCacheStats stats = AnalyzeVertexCache(indices.data(), indices.size(), vertices);
+    std::cout << name << ": ACMR " << stats.acmr << ", ATVR " << stats.atvr << '\n';
+}
+
+//a sphere with its triangles in random order
+void benchmark_mesh_optimize(unsigned rings, unsigned segments)
+{
+    std::vector<Vector<float,3> > positions;
+    std::vector<unsigned> indices;
+    for(unsigned r = 0; r<=rings; ++r)
+        for(unsigned s = 0; s<=segments; ++s)
+        {
+            float theta = 3.14159265f*float(r)/float(rings), phi = 6.2831853f*float(s)/float(segments);
+            positions.push_back(Vector<float,3>(std::sin(theta)*std::cos(phi), std::cos(theta),
+                                                std::sin(theta)*std::sin(phi)));
+        }
+    for(unsigned r = 0; r<rings; ++r)
+        for(unsigned s = 0; s<segments; ++s)
+        {
+            unsigned a = r*(segments+1)+s, b = a+segments+1;
+            const unsigned quad[6] = { a, b, a+1, a+1, b, b+1 };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+    unsigned h = 12345;
+    for(size_t t = indices.size()/3-1; t>0; --t)
+    {
+        h = h*1664525u + 1013904223u;
+        size_t j = (h>>8)%(t+1);
+        for(unsigned k = 0; k<3; ++k)
+            std::swap(indices[3*t+k], indices[3*j+k]);
+    }
+    const size_t n = indices.size(), vertices = positions.size();
+    StridedVectorArray<const float,3> view(positions[0].raw(), vertices, sizeof(Vector<float,3>));
+
+    report_cache("shuffled sphere", indices, vertices);
+    std::vector<unsigned> optimized(n);
+    report("OptimizeVertexCache", n/3, seconds([&]() {
+        OptimizeVertexCache(indices.data(), n, vertices, optimized.data());
+    }, 3), "triangles");
+    report_cache("OptimizeVertexCache", optimized, vertices);
+    std::vector<unsigned> sorted(n);
+    report("OptimizeOverdraw", n/3, seconds([&]() {
+        OptimizeOverdraw(optimized.data(), n, view, sorted.data());
+    }, 3), "triangles");
+    report_cache("OptimizeOverdraw", sorted, vertices);
+    std::vector<unsigned> remap(vertices);
+    std::vector<Vector<float,3> > fetch(vertices);
+    report("OptimizeVertexFetch and RemapVertices", vertices, seconds([&]() {
+        optimized = sorted;
+        OptimizeVertexFetch(optimized.data(), n, vertices, remap.data());
+        RemapVertices(positions.data(), vertices, remap.data(), fetch.data());
+    }, 3), "vertices");
+}
+
+//a field of spheres at increasing distance from the camera
+void benchmark_lod(unsigned rings, unsigned segments, size_t instances)
+{
+    std::vector<Vector<float,3> > positions;
+    std::vector<unsigned> indices;
+    for(unsigned r = 0; r<=rings; ++r)
+        for(unsigned s = 0; s<=segments; ++s)
+        {
+            float theta = 3.14159265f*float(r)/float(rings), phi = 6.2831853f*float(s)/float(segments);
+            positions.push_back(Vector<float,3>(std::sin(theta)*std::cos(phi), std::cos(theta),
+                                                std::sin(theta)*std::sin(phi)));
+        }
+    for(unsigned r = 0; r<rings; ++r)
+        for(unsigned s = 0; s<segments; ++s)
+        {
+            unsigned a = r*(segments+1)+s, b = a+segments+1;
+            const unsigned quad[6] = { a, a+1, b, a+1, b+1, b };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+    StridedVectorArray<const float,3> view(positions[0].raw(), positions.size(), sizeof(Vector<float,3>));
+
+    LodChain<unsigned> chain;
+    report("BuildLodChain", indices.size()/3, seconds([&]() {
+        chain = BuildLodChain(indices.data(), indices.size(), view);
+    }, 1), "triangles");
+
+    VectorArray<float,3> centers(instances, uninitialized);
+    VectorArray<float,1> radii(instances, uninitialized);
+    unsigned h = 12345;
+    for(size_t i = 0; i<instances; ++i)
+    {
+        h = h*1664525u + 1013904223u;
+        centers.set(i, Vector<float,3>(float(h%400)-200, 0.0f, -float((h>>10)%1000)));
+        radii.set(i, Vector<float,1>(chain.radius));
+    }
+    std::vector<unsigned> lods(instances);
+    float scale = LodPixelScale(-0.75f, 0.75f, 1.0f, 1080u);
+    double select = seconds([&]() {
+        SelectLods(Vector<float,3>(0, 0, 0), scale, centers, radii, chain.errors.data(),
+                   chain.levels(), 1.0f, lods.data());
+    }, 10);
+    size_t full = 0, submitted = 0;
+    for(size_t i = 0; i<instances; ++i)
+    {
+        full += chain.offsets[1]/3;
+        submitted += (chain.offsets[lods[i]+1]-chain.offsets[lods[i]])/3;
+    }
+    std::cout << "SelectLods " << instances << " instances: " << select*1000 << " ms/frame\n";
+    std::cout << "triangles submitted: " << submitted << " instead of " << full
+              << " (" << 100.0*double(submitted)/double(full) << "%)\n";
+}
+
+//a height field with position, normal, texture coordinate and tangent
+void benchmark_normals(unsigned grid)
+{
+    typedef fusion::vector<Vector<float,3>, Vector<float,3>, Vector<float,2>, Vector<float,4> > Vertex;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned> indices;
+    for(unsigned y = 0; y<=grid; ++y)
+        for(unsigned x = 0; x<=grid; ++x)
+        {
+            float u = float(x)/float(grid), v = float(y)/float(grid);
+            vertices.push_back(Vertex(Vector<float,3>(u, std::sin(u*20)*std::cos(v*20)*0.05f, v),
+                                      Vector<float,3>(0, 0, 0), Vector<float,2>(u, v),
+                                      Vector<float,4>(0, 0, 0, 0)));
+        }
+    for(unsigned y = 0; y<grid; ++y)
+        for(unsigned x = 0; x<grid; ++x)
+        {
+            unsigned a = y*(grid+1)+x, b = a+grid+1;
+            const unsigned quad[6] = { a, b, a+1, a+1, b, b+1 };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+
+    report("GenerateNormals area weights", vertices.size(), seconds([&]() {
+        GenerateNormals<0,1>(vertices, indices.data(), indices.size(), AreaWeights);
+    }, 3), "vertices");
+    report("GenerateNormals angle weights", vertices.size(), seconds([&]() {
+        GenerateNormals<0,1>(vertices, indices.data(), indices.size(), AngleWeights);
+    }, 3), "vertices");
+    report("GenerateTangents", vertices.size(), seconds([&]() {
+        GenerateTangents<0,2,1,3>(vertices, indices.data(), indices.size());
+    }, 3), "vertices");
+}
+
+//a level of props built from a few meshes with a handful of materials
+void benchmark_static_batch(size_t instances, float cell)
+{
+    StaticBatchBuilder<PositionNormalUV> builder;
+    for(unsigned m = 0; m<4; ++m)
+    {
+        //spheres of 4 to 32 segments
+        unsigned rings = 2 << m, segments = 4 << m;
+        std::vector<PositionNormalUV> vertices;
+        std::vector<unsigned> indices;
+        for(unsigned r = 0; r<=rings; ++r)
+            for(unsigned s = 0; s<=segments; ++s)
+            {
+                float theta = 3.14159265f*float(r)/float(rings), phi = 6.2831853f*float(s)/float(segments);
+                Vector<float,3> n(std::sin(theta)*std::cos(phi), std::cos(theta), std::sin(theta)*std::sin(phi));
+                vertices.push_back(PositionNormalUV(n, n, Vector<float,2>(float(s)/float(segments), float(r)/float(rings))));
+            }
+        for(unsigned r = 0; r<rings; ++r)
+            for(unsigned s = 0; s<segments; ++s)
+            {
+                unsigned a = r*(segments+1)+s, b = a+segments+1;
+                const unsigned quad[6] = { a, a+1, b, a+1, b+1, b };
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        builder.add_mesh(vertices, indices);
+    }
+    for(size_t i = 0; i<instances; ++i)
+    {
+        //pseudo random placement in a 2000x2000 area
+        unsigned h = unsigned(i)*2654435761u;
+        builder.add_instance(unsigned(i%4), unsigned(i%8),
+                             TranslationMatrix(float(h%2000)-1000, 0.0f, float((h>>11)%2000)-1000)*
+                             RotationMatrix(0.001f*float(h>>22), 0.0f, 1.0f, 0.0f));
+    }
+
+    double s = seconds([&]() { builder.build<0,1>(cell); }, 3);
+    report("StaticBatchBuilder", instances, s, "instances");
+    report("StaticBatchBuilder", builder.vertices().size(), s, "vertices");
+    StaticBatchStats stats = builder.stats();
+    std::cout << "draws: " << stats.draws << " instead of " << stats.instances
+              << " (" << stats.draw_reduction() << "x fewer, " << stats.materials << " materials)\n";
+    std::cout << "memory: " << stats.batched_bytes/1024 << " KiB instead of " << stats.source_bytes/1024
+              << " KiB (" << stats.memory_ratio() << "x)\n";
+}
+
+//the batch kernels on 1 thread, powers of two and all hardware threads
+void benchmark_scaling(size_t n)
+{
+    std::vector<PositionNormalColor> vertices(n);
+    std::vector<Vector<float,4> > clip(n);
+    std::vector<Matrix<float,4,4> > matrices(n/4), inverses(n/4);
+    VectorArray<float,3> centers(n, uninitialized);
+    VectorArray<float,1> radii(n, uninitialized);
+    std::vector<unsigned> visible(n);
+    for(size_t i = 0; i<n; ++i)
+    {
+        unsigned h = unsigned(i)*2654435761u;
+        Vector<float,3> c(float(h%1000)-500, float((h>>10)%200)-100, float((h>>20)%1000)-500);
+        vertices[i] = PositionNormalColor(c, Vector<float,3>(0, 0, 1), Vector<float,4>(1, 1, 1, 1));
+        centers.set(i, c);
+        radii.set(i, Vector<float,1>(1.0f + (h>>28)));
+    }
+    for(size_t i = 0; i<matrices.size(); ++i)
+        matrices[i] = TranslationMatrix(float(i), 1.0f, 2.0f)
+                    * RotationMatrix(0.001f*i, 1.0f, 2.0f, 3.0f);
+    Matrix<float,4,4> mvp = FrustumMatrix(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 100.0f)
+                          * TranslationMatrix(1.0f, 2.0f, 3.0f);
+    Frustum<float> frustum(mvp);
+    StridedVectorArray<float,3> positions = AttributeArray<0>(vertices);
+    StridedVectorArray<float,3> normals = AttributeArray<1>(vertices);
+    StridedVectorArray<float,4> out = MakeStridedArray<4>(clip[0].raw(), n, sizeof(clip[0]));
+    const int reps = 10;
+
+    std::vector<unsigned> counts;
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned threads = 1; threads<hardware; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(hardware);
+
+    glp::TaskScheduler &scheduler = glp::TaskScheduler::instance();
+    for(size_t c = 0; c<counts.size(); ++c)
+    {
+        unsigned threads = counts[c];
+        scheduler.set_threads(threads);
+        std::cout << threads << " threads\n";
+        report("TransformPoints", n, seconds([&]() {
+            TransformPoints(mvp, positions, out);
+        }, reps), "vertices");
+        report("NormalizeVectors", n, seconds([&]() {
+            NormalizeVectors(normals, normals);
+        }, reps), "vectors");
+        report("BatchInverse", matrices.size(), seconds([&]() {
+            BatchInverse(matrices.data(), inverses.data(), matrices.size());
+        }, reps), "matrices");
+        report_per_ms("CullSpheres", n, seconds([&]() {
+            CullSpheres(frustum, centers, radii, visible.data());
+        }, reps), "objects");
+        //what VertexBuffer::fill does with a mapped buffer
+        report("vertex fill", n, seconds([&]() {
+            PositionNormalColor *v = vertices.data();
+            glp::parallel_for(0, n, 16384, [v](size_t begin, size_t end) {
+                for(size_t i = begin; i<end; ++i)
+                    fusion::at_c<2>(v[i]) = Vector<float,4>(float(i&255)/255, 0.5f, 0.5f, 1.0f);
+            });
+        }, reps), "vertices");
+    }
+    scheduler.set_threads(0);
+}
+
+int main()
+{
+    benchmark_transform(1 << 20);
+    benchmark_particles(1 << 20);
+    benchmark_inverse(1 << 18);
+    benchmark_quaternion(1 << 20);
+    benchmark_culling(200000);
+    benchmark_hierarchy(1 << 18);
+    benchmark_packing(1 << 20);
+    benchmark_skinning(4096, 32);
+    benchmark_skinning(4096, 64);
+    benchmark_skinning(1024, 128);
+    benchmark_cpu_skinning(1 << 20, 64);
+    benchmark_bvh(512, 1024);
+    benchmark_solve<3>(1 << 18);
+    benchmark_solve<6>(1 << 16);
+    benchmark_spatial_grid<HashedCells>("SpatialGrid hashed cells", 1 << 21);
+    benchmark_spatial_grid<UniformCells>("SpatialGrid uniform cells", 1 << 21);
+    benchmark_occlusion(1024, 1 << 18);
+    benchmark_weld(512);
+    benchmark_mesh_optimize(256, 512);
+    benchmark_lod(64, 128, 100000);
+    benchmark_normals(1024);
+    benchmark_static_batch(10000, 256.0f);
+    benchmark_scaling(1 << 20);
+    return 0;
+}
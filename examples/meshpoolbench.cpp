@@ -0,0 +1,198 @@
+// draws many small meshes once with their own buffers and vertex array
+// each and once from a glp::MeshPool, then removes every other mesh and
+// defragments the pool a step per frame:
+//
+//   separate buffers - a VertexBuffer, IndexBuffer and VertexArray per mesh
+//   mesh pool        - shared buffers, one vertex array per buffer
+//
+// Runs headless on an EGL surfaceless context like streambench.cpp:
+//
+//   g++ -O3 -std=c++11 -pthread -Iinclude examples/meshpoolbench.cpp -lEGL -lGL -lGLU
+//
+// The triangles lie outside the view volume so the draws cost little
+// more than their submission.
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/fusion/include/vector.hpp>
+
+#include "MathVector.h"
+#include "GLVertexBuffer.h"
+#include "GLVertexArray.h"
+#include "GLMeshPool.h"
+
+namespace fusion = boost::fusion;
+
+typedef fusion::vector<
+            Vector<GLfloat,3>,
+            Vector<GLfloat,3>,
+            Vector<GLfloat,2>
+        > PositionNormalUV;
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+//creates a core profile context without a surface
+bool create_context()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    EGLDisplay display = get_display ?
+        get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0) :
+        eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if(!eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGLConfig(0), EGL_NO_CONTEXT, context_attributes);
+    return context != EGL_NO_CONTEXT &&
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+//a ring of m%32+3 segments behind the far plane
+void make_mesh(unsigned m, std::vector<PositionNormalUV> &vertices, std::vector<GLuint> &indices)
+{
+    unsigned segments = m%32+3;
+    vertices.clear();
+    indices.clear();
+    vertices.push_back(PositionNormalUV(Vector<GLfloat,3>(0, 0, 2), Vector<GLfloat,3>(0, 0, 1),
+                                        Vector<GLfloat,2>(0.5f, 0.5f)));
+    for(unsigned s = 0; s<segments; ++s)
+    {
+        float a = 6.2831853f*float(s)/float(segments);
+        vertices.push_back(PositionNormalUV(Vector<GLfloat,3>(std::cos(a), std::sin(a), 2),
+                                            Vector<GLfloat,3>(0, 0, 1),
+                                            Vector<GLfloat,2>(std::cos(a), std::sin(a))));
+        indices.push_back(0);
+        indices.push_back(s+1);
+        indices.push_back((s+1)%segments+1);
+    }
+}
+
+template<class F>
+double milliseconds(F f, unsigned frames)
+{
+    glFinish();
+    benchmark_clock::time_point start = benchmark_clock::now();
+    for(unsigned i = 0; i<frames; ++i)
+        f();
+    glFinish();
+    std::chrono::duration<double> d = benchmark_clock::now()-start;
+    return d.count()*1000/frames;
+}
+
+void report(const glp::MeshPoolStats &stats)
+{
+    std::cout << "  " << stats.meshes << " meshes in " << stats.buffers << " buffers, "
+              << stats.live_bytes/1024 << " KiB live, " << stats.free_bytes/1024 << " KiB free in "
+              << stats.free_ranges << " ranges, fragmentation " << stats.fragmentation() << '\n';
+}
+
+int main()
+{
+    if(!create_context())
+    {
+        std::cerr << "no OpenGL 3.3 context\n";
+        return 1;
+    }
+    std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << '\n';
+
+    GLuint framebuffer, renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 16, 16);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    const unsigned meshes = 10000, frames = 20;
+    std::vector<PositionNormalUV> vertices;
+    std::vector<GLuint> indices;
+
+    {
+        std::vector<std::unique_ptr<glp::VertexBuffer<PositionNormalUV> > > vbos;
+        std::vector<std::unique_ptr<glp::IndexBuffer<GLuint> > > ibos;
+        std::vector<std::unique_ptr<glp::VertexArray> > vaos;
+        benchmark_clock::time_point start = benchmark_clock::now();
+        for(unsigned m = 0; m<meshes; ++m)
+        {
+            make_mesh(m, vertices, indices);
+            vbos.push_back(std::unique_ptr<glp::VertexBuffer<PositionNormalUV> >(
+                new glp::VertexBuffer<PositionNormalUV>(vertices.size(), GL_STATIC_DRAW)));
+            vbos.back()->map();
+            std::copy(vertices.begin(), vertices.end(), vbos.back()->data());
+            vbos.back()->unmap();
+            ibos.push_back(std::unique_ptr<glp::IndexBuffer<GLuint> >(new glp::IndexBuffer<GLuint>(indices.size())));
+            ibos.back()->map();
+            std::copy(indices.begin(), indices.end(), ibos.back()->data());
+            ibos.back()->unmap();
+            vaos.push_back(std::unique_ptr<glp::VertexArray>(new glp::VertexArray));
+            vaos.back()->attach(*vbos.back());
+            vaos.back()->attach(*ibos.back());
+        }
+        std::chrono::duration<double> upload = benchmark_clock::now()-start;
+        double draw = milliseconds([&]() {
+            for(unsigned m = 0; m<meshes; ++m)
+                vaos[m]->draw(GL_TRIANGLES);
+        }, frames);
+        std::cout << "separate buffers: " << 2*meshes << " buffer objects, upload "
+                  << upload.count()*1000 << " ms, " << draw << " ms/frame\n";
+    }
+
+    {
+        glp::MeshPool<PositionNormalUV> pool;
+        std::vector<unsigned> handles;
+        benchmark_clock::time_point start = benchmark_clock::now();
+        for(unsigned m = 0; m<meshes; ++m)
+        {
+            make_mesh(m, vertices, indices);
+            handles.push_back(pool.add(vertices.data(), vertices.size(), indices.data(), indices.size()));
+        }
+        std::chrono::duration<double> upload = benchmark_clock::now()-start;
+        double draw = milliseconds([&]() {
+            pool.draw(handles.data(), handles.size());
+        }, frames);
+        std::cout << "mesh pool: " << pool.stats().buffers << " buffer objects, upload "
+                  << upload.count()*1000 << " ms, " << draw << " ms/frame\n";
+        report(pool.stats());
+
+        std::vector<unsigned> kept;
+        for(unsigned m = 0; m<meshes; ++m)
+            if(m%2)
+                pool.remove(handles[m]);
+            else
+                kept.push_back(handles[m]);
+        std::cout << "every other mesh removed\n";
+        report(pool.stats());
+
+        unsigned steps = 0;
+        size_t copied = 0;
+        double defragment = milliseconds([&]() {
+            size_t bytes = pool.defragment();
+            copied += bytes;
+            steps += bytes > 0;
+            pool.draw(kept.data(), kept.size());
+        }, frames);
+        std::cout << "defragmented in " << steps << " frames, " << copied/1024 << " KiB copied, "
+                  << defragment << " ms/frame with draws\n";
+        report(pool.stats());
+    }
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    return 0;
+}
@@ -0,0 +1,530 @@
+// microbenchmarks of the math headers against hand written baselines.
+// Every operation is timed over arrays of several sizes in up to four
+// variants:
+//
+//   expression  - the MathVector.h/MathMatrix.h operators, per element
+//   loop        - plain scalar loops over float arrays
+//   intrinsics  - hand written SSE, if available
+//   batch       - the VectorArray.h/BatchTransform.h whole array forms
+//
+// The precision policies of normalize/norm (see MathVector.h) are
+// timed as separate ops and their measured worst case errors are
+// checked against the documented bounds, the program fails if one is
+// exceeded.
+//
+// Results are written to stdout as JSON. The "simd" field tells which
+// kernels the headers used, build once normally and once with
+// -DGLP_NO_SIMD to compare the SIMD and the generic code paths:
+//
+//   g++ -O3 -march=native -std=c++11 -pthread -Iinclude examples/microbench.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "GraphicsMatrices.h"
+#include "BatchTransform.h"
+#include "VectorArray.h"
+
+typedef std::chrono::steady_clock microbench_clock;
+
+//results are summed here so no computation can be optimized away
+volatile float sink;
+
+struct Result {
+    std::string op, variant;
+    size_t batch;
+    double ns_per_item;
+};
+
+std::vector<Result> results;
+
+struct ErrorCheck {
+    std::string op, precision;
+    double max_error, bound;
+};
+
+std::vector<ErrorCheck> errors;
+
+//best of several trials, each repeating f often enough to process
+//about 4M elements
+template<class F>
+void measure(const char *op, const char *variant, size_t batch, F f)
+{
+    const size_t work = 1 << 22;
+    size_t reps = std::max<size_t>(1, work/batch);
+    double best = 1e30;
+    for(int trial = 0; trial<5; ++trial)
+    {
+        microbench_clock::time_point start = microbench_clock::now();
+        for(size_t r = 0; r<reps; ++r)
+            f();
+        std::chrono::duration<double, std::nano> d = microbench_clock::now()-start;
+        best = std::min(best, d.count()/(double(reps)*batch));
+    }
+    Result res = { op, variant, batch, best };
+    results.push_back(res);
+}
+
+const char* simd_name()
+{
+#if defined(GLP_SIMD_AVX)
+    return "avx";
+#elif defined(GLP_SIMD_SSE)
+    return "sse";
+#else
+    return "none";
+#endif
+}
+
+void write_json(std::ostream &out)
+{
+    out << "{\n  \"simd\": \"" << simd_name() << "\",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+    out << "  \"results\": [\n";
+    for(size_t i = 0; i<results.size(); ++i)
+    {
+        const Result &r = results[i];
+        out << "    {\"op\": \"" << r.op << "\", \"variant\": \"" << r.variant
+            << "\", \"batch\": " << r.batch
+            << ", \"ns_per_item\": " << r.ns_per_item
+            << ", \"items_per_second\": " << 1e9/r.ns_per_item << "}"
+            << (i+1<results.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"precision\": [\n";
+    for(size_t i = 0; i<errors.size(); ++i)
+    {
+        const ErrorCheck &e = errors[i];
+        out << "    {\"op\": \"" << e.op << "\", \"precision\": \"" << e.precision
+            << "\", \"max_relative_error\": " << e.max_error
+            << ", \"bound\": " << e.bound
+            << ", \"ok\": " << (e.max_error <= e.bound ? "true" : "false") << "}"
+            << (i+1<errors.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void bench_vector(size_t n)
+{
+    std::vector<Vector<float,3> > a3(n), b3(n), out3(n);
+    std::vector<Vector<float,4> > a4(n), b4(n), out4(n);
+    std::vector<float> s(n);
+    for(size_t i = 0; i<n; ++i)
+    {
+        float f = float(i%97)+1;
+        a3[i] = Vector<float,3>(f, 2*f, 3);
+        b3[i] = Vector<float,3>(1, f, -f);
+        a4[i] = Vector<float,4>(f, 2*f, 3, 1);
+        b4[i] = Vector<float,4>(1, f, -f, 2);
+    }
+    VectorArray<float,3> va(n, uninitialized), vb(n, uninitialized), vout(n, uninitialized);
+    VectorArray<float,1> vs(n, uninitialized);
+    for(size_t i = 0; i<n; ++i)
+    {
+        va.set(i, a3[i]);
+        vb.set(i, b3[i]);
+    }
+    const float *pa = a3[0].raw(), *pb = b3[0].raw();
+    float *po = out3[0].raw();
+
+    measure("dot3", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            s[i] = dot(a3[i], b3[i]);
+        sink = sink + s[n-1];
+    });
+    measure("dot3", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            s[i] = pa[3*i]*pb[3*i] + pa[3*i+1]*pb[3*i+1] + pa[3*i+2]*pb[3*i+2];
+        sink = sink + s[n-1];
+    });
+    measure("dot3", "batch", n, [&]() {
+        vs = dot(va, vb);
+        sink = sink + vs.lane(0)[n-1];
+    });
+
+    measure("dot4", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            s[i] = dot(a4[i], b4[i]);
+        sink = sink + s[n-1];
+    });
+#ifdef __SSE__
+    measure("dot4", "intrinsics", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            __m128 m = _mm_mul_ps(_mm_loadu_ps(a4[i].raw()), _mm_loadu_ps(b4[i].raw()));
+            m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+            m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+            s[i] = _mm_cvtss_f32(m);
+        }
+        sink = sink + s[n-1];
+    });
+#endif
+
+    measure("cross", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out3[i] = cross(a3[i], b3[i]);
+        sink = sink + out3[n-1][0];
+    });
+    measure("cross", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *x = pa+3*i, *y = pb+3*i;
+            po[3*i]   = x[1]*y[2]-x[2]*y[1];
+            po[3*i+1] = x[2]*y[0]-x[0]*y[2];
+            po[3*i+2] = x[0]*y[1]-x[1]*y[0];
+        }
+        sink = sink + po[0];
+    });
+
+    measure("normalize3", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out3[i] = normalize(a3[i]);
+        sink = sink + out3[n-1][0];
+    });
+    measure("normalize3", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *x = pa+3*i;
+            float inv = 1.0f/std::sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2]);
+            po[3*i] = x[0]*inv;
+            po[3*i+1] = x[1]*inv;
+            po[3*i+2] = x[2]*inv;
+        }
+        sink = sink + po[0];
+    });
+    measure("normalize3", "batch", n, [&]() {
+        vout = normalize(va);
+        sink = sink + vout.lane(0)[n-1];
+    });
+
+    measure("normalize4", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out4[i] = normalize(a4[i]);
+        sink = sink + out4[n-1][0];
+    });
+#ifdef __SSE__
+    measure("normalize4", "intrinsics", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            __m128 v = _mm_loadu_ps(a4[i].raw());
+            __m128 m = _mm_mul_ps(v, v);
+            m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2,3,0,1)));
+            m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1,0,3,2)));
+            _mm_storeu_ps(out4[i].raw(), _mm_div_ps(v, _mm_sqrt_ps(m)));
+        }
+        sink = sink + out4[n-1][0];
+    });
+#endif
+}
+
+//4x4 column major product out = a*b
+inline void loop_mat4_mul(const float *a, const float *b, float *out)
+{
+    for(unsigned j = 0; j<4; ++j)
+        for(unsigned i = 0; i<4; ++i)
+            out[i+4*j] = a[i]*b[4*j] + a[i+4]*b[4*j+1] + a[i+8]*b[4*j+2] + a[i+12]*b[4*j+3];
+}
+
+void bench_matrix(size_t n)
+{
+    std::vector<Matrix<float,4,4> > ma(n), mb(n), mc(n), mout(n);
+    std::vector<Matrix<float,3,3> > m3(n);
+    std::vector<Vector<float,4> > v(n), vout(n);
+    std::vector<Vector<float,3> > points(n), points_out(n);
+    for(size_t i = 0; i<n; ++i)
+    {
+        float f = 0.001f*i;
+        ma[i] = RotationMatrix(f, 1.0f, 2.0f, 3.0f);
+        mb[i] = TranslationMatrix(f, 1.0f, 2.0f);
+        mc[i] = ScaleMatrix(1.0f, f, 2.0f);
+        v[i] = Vector<float,4>(f, 1, 2, 1);
+        points[i] = Vector<float,3>(f, 1, 2);
+    }
+    const Matrix<float,4,4> m = ma[n/2];
+
+    measure("mat4*vec4", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            vout[i] = ma[i]*v[i];
+        sink = sink + vout[n-1][0];
+    });
+    measure("mat4*vec4", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw(), *x = v[i].raw();
+            float *r = vout[i].raw();
+            for(unsigned k = 0; k<4; ++k)
+                r[k] = a[k]*x[0] + a[k+4]*x[1] + a[k+8]*x[2] + a[k+12]*x[3];
+        }
+        sink = sink + vout[n-1][0];
+    });
+#ifdef __SSE__
+    measure("mat4*vec4", "intrinsics", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw(), *x = v[i].raw();
+            __m128 r = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(x[0]));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+4), _mm_set1_ps(x[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+8), _mm_set1_ps(x[2])));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+12), _mm_set1_ps(x[3])));
+            _mm_storeu_ps(vout[i].raw(), r);
+        }
+        sink = sink + vout[n-1][0];
+    });
+#endif
+    //one matrix applied to every point
+    measure("mat4*point", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            vout[i] = m*Vector<float,4>(points[i][0], points[i][1], points[i][2], 1);
+        sink = sink + vout[n-1][0];
+    });
+    measure("mat4*point", "batch", n, [&]() {
+        TransformPoints(m, MakeStridedArray<3>(points[0].raw(), n, sizeof(points[0])),
+                        MakeStridedArray<3>(points_out[0].raw(), n, sizeof(points_out[0])));
+        sink = sink + points_out[n-1][0];
+    });
+
+    measure("mat4*mat4", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            mout[i] = ma[i]*mb[i];
+        sink = sink + mout[n-1](0,0);
+    });
+    measure("mat4*mat4", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            loop_mat4_mul(ma[i].raw(), mb[i].raw(), mout[i].raw());
+        sink = sink + mout[n-1](0,0);
+    });
+#ifdef __SSE__
+    measure("mat4*mat4", "intrinsics", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw(), *b = mb[i].raw();
+            float *r = mout[i].raw();
+            __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a+4);
+            __m128 a2 = _mm_loadu_ps(a+8), a3 = _mm_loadu_ps(a+12);
+            for(unsigned j = 0; j<4; ++j)
+            {
+                __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[4*j]));
+                c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[4*j+1])));
+                c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[4*j+2])));
+                c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[4*j+3])));
+                _mm_storeu_ps(r+4*j, c);
+            }
+        }
+        sink = sink + mout[n-1](0,0);
+    });
+#endif
+
+    measure("mat4*mat4*mat4*vec4", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            vout[i] = ma[i]*mb[i]*mc[i]*v[i];
+        sink = sink + vout[n-1][0];
+    });
+    measure("mat4*mat4*mat4*vec4", "loop", n, [&]() {
+        float t0[16], t1[16];
+        for(size_t i = 0; i<n; ++i)
+        {
+            loop_mat4_mul(ma[i].raw(), mb[i].raw(), t0);
+            loop_mat4_mul(t0, mc[i].raw(), t1);
+            const float *x = v[i].raw();
+            float *r = vout[i].raw();
+            for(unsigned k = 0; k<4; ++k)
+                r[k] = t1[k]*x[0] + t1[k+4]*x[1] + t1[k+8]*x[2] + t1[k+12]*x[3];
+        }
+        sink = sink + vout[n-1][0];
+    });
+
+    measure("transpose", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            mout[i] = Transpose(ma[i]);
+        sink = sink + mout[n-1](0,1);
+    });
+    measure("transpose", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw();
+            float *r = mout[i].raw();
+            for(unsigned j = 0; j<4; ++j)
+                for(unsigned k = 0; k<4; ++k)
+                    r[k+4*j] = a[j+4*k];
+        }
+        sink = sink + mout[n-1](0,1);
+    });
+#ifdef __SSE__
+    measure("transpose", "intrinsics", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw();
+            float *r = mout[i].raw();
+            __m128 c0 = _mm_loadu_ps(a), c1 = _mm_loadu_ps(a+4);
+            __m128 c2 = _mm_loadu_ps(a+8), c3 = _mm_loadu_ps(a+12);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _mm_storeu_ps(r, c0);
+            _mm_storeu_ps(r+4, c1);
+            _mm_storeu_ps(r+8, c2);
+            _mm_storeu_ps(r+12, c3);
+        }
+        sink = sink + mout[n-1](0,1);
+    });
+#endif
+
+    measure("submatrix3x3", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            m3[i] = SubMatrix<3,3>(ma[i], 0, 0);
+        sink = sink + m3[n-1](0,0);
+    });
+    measure("submatrix3x3", "loop", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+        {
+            const float *a = ma[i].raw();
+            float *r = m3[i].raw();
+            for(unsigned j = 0; j<3; ++j)
+                for(unsigned k = 0; k<3; ++k)
+                    r[k+3*j] = a[k+4*j];
+        }
+        sink = sink + m3[n-1](0,0);
+    });
+}
+
+void bench_builders(size_t n)
+{
+    std::vector<Matrix<float,4,4> > out(n);
+    std::vector<float> f(n);
+    for(size_t i = 0; i<n; ++i)
+        f[i] = 1.0f+0.001f*i;
+
+    measure("TranslationMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = TranslationMatrix(f[i], 2.0f, 3.0f);
+        sink = sink + out[n-1](0,3);
+    });
+    measure("ScaleMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = ScaleMatrix(f[i], 2.0f, 3.0f);
+        sink = sink + out[n-1](0,0);
+    });
+    measure("RotationMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = RotationMatrix(f[i], 1.0f, 2.0f, 3.0f);
+        sink = sink + out[n-1](0,0);
+    });
+    measure("FrustumMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = FrustumMatrix(-f[i], f[i], -1.0f, 1.0f, 1.0f, 100.0f);
+        sink = sink + out[n-1](0,0);
+    });
+    measure("OrthoMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = OrthoMatrix(-f[i], f[i], -1.0f, 1.0f, 1.0f, 100.0f);
+        sink = sink + out[n-1](0,0);
+    });
+    measure("ViewportMatrix", "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = ViewportMatrix(0.0f, 0.0f, f[i], 768.0f);
+        sink = sink + out[n-1](0,0);
+    });
+}
+
+template<class P>
+void bench_precision(size_t n, const char *name, P precision)
+{
+    std::vector<Vector<float,3> > a(n), out(n);
+    std::vector<float> lengths(n);
+    for(size_t i = 0; i<n; ++i)
+    {
+        float f = float(i%97)+1;
+        a[i] = Vector<float,3>(f, 2*f, 3);
+    }
+    StridedVectorArray<float,3> in = MakeStridedArray<3>(a[0].raw(), n, sizeof(a[0]));
+    StridedVectorArray<float,3> dst = MakeStridedArray<3>(out[0].raw(), n, sizeof(out[0]));
+    std::string op = std::string("normalize3 ") + name;
+    measure(op.c_str(), "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            out[i] = normalize(a[i], precision);
+        sink = sink + out[n-1][0];
+    });
+    measure(op.c_str(), "batch", n, [&]() {
+        NormalizeVectors(in, dst, precision, n);
+        sink = sink + out[n-1][0];
+    });
+    op = std::string("norm3 ") + name;
+    measure(op.c_str(), "expression", n, [&]() {
+        for(size_t i = 0; i<n; ++i)
+            lengths[i] = norm(a[i], precision);
+        sink = sink + lengths[n-1];
+    });
+    measure(op.c_str(), "batch", n, [&]() {
+        VectorNorms(in, lengths.data(), precision, n);
+        sink = sink + lengths[n-1];
+    });
+}
+
+//worst relative errors of rsqrt over every float in [1, 4) (the
+//estimate tables repeat with every second exponent) and of norm and
+//normalize over vectors of many magnitudes
+template<class P>
+void check_precision(const char *name, P precision, double bound)
+{
+    double rsqrt_error = 0;
+    for(float x = 1.0f; x<4.0f; x = std::nextafter(x, 5.0f))
+    {
+        double exact = 1/std::sqrt(double(x));
+        rsqrt_error = std::max(rsqrt_error, std::fabs(rsqrt(x, precision)-exact)/exact);
+    }
+    ErrorCheck r = { "rsqrt", name, rsqrt_error, bound };
+    errors.push_back(r);
+
+    double norm_error = 0, normalize_error = 0;
+    for(unsigned i = 0; i<200000; ++i)
+    {
+        unsigned h = i*2654435761u;
+        float scale = std::pow(10.0f, float(int(i%21)-10));
+        Vector<float,3> v(float(h%1000)-500, float((h>>10)%1000)-500, float((h>>20)%1000)+1);
+        v *= scale;
+        Vector<double,3> d(v[0], v[1], v[2]);
+        double length = norm(d);
+        norm_error = std::max(norm_error, std::fabs(norm(v, precision)-length)/length);
+        Vector<float,3> u = normalize(v, precision);
+        for(unsigned k = 0; k<3; ++k)
+            normalize_error = std::max(normalize_error, std::fabs(u[k]-d[k]/length));
+    }
+    ErrorCheck n = { "norm3", name, norm_error, bound };
+    ErrorCheck u = { "normalize3", name, normalize_error, bound };
+    errors.push_back(n);
+    errors.push_back(u);
+}
+
+int main()
+{
+    //in cache, L2 sized and memory bound batches
+    const size_t batches[] = { 64, 4096, 1 << 18 };
+    for(unsigned b = 0; b<3; ++b)
+    {
+        bench_vector(batches[b]);
+        bench_matrix(batches[b]);
+        bench_builders(batches[b]);
+        bench_precision(batches[b], "exact", exact_precision);
+        bench_precision(batches[b], "refined", refined_precision);
+        bench_precision(batches[b], "approximate", approximate_precision);
+    }
+    //the bounds documented in MathVector.h, exact is correctly rounded
+    //up to the error of the sum of squares
+    check_precision("exact", exact_precision, 2.5e-7);
+    check_precision("refined", refined_precision, 5e-7);
+    check_precision("approximate", approximate_precision, 3.7e-4);
+    write_json(std::cout);
+    for(size_t i = 0; i<errors.size(); ++i)
+        if(errors[i].max_error > errors[i].bound)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,195 @@
+// streams vertex data to the GPU every frame and draws it, comparing
+// the ways of updating a buffer:
+//
+//   glBufferSubData  - copy from client memory into a GL_STREAM_DRAW buffer
+//   map invalidate   - glp::VertexBuffer::map(), which orphans the buffer
+//   ring coherent    - glp::StreamRingBuffer, persistent coherent mapping
+//   ring flush       - glp::StreamRingBuffer, explicit flushes
+//
+// Runs headless on an EGL surfaceless context (Mesa llvmpipe is fine)
+// and draws to a small framebuffer object, so no window is needed:
+//
+//   g++ -O3 -std=c++11 -pthread -Iinclude examples/streambench.cpp GLShaderProgram.cpp -lEGL -lGL -lGLU
+//
+// Software rasterizers run the draws on the CPU, so the numbers mostly
+// show the driver overhead of each path, not bus transfer speeds.
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <boost/fusion/include/vector.hpp>
+
+#include "MathVector.h"
+#include "GLShaderProgram.h"
+#include "GLVertexBuffer.h"
+#include "GLVertexArray.h"
+#include "GLStreamRingBuffer.h"
+
+namespace fusion = boost::fusion;
+
+typedef fusion::vector<
+            Vector<GLfloat,4>,
+            Vector<GLfloat,4>
+        > PositionColor;
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+//creates a core profile context without a surface
+bool create_context()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    EGLDisplay display = get_display ?
+        get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0) :
+        eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if(!eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+    const EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configs = 0;
+    eglChooseConfig(display, config_attributes, &config, 1, &configs);
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, configs ? config : EGLConfig(0),
+                                          EGL_NO_CONTEXT, context_attributes);
+    return context != EGL_NO_CONTEXT &&
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+//a frame worth of points on a circle that moves with the frame
+void write_frame(PositionColor *out, size_t n, unsigned frame)
+{
+    for(size_t i = 0; i<n; ++i)
+    {
+        float a = 0.001f*float(i+frame);
+        out[i] = PositionColor(Vector<GLfloat,4>(0.9f*std::cos(a), 0.9f*std::sin(a), 0, 1),
+                               Vector<GLfloat,4>(float(i&255)/255.0f, 0.5f, 0.5f, 1));
+    }
+}
+
+template<class F>
+void run(const char *name, size_t vertices, unsigned frames, F frame)
+{
+    glFinish();
+    benchmark_clock::time_point start = benchmark_clock::now();
+    for(unsigned f = 0; f<frames; ++f)
+    {
+        frame(f);
+        glFlush();
+    }
+    glFinish();
+    std::chrono::duration<double> d = benchmark_clock::now()-start;
+    std::cout << name << ": " << d.count()*1000/frames << " ms/frame, "
+              << double(vertices*sizeof(PositionColor))*frames/d.count()/(1 << 20) << " MiB/s\n";
+}
+
+int main()
+{
+    if(!create_context())
+    {
+        std::cerr << "no OpenGL 4.4 context\n";
+        return 1;
+    }
+    std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << '\n';
+
+    GLuint framebuffer, renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 64, 64);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    glViewport(0, 0, 64, 64);
+
+    glp::ShaderProgram shader;
+    shader.setVertexShaderSource(
+        "#version 330\n"
+        "in vec4 position;\n"
+        "in vec4 color;\n"
+        "out vec4 fcolor;\n"
+        "void main() {\n"
+        "   fcolor = color;\n"
+        "   gl_Position = position;\n"
+        "}\n"
+    );
+    shader.setFragmentShaderSource(
+        "#version 330\n"
+        "in vec4 fcolor;\n"
+        "out vec4 FragColor;\n"
+        "void main() {\n"
+        "   FragColor = fcolor;\n"
+        "}\n"
+    );
+    shader.compileProgram();
+    shader.bindAttributeLocation(0, "position");
+    shader.bindAttributeLocation(1, "color");
+    shader.bindFragDataLocation(0, "FragColor");
+    shader.linkProgram();
+    shader.bindProgram();
+
+    const size_t vertices = 1 << 16;
+    const unsigned frames = 300;
+
+    {
+        glp::VertexBuffer<PositionColor> vbo(vertices, GL_STREAM_DRAW);
+        glp::VertexArray vao;
+        vao.attach(vbo);
+        std::vector<PositionColor> client(vertices);
+        run("glBufferSubData", vertices, frames, [&](unsigned f) {
+            write_frame(client.data(), vertices, f);
+            vbo.bind();
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertices*sizeof(PositionColor), client.data());
+            vbo.unbind();
+            vao.draw(GL_POINTS);
+        });
+    }
+
+    {
+        glp::VertexBuffer<PositionColor> vbo(vertices, GL_STREAM_DRAW);
+        glp::VertexArray vao;
+        vao.attach(vbo);
+        run("map invalidate", vertices, frames, [&](unsigned f) {
+            vbo.map();
+            write_frame(vbo.data(), vertices, f);
+            vbo.unmap();
+            vao.draw(GL_POINTS);
+        });
+    }
+
+    const glp::StreamFlush modes[2] = { glp::CoherentFlush, glp::ExplicitFlush };
+    const char *names[2] = { "ring coherent", "ring flush" };
+    for(unsigned m = 0; m<2; ++m)
+    {
+        glp::StreamRingBuffer<PositionColor, GL_ARRAY_BUFFER> ring(vertices, glp::StreamRingFrames, modes[m]);
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        ring.bindVertexAttributes();
+        run(names[m], vertices, frames, [&](unsigned f) {
+            ring.beginFrame();
+            glp::StreamRange<PositionColor> range = ring.allocate(vertices);
+            write_frame(range.data, vertices, f);
+            ring.flush();
+            glDrawArrays(GL_POINTS, GLint(range.first), GLsizei(range.count));
+            ring.endFrame();
+        });
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &vao);
+        std::cout << names[m] << " stalls: " << ring.stalls() << " of " << frames << " frames\n";
+    }
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    return 0;
+}
@@ -0,0 +1,818 @@
+/*
+ * BVH.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * BVH.h provides a bounding volume hierarchy over indexed triangle
+ * meshes for ray picking and proximity queries. It is built from a
+ * strided position stream (see AttributeArray) and triangle list
+ * indices, for example a mapped glp::VertexBuffer and IndexBuffer:
+ *
+ *     BVH<float> bvh(AttributeArray<0>(vbo), ibo);
+ *     RayHit<float> hit;
+ *     if(bvh.intersect(Ray<float>(eye, dir), hit))
+ *         picked = hit.triangle;
+ *
+ * Splits are chosen by the surface area heuristic over binned
+ * centroids. The upper levels are binned in parallel, the subtrees
+ * below them are built in parallel. Nodes are 32 bytes (for float) in
+ * one array with the two children of a node next to each other, the
+ * triangle vertices are copied into leaf order. refit() updates the
+ * bounds after the vertices moved without changing the tree.
+ *
+ * Queries report triangles by their position in the index list
+ * divided by 3. Rays can be traced one at a time (nearest hit or any
+ * hit) or in packets of 4 that share a traversal, which pays off for
+ * coherent rays such as picking or visibility grids.
+ */
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "MathVector.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//ranges of triangles smaller than this are binned on one thread and
+//built as one subtree
+const size_t BVHBuildGrain = 16384;
+
+//rays per thread for packet queries
+const size_t BVHQueryGrain = 4096;
+
+//number of bins per axis for the surface area heuristic
+const unsigned BVHBins = 16;
+
+//largest number of triangles per leaf
+const unsigned BVHMaxLeafSize = 4;
+
+template<class T>
+struct Ray {
+    Ray()
+    { }
+
+    Ray(const Vector<T,3> &o, const Vector<T,3> &d,
+        T t0 = 0, T t1 = std::numeric_limits<T>::max())
+        : origin(o), direction(d), tmin(t0), tmax(t1)
+    { }
+
+    Vector<T,3> origin, direction;
+    T tmin, tmax;
+};
+
+//hit point origin+t*direction at barycentric coordinates (u, v) of
+//the triangle, triangle is BVH<T>::none for misses
+template<class T>
+struct RayHit {
+    T t, u, v;
+    unsigned triangle;
+};
+
+//Moeller-Trumbore, false if the ray is parallel to the triangle
+//or misses its interior, t may be negative
+template<class T>
+inline bool IntersectTriangle(const T *o, const T *d,
+                              const T *a, const T *b, const T *c,
+                              T &t, T &u, T &v)
+{
+    T e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    T e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    T p[3] = { d[1]*e2[2]-d[2]*e2[1], d[2]*e2[0]-d[0]*e2[2], d[0]*e2[1]-d[1]*e2[0] };
+    T det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if(det == 0)
+        return false;
+    T inv = 1/det;
+    T s[3] = { o[0]-a[0], o[1]-a[1], o[2]-a[2] };
+    u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv;
+    T q[3] = { s[1]*e1[2]-s[2]*e1[1], s[2]*e1[0]-s[0]*e1[2], s[0]*e1[1]-s[1]*e1[0] };
+    v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2])*inv;
+    t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv;
+    return u >= 0 && v >= 0 && u+v <= 1;
+}
+
+//traversal kernels for packets of 4 rays, see simd::ray4_box and
+//simd::ray4_triangle
+template<class T>
+struct RayPacketKernel {
+    static unsigned box(const T *o, const T *inv, const T *tmin, const T *tmax,
+                        const T *lo, const T *hi)
+    {
+        unsigned mask = 0;
+        for(unsigned r = 0; r<4; ++r)
+        {
+            T tn = tmin[r], tf = tmax[r];
+            for(unsigned k = 0; k<3; ++k)
+            {
+                T t0 = (lo[k]-o[4*k+r])*inv[4*k+r];
+                T t1 = (hi[k]-o[4*k+r])*inv[4*k+r];
+                tn = std::max(std::min(t0, t1), tn);
+                tf = std::min(std::max(t0, t1), tf);
+            }
+            mask |= unsigned(tn <= tf) << r;
+        }
+        return mask;
+    }
+
+    static unsigned triangle(const T *o, const T *d, unsigned mask,
+                             const T *tmin, T *tmax, T *u, T *v,
+                             const T *a, const T *b, const T *c)
+    {
+        unsigned res = 0;
+        for(unsigned r = 0; r<4; ++r)
+        {
+            if(!(mask & (1u << r)))
+                continue;
+            T orig[3] = { o[r], o[4+r], o[8+r] };
+            T dir[3] = { d[r], d[4+r], d[8+r] };
+            T t, uu, vv;
+            if(IntersectTriangle(orig, dir, a, b, c, t, uu, vv) &&
+               t >= tmin[r] && t < tmax[r])
+            {
+                tmax[r] = t;
+                u[r] = uu;
+                v[r] = vv;
+                res |= 1u << r;
+            }
+        }
+        return res;
+    }
+};
+
+template<>
+struct RayPacketKernel<float> {
+    static unsigned box(const float *o, const float *inv, const float *tmin, const float *tmax,
+                        const float *lo, const float *hi)
+    {
+        return simd::ray4_box(o, inv, tmin, tmax, lo, hi);
+    }
+
+    static unsigned triangle(const float *o, const float *d, unsigned mask,
+                             const float *tmin, float *tmax, float *u, float *v,
+                             const float *a, const float *b, const float *c)
+    {
+        return simd::ray4_triangle(o, d, mask, tmin, tmax, u, v, a, b, c);
+    }
+};
+
+template<class T>
+class BVH {
+public:
+    //triangle of misses
+    static const unsigned none = unsigned(-1);
+
+    struct Node {
+        Vector<T,3> lo;
+        //first triangle of leaves, left child of inner nodes
+        unsigned first;
+        Vector<T,3> hi;
+        //triangles of leaves, 0 for inner nodes
+        unsigned count;
+    };
+
+    BVH() : max_depth(0)
+    { }
+
+    template<class TP, class B>
+    BVH(const StridedVectorArray<TP,3> &positions, const B &indices,
+        size_t grain = BVHBuildGrain)
+        : max_depth(0)
+    {
+        build(positions, indices, grain);
+    }
+
+    //indices is a triangle list, any container with data() and size()
+    //such as a mapped glp::IndexBuffer or a std::vector
+    template<class TP, class B>
+    void build(const StridedVectorArray<TP,3> &positions, const B &indices,
+               size_t grain = BVHBuildGrain)
+    {
+        size_t n = indices.size()/3;
+        nodes_.clear();
+        triangles.resize(n);
+        vertex_indices.resize(3*n);
+        max_depth = 0;
+        if(n == 0)
+            return;
+
+        const typename B::value_type *idx = indices.data();
+        refs.resize(n);
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                Ref &r = refs[i];
+                r.box.clear();
+                for(unsigned k = 0; k<3; ++k)
+                    r.box.grow(positions.ptr(size_t(idx[3*i+k])));
+                for(unsigned k = 0; k<3; ++k)
+                    r.center[k] = r.box.center(k);
+                r.triangle = unsigned(i);
+            }
+        });
+
+        //upper levels, subtrees below grain are only recorded
+        std::vector<Job> jobs;
+        nodes_.resize(1);
+        build_node(nodes_, 0, 0, n, 1, grain, &jobs);
+
+        std::vector<std::vector<Node> > subtrees(jobs.size());
+        std::vector<unsigned> depths(jobs.size());
+        glp::parallel_for(0, jobs.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t j = begin; j<end; ++j)
+            {
+                subtrees[j].resize(1);
+                depths[j] = build_node(subtrees[j], 0, jobs[j].begin, jobs[j].end,
+                                       jobs[j].depth, grain, 0);
+            }
+        });
+
+        //the subtree roots replace their placeholders, everything else
+        //is appended with the child indices moved along
+        for(size_t j = 0; j<jobs.size(); ++j)
+        {
+            unsigned base = unsigned(nodes_.size())-1;
+            std::vector<Node> &sub = subtrees[j];
+            for(size_t k = 0; k<sub.size(); ++k)
+                if(sub[k].count == 0)
+                    sub[k].first += base;
+            nodes_[jobs[j].node] = sub[0];
+            nodes_.insert(nodes_.end(), sub.begin()+1, sub.end());
+            max_depth = std::max(max_depth, depths[j]);
+        }
+
+        //triangle data in leaf order
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                triangles[i] = refs[i].triangle;
+                for(unsigned k = 0; k<3; ++k)
+                    vertex_indices[3*i+k] = unsigned(idx[3*triangles[i]+k]);
+            }
+        });
+        std::vector<Ref>().swap(refs);
+        refit(positions, grain);
+    }
+
+    //recomputes all bounds from the moved vertices, the triangles and
+    //tree structure stay the same
+    template<class TP>
+    void refit(const StridedVectorArray<TP,3> &positions, size_t grain = BVHBuildGrain)
+    {
+        size_t n = triangles.size();
+        vertices.resize(3*n);
+        glp::parallel_for(0, 3*n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                const TP *p = positions.ptr(vertex_indices[i]);
+                vertices[i] = Vector<T,3>(p[0], p[1], p[2]);
+            }
+        });
+        //children are always stored after their parents
+        for(size_t i = nodes_.size(); i-- > 0;)
+        {
+            Node &node = nodes_[i];
+            Box box;
+            box.clear();
+            if(node.count)
+            {
+                for(size_t v = 3*node.first; v<3*(node.first+node.count); ++v)
+                    box.grow(vertices[v].raw());
+            }
+            else
+            {
+                box.grow(nodes_[node.first]);
+                box.grow(nodes_[node.first+1]);
+            }
+            for(unsigned k = 0; k<3; ++k)
+            {
+                node.lo[k] = box.lo[k];
+                node.hi[k] = box.hi[k];
+            }
+        }
+    }
+
+    size_t size() const { return triangles.size(); }
+    const std::vector<Node>& nodes() const { return nodes_; }
+    unsigned depth() const { return max_depth; }
+
+    //nearest hit within [ray.tmin, ray.tmax]
+    bool intersect(const Ray<T> &ray, RayHit<T> &hit) const
+    {
+        hit.triangle = none;
+        hit.t = ray.tmax;
+        traverse(ray, hit, false);
+        return hit.triangle != none;
+    }
+
+    //true if anything is hit within [ray.tmin, ray.tmax]
+    bool occluded(const Ray<T> &ray) const
+    {
+        RayHit<T> hit;
+        hit.triangle = none;
+        hit.t = ray.tmax;
+        traverse(ray, hit, true);
+        return hit.triangle != none;
+    }
+
+    //nearest hits of n rays, traced in packets of 4 consecutive rays
+    void intersect(const Ray<T> *rays, RayHit<T> *hits, size_t n,
+                   size_t grain = BVHQueryGrain) const
+    {
+        glp::parallel_for(0, (n+3)/4, (grain+3)/4, [&](size_t begin, size_t end) {
+            for(size_t p = begin; p<end; ++p)
+                intersect4(rays+4*p, hits+4*p, unsigned(std::min<size_t>(4, n-4*p)));
+        });
+    }
+
+    //calls f(triangle) for every triangle whose bounding box overlaps
+    //the box [lo, hi]
+    template<class F>
+    void overlap(const Vector<T,3> &lo, const Vector<T,3> &hi, F f) const
+    {
+        if(nodes_.empty())
+            return;
+        TraversalStack<unsigned> stack(max_depth+1);
+        unsigned sp = 0;
+        stack[sp++] = 0;
+        while(sp)
+        {
+            const Node &node = nodes_[stack[--sp]];
+            if(!boxes_overlap(node.lo, node.hi, lo, hi))
+                continue;
+            if(node.count == 0)
+            {
+                stack[sp++] = node.first+1;
+                stack[sp++] = node.first;
+                continue;
+            }
+            for(unsigned i = node.first; i<node.first+node.count; ++i)
+            {
+                Box box;
+                box.clear();
+                for(unsigned k = 0; k<3; ++k)
+                    box.grow(vertices[3*i+k].raw());
+                if(boxes_overlap(box.lo, box.hi, lo, hi))
+                    f(triangles[i]);
+            }
+        }
+    }
+
+    size_t overlap(const Vector<T,3> &lo, const Vector<T,3> &hi,
+                   std::vector<unsigned> &result) const
+    {
+        size_t before = result.size();
+        overlap(lo, hi, [&result](unsigned t) { result.push_back(t); });
+        return result.size()-before;
+    }
+
+private:
+    struct Box {
+        T lo[3], hi[3];
+
+        void clear()
+        {
+            for(unsigned k = 0; k<3; ++k)
+            {
+                lo[k] = std::numeric_limits<T>::max();
+                hi[k] = -std::numeric_limits<T>::max();
+            }
+        }
+
+        template<class TP>
+        void grow(const TP *p)
+        {
+            for(unsigned k = 0; k<3; ++k)
+            {
+                lo[k] = std::min(lo[k], T(p[k]));
+                hi[k] = std::max(hi[k], T(p[k]));
+            }
+        }
+
+        void grow(const Box &b)
+        {
+            for(unsigned k = 0; k<3; ++k)
+            {
+                lo[k] = std::min(lo[k], b.lo[k]);
+                hi[k] = std::max(hi[k], b.hi[k]);
+            }
+        }
+
+        void grow(const Node &b)
+        {
+            for(unsigned k = 0; k<3; ++k)
+            {
+                lo[k] = std::min(lo[k], b.lo[k]);
+                hi[k] = std::max(hi[k], b.hi[k]);
+            }
+        }
+
+        T center(unsigned k) const { return (lo[k]+hi[k])/2; }
+
+        //half the surface area, 0 for empty boxes
+        T area() const
+        {
+            if(lo[0] > hi[0])
+                return 0;
+            T dx = hi[0]-lo[0], dy = hi[1]-lo[1], dz = hi[2]-lo[2];
+            return dx*dy + dy*dz + dz*dx;
+        }
+    };
+
+    //triangle bounds and centroid during the build
+    struct Ref {
+        Box box;
+        T center[3];
+        unsigned triangle;
+    };
+
+    struct Bin {
+        Box box;
+        size_t count;
+    };
+
+    typedef Bin Bins[3][BVHBins];
+
+    struct Job {
+        unsigned node;
+        size_t begin, end;
+        unsigned depth;
+    };
+
+    //fixed size stack for the usual tree depths, heap allocated for
+    //degenerate ones
+    template<class E>
+    class TraversalStack {
+    public:
+        TraversalStack(size_t size) : data(local)
+        {
+            if(size > 64)
+            {
+                heap.resize(size);
+                data = &heap[0];
+            }
+        }
+        E& operator[](size_t i) { return data[i]; }
+    private:
+        E local[64];
+        std::vector<E> heap;
+        E *data;
+    };
+
+    template<class A, class B>
+    static bool boxes_overlap(const A &alo, const A &ahi, const B &blo, const B &bhi)
+    {
+        for(unsigned k = 0; k<3; ++k)
+            if(alo[k] > bhi[k] || blo[k] > ahi[k])
+                return false;
+        return true;
+    }
+
+    //bounds of the triangles and of their centroids in [begin, end)
+    void range_bounds(size_t begin, size_t end, size_t grain, Box &box, Box &cbox) const
+    {
+        box.clear();
+        cbox.clear();
+        std::mutex m;
+        glp::parallel_for(begin, end, grain, [&](size_t b, size_t e) {
+            Box lb, lc;
+            lb.clear();
+            lc.clear();
+            for(size_t i = b; i<e; ++i)
+            {
+                lb.grow(refs[i].box);
+                lc.grow(refs[i].center);
+            }
+            std::lock_guard<std::mutex> lock(m);
+            box.grow(lb);
+            cbox.grow(lc);
+        });
+    }
+
+    //small ranges use fewer bins
+    static unsigned bin_count(size_t count)
+    {
+        return unsigned(std::min<size_t>(BVHBins, count));
+    }
+
+    static unsigned bin_index(T c, T lo, T scale, unsigned bins)
+    {
+        T k = (c-lo)*scale;
+        return k <= 0 ? 0 : std::min(bins-1, unsigned(k));
+    }
+
+    static void clear_bins(Bins &bins, unsigned nb)
+    {
+        for(unsigned a = 0; a<3; ++a)
+            for(unsigned k = 0; k<nb; ++k)
+            {
+                bins[a][k].box.clear();
+                bins[a][k].count = 0;
+            }
+    }
+
+    void fill_bins(size_t begin, size_t end, const Box &cbox, const T *scale,
+                   unsigned nb, Bins &bins) const
+    {
+        for(size_t i = begin; i<end; ++i)
+            for(unsigned a = 0; a<3; ++a)
+            {
+                Bin &bin = bins[a][bin_index(refs[i].center[a], cbox.lo[a], scale[a], nb)];
+                bin.box.grow(refs[i].box);
+                ++bin.count;
+            }
+    }
+
+    //best binned SAH split of [begin, end), returns false if a leaf is
+    //cheaper or the centroids can't be separated
+    bool find_split(size_t begin, size_t end, size_t grain, const Box &box,
+                    const Box &cbox, unsigned &axis, unsigned &split) const
+    {
+        size_t count = end-begin;
+        unsigned nb = bin_count(count);
+        Bins bins;
+        clear_bins(bins, nb);
+        T scale[3];
+        for(unsigned a = 0; a<3; ++a)
+        {
+            T extent = cbox.hi[a]-cbox.lo[a];
+            scale[a] = extent > 0 ? T(nb)/extent : T(0);
+        }
+
+        if(count <= grain)
+        {
+            fill_bins(begin, end, cbox, scale, nb, bins);
+        }
+        else
+        {
+            std::mutex m;
+            glp::parallel_for(begin, end, grain, [&](size_t b, size_t e) {
+                Bins local;
+                clear_bins(local, nb);
+                fill_bins(b, e, cbox, scale, nb, local);
+                std::lock_guard<std::mutex> lock(m);
+                for(unsigned a = 0; a<3; ++a)
+                    for(unsigned k = 0; k<nb; ++k)
+                    {
+                        bins[a][k].box.grow(local[a][k].box);
+                        bins[a][k].count += local[a][k].count;
+                    }
+            });
+        }
+
+        T best = std::numeric_limits<T>::max();
+        for(unsigned a = 0; a<3; ++a)
+        {
+            if(scale[a] == 0)
+                continue;
+            //right[k] is the cost of the bins k..nb-1
+            T right[BVHBins];
+            Box acc;
+            acc.clear();
+            size_t n = 0;
+            for(unsigned k = nb; k-- > 1;)
+            {
+                acc.grow(bins[a][k].box);
+                n += bins[a][k].count;
+                right[k] = n*acc.area();
+            }
+            acc.clear();
+            n = 0;
+            for(unsigned k = 1; k<nb; ++k)
+            {
+                acc.grow(bins[a][k-1].box);
+                n += bins[a][k-1].count;
+                T cost = n*acc.area() + right[k];
+                if(n > 0 && n < count && cost < best)
+                {
+                    best = cost;
+                    axis = a;
+                    split = k;
+                }
+            }
+        }
+        if(best == std::numeric_limits<T>::max())
+            return false;
+        //traversal and intersection cost are assumed to be equal
+        T area = box.area();
+        return count > BVHMaxLeafSize || area + best < count*area;
+    }
+
+    //builds the triangles [begin, end) into nodes[n], returns the depth
+    //of the subtree. With jobs set ranges below grain are recorded
+    //there instead.
+    unsigned build_node(std::vector<Node> &nodes, unsigned n, size_t begin, size_t end,
+                        unsigned depth, size_t grain, std::vector<Job> *jobs)
+    {
+        size_t count = end-begin;
+        if(jobs && count <= grain)
+        {
+            Job job = { n, begin, end, depth };
+            jobs->push_back(job);
+            return depth;
+        }
+
+        Box box, cbox;
+        range_bounds(begin, end, grain, box, cbox);
+        unsigned axis = 0, split = 0;
+        size_t mid;
+        if(count > 1 && find_split(begin, end, grain, box, cbox, axis, split))
+        {
+            unsigned nb = bin_count(count);
+            T lo = cbox.lo[axis], scale = T(nb)/(cbox.hi[axis]-cbox.lo[axis]);
+            mid = std::partition(refs.begin()+begin, refs.begin()+end,
+                                 [&](const Ref &r) {
+                                     return bin_index(r.center[axis], lo, scale, nb) < split;
+                                 }) - refs.begin();
+            if(mid == begin || mid == end)
+                mid = begin+count/2;
+        }
+        else if(count > BVHMaxLeafSize)
+        {
+            //identical centroids
+            mid = begin+count/2;
+        }
+        else
+        {
+            nodes[n].first = unsigned(begin);
+            nodes[n].count = unsigned(count);
+            return depth;
+        }
+
+        unsigned left = unsigned(nodes.size());
+        nodes.resize(left+2);
+        nodes[n].first = left;
+        nodes[n].count = 0;
+        unsigned d0 = build_node(nodes, left, begin, mid, depth+1, grain, jobs);
+        unsigned d1 = build_node(nodes, left+1, mid, end, depth+1, grain, jobs);
+        return std::max(d0, d1);
+    }
+
+    //entry distance of the ray into the node or false
+    static bool hit_node(const Node &node, const T *o, const T *inv,
+                         T tmin, T tmax, T &t)
+    {
+        for(unsigned k = 0; k<3; ++k)
+        {
+            T t0 = (node.lo[k]-o[k])*inv[k];
+            T t1 = (node.hi[k]-o[k])*inv[k];
+            tmin = std::max(std::min(t0, t1), tmin);
+            tmax = std::min(std::max(t0, t1), tmax);
+        }
+        t = tmin;
+        return tmin <= tmax;
+    }
+
+    //closest first traversal, hit.t is the current far limit
+    void traverse(const Ray<T> &ray, RayHit<T> &hit, bool any) const
+    {
+        if(nodes_.empty())
+            return;
+        const T *o = ray.origin.raw(), *d = ray.direction.raw();
+        T inv[3] = { 1/d[0], 1/d[1], 1/d[2] };
+        struct Entry { unsigned node; T t; };
+        TraversalStack<Entry> stack(max_depth+1);
+        unsigned sp = 0;
+        T t;
+        if(!hit_node(nodes_[0], o, inv, ray.tmin, hit.t, t))
+            return;
+        Entry e = { 0, t };
+        stack[sp++] = e;
+        while(sp)
+        {
+            e = stack[--sp];
+            if(e.t > hit.t)
+                continue;
+            const Node *node = &nodes_[e.node];
+            while(node->count == 0)
+            {
+                T t0, t1;
+                bool h0 = hit_node(nodes_[node->first], o, inv, ray.tmin, hit.t, t0);
+                bool h1 = hit_node(nodes_[node->first+1], o, inv, ray.tmin, hit.t, t1);
+                if(h0 && h1)
+                {
+                    Entry far = { t0 <= t1 ? node->first+1 : node->first, std::max(t0, t1) };
+                    stack[sp++] = far;
+                    node = &nodes_[t0 <= t1 ? node->first : node->first+1];
+                }
+                else if(h0 || h1)
+                {
+                    node = &nodes_[h0 ? node->first : node->first+1];
+                }
+                else
+                {
+                    node = 0;
+                    break;
+                }
+            }
+            if(!node)
+                continue;
+            for(unsigned i = node->first; i<node->first+node->count; ++i)
+            {
+                T tt, u, v;
+                if(IntersectTriangle(o, d, vertices[3*i].raw(),
+                        vertices[3*i+1].raw(), vertices[3*i+2].raw(), tt, u, v) &&
+                   tt >= ray.tmin && tt < hit.t)
+                {
+                    hit.t = tt;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = triangles[i];
+                    if(any)
+                        return;
+                }
+            }
+        }
+    }
+
+    //up to 4 rays sharing one traversal
+    void intersect4(const Ray<T> *rays, RayHit<T> *hits, unsigned count) const
+    {
+        T o[12], d[12], inv[12], tmin[4], tmax[4], u[4], v[4];
+        unsigned tri[4] = { none, none, none, none };
+        for(unsigned r = 0; r<4; ++r)
+        {
+            const Ray<T> &ray = rays[r < count ? r : 0];
+            for(unsigned k = 0; k<3; ++k)
+            {
+                o[4*k+r] = ray.origin[k];
+                d[4*k+r] = ray.direction[k];
+                inv[4*k+r] = 1/ray.direction[k];
+            }
+            tmin[r] = ray.tmin;
+            //unused lanes never hit anything
+            tmax[r] = r < count ? ray.tmax : -std::numeric_limits<T>::max();
+            u[r] = v[r] = 0;
+        }
+        if(!nodes_.empty())
+        {
+            TraversalStack<unsigned> stack(2*max_depth+2);
+            unsigned sp = 0;
+            stack[sp++] = 0;
+            while(sp)
+            {
+                const Node &node = nodes_[stack[--sp]];
+                unsigned mask = RayPacketKernel<T>::box(o, inv, tmin, tmax,
+                                                        node.lo.raw(), node.hi.raw());
+                if(!mask)
+                    continue;
+                if(node.count == 0)
+                {
+                    stack[sp++] = node.first+1;
+                    stack[sp++] = node.first;
+                    continue;
+                }
+                for(unsigned i = node.first; i<node.first+node.count; ++i)
+                {
+                    unsigned h = RayPacketKernel<T>::triangle(o, d, mask, tmin, tmax, u, v,
+                                     vertices[3*i].raw(), vertices[3*i+1].raw(),
+                                     vertices[3*i+2].raw());
+                    for(unsigned r = 0; r<4; ++r)
+                        if(h & (1u << r))
+                            tri[r] = triangles[i];
+                }
+            }
+        }
+        for(unsigned r = 0; r<count; ++r)
+        {
+            hits[r].t = tmax[r];
+            hits[r].u = u[r];
+            hits[r].v = v[r];
+            hits[r].triangle = tri[r];
+        }
+    }
+
+    std::vector<Node> nodes_;
+    //original triangle and vertex indices in leaf order
+    std::vector<unsigned> triangles;
+    std::vector<unsigned> vertex_indices;
+    std::vector<Vector<T,3> > vertices;
+    std::vector<Ref> refs;
+    unsigned max_depth;
+};
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * BatchSolve.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * BatchSolve.h solves many small linear systems a[i]*x[i] = b[i] of the
+ * same size at once. The systems are stored as structure of arrays:
+ * lane r+c*D of a VectorArray<T,D*D> holds element (r,c) of every
+ * matrix, the right hand sides and solutions are VectorArray<T,D>.
+ * Blocks of BatchSolveBlock systems are factorized side by side with
+ * the system index in the innermost loop, so every step is one vector
+ * operation over the block. Large batches are split across threads.
+ *
+ * As with the single matrix versions in MathMatrix.h, singular (or
+ * for Cholesky not positive definite) systems get non finite
+ * solutions without affecting the others.
+ */
+
+#ifndef BATCH_SOLVE_H
+#define BATCH_SOLVE_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "MathMatrix.h"
+#include "ParallelFor.h"
+#include "VectorArray.h"
+
+//systems per thread
+const size_t BatchSolveGrain = 4096;
+
+//systems factorized side by side
+const unsigned BatchSolveBlock = 64;
+
+//factorizations of a block of systems, a[e][l] is element e of
+//system l. The solution replaces the right hand side in x.
+template<class T, unsigned D>
+struct BatchSolveKernel {
+    static const unsigned B = BatchSolveBlock;
+    typedef T Lanes[B];
+
+    //Gaussian elimination with partial pivoting
+    static void lu(Lanes *a, Lanes *x)
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            unsigned p[B];
+            T best[B];
+            for(unsigned l = 0; l<B; ++l)
+            {
+                p[l] = k;
+                best[l] = std::abs(a[k+k*D][l]);
+            }
+            for(unsigned r = k+1; r<D; ++r)
+                for(unsigned l = 0; l<B; ++l)
+                {
+                    T v = std::abs(a[r+k*D][l]);
+                    bool larger = v > best[l];
+                    best[l] = larger ? v : best[l];
+                    p[l] = larger ? r : p[l];
+                }
+            //row exchanges as selects so all systems stay in step
+            for(unsigned r = k+1; r<D; ++r)
+            {
+                for(unsigned c = k; c<D; ++c)
+                    swap_rows(a[k+c*D], a[r+c*D], p, r);
+                swap_rows(x[k], x[r], p, r);
+            }
+            T inv[B];
+            for(unsigned l = 0; l<B; ++l)
+                inv[l] = T(1)/a[k+k*D][l];
+            for(unsigned r = k+1; r<D; ++r)
+            {
+                T f[B];
+                for(unsigned l = 0; l<B; ++l)
+                    f[l] = a[r+k*D][l]*inv[l];
+                for(unsigned c = k+1; c<D; ++c)
+                    for(unsigned l = 0; l<B; ++l)
+                        a[r+c*D][l] -= f[l]*a[k+c*D][l];
+                for(unsigned l = 0; l<B; ++l)
+                    x[r][l] -= f[l]*x[k][l];
+            }
+        }
+        back_substitute(a, x);
+    }
+
+    static void cholesky(Lanes *a, Lanes *x)
+    {
+        for(unsigned j = 0; j<D; ++j)
+        {
+            T d[B];
+            for(unsigned l = 0; l<B; ++l)
+                d[l] = a[j+j*D][l];
+            for(unsigned k = 0; k<j; ++k)
+                for(unsigned l = 0; l<B; ++l)
+                    d[l] -= a[j+k*D][l]*a[j+k*D][l];
+            for(unsigned l = 0; l<B; ++l)
+            {
+                a[j+j*D][l] = std::sqrt(d[l]);
+                d[l] = T(1)/a[j+j*D][l];
+            }
+            for(unsigned i = j+1; i<D; ++i)
+            {
+                for(unsigned k = 0; k<j; ++k)
+                    for(unsigned l = 0; l<B; ++l)
+                        a[i+j*D][l] -= a[i+k*D][l]*a[j+k*D][l];
+                for(unsigned l = 0; l<B; ++l)
+                    a[i+j*D][l] *= d[l];
+            }
+        }
+        //L y = b, then L^T x = y
+        for(unsigned i = 0; i<D; ++i)
+        {
+            for(unsigned k = 0; k<i; ++k)
+                for(unsigned l = 0; l<B; ++l)
+                    x[i][l] -= a[i+k*D][l]*x[k][l];
+            for(unsigned l = 0; l<B; ++l)
+                x[i][l] /= a[i+i*D][l];
+        }
+        for(unsigned i = D; i-- > 0;)
+        {
+            for(unsigned k = i+1; k<D; ++k)
+                for(unsigned l = 0; l<B; ++l)
+                    x[i][l] -= a[k+i*D][l]*x[k][l];
+            for(unsigned l = 0; l<B; ++l)
+                x[i][l] /= a[i+i*D][l];
+        }
+    }
+
+    //Householder QR, see QRKernel
+    static void qr(Lanes *a, Lanes *x)
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            T tau[B], xnorm[B];
+            for(unsigned l = 0; l<B; ++l)
+                xnorm[l] = 0;
+            for(unsigned i = k+1; i<D; ++i)
+                for(unsigned l = 0; l<B; ++l)
+                    xnorm[l] += a[i+k*D][l]*a[i+k*D][l];
+            T scale[B];
+            for(unsigned l = 0; l<B; ++l)
+            {
+                T alpha = a[k+k*D][l];
+                T beta = std::sqrt(alpha*alpha + xnorm[l]);
+                beta = alpha >= 0 ? -beta : beta;
+                bool nonzero = xnorm[l] > 0;
+                tau[l] = nonzero ? (beta-alpha)/beta : T(0);
+                scale[l] = nonzero ? T(1)/(alpha-beta) : T(0);
+                a[k+k*D][l] = nonzero ? beta : alpha;
+            }
+            for(unsigned i = k+1; i<D; ++i)
+                for(unsigned l = 0; l<B; ++l)
+                    a[i+k*D][l] *= scale[l];
+            for(unsigned c = k+1; c<D; ++c)
+                reflect(a, tau, k, a+c*D);
+            reflect(a, tau, k, x);
+        }
+        back_substitute(a, x);
+    }
+
+    //applies reflector k to the column v
+    static void reflect(const Lanes *a, const T *tau, unsigned k, Lanes *v)
+    {
+        T w[B];
+        for(unsigned l = 0; l<B; ++l)
+            w[l] = v[k][l];
+        for(unsigned i = k+1; i<D; ++i)
+            for(unsigned l = 0; l<B; ++l)
+                w[l] += a[i+k*D][l]*v[i][l];
+        for(unsigned l = 0; l<B; ++l)
+        {
+            w[l] *= tau[l];
+            v[k][l] -= w[l];
+        }
+        for(unsigned i = k+1; i<D; ++i)
+            for(unsigned l = 0; l<B; ++l)
+                v[i][l] -= a[i+k*D][l]*w[l];
+    }
+
+    //x = U^-1 x for the upper triangle of a
+    static void back_substitute(const Lanes *a, Lanes *x)
+    {
+        for(unsigned i = D; i-- > 0;)
+        {
+            for(unsigned j = i+1; j<D; ++j)
+                for(unsigned l = 0; l<B; ++l)
+                    x[i][l] -= a[i+j*D][l]*x[j][l];
+            for(unsigned l = 0; l<B; ++l)
+                x[i][l] /= a[i+i*D][l];
+        }
+    }
+
+    static void swap_rows(Lanes &u, Lanes &v, const unsigned *p, unsigned r)
+    {
+        for(unsigned l = 0; l<B; ++l)
+        {
+            T s = u[l], t = v[l];
+            bool swap = p[l] == r;
+            u[l] = swap ? t : s;
+            v[l] = swap ? s : t;
+        }
+    }
+};
+
+//copies blocks of systems in and out of the kernels, unused systems
+//of the last block are identity matrices
+template<class T, unsigned D, class F>
+void BatchSolve(const VectorArray<T,D*D> &a, const VectorArray<T,D> &b,
+                VectorArray<T,D> &x, size_t grain, F factor)
+{
+    typedef typename BatchSolveKernel<T,D>::Lanes Lanes;
+    const unsigned B = BatchSolveBlock;
+    size_t n = std::min(std::min(a.size(), b.size()), x.size());
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        Lanes ma[D*D], mx[D];
+        for(size_t s = begin; s<end; s += B)
+        {
+            size_t m = std::min<size_t>(B, end-s);
+            for(unsigned e = 0; e<D*D; ++e)
+            {
+                std::copy(a.lane(e)+s, a.lane(e)+s+m, ma[e]);
+                std::fill(ma[e]+m, ma[e]+B, e%(D+1) == 0 ? T(1) : T(0));
+            }
+            for(unsigned d = 0; d<D; ++d)
+            {
+                std::copy(b.lane(d)+s, b.lane(d)+s+m, mx[d]);
+                std::fill(mx[d]+m, mx[d]+B, T(0));
+            }
+            factor(ma, mx);
+            for(unsigned d = 0; d<D; ++d)
+                std::copy(mx[d], mx[d]+m, x.lane(d)+s);
+        }
+    });
+}
+
+//x[i] with a[i]*x[i] = b[i], x may be b
+template<class T, unsigned D>
+void BatchSolveLU(const VectorArray<T,D*D> &a, const VectorArray<T,D> &b,
+                  VectorArray<T,D> &x, size_t grain = BatchSolveGrain)
+{
+    BatchSolve(a, b, x, grain, BatchSolveKernel<T,D>::lu);
+}
+
+//only the lower triangles of the symmetric a[i] are read
+template<class T, unsigned D>
+void BatchSolveCholesky(const VectorArray<T,D*D> &a, const VectorArray<T,D> &b,
+                        VectorArray<T,D> &x, size_t grain = BatchSolveGrain)
+{
+    BatchSolve(a, b, x, grain, BatchSolveKernel<T,D>::cholesky);
+}
+
+template<class T, unsigned D>
+void BatchSolveQR(const VectorArray<T,D*D> &a, const VectorArray<T,D> &b,
+                  VectorArray<T,D> &x, size_t grain = BatchSolveGrain)
+{
+    BatchSolve(a, b, x, grain, BatchSolveKernel<T,D>::qr);
+}
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * BatchTransform.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * BatchTransform.h applies a single matrix to whole arrays of points,
+ * directions or normals. The arrays are strided so they can point
+ * directly into interleaved vertex data such as a mapped
+ * glp::VertexBuffer (see AttributeArray). It also inverts whole arrays
+ * of matrices and normalizes or measures whole arrays of vectors with
+ * a precision policy (see MathVector.h). Large arrays are split across
+ * threads, float data uses the MathSimd.h kernels.
+ */
+
+#ifndef BATCH_TRANSFORM_H
+#define BATCH_TRANSFORM_H
+
+#include <cstddef>
+#include <algorithm>
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits.hpp>
+
+#include "MathMatrix.h"
+#include "GraphicsMatrices.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//arrays smaller than this are transformed on the calling thread
+const size_t BatchTransformGrain = 16384;
+const size_t BatchMatrixGrain = 4096;
+
+//per vertex kernel, m is applied to (v, w) for 3 component input
+template<class T, unsigned DI, unsigned DO, bool DIVIDE, bool NORMALIZE>
+struct BatchTransformKernel {
+    static void run(const Matrix<T,4,4> &m,
+                    const char *in, size_t in_stride,
+                    char *out, size_t out_stride,
+                    size_t n, T w)
+    {
+        for(size_t i = 0; i<n; ++i, in += in_stride, out += out_stride)
+        {
+            const T *p = reinterpret_cast<const T*>(in);
+            Vector<T,4> v(p[0], p[1], p[2], DI == 4 ? p[3] : w);
+            Vector<T,4> r = m*v;
+            if(DIVIDE)
+                r /= r[3];
+            if(NORMALIZE)
+                r.normalize();
+            T *q = reinterpret_cast<T*>(out);
+            for(unsigned k = 0; k<DO; ++k)
+                q[k] = r[k];
+        }
+    }
+};
+
+template<unsigned DI, unsigned DO, bool DIVIDE, bool NORMALIZE>
+struct BatchTransformKernel<float, DI, DO, DIVIDE, NORMALIZE> {
+    static void run(const Matrix<float,4,4> &m,
+                    const char *in, size_t in_stride,
+                    char *out, size_t out_stride,
+                    size_t n, float w)
+    {
+        simd::mat4_transform_strided<DI, DO, DIVIDE, NORMALIZE>(
+            m.raw(), in, in_stride, out, out_stride, n, w);
+    }
+};
+
+template<bool DIVIDE, bool NORMALIZE, class T, class TI, unsigned DI, unsigned DO>
+void BatchTransform(const Matrix<T,4,4> &m,
+                    const StridedVectorArray<TI,DI> &in,
+                    const StridedVectorArray<T,DO> &out,
+                    T w, size_t grain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TI>::type, T>::value));
+    BOOST_STATIC_ASSERT(DI == 3 || DI == 4);
+    BOOST_STATIC_ASSERT(DO == 3 || DO == 4);
+    size_t n = std::min(in.size(), out.size());
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        BatchTransformKernel<T, DI, DO, DIVIDE, NORMALIZE>::run(
+            m,
+            reinterpret_cast<const char*>(in.ptr(begin)), in.stride(),
+            reinterpret_cast<char*>(out.ptr(begin)), out.stride(),
+            end-begin, w);
+    });
+}
+
+//3x4 affine matrices get their implicit last row
+template<class T>
+Matrix<T,4,4> AffineMatrix(const Matrix<T,3,4> &m)
+{
+    Matrix<T,4,4> res;
+    for(unsigned j = 0; j<4; ++j)
+        for(unsigned i = 0; i<3; ++i)
+            res(i,j) = m(i,j);
+    res(3,3) = 1;
+    return res;
+}
+
+//scaled inverse transpose of the upper 3x3 (the cofactor matrix with
+//the sign of the determinant), enough for normals that get normalized
+template<class T>
+Matrix<T,4,4> NormalCofactorMatrix(const Matrix<T,4,4> &m)
+{
+    Matrix<T,4,4> res;
+    for(unsigned i = 0; i<3; ++i)
+        for(unsigned j = 0; j<3; ++j)
+        {
+            unsigned i1 = (i+1)%3, i2 = (i+2)%3;
+            unsigned j1 = (j+1)%3, j2 = (j+2)%3;
+            res(i,j) = m(i1,j1)*m(i2,j2) - m(i1,j2)*m(i2,j1);
+        }
+    T det = m(0,0)*res(0,0) + m(0,1)*res(0,1) + m(0,2)*res(0,2);
+    if(det < 0)
+        res *= T(-1);
+    return res;
+}
+
+//out[i] = m*(in[i], 1), or m*in[i] for 4 component input
+template<class T, class TI, unsigned DI, unsigned DO>
+void TransformPoints(const Matrix<T,4,4> &m,
+                     const StridedVectorArray<TI,DI> &in,
+                     const StridedVectorArray<T,DO> &out,
+                     size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, false>(m, in, out, T(1), grain);
+}
+
+template<class T, class TI, unsigned DI, unsigned DO>
+void TransformPoints(const Matrix<T,3,4> &m,
+                     const StridedVectorArray<TI,DI> &in,
+                     const StridedVectorArray<T,DO> &out,
+                     size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, false>(AffineMatrix(m), in, out, T(1), grain);
+}
+
+//out[i] = m*(in[i], 0), translation is ignored
+template<class T, class TI, unsigned DI, unsigned DO>
+void TransformDirections(const Matrix<T,4,4> &m,
+                         const StridedVectorArray<TI,DI> &in,
+                         const StridedVectorArray<T,DO> &out,
+                         size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, false>(m, in, out, T(0), grain);
+}
+
+template<class T, class TI, unsigned DI, unsigned DO>
+void TransformDirections(const Matrix<T,3,4> &m,
+                         const StridedVectorArray<TI,DI> &in,
+                         const StridedVectorArray<T,DO> &out,
+                         size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, false>(AffineMatrix(m), in, out, T(0), grain);
+}
+
+//normals are transformed by the inverse transpose and renormalized
+template<class T, class TI, unsigned DO>
+void TransformNormals(const Matrix<T,4,4> &m,
+                      const StridedVectorArray<TI,3> &in,
+                      const StridedVectorArray<T,DO> &out,
+                      size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, true>(NormalCofactorMatrix(m), in, out, T(0), grain);
+}
+
+template<class T, class TI, unsigned DO>
+void TransformNormals(const Matrix<T,3,4> &m,
+                      const StridedVectorArray<TI,3> &in,
+                      const StridedVectorArray<T,DO> &out,
+                      size_t grain = BatchTransformGrain)
+{
+    BatchTransform<false, true>(NormalCofactorMatrix(AffineMatrix(m)), in, out, T(0), grain);
+}
+
+//transforms points to clip space and performs the perspective divide
+template<class T, class TI, unsigned DI, unsigned DO>
+void ProjectPoints(const Matrix<T,4,4> &m,
+                   const StridedVectorArray<TI,DI> &in,
+                   const StridedVectorArray<T,DO> &out,
+                   size_t grain = BatchTransformGrain)
+{
+    BatchTransform<true, false>(m, in, out, T(1), grain);
+}
+
+//same as above followed by the viewport mapping (see ViewportMatrix),
+//since the viewport is affine it can be applied before the divide
+template<class T, class TI, unsigned DI, unsigned DO>
+void ProjectPoints(const Matrix<T,4,4> &m,
+                   const Matrix<T,4,4> &viewport,
+                   const StridedVectorArray<TI,DI> &in,
+                   const StridedVectorArray<T,DO> &out,
+                   size_t grain = BatchTransformGrain)
+{
+    Matrix<T,4,4> vm = viewport*m;
+    BatchTransform<true, false>(vm, in, out, T(1), grain);
+}
+
+
+//vectors per block in NormalizeVectors and VectorNorms
+const size_t BatchNormalizeBlock = 256;
+
+//rsqrt and precision_sqrt over a block of squared lengths in place
+template<class T, class P>
+struct BatchNormalizeKernel {
+    static void rsqrt(T *x, size_t n)
+    {
+        for(size_t i = 0; i<n; ++i)
+            x[i] = ::rsqrt(x[i], P());
+    }
+
+    static void sqrt(T *x, size_t n)
+    {
+        for(size_t i = 0; i<n; ++i)
+            x[i] = precision_sqrt(x[i], P());
+    }
+};
+
+//the float estimates run 4 or 8 at a time
+template<bool REFINE>
+struct BatchRsqrtEstimateKernel {
+    static void rsqrt(float *x, size_t n)
+    {
+        simd::rsqrt_n(x, x, n, REFINE);
+    }
+
+    static void sqrt(float *x, size_t n)
+    {
+        float r[BatchNormalizeBlock];
+        simd::rsqrt_n(x, r, n, REFINE);
+        for(size_t i = 0; i<n; ++i)
+            x[i] = x[i] > 0 ? x[i]*r[i] : 0.0f;
+    }
+};
+
+template<>
+struct BatchNormalizeKernel<float, RefinedPrecision> : BatchRsqrtEstimateKernel<true> { };
+
+template<>
+struct BatchNormalizeKernel<float, ApproximatePrecision> : BatchRsqrtEstimateKernel<false> { };
+
+//out[i] = normalize(in[i], precision), in and out may be the same
+template<class T, class TI, unsigned D, class P>
+void NormalizeVectors(const StridedVectorArray<TI,D> &in,
+                      const StridedVectorArray<T,D> &out,
+                      P, size_t grain = BatchTransformGrain)
+{
+    size_t n = std::min(in.size(), out.size());
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        T scale[BatchNormalizeBlock];
+        for(size_t b = begin; b<end; b += BatchNormalizeBlock)
+        {
+            size_t m = std::min(BatchNormalizeBlock, end-b);
+            for(size_t i = 0; i<m; ++i)
+            {
+                const TI *p = in.ptr(b+i);
+                T s = 0;
+                for(unsigned d = 0; d<D; ++d)
+                    s += T(p[d])*T(p[d]);
+                scale[i] = s;
+            }
+            BatchNormalizeKernel<T,P>::rsqrt(scale, m);
+            for(size_t i = 0; i<m; ++i)
+            {
+                const TI *p = in.ptr(b+i);
+                T *q = out.ptr(b+i);
+                for(unsigned d = 0; d<D; ++d)
+                    q[d] = T(p[d])*scale[i];
+            }
+        }
+    });
+}
+
+template<class T, class TI, unsigned D>
+void NormalizeVectors(const StridedVectorArray<TI,D> &in,
+                      const StridedVectorArray<T,D> &out)
+{
+    NormalizeVectors(in, out, exact_precision);
+}
+
+//out[i] = norm(in[i], precision)
+template<class T, class TI, unsigned D, class P>
+void VectorNorms(const StridedVectorArray<TI,D> &in, T *out,
+                 P, size_t grain = BatchTransformGrain)
+{
+    glp::parallel_for(0, in.size(), grain, [&](size_t begin, size_t end) {
+        for(size_t b = begin; b<end; b += BatchNormalizeBlock)
+        {
+            size_t m = std::min(BatchNormalizeBlock, end-b);
+            for(size_t i = 0; i<m; ++i)
+            {
+                const TI *p = in.ptr(b+i);
+                T s = 0;
+                for(unsigned d = 0; d<D; ++d)
+                    s += T(p[d])*T(p[d]);
+                out[b+i] = s;
+            }
+            BatchNormalizeKernel<T,P>::sqrt(out+b, m);
+        }
+    });
+}
+
+template<class T, class TI, unsigned D>
+void VectorNorms(const StridedVectorArray<TI,D> &in, T *out)
+{
+    VectorNorms(in, out, exact_precision);
+}
+
+//out[i] = f(in[i]) for arrays of matrices, in and out may be the same
+template<class TI, class TO, class F>
+void BatchMap(const TI *in, TO *out, size_t n, size_t grain, F f)
+{
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i<end; ++i)
+            out[i] = f(in[i]);
+    });
+}
+
+template<class T, unsigned D>
+void BatchDeterminant(const Matrix<T,D,D> *in, T *out, size_t n,
+                      size_t grain = BatchMatrixGrain)
+{
+    BatchMap(in, out, n, grain, [](const Matrix<T,D,D> &m) {
+        return InverseKernel<T,D>::determinant(m.raw());
+    });
+}
+
+template<class T, unsigned D>
+void BatchInverse(const Matrix<T,D,D> *in, Matrix<T,D,D> *out, size_t n,
+                  size_t grain = BatchMatrixGrain)
+{
+    BatchMap(in, out, n, grain, [](const Matrix<T,D,D> &m) {
+        Matrix<T,D,D> res(uninitialized);
+        InverseKernel<T,D>::inverse(m.raw(), res.raw());
+        return res;
+    });
+}
+
+template<class T>
+void BatchRigidInverse(const Matrix<T,4,4> *in, Matrix<T,4,4> *out, size_t n,
+                       size_t grain = BatchMatrixGrain)
+{
+    BatchMap(in, out, n, grain, RigidInverse<T, Matrix<T,4,4> >);
+}
+
+template<class T>
+void BatchAffineInverse(const Matrix<T,4,4> *in, Matrix<T,4,4> *out, size_t n,
+                        size_t grain = BatchMatrixGrain)
+{
+    BatchMap(in, out, n, grain, AffineInverse<T, Matrix<T,4,4> >);
+}
+
+template<class T>
+void BatchNormalMatrix(const Matrix<T,4,4> *in, Matrix<T,3,3> *out, size_t n,
+                       size_t grain = BatchMatrixGrain)
+{
+    BatchMap(in, out, n, grain, NormalMatrix<T, Matrix<T,4,4> >);
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Frustum.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * Frustum.h extracts the six clip planes from a view projection matrix
+ * (for example FrustumMatrix(...)*view) and tests points, spheres and
+ * axis aligned boxes against them. CullSpheres and CullBoxes test whole
+ * VectorArrays of bounds and write the indices of the potentially
+ * visible ones to a compact list. Float data is tested 4 or 8 objects
+ * at a time with the MathSimd.h kernel, large arrays are split across
+ * threads. The tests are conservative, objects near the frustum
+ * corners may be reported visible.
+ */
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "VectorArray.h"
+
+//arrays smaller than this are culled on the calling thread
+const size_t FrustumCullGrain = 65536;
+
+template<class T>
+class Frustum {
+public:
+    enum Plane { Left, Right, Bottom, Top, Near, Far };
+
+    //the empty frustum, everything is inside
+    Frustum()
+    {
+        for(unsigned p = 0; p<6; ++p)
+            planes[p] = Vector<T,4>(0, 0, 0, 1);
+    }
+
+    explicit Frustum(const Matrix<T,4,4> &m)
+    {
+        set(m);
+    }
+
+    //planes are rows 3 +- rows 0 to 2 of m, scaled to unit normals so
+    //plane distances are actual distances. The far plane of an infinite
+    //projection has no normal and is replaced by one that accepts
+    //everything.
+    void set(const Matrix<T,4,4> &m)
+    {
+        for(unsigned p = 0; p<6; ++p)
+        {
+            T sign = p%2 == 0 ? T(1) : T(-1);
+            for(unsigned j = 0; j<4; ++j)
+                planes[p][j] = m(3,j) + sign*m(p/2,j);
+            T len = std::sqrt(planes[p][0]*planes[p][0] +
+                              planes[p][1]*planes[p][1] +
+                              planes[p][2]*planes[p][2]);
+            if(len > 0)
+                planes[p] /= len;
+            else
+                planes[p] = Vector<T,4>(0, 0, 0, 1);
+        }
+    }
+
+    const Vector<T,4>& plane(unsigned p) const { return planes[p]; }
+
+    //signed distance of p to plane, positive on the inside
+    template<class A>
+    T distance(unsigned p, const VectorExpr<T,3,A> &v) const
+    {
+        const A& vo ( v );
+        const Vector<T,4> &pl = planes[p];
+        return pl[0]*vo[0] + pl[1]*vo[1] + pl[2]*vo[2] + pl[3];
+    }
+
+    template<class A>
+    bool contains(const VectorExpr<T,3,A> &v) const
+    {
+        return intersects_sphere(v, T(0));
+    }
+
+    template<class A>
+    bool intersects_sphere(const VectorExpr<T,3,A> &center, const T &radius) const
+    {
+        Vector<T,3> c(center);
+        for(unsigned p = 0; p<6; ++p)
+            if(distance(p, c) < -radius)
+                return false;
+        return true;
+    }
+
+    template<class A, class B>
+    bool intersects_box(const VectorExpr<T,3,A> &lo, const VectorExpr<T,3,B> &hi) const
+    {
+        Vector<T,3> l(lo), h(hi);
+        for(unsigned p = 0; p<6; ++p)
+        {
+            Vector<T,3> v(uninitialized);
+            for(unsigned j = 0; j<3; ++j)
+                v[j] = planes[p][j] < 0 ? l[j] : h[j];
+            if(distance(p, v) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    //6 consecutive (nx, ny, nz, d) planes in the order of Plane
+    const T* raw() const { return planes[0].raw(); }
+
+private:
+    BOOST_STATIC_ASSERT(sizeof(Vector<T,4>) == 4*sizeof(T));
+    Vector<T,4> planes[6];
+};
+
+//structure of arrays culling kernel, see simd::cull_planes
+template<class T>
+struct FrustumCullKernel {
+    static size_t run(const T *planes, const T *const src[6][3],
+                      const T *r, size_t n, unsigned base, unsigned *visible)
+    {
+        size_t count = 0;
+        for(size_t i = 0; i<n; ++i)
+        {
+            T t = r ? -r[i] : T(0);
+            unsigned inside = 1;
+            for(unsigned p = 0; p<6; ++p)
+            {
+                const T *pl = planes+4*p;
+                T s = pl[0]*src[p][0][i] + pl[1]*src[p][1][i] + pl[2]*src[p][2][i] + pl[3];
+                inside &= s >= t;
+            }
+            visible[count] = base+unsigned(i);
+            count += inside;
+        }
+        return count;
+    }
+};
+
+template<>
+struct FrustumCullKernel<float> {
+    static size_t run(const float *planes, const float *const src[6][3],
+                      const float *r, size_t n, unsigned base, unsigned *visible)
+    {
+        return simd::cull_planes(planes, src, r, n, base, visible);
+    }
+};
+
+//every chunk writes its indices to its own range of visible, the
+//ranges are moved together afterwards so the result stays sorted
+template<class T>
+size_t FrustumCull(const Frustum<T> &f, const T *const src[6][3], const T *r,
+                   size_t n, unsigned *visible, size_t grain)
+{
+    std::vector<std::pair<size_t, size_t> > chunks;
+    std::mutex chunks_mutex;
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        const T *s[6][3];
+        for(unsigned p = 0; p<6; ++p)
+            for(unsigned j = 0; j<3; ++j)
+                s[p][j] = src[p][j]+begin;
+        size_t count = FrustumCullKernel<T>::run(
+                            f.raw(), s, r ? r+begin : 0, end-begin,
+                            unsigned(begin), visible+begin);
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        chunks.push_back(std::make_pair(begin, count));
+    });
+    std::sort(chunks.begin(), chunks.end());
+    size_t count = 0;
+    for(size_t c = 0; c<chunks.size(); ++c)
+    {
+        unsigned *first = visible+chunks[c].first;
+        std::copy(first, first+chunks[c].second, visible+count);
+        count += chunks[c].second;
+    }
+    return count;
+}
+
+//writes the indices of all spheres that intersect f to visible, which
+//needs room for centers.size() indices. Returns the number of visible
+//spheres.
+template<class T>
+size_t CullSpheres(const Frustum<T> &f,
+                   const VectorArray<T,3> &centers,
+                   const VectorArray<T,1> &radii,
+                   unsigned *visible,
+                   size_t grain = FrustumCullGrain)
+{
+    const T *src[6][3];
+    for(unsigned p = 0; p<6; ++p)
+        for(unsigned j = 0; j<3; ++j)
+            src[p][j] = centers.lane(j);
+    size_t n = std::min(centers.size(), radii.size());
+    return FrustumCull(f, src, radii.lane(0), n, visible, grain);
+}
+
+//same for boxes given by their minimum and maximum corners, only the
+//corner farthest along each plane normal is tested
+template<class T>
+size_t CullBoxes(const Frustum<T> &f,
+                 const VectorArray<T,3> &lo,
+                 const VectorArray<T,3> &hi,
+                 unsigned *visible,
+                 size_t grain = FrustumCullGrain)
+{
+    const T *src[6][3];
+    for(unsigned p = 0; p<6; ++p)
+        for(unsigned j = 0; j<3; ++j)
+            src[p][j] = f.plane(p)[j] < 0 ? lo.lane(j) : hi.lane(j);
+    size_t n = std::min(lo.size(), hi.size());
+    return FrustumCull(f, src, static_cast<const T*>(0), n, visible, grain);
+}
+
+#endif
@@ -31,9 +31,13 @@
 #include <GL/gl.h>
 
 #include "GLCheckError.h"
+#include "ParallelFor.h"
 
 namespace glp {
 
+//elements per task when filling mapped buffers
+const size_t BufferFillGrain = 16384;
+
 template<class T, GLenum TARGET>
 class Buffer : boost::noncopyable {
 public:
@@ -92,6 +96,19 @@ public:
     inline const_iterator end() const { check_mapped(); return host_ptr+size_; }
     
     inline size_type size() const { return size_; }
+
+    //calls f(i, element) for every element of the mapped buffer on the
+    //TaskScheduler, only the calling thread needs a current context
+    template<class F>
+    void fill(F f, size_t grain = BufferFillGrain)
+    {
+        check_mapped();
+        value_type *p = host_ptr;
+        parallel_for(0, size_, grain, [p, &f](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+                f(i, p[i]);
+        });
+    }
     
     inline void bind()
     {
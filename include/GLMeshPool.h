@@ -0,0 +1,329 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef GL_MESH_POOL_H
+#define GL_MESH_POOL_H
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <boost/utility.hpp>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "RangeAllocator.h"
+#include "TypeToGLConstant.h"
+#include "GLCheckError.h"
+#include "GLVertexBuffer.h"
+#include "GLVertexArray.h"
+
+namespace glp {
+
+//bytes per buffer, meshes larger than that get a buffer of their own
+const size_t MeshPoolPageSize = 1 << 24;
+
+//bytes defragment() copies per call by default
+const size_t MeshPoolDefragmentBytes = 1 << 20;
+
+struct MeshPoolStats {
+    size_t buffers, meshes;
+    size_t capacity;
+    size_t live_bytes, free_bytes;
+    size_t free_ranges;
+    //sum of the largest free range of every buffer
+    size_t largest_free;
+
+    //0 if every buffer has all its free space in one range
+    double fragmentation() const
+    {
+        return free_bytes ? 1.0 - double(largest_free)/double(free_bytes) : 0.0;
+    }
+};
+
+// many small meshes of the same vertex format in a few large buffers.
+// Vertices and indices of a mesh share one buffer, every buffer has one
+// vertex array with its attributes and indices, and a mesh is drawn
+// with glDrawElementsBaseVertex at its offsets. Drawing a list of
+// meshes only binds a vertex array when the buffer changes:
+//
+//     glp::MeshPool<Vertex> pool;
+//     unsigned rock = pool.add(vertices.data(), vertices.size(),
+//                              indices.data(), indices.size());
+//     pool.draw(visible.data(), visible.size());
+//     pool.remove(rock);
+//     pool.defragment();   //once per frame
+//
+// Ranges come from one RangeAllocator per buffer. defragment() moves a
+// limited number of bytes down with glCopyBufferSubData on the GPU, the
+// mesh handles stay valid.
+template<class V, class I = GLuint>
+class MeshPool : boost::noncopyable {
+public:
+    typedef V vertex_type;
+    typedef I index_type;
+
+    explicit MeshPool(size_t page = MeshPoolPageSize, GLenum buffer_usage = GL_STATIC_DRAW)
+        : page_size(page), usage(buffer_usage), scratch(0), scratch_size(0), live(0)
+    { }
+
+    //uploads a mesh and returns its handle, indices are relative to the
+    //first vertex
+    unsigned add(const V *vertices, size_t vertex_count, const I *indices, size_t index_count)
+    {
+        const size_t vertex_bytes = vertex_count*sizeof(V), index_bytes = index_count*sizeof(I);
+        Mesh mesh = { RangeAllocatorNone, RangeAllocatorNone, RangeAllocatorNone, vertex_count, index_count };
+        for(unsigned p = 0; p<pages.size() && mesh.page == RangeAllocatorNone; ++p)
+            if(place(p, vertex_bytes, index_bytes, mesh))
+                mesh.page = p;
+        if(mesh.page == RangeAllocatorNone)
+        {
+            size_t needed = vertex_bytes + index_bytes + sizeof(V) + sizeof(I);
+            add_page(std::max(page_size, needed));
+            mesh.page = unsigned(pages.size()-1);
+            if(!place(mesh.page, vertex_bytes, index_bytes, mesh))
+                throw exception("MeshPool allocation failed");
+        }
+
+        Page &page = *pages[mesh.page];
+        GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, page.buffer);)
+        GLP_CHECKED_CALL(glBufferSubData(GL_COPY_WRITE_BUFFER, page.ranges.offset(mesh.vertices), vertex_bytes, vertices);)
+        GLP_CHECKED_CALL(glBufferSubData(GL_COPY_WRITE_BUFFER, page.ranges.offset(mesh.indices), index_bytes, indices);)
+        GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0);)
+
+        unsigned h;
+        if(!free_meshes.empty())
+        {
+            h = free_meshes.back();
+            free_meshes.pop_back();
+            meshes[h] = mesh;
+        }
+        else
+        {
+            h = unsigned(meshes.size());
+            meshes.push_back(mesh);
+        }
+        ++live;
+        return h;
+    }
+
+    void remove(unsigned h)
+    {
+        Mesh &mesh = check(h);
+        pages[mesh.page]->ranges.free(mesh.vertices);
+        pages[mesh.page]->ranges.free(mesh.indices);
+        mesh.page = RangeAllocatorNone;
+        free_meshes.push_back(h);
+        --live;
+    }
+
+    void draw(unsigned h, GLenum primitives = GL_TRIANGLES)
+    {
+        const Mesh &mesh = check(h);
+        pages[mesh.page]->vao.bind();
+        draw_elements(mesh, primitives);
+        pages[mesh.page]->vao.unbind();
+    }
+
+    //draws the meshes grouped by buffer, in the given order within one
+    void draw(const unsigned *handles, size_t count, GLenum primitives = GL_TRIANGLES)
+    {
+        order.assign(handles, handles+count);
+        for(size_t i = 0; i<count; ++i)
+            check(order[i]);
+        std::stable_sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+            return meshes[a].page < meshes[b].page;
+        });
+        for(size_t i = 0; i<count; ++i)
+        {
+            const Mesh &mesh = meshes[order[i]];
+            if(i == 0 || mesh.page != meshes[order[i-1]].page)
+                pages[mesh.page]->vao.bind();
+            draw_elements(mesh, primitives);
+        }
+        if(count)
+            pages[meshes[order[count-1]].page]->vao.unbind();
+    }
+
+    //moves up to about max_bytes down in every buffer to close the holes
+    //removed meshes left, returns the number of bytes copied
+    size_t defragment(size_t max_bytes = MeshPoolDefragmentBytes)
+    {
+        size_t copied = 0;
+        for(size_t p = 0; p<pages.size(); ++p)
+        {
+            Page &page = *pages[p];
+            unsigned h;
+            size_t from, to, moved = 0;
+            while(moved < max_bytes && page.ranges.compact(h, from, to))
+            {
+                size_t size = page.ranges.size(h);
+                copy(page.buffer, from, to, size);
+                moved += size;
+            }
+            copied += moved;
+        }
+        return copied;
+    }
+
+    //number of meshes
+    size_t size() const { return live; }
+
+    //memory of all buffers, live bytes are the vertex and index ranges
+    //of the meshes without alignment gaps
+    MeshPoolStats stats() const
+    {
+        MeshPoolStats s = { pages.size(), live, 0, 0, 0, 0, 0 };
+        for(size_t p = 0; p<pages.size(); ++p)
+        {
+            RangeAllocatorStats page = pages[p]->ranges.stats();
+            s.capacity += page.capacity;
+            s.live_bytes += page.live_bytes;
+            s.free_bytes += page.free_bytes;
+            s.free_ranges += page.free_ranges;
+            s.largest_free += page.largest_free;
+        }
+        return s;
+    }
+
+    ~MeshPool()
+    {
+        if(scratch)
+            GLP_CHECKED_CALL(glDeleteBuffers(1, &scratch);)
+    }
+
+private:
+    struct Mesh {
+        unsigned page;
+        unsigned vertices, indices;
+        size_t vertex_count, index_count;
+    };
+
+    struct Page : boost::noncopyable {
+        Page(size_t capacity, GLenum usage) : ranges(capacity)
+        {
+            GLP_CHECKED_CALL(glGenBuffers(1, &buffer);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);)
+            GLP_CHECKED_CALL(glBufferData(GL_COPY_WRITE_BUFFER, capacity, 0, usage);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0);)
+            vao.bind();
+            GLP_CHECKED_CALL(glBindBuffer(GL_ARRAY_BUFFER, buffer);)
+            SetVertexAttributes<V>(0, 0);
+            GLP_CHECKED_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);)
+            vao.unbind();
+            GLP_CHECKED_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);)
+        }
+
+        ~Page()
+        {
+            GLP_CHECKED_CALL(glDeleteBuffers(1, &buffer);)
+        }
+
+        GLuint buffer;
+        VertexArray vao;
+        RangeAllocator ranges;
+    };
+
+    //vertices aligned to whole vertices for the base vertex and indices
+    //to their size
+    bool place(unsigned p, size_t vertex_bytes, size_t index_bytes, Mesh &mesh)
+    {
+        RangeAllocator &ranges = pages[p]->ranges;
+        mesh.vertices = ranges.allocate(vertex_bytes, sizeof(V));
+        if(mesh.vertices == RangeAllocatorNone)
+            return false;
+        mesh.indices = ranges.allocate(index_bytes, sizeof(I));
+        if(mesh.indices == RangeAllocatorNone)
+        {
+            ranges.free(mesh.vertices);
+            return false;
+        }
+        return true;
+    }
+
+    void add_page(size_t capacity)
+    {
+        pages.push_back(std::unique_ptr<Page>(new Page(capacity, usage)));
+    }
+
+    void draw_elements(const Mesh &mesh, GLenum primitives)
+    {
+        const RangeAllocator &ranges = pages[mesh.page]->ranges;
+        GLP_CHECKED_CALL(glDrawElementsBaseVertex(primitives, GLsizei(mesh.index_count), TypeToGLConstant<I>::value,
+                                                  static_cast<GLubyte*>(0)+ranges.offset(mesh.indices),
+                                                  GLint(ranges.offset(mesh.vertices)/sizeof(V)));)
+    }
+
+    //copies within one buffer, through the scratch buffer if the ranges
+    //overlap
+    void copy(GLuint buffer, size_t from, size_t to, size_t size)
+    {
+        if(to+size <= from)
+        {
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_READ_BUFFER, buffer);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);)
+            GLP_CHECKED_CALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, size);)
+        }
+        else
+        {
+            if(!scratch)
+                GLP_CHECKED_CALL(glGenBuffers(1, &scratch);)
+            if(scratch_size < size)
+            {
+                scratch_size = size;
+                GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);)
+                GLP_CHECKED_CALL(glBufferData(GL_COPY_WRITE_BUFFER, scratch_size, 0, GL_STREAM_COPY);)
+            }
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_READ_BUFFER, buffer);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);)
+            GLP_CHECKED_CALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, 0, size);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_READ_BUFFER, scratch);)
+            GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);)
+            GLP_CHECKED_CALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, to, size);)
+        }
+        GLP_CHECKED_CALL(glBindBuffer(GL_COPY_READ_BUFFER, 0);)
+        GLP_CHECKED_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0);)
+    }
+
+    Mesh& check(unsigned h)
+    {
+        if(h >= meshes.size() || meshes[h].page == RangeAllocatorNone)
+            throw exception("MeshPool invalid mesh");
+        return meshes[h];
+    }
+
+    size_t page_size;
+    GLenum usage;
+    std::vector<std::unique_ptr<Page> > pages;
+    std::vector<Mesh> meshes;
+    std::vector<unsigned> free_meshes;
+    std::vector<unsigned> order;
+    GLuint scratch;
+    size_t scratch_size;
+    size_t live;
+};
+
+}
+#endif
@@ -0,0 +1,93 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef GL_SKINNING_PALETTE_H
+#define GL_SKINNING_PALETTE_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <boost/utility.hpp>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "Skinning.h"
+#include "GLBuffer.h"
+#include "GLTexture.h"
+
+namespace glp {
+
+// palettes built by BuildPalettes for up to a fixed number of
+// characters, exposed as a RGBA32F buffer texture with 3 texels per
+// bone. The vertex shader reads bone b of instance i with
+//
+//     uniform samplerBuffer palette;
+//     int base = 3*(gl_InstanceID*bones + b);
+//     vec4 r0 = texelFetch(palette, base);
+//     vec4 r1 = texelFetch(palette, base+1);
+//     vec4 r2 = texelFetch(palette, base+2);
+//     vec3 p = vec3(dot(r0, v), dot(r1, v), dot(r2, v));
+class SkinningPalette : boost::noncopyable {
+public:
+    typedef Buffer<Vector<GLfloat,4>, GL_TEXTURE_BUFFER> buffer_type;
+
+    SkinningPalette(size_t bones, size_t characters)
+        : bone_count(bones), character_count(characters),
+        buffer(3*bones*characters, GL_STREAM_DRAW),
+        texture(GL_RGBA32F, buffer)
+    {
+    }
+
+    // rebuilds the palettes of the first count characters from their
+    // local bone poses, see BuildPalettes
+    void update(const Skeleton<GLfloat> &skeleton, const Matrix<GLfloat,4,4> *local, size_t count)
+    {
+        if(skeleton.size() != bone_count)
+            throw std::runtime_error("Skeleton does not match palette size");
+        count = std::min(count, character_count);
+        buffer.map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        BuildPalettes(skeleton, local, count, buffer.data()->raw());
+        buffer.unmap();
+    }
+
+    void bind(GLuint active)
+    {
+        texture.bind(active);
+    }
+
+    size_t getBoneCount() const { return bone_count; }
+    size_t getCharacterCount() const { return character_count; }
+    buffer_type& getBuffer() { return buffer; }
+    BufferTexture& getTexture() { return texture; }
+
+private:
+    size_t bone_count, character_count;
+    buffer_type buffer;
+    BufferTexture texture;
+};
+
+}
+
+#endif
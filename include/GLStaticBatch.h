@@ -0,0 +1,106 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef GL_STATIC_BATCH_H
+#define GL_STATIC_BATCH_H
+
+#include <algorithm>
+#include <vector>
+#include <boost/utility.hpp>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "StaticBatch.h"
+#include "Frustum.h"
+#include "GLVertexBuffer.h"
+#include "GLVertexArray.h"
+
+namespace glp {
+
+// the vertices and indices of a built StaticBatchBuilder in one vertex
+// and one index buffer. Every chunk is one glDrawElementsBaseVertex,
+// indices are stored with 8 or 16 bits if the largest chunk allows it:
+//
+//     glp::StaticBatch<Vertex> batch(builder);
+//     batch.draw(Frustum<float>(projection*view), [&](unsigned material) {
+//         materials[material].bind();
+//     });
+template<class V>
+class StaticBatch : boost::noncopyable {
+public:
+    explicit StaticBatch(const StaticBatchBuilder<V> &builder, GLenum usage = GL_STATIC_DRAW)
+        : vbo(builder.vertices().size(), usage),
+          ibo(builder.indices().data(), builder.indices().size(), builder.max_chunk_vertices(), usage),
+          chunks_(builder.chunks()), lo(builder.chunk_lo()), hi(builder.chunk_hi()),
+          visible(builder.chunks().size())
+    {
+        if(vbo.size())
+        {
+            vbo.map();
+            std::copy(builder.vertices().begin(), builder.vertices().end(), vbo.data());
+            vbo.unmap();
+        }
+        vao.attach(vbo);
+        vao.attach(ibo);
+    }
+
+    //draws chunk c
+    void draw(size_t c)
+    {
+        const StaticBatchChunk &chunk = chunks_[c];
+        vao.drawBaseVertex(GL_TRIANGLES, GLuint(chunk.first), GLuint(chunk.first+chunk.count),
+                           GLint(chunk.base));
+    }
+
+    //draws the chunks that intersect f in material order, bind(material)
+    //is called before the first chunk of every material. Returns the
+    //number of draw calls.
+    template<class F>
+    size_t draw(const Frustum<float> &f, F bind)
+    {
+        size_t count = CullBoxes(f, lo, hi, visible.data());
+        for(size_t v = 0; v<count; ++v)
+        {
+            if(v == 0 || chunks_[visible[v]].material != chunks_[visible[v-1]].material)
+                bind(chunks_[visible[v]].material);
+            draw(visible[v]);
+        }
+        return count;
+    }
+
+    const std::vector<StaticBatchChunk>& chunks() const { return chunks_; }
+
+    VertexArray& getVertexArray() { return vao; }
+
+private:
+    VertexBuffer<V> vbo;
+    PackedIndexBuffer ibo;
+    VertexArray vao;
+    std::vector<StaticBatchChunk> chunks_;
+    VectorArray<float,3> lo, hi;
+    std::vector<unsigned> visible;
+};
+
+}
+#endif
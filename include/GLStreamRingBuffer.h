@@ -0,0 +1,259 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef GL_STREAM_RING_BUFFER_H
+#define GL_STREAM_RING_BUFFER_H
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <boost/utility.hpp>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "GLCheckError.h"
+#include "GLSyncQuery.h"
+#include "GLVertexBuffer.h"
+
+namespace glp {
+
+//frames the CPU may write ahead of the GPU
+const unsigned StreamRingFrames = 3;
+
+//frame regions start at multiples of this many bytes, enough for
+//uniform and shader storage buffer offsets on common hardware
+const size_t StreamRingRegionAlignment = 256;
+
+//nanoseconds per glClientWaitSync while waiting for a region
+const GLuint64 StreamRingWaitTimeout = 1000000000;
+
+enum StreamFlush {
+    //writes become visible to the GPU without further calls
+    CoherentFlush,
+    //flush() makes writes visible with glFlushMappedBufferRange
+    ExplicitFlush
+};
+
+//least common multiple of two byte alignments
+inline size_t StreamRingStep(size_t a, size_t b)
+{
+    size_t x = a, y = b;
+    while(y)
+    {
+        size_t r = x%y;
+        x = y;
+        y = r;
+    }
+    return a/x*b;
+}
+
+//a part of the current frame region
+template<class T>
+struct StreamRange {
+    T *data;
+    //elements
+    size_t count;
+    //offset in bytes in the buffer and in elements
+    size_t offset, first;
+};
+
+// a buffer that is mapped once with GL_MAP_PERSISTENT_BIT and split
+// into one region per frame in flight. Every frame writes to the next
+// region, which is only reused after the fence placed at the end of
+// the frame it was last written in signaled, so neither orphaning nor
+// implicit synchronization happens:
+//
+//     glp::StreamRingBuffer<Instance, GL_ARRAY_BUFFER> instances(4096);
+//     ...
+//     instances.beginFrame();
+//     glp::StreamRange<Instance> r = instances.allocate(n);
+//     std::copy(source, source+n, r.data);
+//     instances.flush();   //only needed with ExplicitFlush
+//     instances.bindVertexAttributes(3, 1);
+//     glDrawArraysInstancedBaseInstance(..., n, r.first);
+//     instances.endFrame();
+//
+// Needs OpenGL 4.4 or ARB_buffer_storage.
+template<class T, GLenum TARGET>
+class StreamRingBuffer : boost::noncopyable {
+public:
+    typedef T value_type;
+
+    //room for frame_size elements per frame, regions are rounded up to
+    //multiples of StreamRingRegionAlignment and sizeof(T) so every
+    //region starts at a whole element
+    explicit StreamRingBuffer(size_t frame_size, unsigned frames = StreamRingFrames,
+                              StreamFlush flush = CoherentFlush)
+        : frames_(std::max(frames, 1u)), flush_(flush),
+          region_bytes(roundUp(frame_size*sizeof(T),
+                               StreamRingStep(StreamRingRegionAlignment, sizeof(T)))),
+          fences(new SyncQuery[std::max(frames, 1u)]),
+          region(0), head(0), flushed(0), in_frame(false), stalls_(0)
+    {
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            (flush == CoherentFlush ? GL_MAP_COHERENT_BIT : GL_MAP_FLUSH_EXPLICIT_BIT);
+        GLbitfield storage = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            (flush == CoherentFlush ? GL_MAP_COHERENT_BIT : 0);
+        GLP_CHECKED_CALL(glGenBuffers(1, &buffer);)
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, buffer);)
+        GLP_CHECKED_CALL(glBufferStorage(TARGET, std::max<size_t>(capacity(), 1), 0, storage);)
+        GLP_CHECKED_CALL(
+        host_ptr = static_cast<char*>(glMapBufferRange(TARGET, 0, std::max<size_t>(capacity(), 1), access));
+        )
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, 0);)
+        if(!host_ptr)
+        {
+            glDeleteBuffers(1, &buffer);
+            throw exception("StreamRingBuffer mapping failed");
+        }
+    }
+
+    //moves to the next region, waits until the GPU is done with it
+    void beginFrame()
+    {
+        if(in_frame)
+            throw exception("StreamRingBuffer frame already begun");
+        SyncQuery &fence = fences[region];
+        if(!fence.signaled())
+        {
+            ++stalls_;
+            while(!fence.signaled())
+                if(fence.wait(StreamRingWaitTimeout) == GL_WAIT_FAILED)
+                    throw exception("StreamRingBuffer wait failed");
+        }
+        head = flushed = 0;
+        in_frame = true;
+    }
+
+    //count elements at an offset that is a multiple of alignment bytes
+    //and of sizeof(T), throws if the region is full. An alignment of 0
+    //means sizeof(T)
+    StreamRange<T> allocate(size_t count, size_t alignment = sizeof(T))
+    {
+        if(!in_frame)
+            throw exception("StreamRingBuffer allocation outside of a frame");
+        size_t offset = roundUp(head, StreamRingStep(alignment ? alignment : sizeof(T), sizeof(T)));
+        if(offset+count*sizeof(T) > region_bytes)
+            throw exception("StreamRingBuffer frame region full");
+        head = offset+count*sizeof(T);
+        size_t absolute = region*region_bytes+offset;
+        StreamRange<T> range = { reinterpret_cast<T*>(host_ptr+absolute), count,
+                                 absolute, absolute/sizeof(T) };
+        return range;
+    }
+
+    //makes the elements allocated since the last flush visible to the
+    //GPU, needed before drawing from them with ExplicitFlush
+    void flush()
+    {
+        if(flush_ == ExplicitFlush && head > flushed)
+        {
+            GLP_CHECKED_CALL(glBindBuffer(TARGET, buffer);)
+            GLP_CHECKED_CALL(glFlushMappedBufferRange(TARGET, region*region_bytes+flushed, head-flushed);)
+            GLP_CHECKED_CALL(glBindBuffer(TARGET, 0);)
+        }
+        flushed = head;
+    }
+
+    //fences the region, call after the last draw that reads from it
+    void endFrame()
+    {
+        if(!in_frame)
+            throw exception("StreamRingBuffer frame not begun");
+        flush();
+        fences[region].fence();
+        region = (region+1)%frames_;
+        in_frame = false;
+    }
+
+    inline void bind()
+    {
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, buffer);)
+    }
+
+    inline void unbind()
+    {
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, 0);)
+    }
+
+    //binds a range to an indexed binding point of TARGET, for uniform,
+    //shader storage and transform feedback buffers
+    void bindRange(GLuint index, const StreamRange<T> &range)
+    {
+        GLP_CHECKED_CALL(glBindBufferRange(TARGET, index, buffer, range.offset, range.count*sizeof(T));)
+    }
+
+    //binds the buffer and points the attributes from base_attrib on at
+    //the fusion vertices T, ranges are then drawn from range.first
+    void bindVertexAttributes(GLuint base_attrib = 0, GLuint divisor = 0)
+    {
+        GLP_CHECKED_CALL(glBindBuffer(GL_ARRAY_BUFFER, buffer);)
+        SetVertexAttributes<T>(base_attrib, divisor);
+    }
+
+    //bytes of all regions
+    size_t capacity() const { return frames_*region_bytes; }
+
+    //bytes per region
+    size_t frameBytes() const { return region_bytes; }
+
+    unsigned frames() const { return frames_; }
+
+    //bytes allocated in the current frame
+    size_t used() const { return head; }
+
+    //frames that had to wait for the GPU
+    size_t stalls() const { return stalls_; }
+
+    operator GLuint() const { return buffer; }
+    GLuint getBuffer() const { return buffer; }
+
+    ~StreamRingBuffer()
+    {
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, buffer);)
+        GLP_CHECKED_CALL(glUnmapBuffer(TARGET);)
+        GLP_CHECKED_CALL(glBindBuffer(TARGET, 0);)
+        GLP_CHECKED_CALL(glDeleteBuffers(1, &buffer);)
+    }
+
+private:
+    static size_t roundUp(size_t bytes, size_t step)
+    {
+        return (bytes+step-1)/step*step;
+    }
+
+    unsigned frames_;
+    StreamFlush flush_;
+    size_t region_bytes;
+    std::unique_ptr<SyncQuery[]> fences;
+    GLuint buffer;
+    char *host_ptr;
+    unsigned region;
+    size_t head, flushed;
+    bool in_frame;
+    size_t stalls_;
+};
+
+}
+#endif
@@ -454,7 +454,7 @@ public:
         : format(f)
     {
         GLP_CHECKED_CALL(glGenTextures(1, &tex);)
-        GLP_CHECKED_CALL(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex);)
+        GLP_CHECKED_CALL(glBindTexture(GL_TEXTURE_BUFFER, tex);)
     }
     
     BufferTexture(GLenum f, GLuint buffer)
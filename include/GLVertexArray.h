@@ -67,6 +67,16 @@ public:
         ibo_type = TypeToGLConstant<T>::value;
         ibo_size = ibo.size();
     }
+
+    void attach(PackedIndexBuffer &ibo)
+    {
+        this->bind();
+        ibo.bind();
+        this->unbind();
+        ibo.unbind();
+        ibo_type = ibo.type();
+        ibo_size = ibo.count();
+    }
     
     void setVertexCount(size_t n) { vbo_size = n; }
     
@@ -101,11 +111,24 @@ public:
         if(ibo_type == GL_FALSE)
             GLP_CHECKED_CALL(glDrawArrays(primitives, begin, end-begin);)
         else
-            GLP_CHECKED_CALL(glDrawRangeElements(primitives, 0, vbo_size, end-begin, ibo_type, static_cast<GLubyte*>(0)+begin);)
+            GLP_CHECKED_CALL(glDrawRangeElements(primitives, 0, vbo_size, end-begin, ibo_type, static_cast<GLubyte*>(0)+begin*IndexTypeSize(ibo_type));)
         
         this->unbind();
     }
 
+    //indices [begin, end) with base added to every index
+    void drawBaseVertex(GLenum primitives, GLuint begin, GLuint end, GLint base)
+    {
+        this->bind();
+
+        if(ibo_type == GL_FALSE)
+            GLP_CHECKED_CALL(glDrawArrays(primitives, base+begin, end-begin);)
+        else
+            GLP_CHECKED_CALL(glDrawElementsBaseVertex(primitives, end-begin, ibo_type, static_cast<GLubyte*>(0)+begin*IndexTypeSize(ibo_type), base);)
+
+        this->unbind();
+    }
+
     void unbind()
     {
         GLP_CHECKED_CALL(glBindVertexArray(0);)
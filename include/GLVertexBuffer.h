@@ -24,6 +24,7 @@
 #ifndef VBO_H
 #define VBO_H
 
+#include <algorithm>
 #include <vector>
 #include <boost/fusion/include/for_each.hpp>
 #include <boost/fusion/include/size.hpp>
@@ -59,6 +60,12 @@ public:
     {
         base_type::map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
     }
+
+    //without GL_MAP_INVALIDATE_BUFFER_BIT for partial updates
+    void map(GLbitfield access)
+    {
+        base_type::map(access);
+    }
     
     void bind();
     void unbind();
@@ -107,7 +114,9 @@ struct VertexAttribPred {
                     TypeToGLConstant<
                         typename vector_traits<T>::element_type
                     >::value, 
-                    GL_FALSE, 
+                    TypeIsNormalized<
+                        typename vector_traits<T>::element_type
+                    >::value ? GL_TRUE : GL_FALSE, 
                     size, 
                     (char*)(reinterpret_cast<char*>(&t)-base_ptr)
                 );)
@@ -117,6 +126,26 @@ struct VertexAttribPred {
     int size;
 };
 
+//points the attributes from base_attrib on at the fusion vertices V in
+//the buffer bound to GL_ARRAY_BUFFER and enables them
+template<class V>
+void SetVertexAttributes(GLuint base_attrib, GLuint divisor)
+{
+    {
+        V tmp;
+        int c = base_attrib;
+        VertexAttribPred p(tmp, c);
+        boost::fusion::for_each(tmp, p);
+    }
+
+    const unsigned size = boost::fusion::result_of::size<V>::type::value;
+    for(unsigned i=0;i<size;++i)
+    {
+        GLP_CHECKED_CALL(glEnableVertexAttribArray(base_attrib+i);)
+        GLP_CHECKED_CALL(glVertexAttribDivisor(base_attrib+i, divisor);)
+    }
+}
+
 template<class V>   
 VertexBuffer<V>::VertexBuffer(size_t s)
     : Buffer<V, GL_ARRAY_BUFFER>(s, GL_DYNAMIC_DRAW),
@@ -135,20 +164,7 @@ template<class V>
 void VertexBuffer<V>::bind()
 {
     base_type::bind();
-    
-    {
-        V tmp;
-        int c = base_attrib;
-        VertexAttribPred p(tmp, c);
-        boost::fusion::for_each(tmp, p);
-    }
-
-    const unsigned size = boost::fusion::result_of::size<V>::type::value;
-    for(unsigned i=0;i<size;++i)
-    {
-        GLP_CHECKED_CALL(glEnableVertexAttribArray(base_attrib+i);)
-        GLP_CHECKED_CALL(glVertexAttribDivisor(base_attrib+i, divisor);)
-    }   
+    SetVertexAttributes<V>(base_attrib, divisor);
 }
 
 template<class V>   
@@ -177,5 +193,59 @@ public:
     }
 };
 
+//smallest index type that can address vertices
+inline GLenum NarrowIndexType(size_t vertices)
+{
+    if(vertices <= 0x100)
+        return GL_UNSIGNED_BYTE;
+    if(vertices <= 0x10000)
+        return GL_UNSIGNED_SHORT;
+    return GL_UNSIGNED_INT;
+}
+
+inline size_t IndexTypeSize(GLenum type)
+{
+    switch(type)
+    {
+        case GL_UNSIGNED_BYTE: return sizeof(GLubyte);
+        case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+        default: return sizeof(GLuint);
+    }
+}
+
+//indices stored with the index type picked by NarrowIndexType, the
+//type is only known at runtime and taken over by VertexArray::attach
+class PackedIndexBuffer : public Buffer<GLubyte, GL_ELEMENT_ARRAY_BUFFER> {
+public:
+    typedef Buffer<GLubyte, GL_ELEMENT_ARRAY_BUFFER> base_type;
+
+    template<class I>
+    PackedIndexBuffer(const I *indices, size_t count, size_t vertices, GLenum usage = GL_STATIC_DRAW)
+        : base_type(count*IndexTypeSize(NarrowIndexType(vertices)), usage),
+          type_(NarrowIndexType(vertices)), count_(count)
+    {
+        //mapping an empty range is an error
+        if(count == 0)
+            return;
+        base_type::map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(type_ == GL_UNSIGNED_BYTE)
+            std::copy(indices, indices+count, host_ptr);
+        else if(type_ == GL_UNSIGNED_SHORT)
+            std::copy(indices, indices+count, reinterpret_cast<GLushort*>(host_ptr));
+        else
+            std::copy(indices, indices+count, reinterpret_cast<GLuint*>(host_ptr));
+        base_type::unmap();
+    }
+
+    GLenum type() const { return type_; }
+
+    //number of indices, size() is the size in bytes
+    size_t count() const { return count_; }
+
+private:
+    GLenum type_;
+    size_t count_;
+};
+
 }
 #endif
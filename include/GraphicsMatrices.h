@@ -28,7 +28,7 @@
 #include <cmath>
 
 template<class T>
-Matrix<T, 4, 4> FrustumMatrix(T left, T right, T bottom, T top, T near, T far)
+GLP_CONSTEXPR Matrix<T, 4, 4> FrustumMatrix(T left, T right, T bottom, T top, T near, T far)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = 2*near/(right-left);
@@ -42,7 +42,7 @@ Matrix<T, 4, 4> FrustumMatrix(T left, T right, T bottom, T top, T near, T far)
 }
 
 template<class T>
-Matrix<T, 4, 4> InverseFrustumMatrix(T left, T right, T bottom, T top, T near, T far)
+GLP_CONSTEXPR Matrix<T, 4, 4> InverseFrustumMatrix(T left, T right, T bottom, T top, T near, T far)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = (right-left)/(2*near);
@@ -56,7 +56,7 @@ Matrix<T, 4, 4> InverseFrustumMatrix(T left, T right, T bottom, T top, T near, T
 }
 
 template<class T>
-Matrix<T, 4, 4> InfiniteFrustumMatrix(T left, T right, T bottom, T top, T near)
+GLP_CONSTEXPR Matrix<T, 4, 4> InfiniteFrustumMatrix(T left, T right, T bottom, T top, T near)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = 2*near/(right-left);
@@ -70,7 +70,7 @@ Matrix<T, 4, 4> InfiniteFrustumMatrix(T left, T right, T bottom, T top, T near)
 }
 
 template<class T>
-Matrix<T, 4, 4> OrthoMatrix(T left, T right, T bottom, T top, T near, T far)
+GLP_CONSTEXPR Matrix<T, 4, 4> OrthoMatrix(T left, T right, T bottom, T top, T near, T far)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = 2/(right-left);
@@ -84,7 +84,7 @@ Matrix<T, 4, 4> OrthoMatrix(T left, T right, T bottom, T top, T near, T far)
 }
 
 template<class T>
-Matrix<T, 4, 4> ObliqueMatrix(T left, T right, T bottom, T top, T near, T far, Vector<T, 3> dir)
+GLP_CONSTEXPR Matrix<T, 4, 4> ObliqueMatrix(T left, T right, T bottom, T top, T near, T far, Vector<T, 3> dir)
 {
     dir.normalize();
     dir /= dir[1];
@@ -104,7 +104,7 @@ Matrix<T, 4, 4> ObliqueMatrix(T left, T right, T bottom, T top, T near, T far, V
 }
 
 template<class T>
-Matrix<T, 4, 4> RotationMatrix(T angle, Vector<T,3> dir)
+GLP_CONSTEXPR Matrix<T, 4, 4> RotationMatrix(T angle, Vector<T,3> dir)
 {
     dir.normalize();
     
@@ -131,13 +131,13 @@ Matrix<T, 4, 4> RotationMatrix(T angle, Vector<T,3> dir)
 }
 
 template<class T>
-Matrix<T, 4, 4> RotationMatrix(T angle, T x, T y, T z)
+GLP_CONSTEXPR Matrix<T, 4, 4> RotationMatrix(T angle, T x, T y, T z)
 {
     return RotationMatrix(angle, Vector<T, 3>(x,y,z));
 }
 
 template<class T>
-Matrix<T, 4, 4> TranslationMatrix(Vector<T,3> v)
+GLP_CONSTEXPR Matrix<T, 4, 4> TranslationMatrix(Vector<T,3> v)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = 1;
@@ -151,13 +151,13 @@ Matrix<T, 4, 4> TranslationMatrix(Vector<T,3> v)
 }
 
 template<class T>
-Matrix<T, 4, 4> TranslationMatrix(T x, T y, T z)
+GLP_CONSTEXPR Matrix<T, 4, 4> TranslationMatrix(T x, T y, T z)
 {
     return TranslationMatrix(Vector<T, 3>(x,y,z));
 }
 
 template<class T>
-Matrix<T, 4, 4> ScaleMatrix(Vector<T,3> v)
+GLP_CONSTEXPR Matrix<T, 4, 4> ScaleMatrix(Vector<T,3> v)
 {
     Matrix<T, 4, 4> res;    
     res(0,0) = v[0];
@@ -168,8 +168,93 @@ Matrix<T, 4, 4> ScaleMatrix(Vector<T,3> v)
 }
 
 template<class T>
-Matrix<T, 4, 4> ScaleMatrix(T x, T y, T z)
+GLP_CONSTEXPR Matrix<T, 4, 4> ScaleMatrix(T x, T y, T z)
 {
     return ScaleMatrix(Vector<T, 3>(x,y,z));
 }
+
+//maps normalized device coordinates to window coordinates like
+//glViewport and glDepthRange
+template<class T>
+GLP_CONSTEXPR Matrix<T, 4, 4> ViewportMatrix(T x, T y, T width, T height, T near = 0, T far = 1)
+{
+    Matrix<T, 4, 4> res;
+    res(0,0) = width/2;
+    res(1,1) = height/2;
+    res(2,2) = (far-near)/2;
+    res(0,3) = x+width/2;
+    res(1,3) = y+height/2;
+    res(2,3) = (far+near)/2;
+    res(3,3) = 1;
+    return res;
+}
+
+//inverse of a rotation followed by a translation (any product of
+//TranslationMatrix and RotationMatrix), the rotation is transposed
+template<class T, class A>
+GLP_CONSTEXPR Matrix<T, 4, 4> RigidInverse(const MatrixExpr<T, 4, 4, A> &a)
+{
+    const Matrix<T, 4, 4> m(a);
+    Matrix<T, 4, 4> res;
+    for(unsigned i = 0; i<3; ++i)
+    {
+        for(unsigned j = 0; j<3; ++j)
+            res(i,j) = m(j,i);
+        res(i,3) = -(m(0,i)*m(0,3) + m(1,i)*m(1,3) + m(2,i)*m(2,3));
+    }
+    res(3,3) = 1;
+    return res;
+}
+
+//inverse of matrices with a last row of (0, 0, 0, 1), like products
+//that also contain ScaleMatrix, only the upper 3x3 is inverted
+template<class T>
+struct AffineInverseLoop {
+    static GLP_CONSTEXPR void inverse(const Matrix<T, 4, 4> &m, Matrix<T, 4, 4> &res)
+    {
+        Matrix<T, 3, 3> a = SubMatrix<3,3>(m, 0, 0);
+        InverseKernel<T, 3>::inverse(a.raw(), a.raw());
+        for(unsigned i = 0; i<3; ++i)
+        {
+            for(unsigned j = 0; j<3; ++j)
+                res(i,j) = a(i,j);
+            res(i,3) = -(a(i,0)*m(0,3) + a(i,1)*m(1,3) + a(i,2)*m(2,3));
+        }
+        res(3,3) = 1;
+    }
+};
+
+template<class T>
+struct AffineInverseKernel : AffineInverseLoop<T> { };
+
+#ifdef GLP_SIMD_SSE
+template<>
+struct AffineInverseKernel<float> {
+    static GLP_CONSTEXPR void inverse(const Matrix<float, 4, 4> &m, Matrix<float, 4, 4> &res)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return AffineInverseLoop<float>::inverse(m, res);
+        simd::mat4_affine_inverse(m.raw(), res.raw());
+    }
+};
+#endif
+
+template<class T, class A>
+GLP_CONSTEXPR Matrix<T, 4, 4> AffineInverse(const MatrixExpr<T, 4, 4, A> &a)
+{
+    const Matrix<T, 4, 4> m(a);
+    Matrix<T, 4, 4> res;
+    AffineInverseKernel<T>::inverse(m, res);
+    return res;
+}
+
+//inverse transpose of the upper 3x3 for transforming normals
+template<class T, class A>
+GLP_CONSTEXPR Matrix<T, 3, 3> NormalMatrix(const MatrixExpr<T, 4, 4, A> &a)
+{
+    const Matrix<T, 4, 4> m(a);
+    Matrix<T, 3, 3> n = SubMatrix<3,3>(m, 0, 0);
+    InverseKernel<T, 3>::inverse(n.raw(), n.raw());
+    return Transpose(n);
+}
 #endif
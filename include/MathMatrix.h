@@ -32,87 +32,197 @@
 #include "MathVector.h"
 
 template<class T, unsigned D1, unsigned D2> class Matrix;
+template<class T, unsigned D1, unsigned D2> class InPlaceMatrix;
+template<class T, unsigned D1, unsigned D2> class TemporaryMatrix;
+
+//matrices backed by contiguous memory that can be handed to the simd kernels
+template<class A>
+struct is_dense_matrix { static const bool value = false; };
+
+template<class T, unsigned D1, unsigned D2>
+struct is_dense_matrix< Matrix<T,D1,D2> > { static const bool value = true; };
+
+template<class T, unsigned D1, unsigned D2>
+struct is_dense_matrix< InPlaceMatrix<T,D1,D2> > { static const bool value = true; };
+
+template<class T, unsigned D1, unsigned D2>
+struct is_dense_matrix< TemporaryMatrix<T,D1,D2> > { static const bool value = true; };
+
+template<class T, unsigned D1, unsigned D2>
+struct expression_storage< Matrix<T,D1,D2> > { typedef const Matrix<T,D1,D2>& type; };
+
+//see vector_operand
+template<class A>
+struct matrix_operand {
+    typedef Matrix<typename A::Type, A::Dim1, A::Dim2> value_type;
+    typedef const value_type type;
+};
+
+template<class T, unsigned D1, unsigned D2>
+struct matrix_operand< Matrix<T,D1,D2> > {
+    typedef Matrix<T,D1,D2> value_type;
+    typedef const value_type& type;
+};
+
+template<class T, unsigned D1, unsigned D2>
+struct matrix_operand< InPlaceMatrix<T,D1,D2> > {
+    typedef InPlaceMatrix<T,D1,D2> value_type;
+    typedef const value_type type;
+};
 
 //base class for all expression templates
+//see VectorExpr for aliases and overlaps
 template<class T, unsigned D1, unsigned D2, class A>
 class MatrixExpr {
 public:
-    inline operator const A&() const
+    static const unsigned Dim1 = D1;
+    static const unsigned Dim2 = D2;
+    typedef T Type;
+
+    GLP_CONSTEXPR operator const A&() const
     {
         return *static_cast<const A*>(this);
     }
+
+    GLP_CONSTEXPR bool aliases(const void*, const void*) const { return true; }
+    GLP_CONSTEXPR bool overlaps(const void*, const void*) const { return true; }
 };
 
 //better use macros instead of copy pasting this stuff all over the place
-#define MAKE_MAT_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                   \
-template<class T, unsigned D1, unsigned D2, class A, class B>           \
-class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A, B> > {     \
-public:                                                                 \
-    NAME(const A& pa, const B& pb) : a(pa), b(pb)   { }                 \
-    inline T operator()(unsigned i, unsigned j) const { return EXPR; }  \
-private:                                                                \
-    const A& a;                                                         \
-    const B& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D1, unsigned D2, class A, class B>           \
-inline NAME<T,D1,D2,A,B>                                                \
-FUNCTION(const MatrixExpr<T,D1,D2,A> &a, const MatrixExpr<T,D1,D2,B> &b)\
-{                                                                       \
-    return NAME<T,D1,D2,A,B>(a, b);                                     \
-}
-
-#define MAKE_MAT_SCAL_EXPRESSION(NAME, EXPR, FUNCTION)                  \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {        \
-public:                                                                 \
-    NAME(const A& pa, const T& pb) : a(pa), b(pb)   { }                 \
-    inline T operator()(unsigned i, unsigned j) const { return EXPR; }  \
-private:                                                                \
-    const A& a;                                                         \
-    const T& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-inline NAME<T,D1,D2,A>                                                  \
-FUNCTION(const  MatrixExpr<T,D1,D2,A> &a, const T &b)                   \
-{                                                                       \
-    return NAME<T,D1,D2,A>(a, b);                                       \
-}
-
-#define MAKE_SCAL_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                  \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {        \
-public:                                                                 \
-    NAME(const T& pa, const A& pb) : a(pa), b(pb)   { }                 \
-    inline T operator()(unsigned i, unsigned j) const { return EXPR; }  \
-private:                                                                \
-    const T& a;                                                         \
-    const A& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-inline NAME<T,D1,D2,A>                                                  \
-FUNCTION(const T &a, const MatrixExpr<T,D1,D2,A> &b)                    \
-{                                                                       \
-    return NAME<T,D1,D2,A>(a, b);                                       \
-}
-
-#define MAKE_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                       \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {        \
-public:                                                                 \
-    NAME(const A& pa) : a(pa)   { }                                     \
-    inline T operator()(unsigned i, unsigned j) const { return EXPR; }  \
-private:                                                                \
-    const A& a;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D1, unsigned D2, class A>                    \
-inline NAME<T,D1,D2,A>                                                  \
-FUNCTION(const MatrixExpr<T,D1,D2,A> &a)                                \
-{                                                                       \
-    return NAME<T,D1,D2,A>(a);                                          \
+#define MAKE_MAT_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                         \
+template<class T, unsigned D1, unsigned D2, class A, class B>                 \
+class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A, B> > {           \
+public:                                                                       \
+    GLP_CONSTEXPR NAME(const A& pa, const B& pb) : a(pa), b(pb)   { }         \
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const { return EXPR; } \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const      \
+    { return a.aliases(begin, end) || b.aliases(begin, end); }                \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const     \
+    { return a.overlaps(begin, end) || b.overlaps(begin, end); }              \
+private:                                                                      \
+    typename expression_storage<A>::type a;                                   \
+    typename expression_storage<B>::type b;                                   \
+};                                                                            \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class A, class B>                 \
+inline GLP_CONSTEXPR NAME<T,D1,D2,A,B>                                        \
+FUNCTION(const MatrixExpr<T,D1,D2,A> &a, const MatrixExpr<T,D1,D2,B> &b)      \
+{                                                                             \
+    return NAME<T,D1,D2,A,B>(a, b);                                           \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class B>                          \
+inline GLP_CONSTEXPR NAME<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>                 \
+FUNCTION(Matrix<T,D1,D2> &&a, const MatrixExpr<T,D1,D2,B> &b)                 \
+{                                                                             \
+    return NAME<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>(                          \
+        TemporaryMatrix<T,D1,D2>(a), b);                                      \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+inline GLP_CONSTEXPR NAME<T,D1,D2,A,TemporaryMatrix<T,D1,D2> >                \
+FUNCTION(const MatrixExpr<T,D1,D2,A> &a, Matrix<T,D1,D2> &&b)                 \
+{                                                                             \
+    return NAME<T,D1,D2,A,TemporaryMatrix<T,D1,D2> >(                         \
+        a, TemporaryMatrix<T,D1,D2>(b));                                      \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2>                                   \
+inline GLP_CONSTEXPR                                                          \
+NAME<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryMatrix<T,D1,D2> >              \
+FUNCTION(Matrix<T,D1,D2> &&a, Matrix<T,D1,D2> &&b)                            \
+{                                                                             \
+    return NAME<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryMatrix<T,D1,D2> >(  \
+        TemporaryMatrix<T,D1,D2>(a), TemporaryMatrix<T,D1,D2>(b));            \
+}
+
+#define MAKE_MAT_SCAL_EXPRESSION(NAME, EXPR, FUNCTION)                        \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {              \
+public:                                                                       \
+    GLP_CONSTEXPR NAME(const A& pa, const T& pb) : a(pa), b(pb)   { }         \
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const { return EXPR; } \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const      \
+    { return a.aliases(begin, end); }                                         \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const     \
+    { return a.overlaps(begin, end); }                                        \
+private:                                                                      \
+    typename expression_storage<A>::type a;                                   \
+    const T b;                                                                \
+};                                                                            \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+inline GLP_CONSTEXPR NAME<T,D1,D2,A>                                          \
+FUNCTION(const  MatrixExpr<T,D1,D2,A> &a, const T &b)                         \
+{                                                                             \
+    return NAME<T,D1,D2,A>(a, b);                                             \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2>                                   \
+inline GLP_CONSTEXPR NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >                  \
+FUNCTION(Matrix<T,D1,D2> &&a, const T &b)                                     \
+{                                                                             \
+    return NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >(                           \
+        TemporaryMatrix<T,D1,D2>(a), b);                                      \
+}
+
+#define MAKE_SCAL_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                        \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {              \
+public:                                                                       \
+    GLP_CONSTEXPR NAME(const T& pa, const A& pb) : a(pa), b(pb)   { }         \
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const { return EXPR; } \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const      \
+    { return b.aliases(begin, end); }                                         \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const     \
+    { return b.overlaps(begin, end); }                                        \
+private:                                                                      \
+    const T a;                                                                \
+    typename expression_storage<A>::type b;                                   \
+};                                                                            \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+inline GLP_CONSTEXPR NAME<T,D1,D2,A>                                          \
+FUNCTION(const T &a, const MatrixExpr<T,D1,D2,A> &b)                          \
+{                                                                             \
+    return NAME<T,D1,D2,A>(a, b);                                             \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2>                                   \
+inline GLP_CONSTEXPR NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >                  \
+FUNCTION(const T &a, Matrix<T,D1,D2> &&b)                                     \
+{                                                                             \
+    return NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >(                           \
+        a, TemporaryMatrix<T,D1,D2>(b));                                      \
+}
+
+#define MAKE_MAT_EXPRESSION(NAME, EXPR, FUNCTION)                             \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+class NAME : public MatrixExpr<T, D1, D2, NAME<T, D1, D2, A> > {              \
+public:                                                                       \
+    GLP_CONSTEXPR NAME(const A& pa) : a(pa)   { }                             \
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const { return EXPR; } \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const      \
+    { return a.aliases(begin, end); }                                         \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const     \
+    { return a.overlaps(begin, end); }                                        \
+private:                                                                      \
+    typename expression_storage<A>::type a;                                   \
+};                                                                            \
+                                                                              \
+template<class T, unsigned D1, unsigned D2, class A>                          \
+inline GLP_CONSTEXPR NAME<T,D1,D2,A>                                          \
+FUNCTION(const MatrixExpr<T,D1,D2,A> &a)                                      \
+{                                                                             \
+    return NAME<T,D1,D2,A>(a);                                                \
+}                                                                             \
+                                                                              \
+template<class T, unsigned D1, unsigned D2>                                   \
+inline GLP_CONSTEXPR NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >                  \
+FUNCTION(Matrix<T,D1,D2> &&a)                                                 \
+{                                                                             \
+    return NAME<T,D1,D2,TemporaryMatrix<T,D1,D2> >(                           \
+        TemporaryMatrix<T,D1,D2>(a));                                         \
 }
 
 //create actual functions and operators
@@ -129,145 +239,447 @@ MAKE_MAT_EXPRESSION     (MATNegExpr, -a(i,j), operator-)
 template<class T, unsigned D1, unsigned D2, class A>
 class TransExpr : public MatrixExpr<T, D1, D2, TransExpr<T, D1, D2, A> > {
 public:
-    TransExpr(const A& pa) : a(pa)  { }
-    inline T operator()(unsigned i, unsigned j) const {
+    GLP_CONSTEXPR TransExpr(const A& pa) : a(pa)  { }
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const {
         return a(j,i);
     }
+    GLP_CONSTEXPR const A& operand() const { return a; }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
 private:
-    const A& a;
+    typename expression_storage<A>::type a;
 };
 
 template<class T, unsigned D1, unsigned D2, class A>
-inline TransExpr<T,D2,D1,A>
+inline GLP_CONSTEXPR TransExpr<T,D2,D1,A>
 Transpose(const MatrixExpr<T,D1,D2,A> &a)
 {
     return TransExpr<T,D2,D1,A>(a);
 }
 
+template<class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR TransExpr<T,D2,D1,TemporaryMatrix<T,D1,D2> >
+Transpose(Matrix<T,D1,D2> &&a)
+{
+    return TransExpr<T,D2,D1,TemporaryMatrix<T,D1,D2> >(TemporaryMatrix<T,D1,D2>(a));
+}
+
 //Row, Column vector and submatrix proxies
 template<class T, unsigned D1, unsigned D2, class A>
 class RowVectorExpr : public VectorExpr<T, D2, RowVectorExpr<T, D1, D2, A> > {
 public:
-    RowVectorExpr(const A& pa, const unsigned& i) : a(pa), index(i) { }
-    inline T operator[](unsigned i) const {
+    GLP_CONSTEXPR RowVectorExpr(const A& pa, const unsigned& i) : a(pa), index(i) { }
+    GLP_CONSTEXPR T operator[](unsigned i) const {
         return a(index, i);
     }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
 private:
-    const A& a;
+    typename expression_storage<A>::type a;
     const unsigned index;
 };
 
 template<class T, unsigned D1, unsigned D2, class A>
-inline RowVectorExpr<T,D1,D2,A>
+inline GLP_CONSTEXPR RowVectorExpr<T,D1,D2,A>
 Row(const MatrixExpr<T,D1,D2,A> &a, const unsigned &index)
 {
     return RowVectorExpr<T,D1,D2,A>(a, index);
 }
 
+template<class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR RowVectorExpr<T,D1,D2,TemporaryMatrix<T,D1,D2> >
+Row(Matrix<T,D1,D2> &&a, const unsigned &index)
+{
+    return RowVectorExpr<T,D1,D2,TemporaryMatrix<T,D1,D2> >(TemporaryMatrix<T,D1,D2>(a), index);
+}
+
 template<class T, unsigned D1, unsigned D2, class A>
 class ColumnVectorExpr : public VectorExpr<T, D1, ColumnVectorExpr<T, D1, D2, A> > {
 public:
-    ColumnVectorExpr(const A& pa, const unsigned& i) : a(pa), index(i)  { }
-    inline T operator[](unsigned i) const {
+    GLP_CONSTEXPR ColumnVectorExpr(const A& pa, const unsigned& i) : a(pa), index(i)  { }
+    GLP_CONSTEXPR T operator[](unsigned i) const {
         return a(i, index);
     }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end);
+    }
 private:
-    const A& a;
+    typename expression_storage<A>::type a;
     const unsigned index;
 };
 
 template<class T, unsigned D1, unsigned D2, class A>
-inline ColumnVectorExpr<T,D1,D2,A>
+inline GLP_CONSTEXPR ColumnVectorExpr<T,D1,D2,A>
 Column(const MatrixExpr<T,D1,D2,A> &a, const unsigned &index)
 {
     return ColumnVectorExpr<T,D1,D2,A>(a, index);
 }
 
+template<class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR ColumnVectorExpr<T,D1,D2,TemporaryMatrix<T,D1,D2> >
+Column(Matrix<T,D1,D2> &&a, const unsigned &index)
+{
+    return ColumnVectorExpr<T,D1,D2,TemporaryMatrix<T,D1,D2> >(TemporaryMatrix<T,D1,D2>(a), index);
+}
+
 template<class T, unsigned D1, unsigned D2, class A>
 class SubMatrixExpr : public MatrixExpr<T, D1, D2, SubMatrixExpr<T, D1, D2, A> > {
 public:
-    SubMatrixExpr(const A& pa, const unsigned& i, const unsigned& j)
+    GLP_CONSTEXPR SubMatrixExpr(const A& pa, const unsigned& i, const unsigned& j)
         : a(pa), offseti(i), offsetj(j) { }
-    inline T operator()(unsigned i, unsigned j) const
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const
     {
         return a(i+offseti, j+offsetj);
     }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return a.overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return a.overlaps(begin, end);
+    }
 private:
-    const A& a;
+    typename expression_storage<A>::type a;
     const unsigned offseti, offsetj;
 };
 
 template<unsigned D3, unsigned D4, class T, unsigned D1, unsigned D2, class A>
-inline SubMatrixExpr<T,D3,D4,A>
+inline GLP_CONSTEXPR SubMatrixExpr<T,D3,D4,A>
 SubMatrix(const MatrixExpr<T,D1,D2,A> &a, const unsigned &i, const unsigned &j)
 {
     return SubMatrixExpr<T,D3,D4,A>(a, i, j);
 }
 
+template<unsigned D3, unsigned D4, class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR SubMatrixExpr<T,D3,D4,TemporaryMatrix<T,D1,D2> >
+SubMatrix(Matrix<T,D1,D2> &&a, const unsigned &i, const unsigned &j)
+{
+    return SubMatrixExpr<T,D3,D4,TemporaryMatrix<T,D1,D2> >(TemporaryMatrix<T,D1,D2>(a), i, j);
+}
+
 //matrix-vector and vector-matrix multiplications
+//the operands of all products are evaluated into temporaries when the
+//node is created unless they already are in memory (see matrix_operand),
+//so chained products cost one product each instead of multiplying up
 template<class T, unsigned D1, unsigned D2, class A, class B>
 class MatVecMulExpr : public VectorExpr<T, D1, MatVecMulExpr<T, D1, D2, A, B> > {
 public:
-    MatVecMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
-    inline T operator[](unsigned i) const {
+    typedef typename matrix_operand<A>::value_type left_type;
+    typedef typename vector_operand<B>::value_type right_type;
+
+    GLP_CONSTEXPR MatVecMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
+    GLP_CONSTEXPR T operator[](unsigned i) const {
         return dot(Row(a, i), b);
     }
+    GLP_CONSTEXPR const left_type& left() const { return a; }
+    GLP_CONSTEXPR const right_type& right() const { return b; }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end) || b.overlaps(begin, end);
+    }
 private:
-    const A& a;
-    const B& b;
+    typename matrix_operand<A>::type a;
+    typename vector_operand<B>::type b;
 };
 
 template<class T, unsigned D1, unsigned D2, class A, class B>
-inline MatVecMulExpr<T,D1,D2,A,B>
+inline GLP_CONSTEXPR MatVecMulExpr<T,D1,D2,A,B>
 operator*(const MatrixExpr<T,D1,D2,A> &a, const VectorExpr<T,D2,B> &b)
 {
     return MatVecMulExpr<T,D1,D2,A,B>(a, b);
 }
 
+template<class T, unsigned D1, unsigned D2, class B>
+inline GLP_CONSTEXPR MatVecMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>
+operator*(Matrix<T,D1,D2> &&a, const VectorExpr<T,D2,B> &b)
+{
+    return MatVecMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>(TemporaryMatrix<T,D1,D2>(a), b);
+}
+
+template<class T, unsigned D1, unsigned D2, class A>
+inline GLP_CONSTEXPR MatVecMulExpr<T,D1,D2,A,TemporaryVector<T,D2> >
+operator*(const MatrixExpr<T,D1,D2,A> &a, Vector<T,D2> &&b)
+{
+    return MatVecMulExpr<T,D1,D2,A,TemporaryVector<T,D2> >(a, TemporaryVector<T,D2>(b));
+}
+
+template<class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR MatVecMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryVector<T,D2> >
+operator*(Matrix<T,D1,D2> &&a, Vector<T,D2> &&b)
+{
+    return MatVecMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryVector<T,D2> >(
+        TemporaryMatrix<T,D1,D2>(a), TemporaryVector<T,D2>(b));
+}
+
 template<class T, unsigned D1, unsigned D2, class A, class B>
 class VecMatMulExpr : public VectorExpr<T, D2, VecMatMulExpr<T, D1, D2, A, B> > {
 public:
-    VecMatMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
-    inline T operator[](unsigned i) const {
+    typedef typename matrix_operand<A>::value_type left_type;
+    typedef typename vector_operand<B>::value_type right_type;
+
+    GLP_CONSTEXPR VecMatMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
+    GLP_CONSTEXPR T operator[](unsigned i) const {
         return dot(Column(a, i), b);
     }
+    GLP_CONSTEXPR const left_type& left() const { return a; }
+    GLP_CONSTEXPR const right_type& right() const { return b; }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end) || b.overlaps(begin, end);
+    }
 private:
-    const A& a;
-    const B& b;
+    typename matrix_operand<A>::type a;
+    typename vector_operand<B>::type b;
 };
 
 template<class T, unsigned D1, unsigned D2, class A, class B>
-inline VecMatMulExpr<T,D1,D2,A,B>
+inline GLP_CONSTEXPR VecMatMulExpr<T,D1,D2,A,B>
 operator*(const VectorExpr<T,D1,B> &b, const MatrixExpr<T,D1,D2,A> &a)
 {
     return VecMatMulExpr<T,D1,D2,A,B>(a, b);
 }
 
+template<class T, unsigned D1, unsigned D2, class B>
+inline GLP_CONSTEXPR VecMatMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>
+operator*(const VectorExpr<T,D1,B> &b, Matrix<T,D1,D2> &&a)
+{
+    return VecMatMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,B>(TemporaryMatrix<T,D1,D2>(a), b);
+}
+
+template<class T, unsigned D1, unsigned D2, class A>
+inline GLP_CONSTEXPR VecMatMulExpr<T,D1,D2,A,TemporaryVector<T,D1> >
+operator*(Vector<T,D1> &&b, const MatrixExpr<T,D1,D2,A> &a)
+{
+    return VecMatMulExpr<T,D1,D2,A,TemporaryVector<T,D1> >(a, TemporaryVector<T,D1>(b));
+}
+
+template<class T, unsigned D1, unsigned D2>
+inline GLP_CONSTEXPR VecMatMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryVector<T,D1> >
+operator*(Vector<T,D1> &&b, Matrix<T,D1,D2> &&a)
+{
+    return VecMatMulExpr<T,D1,D2,TemporaryMatrix<T,D1,D2>,TemporaryVector<T,D1> >(
+        TemporaryMatrix<T,D1,D2>(a), TemporaryVector<T,D1>(b));
+}
+
 template<class T, unsigned D1, unsigned D2, class A, class B>
 class MatMatMulExpr : public MatrixExpr<T, D1, D2, MatMatMulExpr<T, D1, D2, A, B> > {
 public:
-    MatMatMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
-    inline T operator()(unsigned i, unsigned j) const {
+    typedef typename matrix_operand<A>::value_type left_type;
+    typedef typename matrix_operand<B>::value_type right_type;
+
+    GLP_CONSTEXPR MatMatMulExpr(const A& pa, const B& pb) : a(pa), b(pb)  { }
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const {
         return dot(Row(a,i),Column(b,j));
     }
+    GLP_CONSTEXPR const left_type& left() const { return a; }
+    GLP_CONSTEXPR const right_type& right() const { return b; }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const {
+        return overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const {
+        return a.overlaps(begin, end) || b.overlaps(begin, end);
+    }
 private:
-    const A& a;
-    const B& b;
+    typename matrix_operand<A>::type a;
+    typename matrix_operand<B>::type b;
 };
 
 template<class T, unsigned D1, unsigned D2, unsigned D3, class A, class B>
-MatMatMulExpr<T,D1,D3,A,B >
+GLP_CONSTEXPR MatMatMulExpr<T,D1,D3,A,B >
 operator*(const MatrixExpr<T,D1,D2,A> &a, const MatrixExpr<T,D2,D3,B> &b)
 {
     return MatMatMulExpr<T,D1,D3,A,B>(a, b);
 }
 
+template<class T, unsigned D1, unsigned D2, unsigned D3, class B>
+GLP_CONSTEXPR MatMatMulExpr<T,D1,D3,TemporaryMatrix<T,D1,D2>,B>
+operator*(Matrix<T,D1,D2> &&a, const MatrixExpr<T,D2,D3,B> &b)
+{
+    return MatMatMulExpr<T,D1,D3,TemporaryMatrix<T,D1,D2>,B>(TemporaryMatrix<T,D1,D2>(a), b);
+}
+
+template<class T, unsigned D1, unsigned D2, unsigned D3, class A>
+GLP_CONSTEXPR MatMatMulExpr<T,D1,D3,A,TemporaryMatrix<T,D2,D3> >
+operator*(const MatrixExpr<T,D1,D2,A> &a, Matrix<T,D2,D3> &&b)
+{
+    return MatMatMulExpr<T,D1,D3,A,TemporaryMatrix<T,D2,D3> >(a, TemporaryMatrix<T,D2,D3>(b));
+}
+
+template<class T, unsigned D1, unsigned D2, unsigned D3>
+GLP_CONSTEXPR MatMatMulExpr<T,D1,D3,TemporaryMatrix<T,D1,D2>,TemporaryMatrix<T,D2,D3> >
+operator*(Matrix<T,D1,D2> &&a, Matrix<T,D2,D3> &&b)
+{
+    return MatMatMulExpr<T,D1,D3,TemporaryMatrix<T,D1,D2>,TemporaryMatrix<T,D2,D3> >(
+        TemporaryMatrix<T,D1,D2>(a), TemporaryMatrix<T,D2,D3>(b));
+}
+
 template<class T, unsigned D1, unsigned D2>
 class Identity : public MatrixExpr<T, D1, D2, Identity<T, D1, D2> > {
 public:
-    inline T operator()(unsigned i, unsigned j) const {
+    GLP_CONSTEXPR T operator()(unsigned i, unsigned j) const {
         return i==j?1:0;
     }
+    GLP_CONSTEXPR bool aliases(const void*, const void*) const { return false; }
+    GLP_CONSTEXPR bool overlaps(const void*, const void*) const { return false; }
+};
+
+//element wise evaluation of an expression into column major memory
+template<class T, unsigned D1, unsigned D2, class A>
+struct MatrixAssignLoop {
+    static GLP_CONSTEXPR void run(T *dst, const A& a)
+    {
+        for(unsigned j = 0; j<D2; ++j)
+            for(unsigned i = 0; i<D1; ++i)
+                dst[i+j*D1] = a(i,j);
+    }
+};
+
+//expressions that have a faster way to evaluate specialize this,
+//alias_safe marks kernels that read all of their input before writing
+template<class T, unsigned D1, unsigned D2, class A>
+struct MatrixAssign : MatrixAssignLoop<T, D1, D2, A> {
+    static const bool alias_safe = false;
+};
+
+//products are evaluated a column at a time as a sum of scaled columns
+//of the left operand, this keeps the inner loop contiguous and
+//accumulates in the same order as dot()
+template<class T, unsigned D1, unsigned D2, class A, class B>
+struct MatMatMulAssignLoop {
+    static GLP_CONSTEXPR void run(T *dst, const MatMatMulExpr<T, D1, D2, A, B>& e)
+    {
+        typedef typename MatMatMulExpr<T, D1, D2, A, B>::left_type left_type;
+        const unsigned DK = left_type::Dim2;
+        for(unsigned j = 0; j<D2; ++j)
+        {
+            T *col = dst+j*D1;
+            for(unsigned i = 0; i<D1; ++i)
+                col[i] = 0;
+            for(unsigned k = 0; k<DK; ++k)
+            {
+                const T b = e.right()(k,j);
+                for(unsigned i = 0; i<D1; ++i)
+                    col[i] += e.left()(i,k)*b;
+            }
+        }
+    }
+};
+
+template<class T, unsigned D1, unsigned D2, class A, class B>
+struct MatrixAssign<T, D1, D2, MatMatMulExpr<T, D1, D2, A, B> >
+    : MatMatMulAssignLoop<T, D1, D2, A, B> {
+    static const bool alias_safe = false;
+};
+
+template<class T, unsigned D1, unsigned D2, class A, class B>
+struct MatVecMulAssignLoop {
+    static GLP_CONSTEXPR void run(T *dst, const MatVecMulExpr<T, D1, D2, A, B>& e)
+    {
+        for(unsigned i = 0; i<D1; ++i)
+            dst[i] = 0;
+        for(unsigned k = 0; k<D2; ++k)
+        {
+            const T b = e.right()[k];
+            for(unsigned i = 0; i<D1; ++i)
+                dst[i] += e.left()(i,k)*b;
+        }
+    }
+};
+
+template<class T, unsigned D1, unsigned D2, class A, class B>
+struct VectorAssign<T, D1, MatVecMulExpr<T, D1, D2, A, B> >
+    : MatVecMulAssignLoop<T, D1, D2, A, B> {
+    static const bool alias_safe = false;
+};
+
+//products and transposes of dense 4x4 float matrices go through the
+//simd kernels. At compile time the loops above run into a temporary
+//instead so the kernels stay alias safe.
+template<class A, class B,
+         bool SQUARE = MatMatMulExpr<float, 4, 4, A, B>::left_type::Dim2 == 4>
+struct Mat4MulAssign : MatMatMulAssignLoop<float, 4, 4, A, B> {
+    static const bool alias_safe = false;
+};
+
+template<class A, class B>
+struct Mat4MulAssign<A, B, true> {
+    static const bool alias_safe = true;
+
+    static GLP_CONSTEXPR void run(float *dst, const MatMatMulExpr<float, 4, 4, A, B>& e)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+        {
+            float tmp[16] = {};
+            MatMatMulAssignLoop<float, 4, 4, A, B>::run(tmp, e);
+            for(unsigned i = 0; i<16; ++i)
+                dst[i] = tmp[i];
+            return;
+        }
+        simd::mat4_mul(e.left().raw(), e.right().raw(), dst);
+    }
+};
+
+template<class A, class B>
+struct MatrixAssign<float, 4, 4, MatMatMulExpr<float, 4, 4, A, B> > : Mat4MulAssign<A, B> { };
+
+template<class A, bool DENSE = is_dense_matrix<A>::value>
+struct Mat4TransAssign : MatrixAssignLoop<float, 4, 4, TransExpr<float, 4, 4, A> > {
+    static const bool alias_safe = false;
+};
+
+template<class A>
+struct Mat4TransAssign<A, true> {
+    static const bool alias_safe = true;
+
+    static GLP_CONSTEXPR void run(float *dst, const TransExpr<float, 4, 4, A>& e)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+        {
+            float tmp[16] = {};
+            MatrixAssignLoop<float, 4, 4, TransExpr<float, 4, 4, A> >::run(tmp, e);
+            for(unsigned i = 0; i<16; ++i)
+                dst[i] = tmp[i];
+            return;
+        }
+        simd::mat4_transpose(e.operand().raw(), dst);
+    }
+};
+
+template<class A>
+struct MatrixAssign<float, 4, 4, TransExpr<float, 4, 4, A> > : Mat4TransAssign<A> { };
+
+template<class A, class B>
+struct VectorAssign<float, 4, MatVecMulExpr<float, 4, 4, A, B> > {
+    static const bool alias_safe = true;
+
+    static GLP_CONSTEXPR void run(float *dst, const MatVecMulExpr<float, 4, 4, A, B>& e)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+        {
+            float tmp[4] = {};
+            MatVecMulAssignLoop<float, 4, 4, A, B>::run(tmp, e);
+            for(unsigned i = 0; i<4; ++i)
+                dst[i] = tmp[i];
+            return;
+        }
+        simd::mat4_vec4_mul(e.left().raw(), e.right().raw(), dst);
+    }
 };
 
 //actual Matrix class
@@ -278,39 +690,50 @@ public:
     static const unsigned Dim2 = D2;
     typedef T Type;
 
-    Matrix()
-    {
-        std::fill(data, data+Dim1*Dim2, T());
-    }
+    GLP_CONSTEXPR Matrix() : data()
+    { }
+
+    explicit Matrix(Uninitialized)
+    { }
 
     template<class A>
-    Matrix(const MatrixExpr<T, D1, D2, A>& a)
+    GLP_CONSTEXPR Matrix(const MatrixExpr<T, D1, D2, A>& a) : data()
     {
         const A& ao ( a );
-        for(unsigned j = 0; j<Dim2; ++j)
-            for(unsigned i = 0; i<Dim1; ++i)
-                operator()(i,j) = ao(i,j);
+        MatrixAssign<T,D1,D2,A>::run(data, ao);
     }
 
-    T* raw() {
+    GLP_CONSTEXPR T* raw() {
+        return data;
+    }
+    GLP_CONSTEXPR const T* raw() const {
         return data;
     }
 
-    T& operator() (unsigned i, unsigned j) {
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return data != begin && overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return memory_overlaps(data, data+Dim1*Dim2, begin, end);
+    }
+
+    GLP_CONSTEXPR T& operator() (unsigned i, unsigned j) {
         return data[i+j*Dim1];
     }
-    const T& operator() (unsigned i, unsigned j) const {
+    GLP_CONSTEXPR const T& operator() (unsigned i, unsigned j) const {
         return data[i+j*Dim1];
     }
 
-    const Matrix& operator*=(const T &b)
+    GLP_CONSTEXPR const Matrix& operator*=(const T &b)
     {
         for(unsigned i = 0; i<Dim1*Dim2; ++i)
             data[i] *= b;
         return *this;
     }
 
-    const Matrix& operator/=(const T &b)
+    GLP_CONSTEXPR const Matrix& operator/=(const T &b)
     {
         for(unsigned i = 0; i<Dim1*Dim2; ++i)
             data[i] /= b;
@@ -318,9 +741,11 @@ public:
     }
 
     template<class A>
-    const Matrix& operator+=(const MatrixExpr<T, D1, D2, A>& a)
+    GLP_CONSTEXPR const Matrix& operator+=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim1*Dim2))
+            return *this += Matrix(ao);
         for(unsigned j = 0; j<Dim2; ++j)
             for(unsigned i = 0; i<Dim1; ++i)
                 operator()(i,j) += ao(i,j);
@@ -328,9 +753,11 @@ public:
     }
 
     template<class A>
-    const Matrix& operator-=(const MatrixExpr<T, D1, D2, A>& a)
+    GLP_CONSTEXPR const Matrix& operator-=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim1*Dim2))
+            return *this -= Matrix(ao);
         for(unsigned j = 0; j<Dim2; ++j)
             for(unsigned i = 0; i<Dim1; ++i)
                 operator()(i,j) -= ao(i,j);
@@ -338,19 +765,19 @@ public:
     }
 
     template<class A>
-    const Matrix& operator*=(const MatrixExpr<T, D1, D2, A>& a)
+    GLP_CONSTEXPR const Matrix& operator*=(const MatrixExpr<T, D1, D2, A>& a)
     {
-        *this = eval(*this * a);
+        *this = *this * a;
         return *this;
     }
 
     template<class A>
-    Matrix& operator=(const MatrixExpr<T, D1, D2, A>& a)
+    GLP_CONSTEXPR Matrix& operator=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
-        for(unsigned j = 0; j<Dim2; ++j)
-            for(unsigned i = 0; i<Dim1; ++i)
-                operator()(i,j) = ao(i,j);
+        if(!MatrixAssign<T,D1,D2,A>::alias_safe && ao.aliases(data, data+Dim1*Dim2))
+            return *this = Matrix(ao);
+        MatrixAssign<T,D1,D2,A>::run(data, ao);
         return *this;
     }
 
@@ -368,18 +795,32 @@ public:
     InPlaceMatrix(T *const d) : data(d)
     { }
 
+    //views the same memory, expressions hold their operands by copy
+    InPlaceMatrix(const InPlaceMatrix& a) : data(a.data)
+    { }
+
     template<class A>
     InPlaceMatrix(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
-        for(unsigned j = 0; j<Dim2; ++j)
-            for(unsigned i = 0; i<Dim1; ++i)
-                operator()(i,j) = ao(i,j);
+        MatrixAssign<T,D1,D2,A>::run(data, ao);
     }
 
     T* raw() {
         return data;
     }
+    const T* raw() const {
+        return data;
+    }
+
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return data != begin && overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return memory_overlaps(data, data+Dim1*Dim2, begin, end);
+    }
 
     T& operator() (unsigned i, unsigned j) {
         return data[i+j*Dim1];
@@ -406,6 +847,8 @@ public:
     const InPlaceMatrix& operator+=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim1*Dim2))
+            return *this += Matrix<T,D1,D2>(ao);
         for(unsigned j = 0; j<Dim2; ++j)
             for(unsigned i = 0; i<Dim1; ++i)
                 operator()(i,j) += ao(i,j);
@@ -416,6 +859,8 @@ public:
     const InPlaceMatrix& operator-=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim1*Dim2))
+            return *this -= Matrix<T,D1,D2>(ao);
         for(unsigned j = 0; j<Dim2; ++j)
             for(unsigned i = 0; i<Dim1; ++i)
                 operator()(i,j) -= ao(i,j);
@@ -425,18 +870,23 @@ public:
     template<class A>
     const InPlaceMatrix& operator*=(const MatrixExpr<T, D1, D2, A>& a)
     {
-        const A& ao ( a );
-        *this = eval(*this * a);
+        *this = *this * a;
         return *this;
     }
 
+    //copies elements, the pointer itself can't be reseated
+    InPlaceMatrix& operator=(const InPlaceMatrix& a)
+    {
+        return operator=<InPlaceMatrix>(a);
+    }
+
     template<class A>
     InPlaceMatrix& operator=(const MatrixExpr<T, D1, D2, A>& a)
     {
         const A& ao ( a );
-        for(unsigned j = 0; j<Dim2; ++j)
-            for(unsigned i = 0; i<Dim1; ++i)
-                operator()(i,j) = ao(i,j);
+        if(!MatrixAssign<T,D1,D2,A>::alias_safe && ao.aliases(data, data+Dim1*Dim2))
+            return *this = Matrix<T,D1,D2>(ao);
+        MatrixAssign<T,D1,D2,A>::run(data, ao);
         return *this;
     }
 
@@ -450,12 +900,551 @@ InPlaceMatrix<T,D1,D2> MakeMatrix(T *const p)
     return InPlaceMatrix<T,D1,D2>(p);
 }
 
+//owns a matrix that was an rvalue operand of an expression, see
+//TemporaryVector
+template<class T, unsigned D1, unsigned D2>
+class TemporaryMatrix : public MatrixExpr<T, D1, D2, TemporaryMatrix<T,D1,D2> > {
+public:
+    explicit GLP_CONSTEXPR TemporaryMatrix(const Matrix<T,D1,D2>& a) : m(a)
+    { }
+
+    GLP_CONSTEXPR const T* raw() const {
+        return m.raw();
+    }
+
+    GLP_CONSTEXPR const T& operator() (unsigned i, unsigned j) const {
+        return m(i,j);
+    }
+
+    GLP_CONSTEXPR bool aliases(const void*, const void*) const { return false; }
+    GLP_CONSTEXPR bool overlaps(const void*, const void*) const { return false; }
+private:
+    Matrix<T,D1,D2> m;
+};
+
 template<class T, unsigned D1, unsigned D2, class A>
-inline Matrix<T, D1, D2> eval(const MatrixExpr<T, D1, D2, A>& a)
+inline GLP_CONSTEXPR Matrix<T, D1, D2> eval(const MatrixExpr<T, D1, D2, A>& a)
 {
     return Matrix<T, D1, D2>(a);
 }
 
+//unrolled determinant and inverse of small square matrices given as
+//column major arrays, inverse returns the determinant. Singular
+//matrices give non finite results.
+template<class T, unsigned D>
+struct InverseKernel {
+    BOOST_STATIC_ASSERT(D>=1 && D<=4);
+};
+
+template<class T>
+struct InverseKernel<T, 1> {
+    static GLP_CONSTEXPR T determinant(const T *m)
+    {
+        return m[0];
+    }
+
+    static GLP_CONSTEXPR T inverse(const T *m, T *out)
+    {
+        T det = m[0];
+        out[0] = T(1)/det;
+        return det;
+    }
+};
+
+template<class T>
+struct InverseKernel<T, 2> {
+    static GLP_CONSTEXPR T determinant(const T *m)
+    {
+        return m[0]*m[3] - m[2]*m[1];
+    }
+
+    static GLP_CONSTEXPR T inverse(const T *m, T *out)
+    {
+        T det = determinant(m);
+        T r = T(1)/det;
+        T a = m[0], b = m[1], c = m[2], d = m[3];
+        out[0] = d*r;
+        out[1] = -b*r;
+        out[2] = -c*r;
+        out[3] = a*r;
+        return det;
+    }
+};
+
+template<class T>
+struct InverseKernel<T, 3> {
+    static GLP_CONSTEXPR T determinant(const T *m)
+    {
+        return m[0]*(m[4]*m[8] - m[7]*m[5])
+             - m[3]*(m[1]*m[8] - m[7]*m[2])
+             + m[6]*(m[1]*m[5] - m[4]*m[2]);
+    }
+
+    static GLP_CONSTEXPR T inverse(const T *m, T *out)
+    {
+        //transposed cofactors
+        T r[9] = {};
+        r[0] = m[4]*m[8] - m[7]*m[5];
+        r[1] = m[7]*m[2] - m[1]*m[8];
+        r[2] = m[1]*m[5] - m[4]*m[2];
+        r[3] = m[6]*m[5] - m[3]*m[8];
+        r[4] = m[0]*m[8] - m[6]*m[2];
+        r[5] = m[3]*m[2] - m[0]*m[5];
+        r[6] = m[3]*m[7] - m[6]*m[4];
+        r[7] = m[6]*m[1] - m[0]*m[7];
+        r[8] = m[0]*m[4] - m[3]*m[1];
+        T det = m[0]*r[0] + m[3]*r[1] + m[6]*r[2];
+        T inv = T(1)/det;
+        for(unsigned i = 0; i<9; ++i)
+            out[i] = r[i]*inv;
+        return det;
+    }
+};
+
+//2x2 determinants of the first two and the last two columns
+template<class T>
+struct Mat4Minors {
+    T s[6], c[6];
+
+    GLP_CONSTEXPR Mat4Minors(const T *m) : s(), c()
+    {
+        s[0] = m[0]*m[5] - m[1]*m[4];
+        s[1] = m[0]*m[6] - m[2]*m[4];
+        s[2] = m[0]*m[7] - m[3]*m[4];
+        s[3] = m[1]*m[6] - m[2]*m[5];
+        s[4] = m[1]*m[7] - m[3]*m[5];
+        s[5] = m[2]*m[7] - m[3]*m[6];
+        c[0] = m[8]*m[13] - m[9]*m[12];
+        c[1] = m[8]*m[14] - m[10]*m[12];
+        c[2] = m[8]*m[15] - m[11]*m[12];
+        c[3] = m[9]*m[14] - m[10]*m[13];
+        c[4] = m[9]*m[15] - m[11]*m[13];
+        c[5] = m[10]*m[15] - m[11]*m[14];
+    }
+
+    GLP_CONSTEXPR T determinant() const
+    {
+        return s[0]*c[5] - s[1]*c[4] + s[2]*c[3]
+             + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+    }
+};
+
+template<class T>
+struct Mat4InverseLoop {
+    static GLP_CONSTEXPR T determinant(const T *m)
+    {
+        return Mat4Minors<T>(m).determinant();
+    }
+
+    static GLP_CONSTEXPR T inverse(const T *m, T *out)
+    {
+        Mat4Minors<T> k(m);
+        const T *s = k.s, *c = k.c;
+        T det = k.determinant();
+        T inv = T(1)/det;
+        T r[16] = {};
+        r[0]  = ( m[5]*c[5] - m[6]*c[4] + m[7]*c[3])*inv;
+        r[1]  = (-m[1]*c[5] + m[2]*c[4] - m[3]*c[3])*inv;
+        r[2]  = ( m[13]*s[5] - m[14]*s[4] + m[15]*s[3])*inv;
+        r[3]  = (-m[9]*s[5] + m[10]*s[4] - m[11]*s[3])*inv;
+        r[4]  = (-m[4]*c[5] + m[6]*c[2] - m[7]*c[1])*inv;
+        r[5]  = ( m[0]*c[5] - m[2]*c[2] + m[3]*c[1])*inv;
+        r[6]  = (-m[12]*s[5] + m[14]*s[2] - m[15]*s[1])*inv;
+        r[7]  = ( m[8]*s[5] - m[10]*s[2] + m[11]*s[1])*inv;
+        r[8]  = ( m[4]*c[4] - m[5]*c[2] + m[7]*c[0])*inv;
+        r[9]  = (-m[0]*c[4] + m[1]*c[2] - m[3]*c[0])*inv;
+        r[10] = ( m[12]*s[4] - m[13]*s[2] + m[15]*s[0])*inv;
+        r[11] = (-m[8]*s[4] + m[9]*s[2] - m[11]*s[0])*inv;
+        r[12] = (-m[4]*c[3] + m[5]*c[1] - m[6]*c[0])*inv;
+        r[13] = ( m[0]*c[3] - m[1]*c[1] + m[2]*c[0])*inv;
+        r[14] = (-m[12]*s[3] + m[13]*s[1] - m[14]*s[0])*inv;
+        r[15] = ( m[8]*s[3] - m[9]*s[1] + m[10]*s[0])*inv;
+        for(unsigned i = 0; i<16; ++i)
+            out[i] = r[i];
+        return det;
+    }
+};
+
+template<class T>
+struct InverseKernel<T, 4> : Mat4InverseLoop<T> { };
+
+#ifdef GLP_SIMD_SSE
+template<>
+struct InverseKernel<float, 4> {
+    static GLP_CONSTEXPR float determinant(const float *m)
+    {
+        return Mat4Minors<float>(m).determinant();
+    }
+
+    static GLP_CONSTEXPR float inverse(const float *m, float *out)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return Mat4InverseLoop<float>::inverse(m, out);
+        return simd::mat4_inverse(m, out);
+    }
+};
+#endif
+
+template<class T, unsigned D, class A>
+inline GLP_CONSTEXPR T Determinant(const MatrixExpr<T, D, D, A>& a)
+{
+    Matrix<T, D, D> m(a);
+    return InverseKernel<T, D>::determinant(m.raw());
+}
+
+template<class T, unsigned D, class A>
+inline GLP_CONSTEXPR Matrix<T, D, D> Inverse(const MatrixExpr<T, D, D, A>& a)
+{
+    Matrix<T, D, D> res(a);
+    InverseKernel<T, D>::inverse(res.raw(), res.raw());
+    return res;
+}
+
+//unrolled factorizations of small square systems given as column
+//major arrays, the loop bounds are compile time constants so the
+//compiler flattens them for the usual 2x2 to 6x6 sizes. Nothing is
+//allocated, failed factorizations still run to the end and make the
+//solutions non finite.
+
+//LU with partial pivoting in place, L (unit diagonal) below and U on
+//and above the diagonal. Row i of the factors is row perm[i] of m.
+//Returns false for singular matrices.
+template<class T, unsigned D>
+struct LUKernel {
+    static GLP_CONSTEXPR bool factor(T *m, unsigned *perm)
+    {
+        bool regular = true;
+        for(unsigned i = 0; i<D; ++i)
+            perm[i] = i;
+        for(unsigned k = 0; k<D; ++k)
+        {
+            //selects instead of branches, pivots of random data are
+            //unpredictable
+            unsigned p = k;
+            T best = m[k+k*D] < 0 ? -m[k+k*D] : m[k+k*D];
+            for(unsigned r = k+1; r<D; ++r)
+            {
+                T v = m[r+k*D] < 0 ? -m[r+k*D] : m[r+k*D];
+                bool larger = v > best;
+                best = larger ? v : best;
+                p = larger ? r : p;
+            }
+            for(unsigned c = 0; c<D; ++c)
+            {
+                T t = m[k+c*D];
+                m[k+c*D] = m[p+c*D];
+                m[p+c*D] = t;
+            }
+            unsigned t = perm[k];
+            perm[k] = perm[p];
+            perm[p] = t;
+            if(best == 0)
+                regular = false;
+            T inv = T(1)/m[k+k*D];
+            for(unsigned r = k+1; r<D; ++r)
+                m[r+k*D] *= inv;
+            for(unsigned c = k+1; c<D; ++c)
+                for(unsigned r = k+1; r<D; ++r)
+                    m[r+c*D] -= m[r+k*D]*m[k+c*D];
+        }
+        return regular;
+    }
+
+    //x = m^-1 b from the factors, x and b may be the same
+    static GLP_CONSTEXPR void solve(const T *lu, const unsigned *perm, const T *b, T *x)
+    {
+        T y[D] = {};
+        for(unsigned i = 0; i<D; ++i)
+        {
+            T s = b[perm[i]];
+            for(unsigned j = 0; j<i; ++j)
+                s -= lu[i+j*D]*y[j];
+            y[i] = s;
+        }
+        for(unsigned i = D; i-- > 0;)
+        {
+            T s = y[i];
+            for(unsigned j = i+1; j<D; ++j)
+                s -= lu[i+j*D]*y[j];
+            y[i] = s/lu[i+i*D];
+        }
+        for(unsigned i = 0; i<D; ++i)
+            x[i] = y[i];
+    }
+
+    static GLP_CONSTEXPR T determinant(const T *lu, const unsigned *perm)
+    {
+        T det = 1;
+        for(unsigned i = 0; i<D; ++i)
+            det *= lu[i+i*D];
+        //every cycle of length n in the permutation is n-1 swaps
+        bool seen[D] = {};
+        for(unsigned i = 0; i<D; ++i)
+        {
+            if(seen[i])
+                continue;
+            for(unsigned j = perm[i]; j != i; j = perm[j])
+            {
+                seen[j] = true;
+                det = -det;
+            }
+        }
+        return det;
+    }
+};
+
+//Cholesky factor L of a symmetric positive definite matrix in place,
+//only the lower triangle of m is read and the upper one is cleared.
+//Returns false if m isn't positive definite.
+template<class T, unsigned D>
+struct CholeskyKernel {
+    static GLP_CONSTEXPR bool factor(T *m)
+    {
+        bool definite = true;
+        for(unsigned j = 0; j<D; ++j)
+        {
+            T d = m[j+j*D];
+            for(unsigned k = 0; k<j; ++k)
+                d -= m[j+k*D]*m[j+k*D];
+            if(!(d > 0))
+                definite = false;
+            d = std::sqrt(d);
+            m[j+j*D] = d;
+            T inv = T(1)/d;
+            for(unsigned i = j+1; i<D; ++i)
+            {
+                T s = m[i+j*D];
+                for(unsigned k = 0; k<j; ++k)
+                    s -= m[i+k*D]*m[j+k*D];
+                m[i+j*D] = s*inv;
+                m[j+i*D] = 0;
+            }
+        }
+        return definite;
+    }
+
+    //x = (L L^T)^-1 b, x and b may be the same
+    static GLP_CONSTEXPR void solve(const T *l, const T *b, T *x)
+    {
+        T y[D] = {};
+        for(unsigned i = 0; i<D; ++i)
+        {
+            T s = b[i];
+            for(unsigned k = 0; k<i; ++k)
+                s -= l[i+k*D]*y[k];
+            y[i] = s/l[i+i*D];
+        }
+        for(unsigned i = D; i-- > 0;)
+        {
+            T s = y[i];
+            for(unsigned k = i+1; k<D; ++k)
+                s -= l[k+i*D]*y[k];
+            y[i] = s/l[i+i*D];
+        }
+        for(unsigned i = 0; i<D; ++i)
+            x[i] = y[i];
+    }
+};
+
+//Householder QR in place, R on and above the diagonal and the
+//reflectors H_k = I - tau[k] v v^T below it (v[k] = 1 is implicit),
+//Q = H_0 H_1 ... H_D-1. Returns false for rank deficient matrices.
+template<class T, unsigned D>
+struct QRKernel {
+    static GLP_CONSTEXPR bool factor(T *m, T *tau)
+    {
+        bool full_rank = true;
+        for(unsigned k = 0; k<D; ++k)
+        {
+            T alpha = m[k+k*D], xnorm = 0;
+            for(unsigned i = k+1; i<D; ++i)
+                xnorm += m[i+k*D]*m[i+k*D];
+            tau[k] = 0;
+            if(xnorm > 0)
+            {
+                T beta = std::sqrt(alpha*alpha + xnorm);
+                if(alpha >= 0)
+                    beta = -beta;
+                tau[k] = (beta-alpha)/beta;
+                T inv = T(1)/(alpha-beta);
+                for(unsigned i = k+1; i<D; ++i)
+                    m[i+k*D] *= inv;
+                m[k+k*D] = beta;
+                for(unsigned c = k+1; c<D; ++c)
+                    reflect(m, tau[k], k, m+c*D);
+            }
+            if(m[k+k*D] == 0)
+                full_rank = false;
+        }
+        return full_rank;
+    }
+
+    //applies H_k to the column vector x
+    static GLP_CONSTEXPR void reflect(const T *qr, T tau, unsigned k, T *x)
+    {
+        T w = x[k];
+        for(unsigned i = k+1; i<D; ++i)
+            w += qr[i+k*D]*x[i];
+        w *= tau;
+        x[k] -= w;
+        for(unsigned i = k+1; i<D; ++i)
+            x[i] -= qr[i+k*D]*w;
+    }
+
+    //x = R^-1 Q^T b, x and b may be the same
+    static GLP_CONSTEXPR void solve(const T *qr, const T *tau, const T *b, T *x)
+    {
+        T y[D] = {};
+        for(unsigned i = 0; i<D; ++i)
+            y[i] = b[i];
+        for(unsigned k = 0; k<D; ++k)
+            reflect(qr, tau[k], k, y);
+        for(unsigned i = D; i-- > 0;)
+        {
+            T s = y[i];
+            for(unsigned j = i+1; j<D; ++j)
+                s -= qr[i+j*D]*y[j];
+            y[i] = s/qr[i+i*D];
+        }
+        for(unsigned i = 0; i<D; ++i)
+            x[i] = y[i];
+    }
+};
+
+//factorizations of a fixed matrix that can solve for any number of
+//right hand sides, see LU, Cholesky and QR below
+template<class T, unsigned D>
+class LUDecomposition {
+public:
+    template<class A>
+    GLP_CONSTEXPR explicit LUDecomposition(const MatrixExpr<T, D, D, A>& a)
+        : lu(a), perm(), regular(false)
+    {
+        regular = LUKernel<T, D>::factor(lu.raw(), perm);
+    }
+
+    GLP_CONSTEXPR bool singular() const { return !regular; }
+
+    template<class B>
+    GLP_CONSTEXPR Vector<T, D> solve(const VectorExpr<T, D, B>& b) const
+    {
+        Vector<T, D> x(b);
+        LUKernel<T, D>::solve(lu.raw(), perm, x.raw(), x.raw());
+        return x;
+    }
+
+    GLP_CONSTEXPR T determinant() const
+    {
+        return LUKernel<T, D>::determinant(lu.raw(), perm);
+    }
+
+    //L and U packed into one matrix and the row permutation
+    GLP_CONSTEXPR const Matrix<T, D, D>& factors() const { return lu; }
+    GLP_CONSTEXPR unsigned permutation(unsigned i) const { return perm[i]; }
+
+private:
+    Matrix<T, D, D> lu;
+    unsigned perm[D];
+    bool regular;
+};
+
+template<class T, unsigned D>
+class CholeskyDecomposition {
+public:
+    template<class A>
+    GLP_CONSTEXPR explicit CholeskyDecomposition(const MatrixExpr<T, D, D, A>& a)
+        : l(a), definite(false)
+    {
+        definite = CholeskyKernel<T, D>::factor(l.raw());
+    }
+
+    GLP_CONSTEXPR bool positive_definite() const { return definite; }
+
+    template<class B>
+    GLP_CONSTEXPR Vector<T, D> solve(const VectorExpr<T, D, B>& b) const
+    {
+        Vector<T, D> x(b);
+        CholeskyKernel<T, D>::solve(l.raw(), x.raw(), x.raw());
+        return x;
+    }
+
+    //lower triangular with a = L*Transpose(L)
+    GLP_CONSTEXPR const Matrix<T, D, D>& L() const { return l; }
+
+private:
+    Matrix<T, D, D> l;
+    bool definite;
+};
+
+template<class T, unsigned D>
+class QRDecomposition {
+public:
+    template<class A>
+    GLP_CONSTEXPR explicit QRDecomposition(const MatrixExpr<T, D, D, A>& a)
+        : qr(a), tau(), rank(false)
+    {
+        rank = QRKernel<T, D>::factor(qr.raw(), tau);
+    }
+
+    GLP_CONSTEXPR bool full_rank() const { return rank; }
+
+    template<class B>
+    GLP_CONSTEXPR Vector<T, D> solve(const VectorExpr<T, D, B>& b) const
+    {
+        Vector<T, D> x(b);
+        QRKernel<T, D>::solve(qr.raw(), tau, x.raw(), x.raw());
+        return x;
+    }
+
+    GLP_CONSTEXPR Matrix<T, D, D> Q() const
+    {
+        Matrix<T, D, D> q = Identity<T, D, D>();
+        for(unsigned c = 0; c<D; ++c)
+            for(unsigned k = D; k-- > 0;)
+                QRKernel<T, D>::reflect(qr.raw(), tau[k], k, q.raw()+c*D);
+        return q;
+    }
+
+    GLP_CONSTEXPR Matrix<T, D, D> R() const
+    {
+        Matrix<T, D, D> r;
+        for(unsigned j = 0; j<D; ++j)
+            for(unsigned i = 0; i<=j; ++i)
+                r(i,j) = qr(i,j);
+        return r;
+    }
+
+private:
+    Matrix<T, D, D> qr;
+    T tau[D];
+    bool rank;
+};
+
+template<class T, unsigned D, class A>
+inline GLP_CONSTEXPR LUDecomposition<T, D> LU(const MatrixExpr<T, D, D, A>& a)
+{
+    return LUDecomposition<T, D>(a);
+}
+
+template<class T, unsigned D, class A>
+inline GLP_CONSTEXPR CholeskyDecomposition<T, D> Cholesky(const MatrixExpr<T, D, D, A>& a)
+{
+    return CholeskyDecomposition<T, D>(a);
+}
+
+template<class T, unsigned D, class A>
+inline GLP_CONSTEXPR QRDecomposition<T, D> QR(const MatrixExpr<T, D, D, A>& a)
+{
+    return QRDecomposition<T, D>(a);
+}
+
+//x with a*x = b, by LU decomposition
+template<class T, unsigned D, class A, class B>
+inline GLP_CONSTEXPR Vector<T, D> Solve(const MatrixExpr<T, D, D, A>& a, const VectorExpr<T, D, B>& b)
+{
+    return LUDecomposition<T, D>(a).solve(b);
+}
+
 template<class T, unsigned D1, unsigned D2, class A>
 std::ostream& operator<<(std::ostream& out, const MatrixExpr<T, D1, D2, A>& a)
 {
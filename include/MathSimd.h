@@ -0,0 +1,999 @@
+/*
+ * MathSimd.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * MathSimd.h provides the raw float kernels used by MathVector.h and
+ * MathMatrix.h for 3 and 4 dimensional vectors and 4x4 matrices.
+ * All kernels work on column major float arrays and use unaligned
+ * loads, so they can be applied to InPlaceVector/InPlaceMatrix data
+ * inside of mapped buffers. Every kernel reads all of its input before
+ * writing the output so out may alias any of the inputs. The batch
+ * kernels behind BatchTransform.h, Frustum.h, PackedVector.h and
+ * OcclusionBuffer.h live here as well.
+ *
+ * SSE is used if available, AVX additionally for matrix products,
+ * culling and depth spans, F16C for half floats.
+ * Defining GLP_NO_SIMD forces the scalar fallbacks.
+ */
+
+#ifndef MATH_SIMD_H
+#define MATH_SIMD_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#if !defined(GLP_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+    #define GLP_SIMD_SSE
+    #include <xmmintrin.h>
+    #if defined(__SSE2__) || defined(_M_X64)
+        #define GLP_SIMD_SSE2
+        #include <emmintrin.h>
+    #endif
+    #if defined(__AVX__)
+        #define GLP_SIMD_AVX
+        #include <immintrin.h>
+    #endif
+    #if defined(__F16C__)
+        #define GLP_SIMD_F16C
+        #include <immintrin.h>
+    #endif
+#endif
+
+namespace simd {
+
+#ifdef GLP_SIMD_SSE
+//horizontal sum, result in all lanes
+inline __m128 hsum(__m128 v)
+{
+    __m128 s = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1,0,3,2)));
+}
+
+//3 floats as (x, y, z, 0) without touching the memory after them
+inline __m128 load3(const float *a)
+{
+    __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(a));
+    return _mm_movelh_ps(xy, _mm_load_ss(a+2));
+}
+
+inline void store3(float *out, __m128 v)
+{
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), v);
+    _mm_store_ss(out+2, _mm_movehl_ps(v, v));
+}
+#endif
+
+//dot and cross products stay scalar, the horizontal sum and the
+//packing of 3 floats into a register cost more than the arithmetic
+//they save
+inline float dot4(const float *a, const float *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+}
+
+inline float dot3(const float *a, const float *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+inline void cross3(const float *a, const float *b, float *out)
+{
+    float x = a[1]*b[2]-a[2]*b[1];
+    float y = a[2]*b[0]-a[0]*b[2];
+    float z = a[0]*b[1]-a[1]*b[0];
+    out[0] = x; out[1] = y; out[2] = z;
+}
+
+inline void normalize4(const float *a, float *out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 v = _mm_loadu_ps(a);
+    __m128 n = _mm_sqrt_ps(hsum(_mm_mul_ps(v, v)));
+    _mm_storeu_ps(out, _mm_div_ps(v, n));
+#else
+    float n = std::sqrt(dot4(a, a));
+    for(unsigned i = 0; i<4; ++i)
+        out[i] = a[i]/n;
+#endif
+}
+
+inline void normalize3(const float *a, float *out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 v = load3(a);
+    __m128 n = _mm_sqrt_ps(hsum(_mm_mul_ps(v, v)));
+    store3(out, _mm_div_ps(v, n));
+#else
+    float n = std::sqrt(dot3(a, a));
+    for(unsigned i = 0; i<3; ++i)
+        out[i] = a[i]/n;
+#endif
+}
+
+#ifdef GLP_SIMD_SSE
+//reciprocal square root estimate, relative error at most 1.5*2^-12.
+//One Newton-Raphson step brings that down to about 2^-22.
+inline __m128 rsqrt_ps(__m128 x, bool refine)
+{
+    __m128 y = _mm_rsqrt_ps(x);
+    if(refine)
+    {
+        __m128 xyy = _mm_mul_ps(_mm_mul_ps(x, y), y);
+        y = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), xyy));
+    }
+    return y;
+}
+#endif
+
+#ifdef GLP_SIMD_AVX
+inline __m256 rsqrt_ps(__m256 x, bool refine)
+{
+    __m256 y = _mm256_rsqrt_ps(x);
+    if(refine)
+    {
+        __m256 xyy = _mm256_mul_ps(_mm256_mul_ps(x, y), y);
+        y = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y), _mm256_sub_ps(_mm256_set1_ps(3.0f), xyy));
+    }
+    return y;
+}
+#endif
+
+//1/sqrt(x) from the estimate instruction, exact without SSE
+inline float rsqrt(float x, bool refine)
+{
+#ifdef GLP_SIMD_SSE
+    return _mm_cvtss_f32(rsqrt_ps(_mm_set_ss(x), refine));
+#else
+    (void)refine;
+    return 1/std::sqrt(x);
+#endif
+}
+
+//out[i] = 1/sqrt(in[i]), in and out may be the same array
+inline void rsqrt_n(const float *in, float *out, size_t n, bool refine)
+{
+    size_t i = 0;
+#ifdef GLP_SIMD_AVX
+    for(; i+8<=n; i+=8)
+        _mm256_storeu_ps(out+i, rsqrt_ps(_mm256_loadu_ps(in+i), refine));
+#endif
+#ifdef GLP_SIMD_SSE
+    for(; i+4<=n; i+=4)
+        _mm_storeu_ps(out+i, rsqrt_ps(_mm_loadu_ps(in+i), refine));
+#endif
+    for(; i<n; ++i)
+        out[i] = rsqrt(in[i], refine);
+}
+
+//normalize4 and normalize3 with the reciprocal square root estimate
+inline void normalize4(const float *a, float *out, bool refine)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 v = _mm_loadu_ps(a);
+    _mm_storeu_ps(out, _mm_mul_ps(v, rsqrt_ps(hsum(_mm_mul_ps(v, v)), refine)));
+#else
+    (void)refine;
+    normalize4(a, out);
+#endif
+}
+
+inline void normalize3(const float *a, float *out, bool refine)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 v = load3(a);
+    store3(out, _mm_mul_ps(v, rsqrt_ps(hsum(_mm_mul_ps(v, v)), refine)));
+#else
+    (void)refine;
+    normalize3(a, out);
+#endif
+}
+
+//out = m*v
+inline void mat4_vec4_mul(const float *m, const float *v, float *out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m+4), _mm_set1_ps(v[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m+8), _mm_set1_ps(v[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m+12), _mm_set1_ps(v[3])));
+    _mm_storeu_ps(out, r);
+#else
+    float r[4];
+    for(unsigned i = 0; i<4; ++i)
+        r[i] = m[i]*v[0] + m[i+4]*v[1] + m[i+8]*v[2] + m[i+12]*v[3];
+    for(unsigned i = 0; i<4; ++i)
+        out[i] = r[i];
+#endif
+}
+
+//out = a*b
+inline void mat4_mul(const float *a, const float *b, float *out)
+{
+#if defined(GLP_SIMD_AVX)
+    //two output columns per iteration, each 128 bit lane holds one column
+    __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a));
+    __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a+4));
+    __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a+8));
+    __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a+12));
+    for(unsigned j = 0; j<4; j+=2)
+    {
+        __m256 bj = _mm256_loadu_ps(b+4*j);
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bj, _MM_SHUFFLE(0,0,0,0)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bj, _MM_SHUFFLE(1,1,1,1))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bj, _MM_SHUFFLE(2,2,2,2))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bj, _MM_SHUFFLE(3,3,3,3))));
+        _mm256_storeu_ps(out+4*j, r);
+    }
+#elif defined(GLP_SIMD_SSE)
+    __m128 a0 = _mm_loadu_ps(a);
+    __m128 a1 = _mm_loadu_ps(a+4);
+    __m128 a2 = _mm_loadu_ps(a+8);
+    __m128 a3 = _mm_loadu_ps(a+12);
+    for(unsigned j = 0; j<4; ++j)
+    {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[4*j]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[4*j+1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[4*j+2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[4*j+3])));
+        _mm_storeu_ps(out+4*j, r);
+    }
+#else
+    float r[16];
+    for(unsigned j = 0; j<4; ++j)
+        for(unsigned i = 0; i<4; ++i)
+            r[i+4*j] = a[i]*b[4*j] + a[i+4]*b[4*j+1]
+                     + a[i+8]*b[4*j+2] + a[i+12]*b[4*j+3];
+    for(unsigned i = 0; i<16; ++i)
+        out[i] = r[i];
+#endif
+}
+
+inline void mat4_transpose(const float *a, float *out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 c0 = _mm_loadu_ps(a);
+    __m128 c1 = _mm_loadu_ps(a+4);
+    __m128 c2 = _mm_loadu_ps(a+8);
+    __m128 c3 = _mm_loadu_ps(a+12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out, c0);
+    _mm_storeu_ps(out+4, c1);
+    _mm_storeu_ps(out+8, c2);
+    _mm_storeu_ps(out+12, c3);
+#else
+    float r[16];
+    for(unsigned j = 0; j<4; ++j)
+        for(unsigned i = 0; i<4; ++i)
+            r[i+4*j] = a[j+4*i];
+    for(unsigned i = 0; i<16; ++i)
+        out[i] = r[i];
+#endif
+}
+
+#ifdef GLP_SIMD_SSE
+//inverse of a 4x4 matrix by 2x2 blocks, returns the determinant.
+//there is no scalar version, MathMatrix.h falls back to its generic
+//cofactor kernel without SSE
+inline float mat4_inverse(const float *m, float *out)
+{
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m+4);
+    __m128 c2 = _mm_loadu_ps(m+8);
+    __m128 c3 = _mm_loadu_ps(m+12);
+
+    //2x2 blocks stored as (x00, x01, x10, x11) of the transpose
+    __m128 a = _mm_movelh_ps(c0, c1);
+    __m128 b = _mm_movehl_ps(c1, c0);
+    __m128 c = _mm_movelh_ps(c2, c3);
+    __m128 d = _mm_movehl_ps(c3, c2);
+
+    //(|a|, |b|, |c|, |d|)
+    __m128 dets = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2,0,2,0)),
+                   _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3,1,3,1))),
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3,1,3,1)),
+                   _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2,0,2,0))));
+    __m128 det_a = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(0,0,0,0));
+    __m128 det_b = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(1,1,1,1));
+    __m128 det_c = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(2,2,2,2));
+    __m128 det_d = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(3,3,3,3));
+
+    //adj(x)*y, x*y and x*adj(y) for 2x2 blocks
+    #define GLP_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w,z,y,x))
+    #define GLP_MAT2_ADJ_MUL(x, y) _mm_sub_ps(_mm_mul_ps(GLP_SWIZZLE(x,3,3,0,0), y), \
+        _mm_mul_ps(GLP_SWIZZLE(x,1,1,2,2), GLP_SWIZZLE(y,2,3,0,1)))
+    #define GLP_MAT2_MUL(x, y) _mm_add_ps(_mm_mul_ps(x, GLP_SWIZZLE(y,0,3,0,3)), \
+        _mm_mul_ps(GLP_SWIZZLE(x,1,0,3,2), GLP_SWIZZLE(y,2,1,2,1)))
+    #define GLP_MAT2_MUL_ADJ(x, y) _mm_sub_ps(_mm_mul_ps(x, GLP_SWIZZLE(y,3,0,3,0)), \
+        _mm_mul_ps(GLP_SWIZZLE(x,1,0,3,2), GLP_SWIZZLE(y,2,1,2,1)))
+
+    __m128 d_c = GLP_MAT2_ADJ_MUL(d, c);
+    __m128 a_b = GLP_MAT2_ADJ_MUL(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), GLP_MAT2_MUL(b, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), GLP_MAT2_MUL(c, a_b));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), GLP_MAT2_MUL_ADJ(d, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), GLP_MAT2_MUL_ADJ(a, d_c));
+
+    //|m| = |a||d| + |b||c| - tr(adj(a)*b*adj(d)*c)
+    __m128 tr = _mm_mul_ps(a_b, GLP_SWIZZLE(d_c,0,2,1,3));
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d),
+                                       _mm_mul_ps(det_b, det_c)),
+                            hsum(tr));
+
+    #undef GLP_SWIZZLE
+    #undef GLP_MAT2_ADJ_MUL
+    #undef GLP_MAT2_MUL
+    #undef GLP_MAT2_MUL_ADJ
+
+    __m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, rdet);
+    y = _mm_mul_ps(y, rdet);
+    z = _mm_mul_ps(z, rdet);
+    w = _mm_mul_ps(w, rdet);
+
+    _mm_storeu_ps(out,    _mm_shuffle_ps(x, y, _MM_SHUFFLE(1,3,1,3)));
+    _mm_storeu_ps(out+4,  _mm_shuffle_ps(x, y, _MM_SHUFFLE(0,2,0,2)));
+    _mm_storeu_ps(out+8,  _mm_shuffle_ps(z, w, _MM_SHUFFLE(1,3,1,3)));
+    _mm_storeu_ps(out+12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0,2,0,2)));
+    return _mm_cvtss_f32(det);
+}
+#endif
+
+#ifdef GLP_SIMD_SSE
+//inverse of a 4x4 matrix with a last row of (0, 0, 0, 1). The rows of
+//the inverse of the upper 3x3 are the cross products of its columns
+//divided by the determinant, the translation is -inverse*translation.
+//Returns the determinant of the upper 3x3.
+inline float mat4_affine_inverse(const float *m, float *out)
+{
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m+4);
+    __m128 c2 = _mm_loadu_ps(m+8);
+    __m128 t = _mm_loadu_ps(m+12);
+
+    //cross(a, b) = (a*b.yzx - a.yzx*b).yzx, the w lanes stay 0
+    #define GLP_YZX(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,0,2,1))
+    #define GLP_CROSS(a, b) GLP_YZX(_mm_sub_ps(_mm_mul_ps(a, GLP_YZX(b)), _mm_mul_ps(GLP_YZX(a), b)))
+    __m128 r0 = GLP_CROSS(c1, c2);
+    __m128 r1 = GLP_CROSS(c2, c0);
+    __m128 r2 = GLP_CROSS(c0, c1);
+    #undef GLP_CROSS
+    #undef GLP_YZX
+
+    __m128 det = hsum(_mm_mul_ps(c0, r0));
+    __m128 rdet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    r0 = _mm_mul_ps(r0, rdet);
+    r1 = _mm_mul_ps(r1, rdet);
+    r2 = _mm_mul_ps(r2, rdet);
+    __m128 r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    __m128 tr = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0,0,0,0)));
+    tr = _mm_add_ps(tr, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1,1,1,1))));
+    tr = _mm_add_ps(tr, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2,2,2,2))));
+    tr = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tr);
+
+    _mm_storeu_ps(out, r0);
+    _mm_storeu_ps(out+4, r1);
+    _mm_storeu_ps(out+8, r2);
+    _mm_storeu_ps(out+12, tr);
+    return _mm_cvtss_f32(det);
+}
+#endif
+
+//top 3 rows of the column major 4x4 matrix m as 12 consecutive floats
+inline void mat4_rows3(const float *m, float *out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m+4);
+    __m128 c2 = _mm_loadu_ps(m+8);
+    __m128 c3 = _mm_loadu_ps(m+12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out, c0);
+    _mm_storeu_ps(out+4, c1);
+    _mm_storeu_ps(out+8, c2);
+#else
+    float r[12];
+    for(unsigned i = 0; i<3; ++i)
+        for(unsigned j = 0; j<4; ++j)
+            r[4*i+j] = m[i+4*j];
+    for(unsigned i = 0; i<12; ++i)
+        out[i] = r[i];
+#endif
+}
+
+//top 3 rows of a*b as in mat4_rows3, bt is the transpose of b. Row i
+//of the product is the sum of the rows of b scaled by a(i,k), so the
+//4th row is never computed and nothing has to be transposed
+inline void mat4_mul_rows3(const float *a, const float *bt, float *out)
+{
+#if defined(GLP_SIMD_AVX)
+    //rows 0 and 1 in the two 128 bit lanes, a(0,k) and a(1,k) are spread
+    //over them with one in-lane permute
+    const __m256i spread = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    __m256 r01 = _mm256_setzero_ps();
+    __m128 r2 = _mm_setzero_ps();
+    for(unsigned k = 0; k<4; ++k)
+    {
+        __m256 ak = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a+4*k));
+        __m256 bk = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(bt+4*k));
+        r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permutevar_ps(ak, spread), bk));
+        r2 = _mm_add_ps(r2, _mm_mul_ps(_mm_permute_ps(_mm256_castps256_ps128(ak), _MM_SHUFFLE(2,2,2,2)),
+                                       _mm256_castps256_ps128(bk)));
+    }
+    _mm256_storeu_ps(out, r01);
+    _mm_storeu_ps(out+8, r2);
+#elif defined(GLP_SIMD_SSE)
+    __m128 b0 = _mm_loadu_ps(bt);
+    __m128 b1 = _mm_loadu_ps(bt+4);
+    __m128 b2 = _mm_loadu_ps(bt+8);
+    __m128 b3 = _mm_loadu_ps(bt+12);
+    for(unsigned i = 0; i<3; ++i)
+    {
+        __m128 r = _mm_mul_ps(b0, _mm_set1_ps(a[i]));
+        r = _mm_add_ps(r, _mm_mul_ps(b1, _mm_set1_ps(a[i+4])));
+        r = _mm_add_ps(r, _mm_mul_ps(b2, _mm_set1_ps(a[i+8])));
+        r = _mm_add_ps(r, _mm_mul_ps(b3, _mm_set1_ps(a[i+12])));
+        _mm_storeu_ps(out+4*i, r);
+    }
+#else
+    float r[12];
+    for(unsigned i = 0; i<3; ++i)
+        for(unsigned j = 0; j<4; ++j)
+            r[4*i+j] = a[i]*bt[j] + a[i+4]*bt[j+4] + a[i+8]*bt[j+8] + a[i+12]*bt[j+12];
+    for(unsigned i = 0; i<12; ++i)
+        out[i] = r[i];
+#endif
+}
+
+//linear blend skinning with 4 influences, palette holds the top 3 rows
+//of every bone matrix (see mat4_rows3). p is transformed as a point,
+//n as a direction and renormalized if it isn't null.
+inline void skin4(const float *palette, const unsigned *bone, const float *weight,
+                  const float *p, const float *n, float *p_out, float *n_out)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 r0 = _mm_setzero_ps(), r1 = r0, r2 = r0;
+    for(unsigned k = 0; k<4; ++k)
+    {
+        const float *b = palette+12*bone[k];
+        __m128 w = _mm_set1_ps(weight[k]);
+        r0 = _mm_add_ps(r0, _mm_mul_ps(w, _mm_loadu_ps(b)));
+        r1 = _mm_add_ps(r1, _mm_mul_ps(w, _mm_loadu_ps(b+4)));
+        r2 = _mm_add_ps(r2, _mm_mul_ps(w, _mm_loadu_ps(b+8)));
+    }
+    __m128 v = _mm_setr_ps(p[0], p[1], p[2], 1.0f);
+    __m128 x = _mm_mul_ps(r0, v), y = _mm_mul_ps(r1, v), z = _mm_mul_ps(r2, v);
+    __m128 s = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, s);
+    store3(p_out, _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, s)));
+    if(n)
+    {
+        v = load3(n);
+        x = _mm_mul_ps(r0, v); y = _mm_mul_ps(r1, v); z = _mm_mul_ps(r2, v);
+        s = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, s);
+        __m128 r = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, s));
+        store3(n_out, _mm_div_ps(r, _mm_sqrt_ps(hsum(_mm_mul_ps(r, r)))));
+    }
+#else
+    float m[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for(unsigned k = 0; k<4; ++k)
+        for(unsigned i = 0; i<12; ++i)
+            m[i] += weight[k]*palette[12*bone[k]+i];
+    float r[3];
+    for(unsigned i = 0; i<3; ++i)
+        r[i] = m[4*i]*p[0] + m[4*i+1]*p[1] + m[4*i+2]*p[2] + m[4*i+3];
+    p_out[0] = r[0]; p_out[1] = r[1]; p_out[2] = r[2];
+    if(n)
+    {
+        for(unsigned i = 0; i<3; ++i)
+            r[i] = m[4*i]*n[0] + m[4*i+1]*n[1] + m[4*i+2]*n[2];
+        float len = std::sqrt(dot3(r, r));
+        for(unsigned i = 0; i<3; ++i)
+            n_out[i] = r[i]/len;
+    }
+#endif
+}
+
+//transforms n vectors of DI floats starting every in_stride bytes by m
+//and writes DO floats every out_stride bytes. If DI is 3 the fourth
+//component is w. DIVIDE performs the perspective divide, NORMALIZE
+//normalizes the result. in and out may be the same array.
+template<unsigned DI, unsigned DO, bool DIVIDE, bool NORMALIZE>
+inline void mat4_transform_strided(const float *m,
+                                   const char *in, size_t in_stride,
+                                   char *out, size_t out_stride,
+                                   size_t n, float w)
+{
+#ifdef GLP_SIMD_SSE
+    const __m128 c0 = _mm_loadu_ps(m);
+    const __m128 c1 = _mm_loadu_ps(m+4);
+    const __m128 c2 = _mm_loadu_ps(m+8);
+    const __m128 c3 = _mm_loadu_ps(m+12);
+    const __m128 cw = _mm_mul_ps(c3, _mm_set1_ps(w));
+    for(size_t i = 0; i<n; ++i, in += in_stride, out += out_stride)
+    {
+        const float *p = reinterpret_cast<const float*>(in);
+        __m128 r = _mm_mul_ps(c0, _mm_set1_ps(p[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+        if(DI == 4)
+            r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(p[3])));
+        else
+            r = _mm_add_ps(r, cw);
+        if(DIVIDE)
+            r = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3,3,3,3)));
+        if(NORMALIZE)
+            r = _mm_div_ps(r, _mm_sqrt_ps(hsum(_mm_mul_ps(r, r))));
+        float *q = reinterpret_cast<float*>(out);
+        if(DO == 4)
+            _mm_storeu_ps(q, r);
+        else
+            store3(q, r);
+    }
+#else
+    for(size_t i = 0; i<n; ++i, in += in_stride, out += out_stride)
+    {
+        const float *p = reinterpret_cast<const float*>(in);
+        float pw = DI == 4 ? p[3] : w;
+        float r[4];
+        for(unsigned k = 0; k<4; ++k)
+            r[k] = m[k]*p[0] + m[k+4]*p[1] + m[k+8]*p[2] + m[k+12]*pw;
+        if(DIVIDE)
+        {
+            float iw = r[3];
+            for(unsigned k = 0; k<4; ++k)
+                r[k] /= iw;
+        }
+        if(NORMALIZE)
+        {
+            float len = std::sqrt(dot4(r, r));
+            for(unsigned k = 0; k<4; ++k)
+                r[k] /= len;
+        }
+        float *q = reinterpret_cast<float*>(out);
+        for(unsigned k = 0; k<DO; ++k)
+            q[k] = r[k];
+    }
+#endif
+}
+
+#ifdef GLP_SIMD_SSE
+//loads D <= 4 floats, the remaining lanes are zero
+template<unsigned D>
+inline __m128 load_partial(const float *a)
+{
+    switch(D)
+    {
+        case 1: return _mm_load_ss(a);
+        case 2: return _mm_setr_ps(a[0], a[1], 0.0f, 0.0f);
+        case 3: return load3(a);
+        default: return _mm_loadu_ps(a);
+    }
+}
+#endif
+
+//round(clamp(v[k], lo[k], 1)*scale[k]) for the first D <= 4 components,
+//lo and scale hold 4 values each
+template<unsigned D>
+inline void quantize(const float *v, const float *lo, const float *scale, int *out)
+{
+#ifdef GLP_SIMD_SSE2
+    __m128 c = _mm_min_ps(_mm_max_ps(load_partial<D>(v), _mm_loadu_ps(lo)), _mm_set1_ps(1.0f));
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(c, _mm_loadu_ps(scale)));
+    int tmp[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(tmp), q);
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = tmp[k];
+#else
+    for(unsigned k = 0; k<D; ++k)
+    {
+        float c = v[k] < lo[k] ? lo[k] : (v[k] > 1.0f ? 1.0f : v[k]);
+        out[k] = int(std::lrint(c*scale[k]));
+    }
+#endif
+}
+
+//max(q[k]*inv_scale[k], lo[k]), the inverse of quantize
+template<unsigned D>
+inline void dequantize(const int *q, const float *lo, const float *inv_scale, float *out)
+{
+#ifdef GLP_SIMD_SSE2
+    int tmp[4] = {0, 0, 0, 0};
+    for(unsigned k = 0; k<D; ++k)
+        tmp[k] = q[k];
+    __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tmp)));
+    v = _mm_max_ps(_mm_mul_ps(v, _mm_loadu_ps(inv_scale)), _mm_loadu_ps(lo));
+    float r[4];
+    _mm_storeu_ps(r, v);
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = r[k];
+#else
+    for(unsigned k = 0; k<D; ++k)
+    {
+        float v = float(q[k])*inv_scale[k];
+        out[k] = v < lo[k] ? lo[k] : v;
+    }
+#endif
+}
+
+//IEEE half precision with round to nearest even, infinities and NaNs
+//are preserved
+inline unsigned short float_to_half(float f)
+{
+    unsigned u;
+    std::memcpy(&u, &f, sizeof(u));
+    unsigned sign = (u >> 16) & 0x8000u;
+    u &= 0x7fffffffu;
+    unsigned short h;
+    if(u >= 0x47800000u)
+    {
+        h = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+    }
+    else if(u < 0x38800000u)
+    {
+        //subnormal, let the float addition do the rounding
+        float magic = 0.5f, v;
+        std::memcpy(&v, &u, sizeof(v));
+        v += magic;
+        std::memcpy(&u, &v, sizeof(u));
+        h = (unsigned short)(u - 0x3f000000u);
+    }
+    else
+    {
+        unsigned odd = (u >> 13) & 1;
+        u += 0xc8000fffu + odd;
+        h = (unsigned short)(u >> 13);
+    }
+    return (unsigned short)(h | sign);
+}
+
+inline float half_to_float(unsigned short h)
+{
+    unsigned u = (h & 0x7fffu) << 13;
+    unsigned exp = u & 0x0f800000u;
+    u += 0x38000000u;
+    if(exp == 0x0f800000u)
+    {
+        u += 0x38000000u;
+    }
+    else if(exp == 0)
+    {
+        //subnormal, renormalize
+        float magic = 6.103515625e-05f, v;
+        u += 0x00800000u;
+        std::memcpy(&v, &u, sizeof(v));
+        v -= magic;
+        std::memcpy(&u, &v, sizeof(u));
+    }
+    u |= unsigned(h & 0x8000u) << 16;
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+//D <= 4 floats to halfs and back
+template<unsigned D>
+inline void floats_to_halfs(const float *v, unsigned short *out)
+{
+#ifdef GLP_SIMD_F16C
+    unsigned short tmp[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(tmp),
+                     _mm_cvtps_ph(load_partial<D>(v), _MM_FROUND_TO_NEAREST_INT));
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = tmp[k];
+#else
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = float_to_half(v[k]);
+#endif
+}
+
+template<unsigned D>
+inline void halfs_to_floats(const unsigned short *h, float *out)
+{
+#ifdef GLP_SIMD_F16C
+    unsigned short tmp[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for(unsigned k = 0; k<D; ++k)
+        tmp[k] = h[k];
+    float r[4];
+    _mm_storeu_ps(r, _mm_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tmp))));
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = r[k];
+#else
+    for(unsigned k = 0; k<D; ++k)
+        out[k] = half_to_float(h[k]);
+#endif
+}
+
+//ray packets: o, d and inv hold the origins, directions and inverse
+//directions of 4 rays as x[4], y[4], z[4]. tmin and tmax are per ray.
+
+//slab test against the box [lo, hi], returns a bit mask of the rays
+//that enter it within [tmin, tmax]
+inline unsigned ray4_box(const float *o, const float *inv,
+                         const float *tmin, const float *tmax,
+                         const float *lo, const float *hi)
+{
+#ifdef GLP_SIMD_SSE
+    __m128 tn = _mm_loadu_ps(tmin), tf = _mm_loadu_ps(tmax);
+    for(unsigned k = 0; k<3; ++k)
+    {
+        __m128 ok = _mm_loadu_ps(o+4*k), ik = _mm_loadu_ps(inv+4*k);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo[k]), ok), ik);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi[k]), ok), ik);
+        tn = _mm_max_ps(_mm_min_ps(t0, t1), tn);
+        tf = _mm_min_ps(_mm_max_ps(t0, t1), tf);
+    }
+    return unsigned(_mm_movemask_ps(_mm_cmple_ps(tn, tf)));
+#else
+    unsigned mask = 0;
+    for(unsigned r = 0; r<4; ++r)
+    {
+        float tn = tmin[r], tf = tmax[r];
+        for(unsigned k = 0; k<3; ++k)
+        {
+            float t0 = (lo[k]-o[4*k+r])*inv[4*k+r];
+            float t1 = (hi[k]-o[4*k+r])*inv[4*k+r];
+            tn = std::max(std::min(t0, t1), tn);
+            tf = std::min(std::max(t0, t1), tf);
+        }
+        mask |= unsigned(tn <= tf) << r;
+    }
+    return mask;
+#endif
+}
+
+//Moeller-Trumbore test of the rays in mask against the triangle
+//(a, b, c). Rays hitting it within [tmin, tmax] get tmax, u and v
+//updated, their bits are returned.
+inline unsigned ray4_triangle(const float *o, const float *d, unsigned mask,
+                              const float *tmin, float *tmax, float *u, float *v,
+                              const float *a, const float *b, const float *c)
+{
+    float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    float e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+#ifdef GLP_SIMD_SSE
+    __m128 dx = _mm_loadu_ps(d), dy = _mm_loadu_ps(d+4), dz = _mm_loadu_ps(d+8);
+    __m128 e1x = _mm_set1_ps(e1[0]), e1y = _mm_set1_ps(e1[1]), e1z = _mm_set1_ps(e1[2]);
+    __m128 e2x = _mm_set1_ps(e2[0]), e2y = _mm_set1_ps(e2[1]), e2z = _mm_set1_ps(e2[2]);
+    //p = d x e2
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 sx = _mm_sub_ps(_mm_loadu_ps(o), _mm_set1_ps(a[0]));
+    __m128 sy = _mm_sub_ps(_mm_loadu_ps(o+4), _mm_set1_ps(a[1]));
+    __m128 sz = _mm_sub_ps(_mm_loadu_ps(o+8), _mm_set1_ps(a[2]));
+    __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+    //q = s x e1
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+    __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_cmpneq_ps(det, zero);
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(uu, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(vv, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, _mm_loadu_ps(tmin)));
+    __m128 tm = _mm_loadu_ps(tmax);
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, tm));
+    mask &= unsigned(_mm_movemask_ps(hit));
+    if(mask)
+    {
+        float tt[4], ut[4], vt[4];
+        _mm_storeu_ps(tt, t);
+        _mm_storeu_ps(ut, uu);
+        _mm_storeu_ps(vt, vv);
+        for(unsigned r = 0; r<4; ++r)
+            if(mask & (1u << r))
+            {
+                tmax[r] = tt[r];
+                u[r] = ut[r];
+                v[r] = vt[r];
+            }
+    }
+    return mask;
+#else
+    unsigned res = 0;
+    for(unsigned r = 0; r<4; ++r)
+    {
+        if(!(mask & (1u << r)))
+            continue;
+        float dr[3] = { d[r], d[4+r], d[8+r] };
+        float p[3];
+        cross3(dr, e2, p);
+        float det = dot3(e1, p);
+        if(det == 0)
+            continue;
+        float inv = 1/det;
+        float s[3] = { o[r]-a[0], o[4+r]-a[1], o[8+r]-a[2] };
+        float uu = dot3(s, p)*inv;
+        float q[3];
+        cross3(s, e1, q);
+        float vv = dot3(dr, q)*inv;
+        float t = dot3(e2, q)*inv;
+        if(uu >= 0 && vv >= 0 && uu+vv <= 1 && t >= tmin[r] && t < tmax[r])
+        {
+            tmax[r] = t;
+            u[r] = uu;
+            v[r] = vv;
+            res |= 1u << r;
+        }
+    }
+    return res;
+#endif
+}
+
+//appends first+b to visible for every bit b set in the lower width bits
+//of mask, branch free. Writes one slot past the result per clear bit.
+inline size_t compact_indices(unsigned mask, unsigned width, unsigned first,
+                              unsigned *visible, size_t count)
+{
+    for(unsigned b = 0; b<width; ++b)
+    {
+        visible[count] = first+b;
+        count += (mask>>b)&1;
+    }
+    return count;
+}
+
+//culls n objects in structure of arrays layout against 6 planes
+//(nx, ny, nz, d). For plane p the tested point is (src[p][0][i],
+//src[p][1][i], src[p][2][i]), the object is outside if
+//dot(n, point)+d < -r[i] (or < 0 if r is null). Writes base+i of every
+//object inside all planes to visible, which needs room for n indices,
+//and returns their count. Spheres use their centers for all planes,
+//boxes the corner farthest along each plane normal.
+inline size_t cull_planes(const float *planes, const float *const src[6][3],
+                          const float *r, size_t n, unsigned base,
+                          unsigned *visible)
+{
+    size_t i = 0, count = 0;
+#if defined(GLP_SIMD_AVX)
+    for(; i+8<=n; i += 8)
+    {
+        __m256 t = r ? _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r+i))
+                     : _mm256_setzero_ps();
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(unsigned p = 0; p<6; ++p)
+        {
+            const float *pl = planes+4*p;
+            __m256 s = _mm256_add_ps(_mm256_set1_ps(pl[3]),
+                         _mm256_mul_ps(_mm256_set1_ps(pl[0]), _mm256_loadu_ps(src[p][0]+i)));
+            s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(pl[1]), _mm256_loadu_ps(src[p][1]+i)));
+            s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(pl[2]), _mm256_loadu_ps(src[p][2]+i)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(s, t, _CMP_GE_OQ));
+        }
+        count = compact_indices(_mm256_movemask_ps(inside), 8,
+                                base+unsigned(i), visible, count);
+    }
+#endif
+#ifdef GLP_SIMD_SSE
+    for(; i+4<=n; i += 4)
+    {
+        __m128 t = r ? _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r+i))
+                     : _mm_setzero_ps();
+        __m128 inside = _mm_cmpeq_ps(t, t);
+        for(unsigned p = 0; p<6; ++p)
+        {
+            const float *pl = planes+4*p;
+            __m128 s = _mm_add_ps(_mm_set1_ps(pl[3]),
+                         _mm_mul_ps(_mm_set1_ps(pl[0]), _mm_loadu_ps(src[p][0]+i)));
+            s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(pl[1]), _mm_loadu_ps(src[p][1]+i)));
+            s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(pl[2]), _mm_loadu_ps(src[p][2]+i)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(s, t));
+        }
+        count = compact_indices(_mm_movemask_ps(inside), 4,
+                                base+unsigned(i), visible, count);
+    }
+#endif
+    for(; i<n; ++i)
+    {
+        float t = r ? -r[i] : 0.0f;
+        unsigned inside = 1;
+        for(unsigned p = 0; p<6; ++p)
+        {
+            const float *pl = planes+4*p;
+            float s = pl[0]*src[p][0][i] + pl[1]*src[p][1][i] + pl[2]*src[p][2][i] + pl[3];
+            inside &= s >= t;
+        }
+        visible[count] = base+unsigned(i);
+        count += inside;
+    }
+    return count;
+}
+
+
+//depth spans of the occlusion rasterizer: row[i] = min(row[i], z0+zx*i)
+//for the pixels i < n where all three edge functions e0[k]+ex[k]*i are
+//non negative
+inline void depth_span(float *row, unsigned n, const float *ex, const float *e0,
+                       float zx, float z0)
+{
+    unsigned i = 0;
+#if defined(GLP_SIMD_AVX)
+    {
+        const __m256 step = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 a[3], b[3];
+        for(unsigned k = 0; k<3; ++k)
+        {
+            a[k] = _mm256_set1_ps(ex[k]);
+            b[k] = _mm256_set1_ps(e0[k]);
+        }
+        const __m256 za = _mm256_set1_ps(zx), zb = _mm256_set1_ps(z0);
+        for(; i+8<=n; i += 8)
+        {
+            __m256 x = _mm256_add_ps(_mm256_set1_ps(float(i)), step);
+            __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a[0], x), b[0]), zero, _CMP_GE_OQ);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a[1], x), b[1]), zero, _CMP_GE_OQ));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a[2], x), b[2]), zero, _CMP_GE_OQ));
+            __m256 d = _mm256_loadu_ps(row+i);
+            __m256 z = _mm256_min_ps(d, _mm256_add_ps(_mm256_mul_ps(za, x), zb));
+            _mm256_storeu_ps(row+i, _mm256_blendv_ps(d, z, inside));
+        }
+    }
+#endif
+#ifdef GLP_SIMD_SSE
+    {
+        const __m128 step = _mm_setr_ps(0, 1, 2, 3);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 a[3], b[3];
+        for(unsigned k = 0; k<3; ++k)
+        {
+            a[k] = _mm_set1_ps(ex[k]);
+            b[k] = _mm_set1_ps(e0[k]);
+        }
+        const __m128 za = _mm_set1_ps(zx), zb = _mm_set1_ps(z0);
+        for(; i+4<=n; i += 4)
+        {
+            __m128 x = _mm_add_ps(_mm_set1_ps(float(i)), step);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], x), b[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], x), b[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], x), b[2]), zero));
+            __m128 d = _mm_loadu_ps(row+i);
+            __m128 z = _mm_min_ps(d, _mm_add_ps(_mm_mul_ps(za, x), zb));
+            _mm_storeu_ps(row+i, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, d)));
+        }
+    }
+#endif
+    for(; i<n; ++i)
+    {
+        float x = float(i);
+        bool inside = ex[0]*x+e0[0] >= 0 && ex[1]*x+e0[1] >= 0 && ex[2]*x+e0[2] >= 0;
+        float z = zx*x+z0;
+        if(inside && z < row[i])
+            row[i] = z;
+    }
+}
+
+}
+
+#endif
@@ -32,92 +32,242 @@
 #include <cmath>
 #include <algorithm>
 #include <ostream>
+#include <functional>
 
 #include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
 #include "vector_traits.h"
+#include "MathSimd.h"
+
+//with C++14 the vectors, matrices and the expressions on them can be
+//used in constant expressions, e.g. constexpr Matrix<float,4,4> hud =
+//OrthoMatrix(...). GLP_CONSTANT_EVALUATED() tells the simd dispatch
+//that it runs at compile time and has to use the plain loops instead,
+//without compiler support float products stay runtime only.
+#if defined(__cpp_constexpr) && __cpp_constexpr >= 201304
+    #define GLP_CONSTEXPR constexpr
+#else
+    #define GLP_CONSTEXPR
+#endif
+
+#if defined(__has_builtin)
+    #if __has_builtin(__builtin_is_constant_evaluated)
+        #define GLP_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+    #endif
+#endif
+#if !defined(GLP_CONSTANT_EVALUATED) && !defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 9
+    #define GLP_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#ifndef GLP_CONSTANT_EVALUATED
+    #define GLP_CONSTANT_EVALUATED() false
+#endif
 
 template<class T, unsigned D> class Vector;
+template<class T, unsigned D> class InPlaceVector;
+template<class T, unsigned D> class TemporaryVector;
+
+//vectors backed by contiguous memory that can be handed to the simd kernels
+template<class A>
+struct is_dense_vector { static const bool value = false; };
+
+template<class T, unsigned D>
+struct is_dense_vector< Vector<T,D> > { static const bool value = true; };
+
+template<class T, unsigned D>
+struct is_dense_vector< InPlaceVector<T,D> > { static const bool value = true; };
+
+template<class T, unsigned D>
+struct is_dense_vector< TemporaryVector<T,D> > { static const bool value = true; };
+
+//expression nodes are stored by value inside of other expressions so
+//they can't dangle, actual vectors are stored by reference. Vectors
+//passed as rvalues are copied into a TemporaryVector node instead, so
+//auto e = normalize(a) + b; stays valid after the statement.
+template<class A>
+struct expression_storage { typedef const A type; };
+
+template<class T, unsigned D>
+struct expression_storage< Vector<T,D> > { typedef const Vector<T,D>& type; };
+
+//operands of products are read several times per element, so anything
+//that isn't already in memory gets evaluated once into a temporary
+template<class A>
+struct vector_operand {
+    typedef Vector<typename A::Type, A::Dim> value_type;
+    typedef const value_type type;
+};
+
+template<class T, unsigned D>
+struct vector_operand< Vector<T,D> > {
+    typedef Vector<T,D> value_type;
+    typedef const value_type& type;
+};
+
+template<class T, unsigned D>
+struct vector_operand< InPlaceVector<T,D> > {
+    typedef InPlaceVector<T,D> value_type;
+    typedef const value_type type;
+};
+
+//unrelated pointers can't be ordered at compile time, there only
+//whole objects exist so only the same object overlaps
+inline GLP_CONSTEXPR bool memory_overlaps(const void *b1, const void *e1, const void *b2, const void *e2)
+{
+    if(GLP_CONSTANT_EVALUATED())
+        return b1 == b2;
+    std::less<const void*> less;
+    return less(b1, e2) && less(b2, e1);
+}
 
 //base class for all expression templates
+//aliases(begin, end) tells whether evaluating the expression element by
+//element into [begin, end) could read an element that was already
+//written, overlaps(begin, end) whether it reads that memory at all.
+//Expressions that don't know better are conservative.
 template<class T, unsigned D, class A>
 class VectorExpr {
 public:
-    inline operator const A&() const
+    static const unsigned Dim = D;
+    typedef T Type;
+
+    GLP_CONSTEXPR operator const A&() const
     {
         return *static_cast<const A*>(this);
     }
+
+    GLP_CONSTEXPR bool aliases(const void*, const void*) const { return true; }
+    GLP_CONSTEXPR bool overlaps(const void*, const void*) const { return true; }
 };
 
 //better use macros instead of copy pasting this stuff all over the place
-#define MAKE_VEC_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                   \
-template<class T, unsigned D, class A, class B>                         \
-class NAME : public VectorExpr<T, D, NAME<T, D, A, B> > {               \
-public:                                                                 \
-    NAME(const A& pa, const B& pb) : a(pa), b(pb)   { }                 \
-    inline T operator[](unsigned i) const { return EXPR; }              \
-private:                                                                \
-    const A& a;                                                         \
-    const B& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D, class A, class B>                         \
-inline NAME<T,D,A,B>                                                    \
-FUNCTION(const  VectorExpr<T,D,A> &a, const VectorExpr<T,D,B> &b)       \
-{                                                                       \
-    return NAME<T,D,A,B>(a, b);                                         \
+#define MAKE_VEC_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                     \
+template<class T, unsigned D, class A, class B>                           \
+class NAME : public VectorExpr<T, D, NAME<T, D, A, B> > {                 \
+public:                                                                   \
+    GLP_CONSTEXPR NAME(const A& pa, const B& pb) : a(pa), b(pb)   { }     \
+    GLP_CONSTEXPR T operator[](unsigned i) const { return EXPR; }         \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const  \
+    { return a.aliases(begin, end) || b.aliases(begin, end); }            \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const \
+    { return a.overlaps(begin, end) || b.overlaps(begin, end); }          \
+private:                                                                  \
+    typename expression_storage<A>::type a;                               \
+    typename expression_storage<B>::type b;                               \
+};                                                                        \
+                                                                          \
+template<class T, unsigned D, class A, class B>                           \
+inline GLP_CONSTEXPR NAME<T,D,A,B>                                        \
+FUNCTION(const  VectorExpr<T,D,A> &a, const VectorExpr<T,D,B> &b)         \
+{                                                                         \
+    return NAME<T,D,A,B>(a, b);                                           \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D, class B>                                    \
+inline GLP_CONSTEXPR NAME<T,D,TemporaryVector<T,D>,B>                     \
+FUNCTION(Vector<T,D> &&a, const VectorExpr<T,D,B> &b)                     \
+{                                                                         \
+    return NAME<T,D,TemporaryVector<T,D>,B>(TemporaryVector<T,D>(a), b);  \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D, class A>                                    \
+inline GLP_CONSTEXPR NAME<T,D,A,TemporaryVector<T,D> >                    \
+FUNCTION(const VectorExpr<T,D,A> &a, Vector<T,D> &&b)                     \
+{                                                                         \
+    return NAME<T,D,A,TemporaryVector<T,D> >(a, TemporaryVector<T,D>(b)); \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D>                                             \
+inline GLP_CONSTEXPR NAME<T,D,TemporaryVector<T,D>,TemporaryVector<T,D> > \
+FUNCTION(Vector<T,D> &&a, Vector<T,D> &&b)                                \
+{                                                                         \
+    return NAME<T,D,TemporaryVector<T,D>,TemporaryVector<T,D> >(          \
+        TemporaryVector<T,D>(a), TemporaryVector<T,D>(b));                \
 }
 
-#define MAKE_VEC_SCAL_EXPRESSION(NAME, EXPR, FUNCTION)                  \
-template<class T, unsigned D, class A>                                  \
-class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                  \
-public:                                                                 \
-    NAME(const A& pa, const T& pb) : a(pa), b(pb)   { }                 \
-    inline T operator[](unsigned i) const { return EXPR; }              \
-private:                                                                \
-    const A& a;                                                         \
-    const T& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D, class A>                                  \
-inline NAME<T,D,A>                                                      \
-FUNCTION(const  VectorExpr<T,D,A> &a, const T &b)                       \
-{                                                                       \
-    return NAME<T,D,A>(a, b);                                           \
+#define MAKE_VEC_SCAL_EXPRESSION(NAME, EXPR, FUNCTION)                    \
+template<class T, unsigned D, class A>                                    \
+class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                    \
+public:                                                                   \
+    GLP_CONSTEXPR NAME(const A& pa, const T& pb) : a(pa), b(pb)   { }     \
+    GLP_CONSTEXPR T operator[](unsigned i) const { return EXPR; }         \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const  \
+    { return a.aliases(begin, end); }                                     \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const \
+    { return a.overlaps(begin, end); }                                    \
+private:                                                                  \
+    typename expression_storage<A>::type a;                               \
+    const T b;                                                            \
+};                                                                        \
+                                                                          \
+template<class T, unsigned D, class A>                                    \
+inline GLP_CONSTEXPR NAME<T,D,A>                                          \
+FUNCTION(const  VectorExpr<T,D,A> &a, const T &b)                         \
+{                                                                         \
+    return NAME<T,D,A>(a, b);                                             \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D>                                             \
+inline GLP_CONSTEXPR NAME<T,D,TemporaryVector<T,D> >                      \
+FUNCTION(Vector<T,D> &&a, const T &b)                                     \
+{                                                                         \
+    return NAME<T,D,TemporaryVector<T,D> >(TemporaryVector<T,D>(a), b);   \
 }
 
-#define MAKE_SCAL_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                  \
-template<class T, unsigned D, class A>                                  \
-class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                  \
-public:                                                                 \
-    NAME(const T& pa, const A& pb) : a(pa), b(pb)   { }                 \
-    inline T operator[](unsigned i) const { return EXPR; }              \
-private:                                                                \
-    const T& a;                                                         \
-    const A& b;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D, class A>                                  \
-inline NAME<T,D,A>                                                      \
-FUNCTION(const T &a, const VectorExpr<T,D,A> &b)                        \
-{                                                                       \
-    return NAME<T,D,A>(a, b);                                           \
+#define MAKE_SCAL_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                    \
+template<class T, unsigned D, class A>                                    \
+class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                    \
+public:                                                                   \
+    GLP_CONSTEXPR NAME(const T& pa, const A& pb) : a(pa), b(pb)   { }     \
+    GLP_CONSTEXPR T operator[](unsigned i) const { return EXPR; }         \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const  \
+    { return b.aliases(begin, end); }                                     \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const \
+    { return b.overlaps(begin, end); }                                    \
+private:                                                                  \
+    const T a;                                                            \
+    typename expression_storage<A>::type b;                               \
+};                                                                        \
+                                                                          \
+template<class T, unsigned D, class A>                                    \
+inline GLP_CONSTEXPR NAME<T,D,A>                                          \
+FUNCTION(const T &a, const VectorExpr<T,D,A> &b)                          \
+{                                                                         \
+    return NAME<T,D,A>(a, b);                                             \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D>                                             \
+inline GLP_CONSTEXPR NAME<T,D,TemporaryVector<T,D> >                      \
+FUNCTION(const T &a, Vector<T,D> &&b)                                     \
+{                                                                         \
+    return NAME<T,D,TemporaryVector<T,D> >(a, TemporaryVector<T,D>(b));   \
 }
 
-#define MAKE_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                       \
-template<class T, unsigned D, class A>                                  \
-class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                  \
-public:                                                                 \
-    NAME(const A& pa) : a(pa)   { }                                     \
-    inline T operator[](unsigned i) const { return EXPR; }              \
-private:                                                                \
-    const A& a;                                                         \
-};                                                                      \
-                                                                        \
-template<class T, unsigned D, class A>                                  \
-inline NAME<T,D,A>                                                      \
-FUNCTION(const VectorExpr<T,D,A> &a)                                    \
-{                                                                       \
-    return NAME<T,D,A>(a);                                              \
+#define MAKE_VEC_EXPRESSION(NAME, EXPR, FUNCTION)                         \
+template<class T, unsigned D, class A>                                    \
+class NAME : public VectorExpr<T, D, NAME<T, D, A> > {                    \
+public:                                                                   \
+    GLP_CONSTEXPR NAME(const A& pa) : a(pa)   { }                         \
+    GLP_CONSTEXPR T operator[](unsigned i) const { return EXPR; }         \
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const  \
+    { return a.aliases(begin, end); }                                     \
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const \
+    { return a.overlaps(begin, end); }                                    \
+private:                                                                  \
+    typename expression_storage<A>::type a;                               \
+};                                                                        \
+                                                                          \
+template<class T, unsigned D, class A>                                    \
+inline GLP_CONSTEXPR NAME<T,D,A>                                          \
+FUNCTION(const VectorExpr<T,D,A> &a)                                      \
+{                                                                         \
+    return NAME<T,D,A>(a);                                                \
+}                                                                         \
+                                                                          \
+template<class T, unsigned D>                                             \
+inline GLP_CONSTEXPR NAME<T,D,TemporaryVector<T,D> >                      \
+FUNCTION(Vector<T,D> &&a)                                                 \
+{                                                                         \
+    return NAME<T,D,TemporaryVector<T,D> >(TemporaryVector<T,D>(a));      \
 }
 
 //create actual functions and operators
@@ -137,24 +287,73 @@ MAKE_VEC_VEC_EXPRESSION (EMinExpr,  std::min(a[i],b[i]),  min)
 template<class T, unsigned D, class A>
 class SubVectorExpr : public VectorExpr<T, D, SubVectorExpr<T, D, A> > {
 public:
-    SubVectorExpr(const A& pa, const unsigned& o)
+    GLP_CONSTEXPR SubVectorExpr(const A& pa, const unsigned& o)
         : a(pa), offset(o) { }
-    inline T operator[](unsigned i) const
+    GLP_CONSTEXPR T operator[](unsigned i) const
     {
         return a[i+offset];
     }
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return a.overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return a.overlaps(begin, end);
+    }
 private:
-    const A& a;
+    typename expression_storage<A>::type a;
     const unsigned offset;
 };
 
 template<unsigned D1, class T, unsigned D2, class A>
-inline SubVectorExpr<T,D1,A>
+inline GLP_CONSTEXPR SubVectorExpr<T,D1,A>
 SubVector(const VectorExpr<T,D2,A> &a, const unsigned &o)
 {
     return SubVectorExpr<T,D1,A>(a, o);
 }
 
+template<unsigned D1, class T, unsigned D2>
+inline GLP_CONSTEXPR SubVectorExpr<T,D1,TemporaryVector<T,D2> >
+SubVector(Vector<T,D2> &&a, const unsigned &o)
+{
+    return SubVectorExpr<T,D1,TemporaryVector<T,D2> >(TemporaryVector<T,D2>(a), o);
+}
+
+//element wise evaluation of an expression into memory
+template<class T, unsigned D, class A>
+struct VectorAssignLoop {
+    static GLP_CONSTEXPR void run(T *dst, const A& a)
+    {
+        for(unsigned i = 0; i<D; ++i)
+            dst[i] = a[i];
+    }
+};
+
+//expressions that have a faster way to evaluate specialize this
+//(see MathMatrix.h), alias_safe marks kernels that read all of their
+//input before writing
+template<class T, unsigned D, class A>
+struct VectorAssign : VectorAssignLoop<T, D, A> {
+    static const bool alias_safe = false;
+};
+
+//tag for constructors that skip zero initialization when every
+//element is about to be overwritten anyway
+enum Uninitialized { uninitialized };
+
+//precision policies for rsqrt, norm, abs and normalize:
+//  exact_precision        std::sqrt and a division
+//  refined_precision      reciprocal square root estimate plus one
+//                         Newton-Raphson step, relative error < 5e-7
+//  approximate_precision  the raw estimate, relative error < 3.7e-4
+//The estimates are only used for float with SSE, everything else
+//(and constant evaluation) computes the exact result, as do the calls
+//without a policy.
+enum ExactPrecision { exact_precision };
+enum RefinedPrecision { refined_precision };
+enum ApproximatePrecision { approximate_precision };
+
 //actual vector class
 template<class T, unsigned D>
 class Vector : public VectorExpr<T, D, Vector<T,D> > {
@@ -162,69 +361,75 @@ public:
     static const unsigned Dim = D;
     typedef T Type;
 
-    Vector()
-    {
-        std::fill(data, data+Dim, T());
-    }
+    GLP_CONSTEXPR Vector() : data()
+    { }
 
-    Vector(const T &p1)
+    explicit Vector(Uninitialized)
+    { }
+
+    GLP_CONSTEXPR Vector(const T &p1)
+        : data{p1}
     {
         BOOST_STATIC_ASSERT(Dim==1);
-        data[0] = p1;
     }
 
-    Vector(const T &p1, const T &p2)
+    GLP_CONSTEXPR Vector(const T &p1, const T &p2)
+        : data{p1, p2}
     {
         BOOST_STATIC_ASSERT(Dim==2);
-        data[0] = p1;
-        data[1] = p2;
     }
 
-    Vector(const T &p1, const T &p2, const T &p3)
+    GLP_CONSTEXPR Vector(const T &p1, const T &p2, const T &p3)
+        : data{p1, p2, p3}
     {
         BOOST_STATIC_ASSERT(Dim==3);
-        data[0] = p1;
-        data[1] = p2;
-        data[2] = p3;
     }
 
-    Vector(const T &p1, const T &p2, const T &p3, const T &p4)
+    GLP_CONSTEXPR Vector(const T &p1, const T &p2, const T &p3, const T &p4)
+        : data{p1, p2, p3, p4}
     {
         BOOST_STATIC_ASSERT(Dim==4);
-        data[0] = p1;
-        data[1] = p2;
-        data[2] = p3;
-        data[3] = p4;
     }
 
-    T* raw() {
+    GLP_CONSTEXPR T* raw() {
+        return data;
+    }
+    GLP_CONSTEXPR const T* raw() const {
         return data;
     }
 
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return data != begin && overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return memory_overlaps(data, data+Dim, begin, end);
+    }
+
     
     template<class T2, class A>
-    Vector(const VectorExpr<T2, D, A>& a)
+    GLP_CONSTEXPR Vector(const VectorExpr<T2, D, A>& a) : data()
     {
         const A& ao ( a );
-        for(unsigned i = 0; i<Dim; ++i)
-            data[i] = ao[i];
+        VectorAssign<T,D,A>::run(data, ao);
     }
 
-    T& operator[] (unsigned i) {
+    GLP_CONSTEXPR T& operator[] (unsigned i) {
         return data[i];
     }
-    const T& operator[] (unsigned i) const {
+    GLP_CONSTEXPR const T& operator[] (unsigned i) const {
         return data[i];
     }
 
-    const Vector& operator*=(const T &b)
+    GLP_CONSTEXPR const Vector& operator*=(const T &b)
     {
         for(unsigned i = 0; i<Dim; ++i)
             data[i] *= b;
         return *this;
     }
 
-    const Vector& operator/=(const T &b)
+    GLP_CONSTEXPR const Vector& operator/=(const T &b)
     {
         for(unsigned i = 0; i<Dim; ++i)
             data[i] /= b;
@@ -232,35 +437,52 @@ public:
     }
 
     template<class A>
-    const Vector& operator+=(const VectorExpr<T, D, A>& a)
+    GLP_CONSTEXPR const Vector& operator+=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim))
+            return *this += Vector(ao);
         for(unsigned i = 0; i<Dim; ++i)
             data[i] += ao[i];
         return *this;
     }
 
     template<class A>
-    const Vector& operator-=(const VectorExpr<T, D, A>& a)
+    GLP_CONSTEXPR const Vector& operator-=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim))
+            return *this -= Vector(ao);
         for(unsigned i = 0; i<Dim; ++i)
             data[i] -= ao[i];
         return *this;
     }
 
     template<class A>
-    Vector& operator=(const VectorExpr<T, D, A>& a)
+    GLP_CONSTEXPR Vector& operator=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
-        for(unsigned i = 0; i<Dim; ++i)
-            data[i] = ao[i];
+        if(!VectorAssign<T,D,A>::alias_safe && ao.aliases(data, data+Dim))
+            return *this = Vector(ao);
+        VectorAssign<T,D,A>::run(data, ao);
         return *this;
     }
 
-    Vector& normalize()
+    GLP_CONSTEXPR Vector& normalize()
     {
-        *this /= abs(*this);
+        return normalize(exact_precision);
+    }
+
+    GLP_CONSTEXPR Vector& normalize(ExactPrecision)
+    {
+        *this /= abs(*this, exact_precision);
+        return *this;
+    }
+
+    template<class P>
+    GLP_CONSTEXPR Vector& normalize(P p)
+    {
+        *this *= rsqrt(squared_norm(*this), p);
         return *this;
     }
 private:
@@ -280,6 +502,18 @@ public:
     T* raw() {
         return data;
     }
+    const T* raw() const {
+        return data;
+    }
+
+    GLP_CONSTEXPR bool aliases(const void *begin, const void *end) const
+    {
+        return data != begin && overlaps(begin, end);
+    }
+    GLP_CONSTEXPR bool overlaps(const void *begin, const void *end) const
+    {
+        return memory_overlaps(data, data+Dim, begin, end);
+    }
 
     T& operator[] (unsigned i) {
         return data[i];
@@ -306,6 +540,8 @@ public:
     const InPlaceVector& operator+=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim))
+            return *this += Vector<T,D>(ao);
         for(unsigned i = 0; i<Dim; ++i)
             data[i] += ao[i];
         return *this;
@@ -315,23 +551,44 @@ public:
     const InPlaceVector& operator-=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
+        if(ao.aliases(data, data+Dim))
+            return *this -= Vector<T,D>(ao);
         for(unsigned i = 0; i<Dim; ++i)
             data[i] -= ao[i];
         return *this;
     }
 
+    //copies elements, the pointer itself can't be reseated
+    InPlaceVector& operator=(const InPlaceVector& a)
+    {
+        return operator=<InPlaceVector>(a);
+    }
+
     template<class A>
     InPlaceVector& operator=(const VectorExpr<T, D, A>& a)
     {
         const A& ao ( a );
-        for(unsigned i = 0; i<Dim; ++i)
-            data[i] = ao[i];
+        if(!VectorAssign<T,D,A>::alias_safe && ao.aliases(data, data+Dim))
+            return *this = Vector<T,D>(ao);
+        VectorAssign<T,D,A>::run(data, ao);
         return *this;
     }
 
     InPlaceVector& normalize()
     {
-        *this /= abs(*this);
+        return normalize(exact_precision);
+    }
+
+    InPlaceVector& normalize(ExactPrecision)
+    {
+        *this /= abs(*this, exact_precision);
+        return *this;
+    }
+
+    template<class P>
+    InPlaceVector& normalize(P p)
+    {
+        *this *= rsqrt(squared_norm(*this), p);
         return *this;
     }
 private:
@@ -344,15 +601,116 @@ InPlaceVector<T,D> MakeVector(T *const p)
     return InPlaceVector<T,D>(p);
 }
 
+//owns a vector that was an rvalue operand of an expression, it is a
+//copy so it never aliases the destination
+template<class T, unsigned D>
+class TemporaryVector : public VectorExpr<T, D, TemporaryVector<T,D> > {
+public:
+    explicit GLP_CONSTEXPR TemporaryVector(const Vector<T,D>& a) : v(a)
+    { }
+
+    GLP_CONSTEXPR const T* raw() const {
+        return v.raw();
+    }
+
+    GLP_CONSTEXPR const T& operator[] (unsigned i) const {
+        return v[i];
+    }
+
+    GLP_CONSTEXPR bool aliases(const void*, const void*) const { return false; }
+    GLP_CONSTEXPR bool overlaps(const void*, const void*) const { return false; }
+private:
+    Vector<T,D> v;
+};
+
 template<class T, unsigned D, class A>
-inline Vector<T, D> eval(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR Vector<T, D> eval(const VectorExpr<T, D, A>& a)
 {
     return Vector<T, D>(a);
 }
 
+//kernels behind the reductions, the dense float specializations
+//forward normalize to MathSimd.h. Dot and cross products stay scalar
+//expressions, which beat the simd versions for single vectors.
+template<class T, unsigned D, bool DENSE>
+struct VectorKernel {
+    template<class A, class B>
+    static GLP_CONSTEXPR T dot(const A& a, const B& b)
+    {
+        T res = 0;
+        for(unsigned i = 0; i<D; ++i)
+            res += a[i]*b[i];
+        return res;
+    }
+
+    template<class A, class B>
+    static GLP_CONSTEXPR Vector<T, 3> cross(const A& a, const B& b)
+    {
+        return Vector<T, 3>(a[1]*b[2]-a[2]*b[1], a[2]*b[0]-a[0]*b[2], a[0]*b[1]-a[1]*b[0]);
+    }
+
+    template<class A>
+    static GLP_CONSTEXPR Vector<T, D> normalize(const A& a, ExactPrecision)
+    {
+        return eval(a/std::sqrt(dot(a, a)));
+    }
+
+    template<class A, class P>
+    static GLP_CONSTEXPR Vector<T, D> normalize(const A& a, P p)
+    {
+        return eval(a*rsqrt(dot(a, a), p));
+    }
+};
+
+template<>
+struct VectorKernel<float, 4, true> : VectorKernel<float, 4, false> {
+    template<class A>
+    static GLP_CONSTEXPR Vector<float, 4> normalize(const A& a, ExactPrecision)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return VectorKernel<float, 4, false>::normalize(a, exact_precision);
+        Vector<float, 4> res(uninitialized);
+        simd::normalize4(a.raw(), res.raw());
+        return res;
+    }
+
+    template<class A, class P>
+    static GLP_CONSTEXPR Vector<float, 4> normalize(const A& a, P)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return VectorKernel<float, 4, false>::normalize(a, exact_precision);
+        Vector<float, 4> res(uninitialized);
+        simd::normalize4(a.raw(), res.raw(), boost::is_same<P, RefinedPrecision>::value);
+        return res;
+    }
+};
+
+template<>
+struct VectorKernel<float, 3, true> : VectorKernel<float, 3, false> {
+    template<class A>
+    static GLP_CONSTEXPR Vector<float, 3> normalize(const A& a, ExactPrecision)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return VectorKernel<float, 3, false>::normalize(a, exact_precision);
+        Vector<float, 3> res(uninitialized);
+        simd::normalize3(a.raw(), res.raw());
+        return res;
+    }
+
+    template<class A, class P>
+    static GLP_CONSTEXPR Vector<float, 3> normalize(const A& a, P)
+    {
+        if(GLP_CONSTANT_EVALUATED())
+            return VectorKernel<float, 3, false>::normalize(a, exact_precision);
+        Vector<float, 3> res(uninitialized);
+        simd::normalize3(a.raw(), res.raw(), boost::is_same<P, RefinedPrecision>::value);
+        return res;
+    }
+};
+
 //"reduction" functions that don't return expression templates
 template<class T, unsigned D, class A>
-inline T sum(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR T sum(const VectorExpr<T, D, A>& a)
 {
     const A& ao ( a );
     T res = 0;
@@ -362,48 +720,114 @@ inline T sum(const VectorExpr<T, D, A>& a)
 }
 
 template<class T, unsigned D, class A, class B>
-inline T dot(const VectorExpr<T, D, A>& a, const VectorExpr<T, D, B>& b)
+inline GLP_CONSTEXPR T dot(const VectorExpr<T, D, A>& a, const VectorExpr<T, D, B>& b)
 {
-    return sum(multiply_elements(a, b));
+    const A& ao ( a );
+    const B& bo ( b );
+    return VectorKernel<T, D,
+        is_dense_vector<A>::value && is_dense_vector<B>::value
+    >::dot(ao, bo);
 }
 
 template<class T, class A, class B>
-inline Vector<T, 3> cross(const VectorExpr<T, 3, A>& a, const VectorExpr<T, 3, B>& b)
+inline GLP_CONSTEXPR Vector<T, 3> cross(const VectorExpr<T, 3, A>& a, const VectorExpr<T, 3, B>& b)
 {
     const A& ao ( a );
     const B& bo ( b );
-    return Vector<T, 3>(ao[1]*bo[2]-ao[2]*bo[1], ao[2]*bo[0]-ao[0]*bo[2], ao[0]*bo[1]-ao[1]*bo[0]);
+    return VectorKernel<T, 3,
+        is_dense_vector<A>::value && is_dense_vector<B>::value
+    >::cross(ao, bo);
 }
 
 template<class T, unsigned D, class A>
-inline T squared_norm(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR T squared_norm(const VectorExpr<T, D, A>& a)
 {
     const A& ao ( a );
-    T res = 0;
-    for(unsigned i = 0; i<D; ++i)
-    {
-        T tmp = ao[i];
-        res += tmp*tmp;
-    }
-    return res;
+    return VectorKernel<T, D, is_dense_vector<A>::value>::dot(ao, ao);
+}
+
+//1/sqrt(x) with the given precision policy
+template<class T>
+inline GLP_CONSTEXPR T rsqrt(T x, ExactPrecision = exact_precision)
+{
+    return 1/std::sqrt(x);
+}
+
+template<class T>
+inline GLP_CONSTEXPR T rsqrt(T x, RefinedPrecision)
+{
+    return 1/std::sqrt(x);
+}
+
+template<class T>
+inline GLP_CONSTEXPR T rsqrt(T x, ApproximatePrecision)
+{
+    return 1/std::sqrt(x);
+}
+
+inline GLP_CONSTEXPR float rsqrt(float x, RefinedPrecision)
+{
+    if(GLP_CONSTANT_EVALUATED())
+        return 1/std::sqrt(x);
+    return simd::rsqrt(x, true);
+}
+
+inline GLP_CONSTEXPR float rsqrt(float x, ApproximatePrecision)
+{
+    if(GLP_CONSTANT_EVALUATED())
+        return 1/std::sqrt(x);
+    return simd::rsqrt(x, false);
+}
+
+//sqrt(x) with the given precision policy, the estimates compute
+//x/sqrt(x) and have to special case 0
+template<class T>
+inline GLP_CONSTEXPR T precision_sqrt(T x, ExactPrecision)
+{
+    return std::sqrt(x);
+}
+
+template<class T, class P>
+inline GLP_CONSTEXPR T precision_sqrt(T x, P p)
+{
+    return x > 0 ? x*rsqrt(x, p) : T(0);
+}
+
+template<class T, unsigned D, class A, class P>
+inline GLP_CONSTEXPR T norm(const VectorExpr<T, D, A>& a, P p)
+{
+    return precision_sqrt(squared_norm(a), p);
 }
 
 template<class T, unsigned D, class A>
-inline T abs(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR T norm(const VectorExpr<T, D, A>& a)
+{
+    return norm(a, exact_precision);
+}
+
+template<class T, unsigned D, class A, class P>
+inline GLP_CONSTEXPR T abs(const VectorExpr<T, D, A>& a, P p)
 {
-    return std::sqrt(squared_norm(a));
+    return norm(a, p);
 }
 
 template<class T, unsigned D, class A>
-inline T norm(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR T abs(const VectorExpr<T, D, A>& a)
 {
-    return std::sqrt(squared_norm(a));
+    return norm(a, exact_precision);
+}
+
+template<class T, unsigned D, class A, class P>
+inline GLP_CONSTEXPR Vector<T,D> normalize(const VectorExpr<T, D, A>& a, P p)
+{
+    const A& ao ( a );
+    return VectorKernel<T, D, is_dense_vector<A>::value>::normalize(ao, p);
 }
 
 template<class T, unsigned D, class A>
-inline Vector<T,D> normalize(const VectorExpr<T, D, A>& a)
+inline GLP_CONSTEXPR Vector<T,D> normalize(const VectorExpr<T, D, A>& a)
 {
-    return eval(a/norm(a));
+    return normalize(a, exact_precision);
 }
 
 template<class T, unsigned D, class A>
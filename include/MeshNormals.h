@@ -0,0 +1,223 @@
+/*
+ * MeshNormals.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * MeshNormals.h computes smooth vertex normals and tangent frames of
+ * indexed triangle meshes in place, for any container of fusion vertices
+ * such as a mapped glp::VertexBuffer. The template arguments are the
+ * attribute indices:
+ *
+ *     vbo.map(GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+ *     GenerateNormals<0,1>(vbo, indices.data(), indices.size());
+ *     GenerateTangents<0,2,1,3>(vbo, indices.data(), indices.size());
+ *     vbo.unmap();
+ *
+ * Every triangle adds its normal to its three vertices, weighted by its
+ * area or by the angle at the vertex. Tangents follow the texture u
+ * direction like MikkTSpace: they are accumulated with the same weights,
+ * made orthogonal to the vertex normal and a 4 component tangent gets
+ * the handedness of the bitangent in w. Vertices that are duplicated at
+ * seams get their own normals, weld positions first (MeshWeld.h) to
+ * smooth across them.
+ *
+ * The corner contributions are computed per triangle in parallel, then
+ * every vertex sums the ones of its triangles (VertexTriangles), so no
+ * two threads write the same vertex and the result doesn't depend on the
+ * thread count.
+ */
+
+#ifndef MESH_NORMALS_H
+#define MESH_NORMALS_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+
+#include "MathVector.h"
+#include "MeshOptimize.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//triangles or vertices per task
+const size_t MeshNormalsGrain = 16384;
+
+//weights of the triangles around a vertex
+enum NormalWeights {
+    AreaWeights,
+    AngleWeights
+};
+
+//unit normal n of the triangle a, b, c and the weights w of its corners
+inline void TriangleCornerWeights(const Vector<float,3> &a, const Vector<float,3> &b,
+                                  const Vector<float,3> &c, NormalWeights weights,
+                                  Vector<float,3> &n, float *w)
+{
+    Vector<float,3> ab = b-a, ac = c-a, bc = c-b;
+    n = cross(ab, ac);
+    float length = std::sqrt(dot(n, n));
+    if(!(length > 0))
+    {
+        n = Vector<float,3>(0, 0, 0);
+        w[0] = w[1] = w[2] = 0;
+        return;
+    }
+    n /= length;
+    if(weights == AreaWeights)
+    {
+        w[0] = w[1] = w[2] = 0.5f*length;
+        return;
+    }
+    //angles from the edge directions
+    float lab = std::sqrt(dot(ab, ab)), lac = std::sqrt(dot(ac, ac)), lbc = std::sqrt(dot(bc, bc));
+    w[0] = std::acos(std::max(-1.0f, std::min(1.0f, dot(ab, ac)/(lab*lac))));
+    w[1] = std::acos(std::max(-1.0f, std::min(1.0f, -dot(ab, bc)/(lab*lbc))));
+    w[2] = std::max(0.0f, 3.14159265f - w[0] - w[1]);
+}
+
+//recomputes attribute N of every vertex from the positions in attribute
+//P and the triangle list indices. Vertices without triangles get 0.
+template<int P, int N, class B, class I>
+void GenerateNormals(B &vertices, const I *indices, size_t count,
+                     NormalWeights weights = AngleWeights, size_t grain = MeshNormalsGrain)
+{
+    StridedVectorArray<const float,3> positions = AttributeArray<P>(vertices);
+    StridedVectorArray<float,3> normals = AttributeArray<N>(vertices);
+    const size_t triangles = count/3;
+
+    std::vector<Vector<float,3> > corners(3*triangles);
+    glp::parallel_for(0, triangles, grain, [&](size_t begin, size_t end) {
+        for(size_t t = begin; t<end; ++t)
+        {
+            Vector<float,3> n;
+            float w[3];
+            TriangleCornerWeights(positions[indices[3*t]], positions[indices[3*t+1]],
+                                  positions[indices[3*t+2]], weights, n, w);
+            for(unsigned k = 0; k<3; ++k)
+                corners[3*t+k] = n*w[k];
+        }
+    });
+
+    VertexTriangles adjacency(indices, 3*triangles, positions.size());
+    glp::parallel_for(0, positions.size(), grain, [&](size_t begin, size_t end) {
+        for(size_t v = begin; v<end; ++v)
+        {
+            Vector<float,3> sum(0, 0, 0);
+            for(unsigned a = adjacency.offsets[v]; a<adjacency.offsets[v+1]; ++a)
+            {
+                //triangles using v twice are degenerate and add 0
+                unsigned t = adjacency.triangles[a];
+                unsigned k = size_t(indices[3*t]) == v ? 0 : size_t(indices[3*t+1]) == v ? 1 : 2;
+                sum += corners[3*t+k];
+            }
+            float length = std::sqrt(dot(sum, sum));
+            normals[v] = length > 0 ? Vector<float,3>(sum/length) : sum;
+        }
+    });
+}
+
+//recomputes the tangents in attribute T (3 or 4 components) from the
+//positions P, texture coordinates UV and the normals N of the vertices
+template<int P, int UV, int N, int T, class B, class I>
+void GenerateTangents(B &vertices, const I *indices, size_t count,
+                      NormalWeights weights = AngleWeights, size_t grain = MeshNormalsGrain)
+{
+    StridedVectorArray<const float,3> positions = AttributeArray<P>(vertices);
+    StridedVectorArray<const float,2> uvs = AttributeArray<UV>(vertices);
+    StridedVectorArray<const float,3> normals = AttributeArray<N>(vertices);
+    auto tangents = AttributeArray<T>(vertices);
+    typedef decltype(tangents) tangent_array;
+    BOOST_STATIC_ASSERT((boost::is_same<typename tangent_array::value_type, float>::value));
+    BOOST_STATIC_ASSERT(tangent_array::Dim == 3 || tangent_array::Dim == 4);
+    const size_t triangles = count/3;
+
+    //weighted tangent and bitangent of every triangle
+    std::vector<Vector<float,3> > frames(2*triangles);
+    std::vector<Vector<float,3> > corner_weights(triangles);
+    glp::parallel_for(0, triangles, grain, [&](size_t begin, size_t end) {
+        for(size_t t = begin; t<end; ++t)
+        {
+            const I *v = indices+3*t;
+            Vector<float,3> a = positions[v[0]], b = positions[v[1]], c = positions[v[2]];
+            Vector<float,2> ta = uvs[v[0]], tb = uvs[v[1]], tc = uvs[v[2]];
+            Vector<float,3> n;
+            float w[3];
+            TriangleCornerWeights(a, b, c, weights, n, w);
+            corner_weights[t] = Vector<float,3>(w[0], w[1], w[2]);
+
+            Vector<float,3> e1 = b-a, e2 = c-a;
+            float du1 = tb[0]-ta[0], dv1 = tb[1]-ta[1], du2 = tc[0]-ta[0], dv2 = tc[1]-ta[1];
+            float det = du1*dv2 - du2*dv1;
+            //degenerate texture coordinates add nothing
+            if(!(det != 0))
+            {
+                frames[2*t] = frames[2*t+1] = Vector<float,3>(0, 0, 0);
+                continue;
+            }
+            //directions of u and v, only the sign of 1/det matters
+            float sign = det < 0 ? -1.0f : 1.0f;
+            Vector<float,3> s = (e1*dv2 - e2*dv1)*sign, u = (e2*du1 - e1*du2)*sign;
+            float sl = std::sqrt(dot(s, s)), ul = std::sqrt(dot(u, u));
+            frames[2*t] = sl > 0 ? Vector<float,3>(s/sl) : s;
+            frames[2*t+1] = ul > 0 ? Vector<float,3>(u/ul) : u;
+        }
+    });
+
+    VertexTriangles adjacency(indices, 3*triangles, positions.size());
+    glp::parallel_for(0, positions.size(), grain, [&](size_t begin, size_t end) {
+        for(size_t v = begin; v<end; ++v)
+        {
+            Vector<float,3> t(0, 0, 0), b(0, 0, 0);
+            for(unsigned a = adjacency.offsets[v]; a<adjacency.offsets[v+1]; ++a)
+            {
+                unsigned f = adjacency.triangles[a];
+                unsigned k = size_t(indices[3*f]) == v ? 0 : size_t(indices[3*f+1]) == v ? 1 : 2;
+                t += frames[2*f]*corner_weights[f][k];
+                b += frames[2*f+1]*corner_weights[f][k];
+            }
+            Vector<float,3> n = normals[v];
+            //Gram-Schmidt against the normal, any perpendicular if the
+            //texture coordinates gave no direction
+            t -= n*dot(n, t);
+            float length = std::sqrt(dot(t, t));
+            if(!(length > 1e-20f))
+            {
+                t = std::abs(n[0]) < 0.9f ? Vector<float,3>(1, 0, 0) : Vector<float,3>(0, 1, 0);
+                t -= n*dot(n, t);
+                length = std::sqrt(dot(t, t));
+            }
+            t /= length;
+            float *out = tangents.ptr(v);
+            out[0] = t[0];
+            out[1] = t[1];
+            out[2] = t[2];
+            if(tangent_array::Dim == 4)
+                out[tangent_array::Dim-1] = dot(cross(n, t), b) < 0 ? -1.0f : 1.0f;
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * MeshOptimize.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * MeshOptimize.h reorders indexed triangle lists for the GPU, usually in
+ * this order:
+ *
+ *     OptimizeVertexCache(indices, count, vertices, indices);
+ *     OptimizeOverdraw(indices, count, AttributeArray<0>(mesh), indices);
+ *     unique = OptimizeVertexFetch(indices, count, vertices, remap);
+ *     RemapVertices(mesh.data(), vertices, remap, optimized);
+ *
+ * OptimizeVertexCache sorts the triangles for the post transform vertex
+ * cache with Tipsify (Sander, Nehab and Barczak: Fast Triangle
+ * Reordering for Vertex Locality and Reduced Overdraw). The vertices of
+ * a triangle keep their order, so the winding does not change.
+ * OptimizeOverdraw splits the result into clusters where the simulated
+ * cache starts cold or the miss rate drops close to the average, then
+ * draws clusters on the outside of the mesh facing away from its center
+ * first, since those usually occlude the others from any direction.
+ * OptimizeVertexFetch numbers the vertices in order of first use so the
+ * vertex fetch walks memory linearly.
+ *
+ * AnalyzeVertexCache reports the average cache miss ratio per triangle
+ * (ACMR, 0.5 to 3) and per vertex (ATVR, at least 1) of a FIFO cache.
+ * glp::PackedIndexBuffer (GLVertexBuffer.h) stores the result with the
+ * smallest index type for the vertex count.
+ */
+
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "MathVector.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//entries of the simulated FIFO post transform vertex cache
+const unsigned VertexCacheSize = 16;
+
+//overdraw clusters end once their miss rate is within this factor of
+//the average, larger values give more clusters and more cache misses
+const float OverdrawThreshold = 1.05f;
+
+//vertices per task in RemapVertices
+const size_t RemapVerticesGrain = 16384;
+
+//indices per task when building VertexTriangles
+const size_t VertexTrianglesGrain = 65536;
+
+struct VertexCacheStats {
+    //transformed vertices per triangle
+    double acmr;
+    //transformed vertices per referenced vertex
+    double atvr;
+};
+
+//FIFO cache simulation, stamps[v] is the time v entered the cache
+struct VertexCacheSimulation {
+    VertexCacheSimulation(size_t vertices, unsigned size)
+        : stamps(vertices, 0), time(size+1), cache(size)
+    { }
+
+    //true if v had to be transformed
+    bool miss(size_t v)
+    {
+        if(time-stamps[v] <= cache)
+            return false;
+        stamps[v] = time++;
+        return true;
+    }
+
+    void reset()
+    {
+        time += cache;
+    }
+
+    std::vector<size_t> stamps;
+    size_t time;
+    size_t cache;
+};
+
+template<class I>
+VertexCacheStats AnalyzeVertexCache(const I *indices, size_t count, size_t vertices,
+                                    unsigned cache = VertexCacheSize)
+{
+    VertexCacheSimulation sim(vertices, cache);
+    std::vector<bool> used(vertices, false);
+    size_t misses = 0, unique = 0;
+    for(size_t i = 0; i<count; ++i)
+    {
+        misses += sim.miss(indices[i]);
+        if(!used[indices[i]])
+        {
+            used[indices[i]] = true;
+            ++unique;
+        }
+    }
+    VertexCacheStats stats;
+    stats.acmr = count ? double(misses)/double(count/3) : 0.0;
+    stats.atvr = unique ? double(misses)/double(unique) : 0.0;
+    return stats;
+}
+
+//triangles using each vertex, those of v are triangles[offsets[v]] to
+//triangles[offsets[v+1]-1] in increasing order
+struct VertexTriangles {
+    template<class I>
+    VertexTriangles(const I *indices, size_t count, size_t vertices,
+                    size_t grain = VertexTrianglesGrain)
+        : offsets(vertices+1, 0), triangles(count)
+    {
+        std::vector<std::atomic<unsigned> > fill(vertices);
+        glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+                fill[indices[i]].fetch_add(1, std::memory_order_relaxed);
+        });
+        for(size_t v = 0; v<vertices; ++v)
+        {
+            offsets[v+1] = offsets[v] + fill[v].load(std::memory_order_relaxed);
+            fill[v].store(offsets[v], std::memory_order_relaxed);
+        }
+        glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+                triangles[fill[indices[i]].fetch_add(1, std::memory_order_relaxed)] = unsigned(i/3);
+        });
+        //the order of the atomic fill depends on the threads
+        glp::parallel_for(0, vertices, grain, [&](size_t begin, size_t end) {
+            for(size_t v = begin; v<end; ++v)
+                std::sort(triangles.begin()+offsets[v], triangles.begin()+offsets[v+1]);
+        });
+    }
+
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> triangles;
+};
+
+//Tipsify, out may be indices
+template<class I>
+void OptimizeVertexCache(const I *indices, size_t count, size_t vertices, I *out,
+                         unsigned cache = VertexCacheSize)
+{
+    VertexTriangles adjacency(indices, count, vertices);
+    //triangles not emitted yet per vertex
+    std::vector<unsigned> live(vertices);
+    for(size_t v = 0; v<vertices; ++v)
+        live[v] = adjacency.offsets[v+1]-adjacency.offsets[v];
+    std::vector<size_t> stamps(vertices, 0);
+    std::vector<bool> emitted(count/3, false);
+    std::vector<unsigned> dead_ends, candidates;
+    std::vector<I> result;
+    result.reserve(count);
+    size_t time = cache+1, cursor = 0;
+
+    size_t fan = 0;
+    while(fan < vertices && live[fan] == 0)
+        ++fan;
+    while(fan < vertices)
+    {
+        candidates.clear();
+        for(unsigned a = adjacency.offsets[fan]; a<adjacency.offsets[fan+1]; ++a)
+        {
+            unsigned t = adjacency.triangles[a];
+            if(emitted[t])
+                continue;
+            emitted[t] = true;
+            for(unsigned k = 0; k<3; ++k)
+            {
+                I v = indices[3*t+k];
+                result.push_back(v);
+                dead_ends.push_back(unsigned(v));
+                candidates.push_back(unsigned(v));
+                --live[v];
+                if(time-stamps[v] > cache)
+                    stamps[v] = time++;
+            }
+        }
+
+        //the candidate that stays in the cache while its remaining
+        //triangles are emitted and entered it the earliest
+        size_t best = vertices;
+        size_t priority = 0;
+        for(size_t c = 0; c<candidates.size(); ++c)
+        {
+            unsigned v = candidates[c];
+            if(live[v] == 0)
+                continue;
+            size_t p = 1;
+            if(time-stamps[v] + 2*live[v] <= cache)
+                p = time-stamps[v] + 1;
+            if(p > priority)
+            {
+                priority = p;
+                best = v;
+            }
+        }
+        //dead end: recently used vertices first, then any in order
+        while(best == vertices && !dead_ends.empty())
+        {
+            unsigned v = dead_ends.back();
+            dead_ends.pop_back();
+            if(live[v] > 0)
+                best = v;
+        }
+        while(best == vertices && cursor < vertices)
+        {
+            if(live[cursor] > 0)
+                best = cursor;
+            ++cursor;
+        }
+        fan = best;
+    }
+    std::copy(result.begin(), result.end(), out);
+}
+
+//clusters the triangles of a cache optimized list and sorts them to
+//reduce overdraw, out may be indices
+template<class I, class TP>
+void OptimizeOverdraw(const I *indices, size_t count, const StridedVectorArray<TP,3> &positions,
+                      I *out, float threshold = OverdrawThreshold, unsigned cache = VertexCacheSize)
+{
+    const size_t triangles = count/3;
+    if(triangles == 0)
+        return;
+    VertexCacheSimulation sim(positions.size(), cache);
+
+    //hard boundaries where the cache starts over
+    std::vector<size_t> hard;
+    for(size_t t = 0; t<triangles; ++t)
+    {
+        unsigned misses = 0;
+        for(unsigned k = 0; k<3; ++k)
+            misses += sim.miss(indices[3*t+k]);
+        if(t == 0 || misses == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangles);
+
+    //soft boundaries once a cluster has amortized its cold cache
+    std::vector<size_t> clusters;
+    for(size_t h = 0; h+1<hard.size(); ++h)
+    {
+        size_t begin = hard[h], end = hard[h+1];
+        sim.reset();
+        size_t misses = 0;
+        for(size_t t = begin; t<end; ++t)
+            for(unsigned k = 0; k<3; ++k)
+                misses += sim.miss(indices[3*t+k]);
+        double limit = threshold*double(misses)/double(end-begin);
+
+        sim.reset();
+        size_t start = begin;
+        misses = 0;
+        clusters.push_back(begin);
+        for(size_t t = begin; t+1<end; ++t)
+        {
+            for(unsigned k = 0; k<3; ++k)
+                misses += sim.miss(indices[3*t+k]);
+            if(double(misses) <= limit*double(t+1-start))
+            {
+                clusters.push_back(t+1);
+                start = t+1;
+                misses = 0;
+                sim.reset();
+            }
+        }
+    }
+    clusters.push_back(triangles);
+
+    //area weighted centroids and normals
+    std::vector<Vector<float,3> > centroids(clusters.size()-1), normals(clusters.size()-1);
+    Vector<float,3> center(0, 0, 0);
+    float area = 0;
+    for(size_t c = 0; c+1<clusters.size(); ++c)
+    {
+        Vector<float,3> centroid(0, 0, 0), normal(0, 0, 0);
+        float cluster_area = 0;
+        for(size_t t = clusters[c]; t<clusters[c+1]; ++t)
+        {
+            Vector<float,3> p[3];
+            for(unsigned k = 0; k<3; ++k)
+            {
+                const TP *v = positions.ptr(indices[3*t+k]);
+                p[k] = Vector<float,3>(float(v[0]), float(v[1]), float(v[2]));
+            }
+            Vector<float,3> n = cross(p[1]-p[0], p[2]-p[0]);
+            float a = std::sqrt(dot(n, n));
+            centroid += (p[0]+p[1]+p[2])*(a/3);
+            normal += n;
+            cluster_area += a;
+        }
+        center += centroid;
+        area += cluster_area;
+        centroids[c] = cluster_area > 0 ? Vector<float,3>(centroid/cluster_area) : centroid;
+        normals[c] = normal;
+    }
+    if(area > 0)
+        center /= area;
+
+    std::vector<std::pair<float, size_t> > order(clusters.size()-1);
+    for(size_t c = 0; c<order.size(); ++c)
+    {
+        float length = std::sqrt(dot(normals[c], normals[c]));
+        float facing = length > 0 ? dot(centroids[c]-center, normals[c])/length : 0.0f;
+        order[c] = std::make_pair(-facing, c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<I> result;
+    result.reserve(triangles*3);
+    for(size_t o = 0; o<order.size(); ++o)
+    {
+        size_t c = order[o].second;
+        result.insert(result.end(), indices+3*clusters[c], indices+3*clusters[c+1]);
+    }
+    std::copy(result.begin(), result.end(), out);
+}
+
+//numbers the vertices in order of first use in indices and rewrites
+//them. remap[v] becomes the new index of vertex v or ~0u if it is not
+//used. Returns the number of used vertices.
+template<class I>
+size_t OptimizeVertexFetch(I *indices, size_t count, size_t vertices, unsigned *remap)
+{
+    std::fill(remap, remap+vertices, ~0u);
+    unsigned next = 0;
+    for(size_t i = 0; i<count; ++i)
+    {
+        unsigned &r = remap[indices[i]];
+        if(r == ~0u)
+            r = next++;
+        indices[i] = I(r);
+    }
+    return next;
+}
+
+//out[remap[v]] = in[v] for the vertices that are used
+template<class V>
+void RemapVertices(const V *in, size_t vertices, const unsigned *remap, V *out,
+                   size_t grain = RemapVerticesGrain)
+{
+    glp::parallel_for(0, vertices, grain, [=](size_t begin, size_t end) {
+        for(size_t v = begin; v<end; ++v)
+            if(remap[v] != ~0u)
+                out[remap[v]] = in[v];
+    });
+}
+
+#endif
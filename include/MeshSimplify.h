@@ -0,0 +1,482 @@
+/*
+ * MeshSimplify.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * MeshSimplify.h builds levels of detail for indexed triangle meshes and
+ * picks one per instance every frame.
+ *
+ * SimplifyMesh collapses edges ordered by quadric error (Garland and
+ * Heckbert: Surface Simplification Using Quadric Error Metrics). A vertex
+ * always collapses onto a neighbour, so no vertices are created and all
+ * levels index the same vertex buffer. Border vertices only move along
+ * the border, vertices on attribute seams (several vertices at the same
+ * position) stay where they are so the seams don't tear, and collapses
+ * that would flip a triangle are skipped. An optional cost functor adds
+ * an attribute term, see AttributeDistance.
+ *
+ * BuildLodChain stores the levels one after another in one index array
+ * to be uploaded to one glp::IndexBuffer, level l is drawn with
+ * vao.draw(GL_TRIANGLES, chain.offsets[l], chain.offsets[l+1]). Chains of
+ * different meshes are independent and can be built in parallel:
+ *
+ *     glp::TaskGroup group;
+ *     for(size_t m = 0; m<meshes.size(); ++m)
+ *         group.run([&, m]() { chains[m] = BuildLodChain(...); });
+ *     group.wait();
+ *
+ * SelectLods projects the bounding spheres of all instances of a mesh
+ * with the scale of a FrustumMatrix and picks the coarsest level whose
+ * error stays below a number of pixels.
+ */
+
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "MathVector.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+#include "VectorArray.h"
+
+//levels of BuildLodChain including the original mesh
+const unsigned LodLevels = 5;
+
+//fraction of the triangles every level keeps of the previous one
+const float LodReduction = 0.5f;
+
+//weight of the planes that keep borders in place
+const double SimplifyBorderWeight = 10.0;
+
+//instances per task in SelectLods
+const size_t SelectLodsGrain = 16384;
+
+//sum of squared distances to planes, p^T A p + 2 b.p + c with the
+//symmetric A stored as a00 a01 a02 a11 a12 a22
+struct Quadric {
+    Quadric()
+    {
+        std::fill(q, q+10, 0.0);
+        weight = 0;
+    }
+
+    //the plane n.p + d = 0 with unit normal n
+    Quadric(const Vector<double,3> &n, double d, double w)
+    {
+        q[0] = w*n[0]*n[0]; q[1] = w*n[0]*n[1]; q[2] = w*n[0]*n[2];
+        q[3] = w*n[1]*n[1]; q[4] = w*n[1]*n[2]; q[5] = w*n[2]*n[2];
+        q[6] = w*n[0]*d; q[7] = w*n[1]*d; q[8] = w*n[2]*d;
+        q[9] = w*d*d;
+        weight = w;
+    }
+
+    Quadric& operator+=(const Quadric &o)
+    {
+        for(unsigned i = 0; i<10; ++i)
+            q[i] += o.q[i];
+        weight += o.weight;
+        return *this;
+    }
+
+    //mean squared distance of p to the planes
+    double error(const Vector<double,3> &p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double e = q[0]*x*x + q[3]*y*y + q[5]*z*z
+                 + 2*(q[1]*x*y + q[2]*x*z + q[4]*y*z)
+                 + 2*(q[6]*x + q[7]*y + q[8]*z) + q[9];
+        return weight > 0 ? std::max(e, 0.0)/weight : 0.0;
+    }
+
+    double q[10];
+    double weight;
+};
+
+//attribute term of the collapse cost: weight times the squared
+//distance of the attributes of the two vertices
+template<class TA, unsigned DA>
+struct AttributeDistance {
+    AttributeDistance(const StridedVectorArray<TA,DA> &a, float w)
+        : attributes(a), weight(w)
+    { }
+
+    float operator()(unsigned u, unsigned v) const
+    {
+        const TA *a = attributes.ptr(u), *b = attributes.ptr(v);
+        float d2 = 0;
+        for(unsigned d = 0; d<DA; ++d)
+            d2 += (float(a[d])-float(b[d]))*(float(a[d])-float(b[d]));
+        return weight*d2;
+    }
+
+    StridedVectorArray<TA,DA> attributes;
+    float weight;
+};
+
+template<class TA, unsigned DA>
+AttributeDistance<TA,DA> MakeAttributeDistance(const StridedVectorArray<TA,DA> &a, float weight)
+{
+    return AttributeDistance<TA,DA>(a, weight);
+}
+
+//no attribute term
+struct NoAttributeDistance {
+    float operator()(unsigned, unsigned) const { return 0; }
+};
+
+//simplifies the triangle list indices towards target indices and writes
+//the result to out, which may be indices. Returns the new index count,
+//error receives the largest distance a vertex moved from the planes of
+//its original triangles. attribute_cost(u, v) is added to the cost of
+//collapsing vertex u onto v.
+template<class I, class TP, class F>
+size_t SimplifyMesh(const I *indices, size_t count, const StridedVectorArray<TP,3> &positions,
+                    size_t target, I *out, float *error, F attribute_cost)
+{
+    const size_t vertices = positions.size();
+    std::vector<Vector<double,3> > p(vertices);
+    for(size_t v = 0; v<vertices; ++v)
+    {
+        const TP *x = positions.ptr(v);
+        p[v] = Vector<double,3>(double(x[0]), double(x[1]), double(x[2]));
+    }
+    std::vector<unsigned> tri(indices, indices+count);
+    size_t triangles = count/3;
+    tri.resize(3*triangles);
+
+    //vertices sharing their position with another used vertex
+    std::vector<bool> locked(vertices, false);
+    {
+        std::vector<unsigned> used(tri);
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+        std::sort(used.begin(), used.end(), [&p](unsigned a, unsigned b) {
+            return p[a][0] < p[b][0] || (p[a][0] == p[b][0] &&
+                   (p[a][1] < p[b][1] || (p[a][1] == p[b][1] && p[a][2] < p[b][2])));
+        });
+        for(size_t i = 1; i<used.size(); ++i)
+            if(p[used[i]][0] == p[used[i-1]][0] && p[used[i]][1] == p[used[i-1]][1] &&
+               p[used[i]][2] == p[used[i-1]][2])
+                locked[used[i]] = locked[used[i-1]] = true;
+    }
+
+    //directed edges sorted by (from, to)
+    std::vector<std::uint64_t> edges;
+    auto edge = [](unsigned a, unsigned b) { return (std::uint64_t(a) << 32) | b; };
+    auto collect_edges = [&]() {
+        edges.clear();
+        for(size_t t = 0; t<triangles; ++t)
+            for(unsigned k = 0; k<3; ++k)
+                edges.push_back(edge(tri[3*t+k], tri[3*t+(k+1)%3]));
+        std::sort(edges.begin(), edges.end());
+    };
+    auto has_edge = [&](unsigned a, unsigned b) {
+        return std::binary_search(edges.begin(), edges.end(), edge(a, b));
+    };
+
+    //plane quadrics weighted by area and border planes perpendicular to
+    //the triangles
+    collect_edges();
+    std::vector<Quadric> quadrics(vertices);
+    std::vector<bool> border(vertices, false);
+    for(size_t t = 0; t<triangles; ++t)
+    {
+        const unsigned *v = &tri[3*t];
+        Vector<double,3> n = cross(p[v[1]]-p[v[0]], p[v[2]]-p[v[0]]);
+        double length = std::sqrt(dot(n, n));
+        if(length == 0)
+            continue;
+        n /= length;
+        Quadric plane(n, -dot(n, p[v[0]]), length*0.5);
+        for(unsigned k = 0; k<3; ++k)
+        {
+            quadrics[v[k]] += plane;
+            unsigned a = v[k], b = v[(k+1)%3];
+            if(has_edge(b, a))
+                continue;
+            border[a] = border[b] = true;
+            Vector<double,3> e = p[b]-p[a];
+            Vector<double,3> m = cross(e, n);
+            double ml = std::sqrt(dot(m, m));
+            if(ml == 0)
+                continue;
+            m /= ml;
+            Quadric side(m, -dot(m, p[a]), dot(e, e)*SimplifyBorderWeight);
+            quadrics[a] += side;
+            quadrics[b] += side;
+        }
+    }
+
+    struct Collapse {
+        double cost;
+        double error;
+        unsigned from, to;
+        bool operator<(const Collapse &o) const
+        {
+            return cost < o.cost || (cost == o.cost && (from < o.from || (from == o.from && to < o.to)));
+        }
+    };
+    std::vector<Collapse> collapses;
+    std::vector<unsigned> remap(vertices), offsets, around;
+    std::vector<bool> touched(vertices);
+    double max_error = 0;
+
+    while(3*triangles > target)
+    {
+        collect_edges();
+        //triangles around every vertex
+        offsets.assign(vertices+1, 0);
+        for(size_t i = 0; i<3*triangles; ++i)
+            ++offsets[tri[i]+1];
+        for(size_t v = 0; v<vertices; ++v)
+            offsets[v+1] += offsets[v];
+        around.resize(3*triangles);
+        {
+            std::vector<unsigned> fill(offsets.begin(), offsets.end()-1);
+            for(size_t i = 0; i<3*triangles; ++i)
+                around[fill[tri[i]]++] = unsigned(i/3);
+        }
+
+        //the cheaper direction of every edge that may collapse
+        collapses.clear();
+        for(size_t e = 0; e<edges.size(); ++e)
+        {
+            unsigned a = unsigned(edges[e] >> 32), b = unsigned(edges[e]);
+            //each undirected edge once
+            if(a > b && has_edge(b, a))
+                continue;
+            Collapse best = { 0, 0, 0, 0 };
+            bool found = false;
+            for(unsigned dir = 0; dir<2; ++dir)
+            {
+                unsigned from = dir ? b : a, to = dir ? a : b;
+                if(locked[from])
+                    continue;
+                //border vertices slide along border edges only
+                if(border[from] && (has_edge(from, to) == has_edge(to, from)))
+                    continue;
+                Quadric q = quadrics[from];
+                q += quadrics[to];
+                Collapse c;
+                c.error = q.error(p[to]);
+                c.cost = c.error + attribute_cost(from, to);
+                c.from = from;
+                c.to = to;
+                if(!found || c < best)
+                    best = c;
+                found = true;
+            }
+            if(found)
+                collapses.push_back(best);
+        }
+        if(collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end());
+
+        //independent collapses in order of cost, until enough triangles
+        //would be removed
+        for(size_t v = 0; v<vertices; ++v)
+            remap[v] = unsigned(v);
+        std::fill(touched.begin(), touched.end(), false);
+        size_t removed = 0, goal = triangles - target/3;
+        for(size_t c = 0; c<collapses.size() && removed < goal; ++c)
+        {
+            const Collapse &col = collapses[c];
+            unsigned u = col.from, v = col.to;
+            if(touched[u] || touched[v])
+                continue;
+            bool flips = false;
+            size_t gone = 0;
+            for(unsigned a = offsets[u]; a<offsets[u+1] && !flips; ++a)
+            {
+                const unsigned *t = &tri[3*around[a]];
+                if(t[0] == v || t[1] == v || t[2] == v)
+                {
+                    ++gone;
+                    continue;
+                }
+                unsigned k = t[0] == u ? 0 : t[1] == u ? 1 : 2;
+                const Vector<double,3> &x = p[t[(k+1)%3]], &y = p[t[(k+2)%3]];
+                Vector<double,3> before = cross(x-p[u], y-p[u]);
+                Vector<double,3> after = cross(x-p[v], y-p[v]);
+                flips = dot(before, after) <= 0;
+            }
+            if(flips)
+                continue;
+            remap[u] = v;
+            quadrics[v] += quadrics[u];
+            max_error = std::max(max_error, col.error);
+            removed += gone;
+            //neighbours keep their triangles until the next pass
+            for(unsigned a = offsets[u]; a<offsets[u+1]; ++a)
+                for(unsigned k = 0; k<3; ++k)
+                    touched[tri[3*around[a]+k]] = true;
+        }
+        if(removed == 0)
+            break;
+
+        size_t kept = 0;
+        for(size_t t = 0; t<triangles; ++t)
+        {
+            unsigned a = remap[tri[3*t]], b = remap[tri[3*t+1]], c = remap[tri[3*t+2]];
+            if(a == b || b == c || c == a)
+                continue;
+            tri[3*kept] = a;
+            tri[3*kept+1] = b;
+            tri[3*kept+2] = c;
+            ++kept;
+        }
+        triangles = kept;
+    }
+
+    std::copy(tri.begin(), tri.begin()+3*triangles, out);
+    if(error)
+        *error = float(std::sqrt(max_error));
+    return 3*triangles;
+}
+
+template<class I, class TP>
+size_t SimplifyMesh(const I *indices, size_t count, const StridedVectorArray<TP,3> &positions,
+                    size_t target, I *out, float *error = 0)
+{
+    return SimplifyMesh(indices, count, positions, target, out, error, NoAttributeDistance());
+}
+
+//levels of detail over one vertex buffer
+template<class I>
+struct LodChain {
+    //the indices of all levels, level l starts at offsets[l]
+    std::vector<I> indices;
+    std::vector<size_t> offsets;
+    //error of every level relative to the bounding radius, increasing
+    std::vector<float> errors;
+    //bounding sphere of the vertices
+    Vector<float,3> center;
+    float radius;
+
+    unsigned levels() const { return unsigned(errors.size()); }
+};
+
+//level 0 is the mesh itself, every further level keeps about reduction
+//of the triangles of the previous one. Stops early if simplification
+//gets stuck.
+template<class I, class TP, class F>
+LodChain<I> BuildLodChain(const I *indices, size_t count, const StridedVectorArray<TP,3> &positions,
+                          F attribute_cost, unsigned levels = LodLevels, float reduction = LodReduction)
+{
+    LodChain<I> chain;
+    //bounding sphere around the center of the bounding box
+    Vector<float,3> lo(0, 0, 0), hi(0, 0, 0);
+    for(size_t i = 0; i<count; ++i)
+    {
+        const TP *x = positions.ptr(indices[i]);
+        Vector<float,3> v = Vector<float,3>(float(x[0]), float(x[1]), float(x[2]));
+        if(i == 0)
+            lo = hi = v;
+        lo = min(lo, v);
+        hi = max(hi, v);
+    }
+    chain.center = (lo+hi)*0.5f;
+    chain.radius = 0;
+    for(size_t i = 0; i<count; ++i)
+    {
+        const TP *x = positions.ptr(indices[i]);
+        Vector<float,3> d = Vector<float,3>(float(x[0]), float(x[1]), float(x[2])) - chain.center;
+        chain.radius = std::max(chain.radius, std::sqrt(dot(d, d)));
+    }
+
+    chain.indices.assign(indices, indices+count);
+    chain.offsets.push_back(0);
+    chain.offsets.push_back(count);
+    chain.errors.push_back(0);
+    std::vector<I> level;
+    for(unsigned l = 1; l<levels; ++l)
+    {
+        size_t begin = chain.offsets[l-1], previous = chain.offsets[l]-begin;
+        size_t target = size_t(double(previous/3)*reduction)*3;
+        level.resize(previous);
+        float error = 0;
+        size_t n = SimplifyMesh(&chain.indices[begin], previous, positions, target, level.data(),
+                                &error, attribute_cost);
+        //less than a tenth removed
+        if(n*10 > previous*9)
+            break;
+        chain.indices.insert(chain.indices.end(), level.begin(), level.begin()+n);
+        chain.offsets.push_back(chain.indices.size());
+        //errors of consecutive levels add up at most
+        float relative = chain.radius > 0 ? error/chain.radius : 0.0f;
+        chain.errors.push_back(chain.errors.back() + relative);
+    }
+    return chain;
+}
+
+template<class I, class TP>
+LodChain<I> BuildLodChain(const I *indices, size_t count, const StridedVectorArray<TP,3> &positions,
+                          unsigned levels = LodLevels, float reduction = LodReduction)
+{
+    return BuildLodChain(indices, count, positions, NoAttributeDistance(), levels, reduction);
+}
+
+//pixels covered by a unit length at unit distance in front of the
+//camera of FrustumMatrix(left, right, bottom, top, near, far) drawn to a
+//viewport of height pixels
+template<class T>
+T LodPixelScale(T bottom, T top, T near, unsigned height)
+{
+    return near*T(height)/(top-bottom);
+}
+
+//lods[i] = the coarsest level of errors (relative to the radius, as in
+//LodChain) that moves the instance with the world space bounding sphere
+//centers[i], radii[i] by at most threshold pixels when seen from eye
+template<class T>
+void SelectLods(const Vector<T,3> &eye, T pixel_scale, const VectorArray<T,3> &centers,
+                const VectorArray<T,1> &radii, const float *errors, unsigned levels,
+                T threshold, unsigned *lods, size_t grain = SelectLodsGrain)
+{
+    const size_t n = std::min(centers.size(), radii.size());
+    const T *cx = centers.lane(0), *cy = centers.lane(1), *cz = centers.lane(2), *r = radii.lane(0);
+    const T ex = eye[0], ey = eye[1], ez = eye[2];
+    glp::parallel_for(0, n, grain, [=](size_t begin, size_t end) {
+        for(size_t i = begin; i<end; ++i)
+        {
+            T dx = cx[i]-ex, dy = cy[i]-ey, dz = cz[i]-ez;
+            //distance to the closest point of the sphere, at least 1/64
+            //of the radius so instances around the eye get level 0
+            T distance = std::max(std::sqrt(dx*dx + dy*dy + dz*dz) - r[i], r[i]*T(1.0/64));
+            //allowed error relative to the radius
+            T allowed = threshold*distance/(pixel_scale*r[i]);
+            unsigned lod = 0;
+            for(unsigned l = 1; l<levels; ++l)
+                lod += T(errors[l]) <= allowed;
+            lods[i] = lod;
+        }
+    });
+}
+
+#endif
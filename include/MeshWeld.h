@@ -0,0 +1,339 @@
+/*
+ * MeshWeld.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * MeshWeld.h turns unindexed geometry (triangle soups drawn with
+ * glDrawArrays) into a vertex stream without duplicates plus indices:
+ *
+ *     VertexWelder welder;
+ *     welder.weld(soup);
+ *     glp::VertexBuffer<Vertex> vbo(welder.unique());
+ *     vbo.map();
+ *     welder.vertices(soup, vbo.data());
+ *     vbo.unmap();
+ *     glp::IndexBuffer<GLushort> ibo(welder.size());
+ *     ibo.map();
+ *     welder.indices(ibo.data());
+ *     ibo.unmap();
+ *
+ * Vertices are compared by all attributes of the fusion vertex or by the
+ * ones given as template arguments, welder.weld<0,2>(soup, 0.001f)
+ * merges vertices with the same position and texture coordinate. With
+ * an epsilon floating point components are compared after rounding to
+ * multiples of it, so vertices closer than epsilon merge unless a
+ * rounding boundary lies between them. Every merged vertex takes all
+ * attributes of its first occurrence.
+ *
+ * Keys and hashes are computed in parallel, vertices are then sorted
+ * into partitions by the high bits of their hash and every partition is
+ * deduplicated with its own hash table by one task. The result doesn't
+ * depend on the thread count, unique vertices keep the order of their
+ * first occurrence.
+ */
+
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/size.hpp>
+#include <boost/fusion/include/value_at.hpp>
+
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//vertices per task
+const size_t VertexWeldGrain = 16384;
+
+//the vertices are split into 2^VertexWeldPartitionBits partitions by
+//hash that are deduplicated independently
+const unsigned VertexWeldPartitionBits = 8;
+
+//a component as a key word, floating point components rounded to
+//multiples of 1/scale unless scale is 0
+template<class E>
+std::uint64_t VertexWeldWord(E e, double scale)
+{
+    if(!std::is_floating_point<E>::value)
+        return std::uint64_t(e);
+    double d = double(e);
+    if(scale != 0)
+        return std::uint64_t(std::int64_t(std::floor(d*scale + 0.5)));
+    //-0 and 0 are equal
+    if(d == 0)
+        return 0;
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+//key words of the attributes A... of the fusion vertex V
+template<class V, int... A>
+struct VertexWeldKey {
+    static const unsigned words = 0;
+    static void get(const V&, double, std::uint64_t*) { }
+};
+
+template<class V, int N, int... A>
+struct VertexWeldKey<V, N, A...> {
+    typedef typename boost::fusion::result_of::value_at_c<V, N>::type attribute_type;
+    typedef typename attribute_storage<attribute_type>::element_type element_type;
+    static const unsigned dimension = attribute_storage<attribute_type>::dimension;
+    static const unsigned words = dimension + VertexWeldKey<V, A...>::words;
+
+    static void get(const V &v, double scale, std::uint64_t *key)
+    {
+        const element_type *e = reinterpret_cast<const element_type*>(&boost::fusion::at_c<N>(v));
+        for(unsigned d = 0; d<dimension; ++d)
+            key[d] = VertexWeldWord(e[d], scale);
+        VertexWeldKey<V, A...>::get(v, scale, key+dimension);
+    }
+};
+
+//key words of the attributes N to the last one
+template<class V, int N, int End = boost::fusion::result_of::size<V>::type::value>
+struct VertexWeldAllKey {
+    typedef VertexWeldKey<V, N> first;
+    typedef VertexWeldAllKey<V, N+1, End> rest;
+    static const unsigned words = first::words + rest::words;
+
+    static void get(const V &v, double scale, std::uint64_t *key)
+    {
+        first::get(v, scale, key);
+        rest::get(v, scale, key+first::words);
+    }
+};
+
+template<class V, int End>
+struct VertexWeldAllKey<V, End, End> : VertexWeldKey<V> { };
+
+class VertexWelder {
+public:
+    VertexWelder() : partitions(0)
+    { }
+
+    //welds the vertices of a container of fusion vertices such as a
+    //std::vector or a mapped glp::VertexBuffer and returns the number
+    //of unique ones. Only the attributes A... are compared if given.
+    template<int... A, class B>
+    size_t weld(const B &vertices, float epsilon = 0, size_t grain = VertexWeldGrain)
+    {
+        typedef typename B::value_type vertex_type;
+        typedef typename std::conditional<sizeof...(A) == 0,
+                                          VertexWeldAllKey<vertex_type, 0>,
+                                          VertexWeldKey<vertex_type, A...> >::type key_type;
+        const unsigned K = key_type::words;
+        const size_t n = vertices.size();
+        const vertex_type *v = n ? &vertices[0] : 0;
+        const double scale = epsilon > 0 ? 1.0/double(epsilon) : 0.0;
+
+        keys.resize(n*K);
+        hashes.resize(n);
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                std::uint64_t *key = &keys[i*K];
+                key_type::get(v[i], scale, key);
+                std::uint64_t h = 0;
+                for(unsigned k = 0; k<K; ++k)
+                    h = (h ^ key[k])*0x9E3779B97F4A7C15ull;
+                hashes[i] = h ^ (h >> 29);
+            }
+        });
+
+        partition(n, grain);
+
+        //representatives: the first vertex with the same key
+        remap_.resize(n);
+        glp::parallel_for(0, partitions, 1, [&](size_t begin, size_t end) {
+            std::vector<unsigned> table;
+            for(size_t p = begin; p<end; ++p)
+            {
+                size_t count = starts[p+1]-starts[p];
+                size_t size = 16;
+                while(size < 2*count)
+                    size *= 2;
+                table.assign(size, 0);
+                for(size_t s = starts[p]; s<starts[p+1]; ++s)
+                {
+                    unsigned i = order[s];
+                    size_t slot = size_t(hashes[i]) & (size-1);
+                    for(;; slot = (slot+1) & (size-1))
+                    {
+                        if(table[slot] == 0)
+                        {
+                            table[slot] = i+1;
+                            remap_[i] = i;
+                            break;
+                        }
+                        unsigned j = table[slot]-1;
+                        if(hashes[j] == hashes[i] &&
+                           std::equal(&keys[i*K], &keys[i*K]+K, &keys[j*K]))
+                        {
+                            remap_[i] = j;
+                            break;
+                        }
+                    }
+                }
+            }
+        });
+
+        compact(n, grain);
+        return first_.size();
+    }
+
+    //welded vertices
+    size_t size() const { return remap_.size(); }
+
+    //unique vertices
+    size_t unique() const { return first_.size(); }
+
+    //welded per unique vertex
+    double ratio() const { return first_.empty() ? 1.0 : double(size())/double(unique()); }
+
+    //index of every welded vertex in the unique ones
+    const std::vector<unsigned>& remap() const { return remap_; }
+
+    //welded vertex of every unique one
+    const std::vector<unsigned>& first() const { return first_; }
+
+    //writes the unique vertices of the welded vertices to out
+    template<class B, class V>
+    void vertices(const B &vertices, V *out, size_t grain = VertexWeldGrain) const
+    {
+        const typename B::value_type *v = vertices.size() ? &vertices[0] : 0;
+        const unsigned *f = first_.data();
+        glp::parallel_for(0, first_.size(), grain, [v, f, out](size_t begin, size_t end) {
+            for(size_t u = begin; u<end; ++u)
+                out[u] = v[f[u]];
+        });
+    }
+
+    //writes the index of every welded vertex to out, throws if I can't
+    //index all unique vertices
+    template<class I>
+    void indices(I *out, size_t grain = VertexWeldGrain) const
+    {
+        if(first_.size() > size_t(std::numeric_limits<I>::max())+1)
+            throw std::range_error("VertexWelder index type too small");
+        const unsigned *r = remap_.data();
+        glp::parallel_for(0, remap_.size(), grain, [r, out](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+                out[i] = I(r[i]);
+        });
+    }
+
+private:
+    //stable counting sort of the vertices by the high bits of their hash
+    void partition(size_t n, size_t grain)
+    {
+        unsigned bits = VertexWeldPartitionBits;
+        while(bits > 0 && (size_t(1) << bits) > n/64)
+            --bits;
+        partitions = size_t(1) << bits;
+        const unsigned shift = 64-bits;
+        grain = std::max<size_t>(grain, 1);
+        size_t blocks = (n+grain-1)/grain;
+        counts.assign(blocks*partitions, 0);
+        glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+            for(size_t b = begin; b<end; ++b)
+                for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                    ++counts[b*partitions + (bits ? size_t(hashes[i] >> shift) : 0)];
+        });
+        starts.assign(partitions+1, 0);
+        size_t sum = 0;
+        for(size_t p = 0; p<partitions; ++p)
+        {
+            starts[p] = sum;
+            for(size_t b = 0; b<blocks; ++b)
+            {
+                size_t c = counts[b*partitions+p];
+                counts[b*partitions+p] = sum;
+                sum += c;
+            }
+        }
+        starts[partitions] = sum;
+        order.resize(n);
+        glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+            for(size_t b = begin; b<end; ++b)
+                for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                    order[counts[b*partitions + (bits ? size_t(hashes[i] >> shift) : 0)]++] = unsigned(i);
+        });
+    }
+
+    //numbers the representatives in order and points every vertex at
+    //the number of its representative
+    void compact(size_t n, size_t grain)
+    {
+        grain = std::max<size_t>(grain, 1);
+        size_t blocks = (n+grain-1)/grain;
+        counts.assign(blocks+1, 0);
+        glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+            for(size_t b = begin; b<end; ++b)
+                for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                    counts[b+1] += remap_[i] == i;
+        });
+        for(size_t b = 0; b<blocks; ++b)
+            counts[b+1] += counts[b];
+        first_.resize(counts[blocks]);
+        //the hashes aren't needed anymore and hold the numbers
+        glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+            for(size_t b = begin; b<end; ++b)
+            {
+                size_t u = counts[b];
+                for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                    if(remap_[i] == i)
+                    {
+                        first_[u] = unsigned(i);
+                        hashes[i] = u++;
+                    }
+            }
+        });
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+                remap_[i] = unsigned(hashes[remap_[i]]);
+        });
+    }
+
+    std::vector<unsigned> remap_;
+    std::vector<unsigned> first_;
+
+    //kept between welds to avoid reallocations
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint64_t> hashes;
+    std::vector<size_t> counts;
+    std::vector<size_t> starts;
+    std::vector<unsigned> order;
+    size_t partitions;
+};
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * OcclusionBuffer.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * OcclusionBuffer.h rejects objects hidden behind occluders on the CPU
+ * in the same frame, without waiting for GPU occlusion queries. Occluder
+ * triangles are rasterized into a small depth buffer, the maximum depths
+ * of growing blocks of pixels form a Hi-Z pyramid and bounding boxes are
+ * tested against the level where they cover about 2x2 texels:
+ *
+ *     buffer.clear();
+ *     buffer.rasterize(viewproj, AttributeArray<0>(walls), wall_indices);
+ *     buffer.build_hiz();
+ *     count = CullOccludedBoxes(buffer, viewproj, lo, hi, visible, count, visible);
+ *
+ * Matrices map to OpenGL clip space as built by FrustumMatrix and
+ * InfiniteFrustumMatrix, depths are stored in [0, 1] with 1 being far.
+ * Triangles are clipped at the near plane, set up and binned to tiles in
+ * parallel blocks, then every tile is rasterized by one task using
+ * simd::depth_span. Tiles are stored contiguously so threads never
+ * share cache lines. Pixels are covered if their center is inside.
+ */
+
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+#include "VectorArray.h"
+
+//tile size in pixels, each tile is rasterized by one task
+const unsigned OcclusionTileWidth = 64;
+const unsigned OcclusionTileHeight = 16;
+
+//triangles per task for clipping, setup and binning
+const size_t OcclusionTriangleGrain = 2048;
+
+//vertices per task for the clip space transform
+const size_t OcclusionVertexGrain = 16384;
+
+//boxes per task in CullOccludedBoxes
+const size_t OcclusionQueryGrain = 4096;
+
+class OcclusionBuffer {
+public:
+    OcclusionBuffer(unsigned width, unsigned height)
+        : width_(width), height_(height),
+          tiles_x((width+OcclusionTileWidth-1)/OcclusionTileWidth),
+          tiles_y((height+OcclusionTileHeight-1)/OcclusionTileHeight),
+          depth_(tiles_x*tiles_y*OcclusionTileWidth*OcclusionTileHeight, 1.0f),
+          triangles_(0)
+    {
+        //level l has the maximum depth of 2^l x 2^l pixels
+        unsigned w = width, h = height;
+        while(w > 1 || h > 1)
+        {
+            w = (w+1)/2;
+            h = (h+1)/2;
+            hiz.push_back(Level(w, h));
+        }
+    }
+
+    unsigned width() const { return width_; }
+    unsigned height() const { return height_; }
+
+    //pyramid levels above the depth buffer
+    unsigned levels() const { return unsigned(hiz.size()); }
+
+    //triangles rasterized since the last clear
+    size_t triangles() const { return triangles_; }
+
+    void clear()
+    {
+        std::fill(depth_.begin(), depth_.end(), 1.0f);
+        triangles_ = 0;
+    }
+
+    //depth of pixel (x, y), y = 0 is the bottom row
+    float depth(unsigned x, unsigned y) const
+    {
+        return depth_[pixel(x, y)];
+    }
+
+    //maximum depth of texel (x, y) of pyramid level l, level 0 is the
+    //depth buffer
+    float depth(unsigned l, unsigned x, unsigned y) const
+    {
+        if(l == 0)
+            return depth(x, y);
+        const Level &level = hiz[l-1];
+        return level.depth[y*level.width+x];
+    }
+
+    //adds the triangle list indices over positions transformed by mvp as
+    //occluders. indices is any container with data() and size() such as
+    //a mapped glp::IndexBuffer or a std::vector.
+    template<class TP, class B>
+    void rasterize(const Matrix<float,4,4> &mvp, const StridedVectorArray<TP,3> &positions,
+                   const B &indices, size_t grain = OcclusionTriangleGrain)
+    {
+        size_t n = indices.size()/3;
+        if(n == 0)
+            return;
+        clip.resize(positions.size());
+        glp::parallel_for(0, positions.size(), OcclusionVertexGrain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                const TP *p = positions.ptr(i);
+                float v[4] = { float(p[0]), float(p[1]), float(p[2]), 1.0f };
+                simd::mat4_vec4_mul(mvp.raw(), v, clip[i].raw());
+            }
+        });
+
+        //blocks of triangles are set up and binned independently so the
+        //result doesn't depend on the thread count
+        grain = std::max<size_t>(grain, 1);
+        size_t blocks = (n+grain-1)/grain;
+        if(bins.size() < blocks)
+            bins.resize(blocks);
+        const typename B::value_type *idx = indices.data();
+        glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+            for(size_t b = begin; b<end; ++b)
+                setup(bins[b], idx, b*grain, std::min(n, (b+1)*grain));
+        });
+
+        glp::parallel_for(0, tiles_x*tiles_y, 1, [&](size_t begin, size_t end) {
+            for(size_t t = begin; t<end; ++t)
+                for(size_t b = 0; b<blocks; ++b)
+                {
+                    const Bin &bin = bins[b];
+                    for(unsigned i = bin.starts[t]; i<bin.starts[t+1]; ++i)
+                        rasterize_tile(bin.triangles[bin.entries[i]], unsigned(t));
+                }
+        });
+        for(size_t b = 0; b<blocks; ++b)
+            triangles_ += bins[b].triangles.size();
+    }
+
+    //recomputes the pyramid from the depth buffer
+    void build_hiz()
+    {
+        for(size_t l = 0; l<hiz.size(); ++l)
+        {
+            Level &level = hiz[l];
+            unsigned below_w = l ? hiz[l-1].width : width_;
+            unsigned below_h = l ? hiz[l-1].height : height_;
+            glp::parallel_for(0, level.height, 16, [&](size_t begin, size_t end) {
+                for(unsigned y = unsigned(begin); y<end; ++y)
+                    for(unsigned x = 0; x<level.width; ++x)
+                    {
+                        unsigned x1 = std::min(2*x+1, below_w-1);
+                        unsigned y1 = std::min(2*y+1, below_h-1);
+                        float d = std::max(std::max(depth(unsigned(l), 2*x, 2*y),
+                                                    depth(unsigned(l), x1, 2*y)),
+                                           std::max(depth(unsigned(l), 2*x, y1),
+                                                    depth(unsigned(l), x1, y1)));
+                        level.depth[y*level.width+x] = d;
+                    }
+            });
+        }
+    }
+
+    //false if the box [lo, hi] is hidden behind the occluders or outside
+    //of the viewport, boxes crossing the near plane are visible. Needs
+    //build_hiz() after the last rasterize().
+    bool visible(const Matrix<float,4,4> &mvp, const Vector<float,3> &lo,
+                 const Vector<float,3> &hi) const
+    {
+        //corners as the transformed lo corner plus scaled matrix columns
+        float base[4], axis[3][4];
+        float corner[4] = { lo[0], lo[1], lo[2], 1.0f };
+        simd::mat4_vec4_mul(mvp.raw(), corner, base);
+        for(unsigned a = 0; a<3; ++a)
+            for(unsigned k = 0; k<4; ++k)
+                axis[a][k] = mvp(k, a)*(hi[a]-lo[a]);
+
+        float xmin = float(width_), xmax = 0, ymin = float(height_), ymax = 0, zmin = 1;
+        for(unsigned c = 0; c<8; ++c)
+        {
+            float v[4];
+            for(unsigned k = 0; k<4; ++k)
+                v[k] = base[k] + (c&1 ? axis[0][k] : 0) + (c&2 ? axis[1][k] : 0)
+                               + (c&4 ? axis[2][k] : 0);
+            if(v[3] <= 0 || v[2] < -v[3])
+                return true;
+            float inv = 1.0f/v[3];
+            float x = (v[0]*inv*0.5f+0.5f)*float(width_);
+            float y = (v[1]*inv*0.5f+0.5f)*float(height_);
+            xmin = std::min(xmin, x);
+            xmax = std::max(xmax, x);
+            ymin = std::min(ymin, y);
+            ymax = std::max(ymax, y);
+            zmin = std::min(zmin, v[2]*inv*0.5f+0.5f);
+        }
+        if(xmax < 0 || ymax < 0 || xmin >= float(width_) || ymin >= float(height_) || zmin > 1)
+            return false;
+
+        unsigned x0 = unsigned(std::max(xmin, 0.0f)), x1 = std::min(unsigned(xmax), width_-1);
+        unsigned y0 = unsigned(std::max(ymin, 0.0f)), y1 = std::min(unsigned(ymax), height_-1);
+        unsigned l = 0;
+        while(l < hiz.size() && ((x1>>l)-(x0>>l) > 1 || (y1>>l)-(y0>>l) > 1))
+            ++l;
+        for(unsigned y = y0>>l; y<=y1>>l; ++y)
+            for(unsigned x = x0>>l; x<=x1>>l; ++x)
+                if(zmin <= depth(l, x, y))
+                    return true;
+        return false;
+    }
+
+private:
+    struct Level {
+        Level(unsigned w, unsigned h) : width(w), height(h), depth(w*h, 1.0f)
+        { }
+        unsigned width, height;
+        std::vector<float> depth;
+    };
+
+    //edge functions ex*x+ey*y+e0 and depth plane over pixel centers with
+    //the pixel bounds of a triangle
+    struct Triangle {
+        float ex[3], ey[3], e0[3];
+        float zx, zy, z0;
+        unsigned x0, x1, y0, y1;
+    };
+
+    //set up triangles of a block and their tiles, the triangles of tile
+    //t are entries[starts[t]] to entries[starts[t+1]-1]
+    struct Bin {
+        std::vector<Triangle> triangles;
+        std::vector<unsigned> starts;
+        std::vector<unsigned> entries;
+    };
+
+    size_t pixel(unsigned x, unsigned y) const
+    {
+        unsigned tile = (y/OcclusionTileHeight)*tiles_x + x/OcclusionTileWidth;
+        return size_t(tile)*OcclusionTileWidth*OcclusionTileHeight
+             + (y%OcclusionTileHeight)*OcclusionTileWidth + x%OcclusionTileWidth;
+    }
+
+    template<class I>
+    void setup(Bin &bin, const I *idx, size_t begin, size_t end)
+    {
+        bin.triangles.clear();
+        for(size_t t = begin; t<end; ++t)
+        {
+            const Vector<float,4> *v[3] = {
+                &clip[size_t(idx[3*t])], &clip[size_t(idx[3*t+1])], &clip[size_t(idx[3*t+2])] };
+
+            //trivially outside of one frustum plane
+            bool outside = false;
+            for(unsigned a = 0; a<3 && !outside; ++a)
+            {
+                outside = outside || ((*v[0])[a] > (*v[0])[3] && (*v[1])[a] > (*v[1])[3] && (*v[2])[a] > (*v[2])[3]);
+                outside = outside || ((*v[0])[a] < -(*v[0])[3] && (*v[1])[a] < -(*v[1])[3] && (*v[2])[a] < -(*v[2])[3]);
+            }
+            if(outside)
+                continue;
+
+            //clipped against z >= -w into a polygon of up to 4 vertices
+            Vector<float,4> poly[4];
+            unsigned count = 0;
+            for(unsigned k = 0; k<3; ++k)
+            {
+                const Vector<float,4> &a = *v[k], &b = *v[(k+1)%3];
+                float da = a[2]+a[3], db = b[2]+b[3];
+                if(da >= 0)
+                    poly[count++] = a;
+                if((da >= 0) != (db >= 0))
+                    poly[count++] = a + (b-a)*(da/(da-db));
+            }
+            for(unsigned k = 2; k<count; ++k)
+                add_triangle(bin, poly[0], poly[k-1], poly[k]);
+        }
+
+        //counting sort of the triangle tile ranges into the tile lists
+        const unsigned tiles = tiles_x*tiles_y;
+        bin.starts.assign(tiles+2, 0);
+        for(size_t i = 0; i<bin.triangles.size(); ++i)
+            for_tiles(bin.triangles[i], [&bin](unsigned tile) { ++bin.starts[tile+2]; });
+        for(unsigned t = 2; t<tiles+2; ++t)
+            bin.starts[t] += bin.starts[t-1];
+        bin.entries.resize(bin.starts[tiles+1]);
+        for(size_t i = 0; i<bin.triangles.size(); ++i)
+            for_tiles(bin.triangles[i], [&bin, i](unsigned tile) {
+                bin.entries[bin.starts[tile+1]++] = unsigned(i);
+            });
+        bin.starts.pop_back();
+    }
+
+    void add_triangle(Bin &bin, const Vector<float,4> &a, const Vector<float,4> &b,
+                      const Vector<float,4> &c)
+    {
+        float sx[3], sy[3], sz[3];
+        const Vector<float,4> *v[3] = { &a, &b, &c };
+        for(unsigned k = 0; k<3; ++k)
+        {
+            const Vector<float,4> &p = *v[k];
+            float inv = 1.0f/p[3];
+            sx[k] = (p[0]*inv*0.5f+0.5f)*float(width_);
+            sy[k] = (p[1]*inv*0.5f+0.5f)*float(height_);
+            sz[k] = p[2]*inv*0.5f+0.5f;
+        }
+        float area = (sx[1]-sx[0])*(sy[2]-sy[0]) - (sx[2]-sx[0])*(sy[1]-sy[0]);
+        if(!(area != 0))
+            return;
+        //both windings are occluders, make the triangle counter clockwise
+        if(area < 0)
+        {
+            std::swap(sx[1], sx[2]);
+            std::swap(sy[1], sy[2]);
+            std::swap(sz[1], sz[2]);
+            area = -area;
+        }
+
+        float xmin = std::min(std::min(sx[0], sx[1]), sx[2]);
+        float xmax = std::max(std::max(sx[0], sx[1]), sx[2]);
+        float ymin = std::min(std::min(sy[0], sy[1]), sy[2]);
+        float ymax = std::max(std::max(sy[0], sy[1]), sy[2]);
+        //pixels whose centers can be inside
+        float px0 = std::max(std::ceil(xmin-0.5f), 0.0f), px1 = std::min(std::floor(xmax-0.5f), float(width_)-1);
+        float py0 = std::max(std::ceil(ymin-0.5f), 0.0f), py1 = std::min(std::floor(ymax-0.5f), float(height_)-1);
+        if(px0 > px1 || py0 > py1)
+            return;
+
+        Triangle t;
+        for(unsigned k = 0; k<3; ++k)
+        {
+            unsigned j = (k+1)%3;
+            t.ex[k] = sy[k]-sy[j];
+            t.ey[k] = sx[j]-sx[k];
+            t.e0[k] = sx[k]*sy[j]-sx[j]*sy[k];
+        }
+        float inv_area = 1.0f/area;
+        //z = sz[0] + barycentric weights of vertices 1 and 2, which are
+        //the edge functions opposite of them
+        float d1 = (sz[1]-sz[0])*inv_area, d2 = (sz[2]-sz[0])*inv_area;
+        t.zx = d1*t.ex[2] + d2*t.ex[0];
+        t.zy = d1*t.ey[2] + d2*t.ey[0];
+        t.z0 = sz[0] + d1*t.e0[2] + d2*t.e0[0];
+        t.x0 = unsigned(px0);
+        t.x1 = unsigned(px1);
+        t.y0 = unsigned(py0);
+        t.y1 = unsigned(py1);
+        bin.triangles.push_back(t);
+    }
+
+    template<class F>
+    void for_tiles(const Triangle &t, F f) const
+    {
+        for(unsigned y = t.y0/OcclusionTileHeight; y<=t.y1/OcclusionTileHeight; ++y)
+            for(unsigned x = t.x0/OcclusionTileWidth; x<=t.x1/OcclusionTileWidth; ++x)
+                f(y*tiles_x+x);
+    }
+
+    void rasterize_tile(const Triangle &t, unsigned tile)
+    {
+        unsigned tx = (tile%tiles_x)*OcclusionTileWidth, ty = (tile/tiles_x)*OcclusionTileHeight;
+        unsigned x0 = std::max(t.x0, tx), x1 = std::min(t.x1, tx+OcclusionTileWidth-1);
+        unsigned y0 = std::max(t.y0, ty), y1 = std::min(t.y1, ty+OcclusionTileHeight-1);
+        float *rows = &depth_[size_t(tile)*OcclusionTileWidth*OcclusionTileHeight];
+        float cx = float(tx)+0.5f;
+        for(unsigned y = y0; y<=y1; ++y)
+        {
+            float cy = float(y)+0.5f;
+            float e0[3];
+            //narrows the span to where each edge can be non negative
+            float lo = float(x0-tx), hi = float(x1-tx);
+            for(unsigned k = 0; k<3; ++k)
+            {
+                e0[k] = t.ex[k]*cx + t.ey[k]*cy + t.e0[k];
+                if(t.ex[k] > 0)
+                    lo = std::max(lo, std::floor(-e0[k]/t.ex[k]));
+                else if(t.ex[k] < 0)
+                    hi = std::min(hi, std::ceil(-e0[k]/t.ex[k]));
+                else if(e0[k] < 0)
+                    hi = -1;
+            }
+            if(lo > hi)
+                continue;
+            //widened to multiples of 4 pixels within the tile, the edge
+            //functions reject the extra ones
+            unsigned begin = unsigned(lo) & ~3u;
+            unsigned end = std::min((unsigned(hi)+4) & ~3u, OcclusionTileWidth);
+            for(unsigned k = 0; k<3; ++k)
+                e0[k] += t.ex[k]*float(begin);
+            simd::depth_span(rows + (y-ty)*OcclusionTileWidth + begin, end-begin,
+                             t.ex, e0, t.zx, t.zx*(cx+float(begin)) + t.zy*cy + t.z0);
+        }
+    }
+
+    unsigned width_, height_;
+    unsigned tiles_x, tiles_y;
+    std::vector<float> depth_;
+    std::vector<Level> hiz;
+    size_t triangles_;
+
+    //kept between frames to avoid reallocations
+    std::vector<Vector<float,4> > clip;
+    std::vector<Bin> bins;
+};
+
+//writes the indices of the boxes [lo[i], hi[i]] for every i in
+//candidates that are not hidden in buffer to visible and returns their
+//count. visible may be candidates, for example the result of CullBoxes.
+inline size_t CullOccludedBoxes(const OcclusionBuffer &buffer, const Matrix<float,4,4> &mvp,
+                                const VectorArray<float,3> &lo, const VectorArray<float,3> &hi,
+                                const unsigned *candidates, size_t count, unsigned *visible,
+                                size_t grain = OcclusionQueryGrain)
+{
+    //every chunk compacts its own range first, like FrustumCull
+    std::vector<std::pair<size_t, size_t> > chunks;
+    std::mutex chunks_mutex;
+    glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+        size_t n = begin;
+        for(size_t c = begin; c<end; ++c)
+        {
+            unsigned i = candidates[c];
+            if(buffer.visible(mvp, lo.at(i), hi.at(i)))
+                visible[n++] = i;
+        }
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        chunks.push_back(std::make_pair(begin, n-begin));
+    });
+    std::sort(chunks.begin(), chunks.end());
+    size_t n = 0;
+    for(size_t c = 0; c<chunks.size(); ++c)
+    {
+        unsigned *first = visible+chunks[c].first;
+        std::copy(first, first+chunks[c].second, visible+n);
+        n += chunks[c].second;
+    }
+    return n;
+}
+
+//all boxes
+inline size_t CullOccludedBoxes(const OcclusionBuffer &buffer, const Matrix<float,4,4> &mvp,
+                                const VectorArray<float,3> &lo, const VectorArray<float,3> &hi,
+                                unsigned *visible, size_t grain = OcclusionQueryGrain)
+{
+    size_t n = std::min(lo.size(), hi.size());
+    for(size_t i = 0; i<n; ++i)
+        visible[i] = unsigned(i);
+    return CullOccludedBoxes(buffer, mvp, lo, hi, visible, n, visible, grain);
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * PackedVector.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * PackedVector.h provides compressed vertex component types: Half
+ * floats, normalized 8 and 16 bit integers (Norm), normals packed into
+ * GL_INT_2_10_10_10_REV (PackedNormal) and octahedral encoded normals
+ * (OctahedralNormal). They can be used as elements of Vector or as
+ * vertex attributes directly, TypeToGLConstant.h maps them to the
+ * matching GL types and normalization:
+ *
+ *     typedef fusion::vector<
+ *                 Vector<Half,4>,         //position
+ *                 PackedNormal,           //normal
+ *                 Vector<UNorm16,2>       //texture coordinate
+ *             > CompressedVertex;
+ *
+ * Encode/Decode and their Normals and Octahedral variants convert whole
+ * strided float streams (see AttributeArray) using the MathSimd.h
+ * kernels. Octahedral normals arrive as a 2 component vector in the
+ * shader and are decoded with
+ *
+ *     vec3 n = vec3(e, 1.0-abs(e.x)-abs(e.y));
+ *     if(n.z < 0.0) n.xy = (1.0-abs(n.yx))*sign(n.xy);
+ *     n = normalize(n);
+ */
+
+#ifndef PACKED_VECTOR_H
+#define PACKED_VECTOR_H
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits.hpp>
+
+#include "PackedTypes.h"
+#include "MathVector.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+#include "vector_traits.h"
+
+//streams smaller than this are converted on the calling thread
+const size_t PackGrain = 65536;
+
+//16 bit IEEE float
+class Half {
+public:
+    Half() : bits(0)
+    { }
+
+    explicit Half(float f) : bits(simd::float_to_half(f))
+    { }
+
+    operator float() const { return simd::half_to_float(bits); }
+
+    unsigned short bits;
+};
+
+//fixed point value in [-1, 1] for signed and [0, 1] for unsigned I,
+//conversions follow the GL rules for normalized integers
+template<class I>
+class Norm {
+public:
+    typedef I int_type;
+
+    static float scale() { return float(std::numeric_limits<I>::max()); }
+    static float lowest() { return std::numeric_limits<I>::is_signed ? -1.0f : 0.0f; }
+
+    Norm() : bits(0)
+    { }
+
+    explicit Norm(float f)
+    {
+        encode<1>(&f, this);
+    }
+
+    operator float() const
+    {
+        float f;
+        decode<1>(this, &f);
+        return f;
+    }
+
+    //D <= 4 floats to consecutive Norms and back
+    template<unsigned D>
+    static void encode(const float *v, Norm *out)
+    {
+        const float l = lowest(), s = scale();
+        const float lo[4] = {l, l, l, l}, sc[4] = {s, s, s, s};
+        int q[4];
+        simd::quantize<D>(v, lo, sc, q);
+        for(unsigned k = 0; k<D; ++k)
+            out[k].bits = I(q[k]);
+    }
+
+    template<unsigned D>
+    static void decode(const Norm *n, float *out)
+    {
+        const float l = lowest(), s = 1.0f/scale();
+        const float lo[4] = {l, l, l, l}, sc[4] = {s, s, s, s};
+        int q[4];
+        for(unsigned k = 0; k<D; ++k)
+            q[k] = n[k].bits;
+        simd::dequantize<D>(q, lo, sc, out);
+    }
+
+    I bits;
+};
+
+typedef Norm<signed char> SNorm8;
+typedef Norm<short> SNorm16;
+typedef Norm<unsigned char> UNorm8;
+typedef Norm<unsigned short> UNorm16;
+
+//signed normalized x, y, z in 10 bits each and w in 2 bits, laid out
+//as GL_INT_2_10_10_10_REV. Meant for normals and for tangents with the
+//handedness in w.
+class PackedNormal {
+public:
+    PackedNormal() : bits(0)
+    { }
+
+    template<class A>
+    explicit PackedNormal(const VectorExpr<float, 3, A> &v, float w = 0)
+    {
+        const A& vo ( v );
+        Vector<float, 4> t(vo[0], vo[1], vo[2], w);
+        bits = pack<4>(t.raw());
+    }
+
+    template<class A>
+    explicit PackedNormal(const VectorExpr<float, 4, A> &v)
+    {
+        Vector<float, 4> t(v);
+        bits = pack<4>(t.raw());
+    }
+
+    Vector<float, 4> unpack() const
+    {
+        Vector<float, 4> res(uninitialized);
+        unpack<4>(bits, res.raw());
+        return res;
+    }
+
+    //D = 3 (w = 0) or 4 floats
+    template<unsigned D>
+    static unsigned pack(const float *v)
+    {
+        static const float lo[4] = {-1, -1, -1, -1};
+        static const float sc[4] = {511, 511, 511, 1};
+        int q[4] = {0, 0, 0, 0};
+        simd::quantize<D>(v, lo, sc, q);
+        return (unsigned(q[0]) & 0x3ffu) | (unsigned(q[1]) & 0x3ffu) << 10 |
+               (unsigned(q[2]) & 0x3ffu) << 20 | unsigned(q[3]) << 30;
+    }
+
+    template<unsigned D>
+    static void unpack(unsigned p, float *out)
+    {
+        static const float lo[4] = {-1, -1, -1, -1};
+        static const float sc[4] = {1.0f/511, 1.0f/511, 1.0f/511, 1};
+        //sign extension by arithmetic shifts
+        int q[4] = {
+            int(p << 22) >> 22, int(p << 12) >> 22,
+            int(p << 2) >> 22, int(p) >> 30
+        };
+        simd::dequantize<D>(q, lo, sc, out);
+    }
+
+    unsigned bits;
+};
+
+//unit vector mapped onto the octahedron |x|+|y|+|z| = 1 whose lower
+//half is folded over the upper one, stored as 2 Norm<I>
+template<class I>
+class OctahedralNormal {
+public:
+    OctahedralNormal()
+    { }
+
+    template<class A>
+    explicit OctahedralNormal(const VectorExpr<float, 3, A> &v)
+    {
+        Vector<float, 3> t(v);
+        encode(t.raw(), xy);
+    }
+
+    Vector<float, 3> unpack() const
+    {
+        Vector<float, 3> res(uninitialized);
+        decode(xy, res.raw());
+        return res;
+    }
+
+    static void encode(const float *n, Norm<I> *out)
+    {
+        float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        if(l1 == 0)
+            l1 = 1;
+        float e[2] = { n[0]/l1, n[1]/l1 };
+        if(n[2] < 0)
+        {
+            float x = e[0], y = e[1];
+            e[0] = (1-std::abs(y))*(x < 0 ? -1.0f : 1.0f);
+            e[1] = (1-std::abs(x))*(y < 0 ? -1.0f : 1.0f);
+        }
+        Norm<I>::template encode<2>(e, out);
+    }
+
+    static void decode(const Norm<I> *in, float *out)
+    {
+        float e[2];
+        Norm<I>::template decode<2>(in, e);
+        Vector<float, 3> n(e[0], e[1], 1-std::abs(e[0])-std::abs(e[1]));
+        if(n[2] < 0)
+        {
+            n[0] = (1-std::abs(e[1]))*(e[0] < 0 ? -1.0f : 1.0f);
+            n[1] = (1-std::abs(e[0]))*(e[1] < 0 ? -1.0f : 1.0f);
+        }
+        n.normalize();
+        std::copy(n.raw(), n.raw()+3, out);
+    }
+
+    Norm<I> xy[2];
+};
+
+template<>
+struct vector_traits<PackedNormal>
+{
+    typedef PackedNormal element_type;
+    static const size_t dimension = 4;
+};
+
+template<class I>
+struct vector_traits< OctahedralNormal<I> >
+{
+    typedef Norm<I> element_type;
+    static const size_t dimension = 2;
+};
+
+//component wise conversion used by Encode and Decode
+template<class T>
+struct PackTraits { };
+
+template<>
+struct PackTraits<Half> {
+    template<unsigned D>
+    static void encode(const float *v, Half *out)
+    {
+        simd::floats_to_halfs<D>(v, &out->bits);
+    }
+
+    template<unsigned D>
+    static void decode(const Half *h, float *out)
+    {
+        simd::halfs_to_floats<D>(&h->bits, out);
+    }
+};
+
+template<class I>
+struct PackTraits< Norm<I> > {
+    template<unsigned D>
+    static void encode(const float *v, Norm<I> *out)
+    {
+        Norm<I>::template encode<D>(v, out);
+    }
+
+    template<unsigned D>
+    static void decode(const Norm<I> *n, float *out)
+    {
+        Norm<I>::template decode<D>(n, out);
+    }
+};
+
+//f(&in[i], &out[i]) for all elements of two strided streams
+template<class TI, unsigned DI, class TO, unsigned DO, class F>
+void BatchConvert(const StridedVectorArray<TI,DI> &in,
+                  const StridedVectorArray<TO,DO> &out,
+                  size_t grain, F f)
+{
+    size_t n = std::min(in.size(), out.size());
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i<end; ++i)
+            f(in.ptr(i), out.ptr(i));
+    });
+}
+
+//float stream to Half or Norm components
+template<class TI, class TO, unsigned D>
+void Encode(const StridedVectorArray<TI,D> &in,
+            const StridedVectorArray<TO,D> &out,
+            size_t grain = PackGrain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TI>::type, float>::value));
+    BOOST_STATIC_ASSERT(D <= 4);
+    BatchConvert(in, out, grain, [](const float *p, TO *q) {
+        PackTraits<TO>::template encode<D>(p, q);
+    });
+}
+
+template<class TI, class TO, unsigned D>
+void Decode(const StridedVectorArray<TI,D> &in,
+            const StridedVectorArray<TO,D> &out,
+            size_t grain = PackGrain)
+{
+    typedef typename boost::remove_const<TI>::type packed_type;
+    BOOST_STATIC_ASSERT((boost::is_same<TO, float>::value));
+    BOOST_STATIC_ASSERT(D <= 4);
+    BatchConvert(in, out, grain, [](const packed_type *p, float *q) {
+        PackTraits<packed_type>::template decode<D>(p, q);
+    });
+}
+
+//normals (D = 3, w = 0) or tangents (D = 4) to PackedNormal
+template<class TI, unsigned D>
+void EncodeNormals(const StridedVectorArray<TI,D> &in,
+                   const StridedVectorArray<PackedNormal,1> &out,
+                   size_t grain = PackGrain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TI>::type, float>::value));
+    BOOST_STATIC_ASSERT(D == 3 || D == 4);
+    BatchConvert(in, out, grain, [](const float *p, PackedNormal *q) {
+        q->bits = PackedNormal::pack<D>(p);
+    });
+}
+
+template<class TI, unsigned D>
+void DecodeNormals(const StridedVectorArray<TI,1> &in,
+                   const StridedVectorArray<float,D> &out,
+                   size_t grain = PackGrain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TI>::type, PackedNormal>::value));
+    BOOST_STATIC_ASSERT(D == 3 || D == 4);
+    BatchConvert(in, out, grain, [](const PackedNormal *p, float *q) {
+        PackedNormal::unpack<D>(p->bits, q);
+    });
+}
+
+//unit normals to OctahedralNormal<I>, in is 3 components, out 2
+template<class TI, class I>
+void EncodeOctahedral(const StridedVectorArray<TI,3> &in,
+                      const StridedVectorArray<Norm<I>,2> &out,
+                      size_t grain = PackGrain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TI>::type, float>::value));
+    BatchConvert(in, out, grain, [](const float *p, Norm<I> *q) {
+        OctahedralNormal<I>::encode(p, q);
+    });
+}
+
+template<class TI>
+void DecodeOctahedral(const StridedVectorArray<TI,2> &in,
+                      const StridedVectorArray<float,3> &out,
+                      size_t grain = PackGrain)
+{
+    typedef typename boost::remove_const<TI>::type packed_type;
+    typedef typename packed_type::int_type int_type;
+    BatchConvert(in, out, grain, [](const packed_type *p, float *q) {
+        OctahedralNormal<int_type>::decode(p, q);
+    });
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+#ifndef GLP_PARALLEL_FOR_H
+#define GLP_PARALLEL_FOR_H
+
+#include <cstddef>
+#include <algorithm>
+
+#include "TaskScheduler.h"
+
+namespace glp {
+
+//chunks per thread parallel_for splits large ranges into at most, so
+//stealing can even out the load without tiny tasks
+const size_t ParallelForChunksPerThread = 8;
+
+//splits a range in halves, the upper ones become tasks
+template<class F>
+struct ParallelForRange {
+    TaskGroup *group;
+    F *f;
+    size_t grain;
+
+    void operator()(size_t begin, size_t end) const
+    {
+        while(end-begin >= 2*grain)
+        {
+            size_t middle = begin+(end-begin)/2;
+            ParallelForRange upper = *this;
+            group->run([upper, middle, end]() { upper(middle, end); });
+            end = middle;
+        }
+        (*f)(begin, end);
+    }
+};
+
+// calls f(chunk_begin, chunk_end) for consecutive chunks covering
+// [begin, end) on the TaskScheduler. Chunks are at least grain elements
+// large, ranges that don't exceed grain run on the calling thread.
+// Exceptions thrown by f are rethrown on the calling thread.
+template<class F>
+void parallel_for(size_t begin, size_t end, size_t grain, F f)
+{
+    if(end <= begin)
+        return;
+    size_t n = end-begin;
+    if(grain == 0)
+        grain = 1;
+    if(n <= grain)
+    {
+        f(begin, end);
+        return;
+    }
+    TaskScheduler &scheduler = TaskScheduler::instance();
+    size_t threads = scheduler.threads();
+    if(threads < 2)
+    {
+        f(begin, end);
+        return;
+    }
+    grain = std::max(grain, n/(ParallelForChunksPerThread*threads));
+
+    TaskGroup group(scheduler);
+    ParallelForRange<F> range = { &group, &f, grain };
+    group.run([range, begin, end]() { range(begin, end); });
+    group.wait();
+}
+
+}
+
+#endif
@@ -0,0 +1,484 @@
+/*
+ * Quaternion.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * Quaternion.h provides rotation quaternions and dual quaternions for
+ * rigid transforms. Quaternion<T> is a Vector<T,4> stored as (x, y, z, w)
+ * with w as the scalar part, DualQuaternion<T> is a Vector<T,8> holding
+ * the real and the dual quaternion. Both take part in the usual vector
+ * expressions (sums, scaling, dot, lerping) and convert to and from
+ * rotation matrices without trigonometry. slerp and nlerp are also
+ * available as VectorArray expressions for whole arrays of quaternions.
+ */
+
+#ifndef QUATERNION_H
+#define QUATERNION_H
+
+#include <cmath>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "VectorArray.h"
+
+template<class T>
+class Quaternion : public Vector<T, 4> {
+public:
+    //the identity rotation
+    Quaternion() : Vector<T, 4>(0, 0, 0, 1)
+    { }
+
+    explicit Quaternion(Uninitialized u) : Vector<T, 4>(u)
+    { }
+
+    Quaternion(const T &x, const T &y, const T &z, const T &w)
+        : Vector<T, 4>(x, y, z, w)
+    { }
+
+    template<class A>
+    Quaternion(const VectorExpr<T, 3, A> &v, const T &w)
+        : Vector<T, 4>(uninitialized)
+    {
+        const A& vo ( v );
+        (*this)[0] = vo[0];
+        (*this)[1] = vo[1];
+        (*this)[2] = vo[2];
+        (*this)[3] = w;
+    }
+
+    template<class A>
+    Quaternion(const VectorExpr<T, 4, A> &a) : Vector<T, 4>(a)
+    { }
+
+    template<class A>
+    Quaternion& operator=(const VectorExpr<T, 4, A> &a)
+    {
+        Vector<T, 4>::operator=(a);
+        return *this;
+    }
+
+    using Vector<T, 4>::operator*=;
+
+    Quaternion& operator*=(const Quaternion &b)
+    {
+        return *this = *this * b;
+    }
+
+    Vector<T, 3> vector_part() const
+    {
+        return Vector<T, 3>((*this)[0], (*this)[1], (*this)[2]);
+    }
+
+    T scalar_part() const
+    {
+        return (*this)[3];
+    }
+};
+
+//hamilton product, a*b rotates by b first
+template<class T>
+inline Quaternion<T> operator*(const Quaternion<T> &a, const Quaternion<T> &b)
+{
+    return Quaternion<T>(
+        a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1],
+        a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0],
+        a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3],
+        a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2]);
+}
+
+//rotates v by the unit quaternion q
+template<class T, class A>
+inline Vector<T, 3> operator*(const Quaternion<T> &q, const VectorExpr<T, 3, A> &v)
+{
+    Vector<T, 3> vo(v);
+    Vector<T, 3> u = q.vector_part();
+    Vector<T, 3> t = T(2)*cross(u, vo);
+    return vo + q[3]*t + cross(u, t);
+}
+
+template<class T>
+inline Quaternion<T> conjugate(const Quaternion<T> &q)
+{
+    return Quaternion<T>(-q[0], -q[1], -q[2], q[3]);
+}
+
+template<class T>
+inline Quaternion<T> inverse(const Quaternion<T> &q)
+{
+    return conjugate(q)/squared_norm(q);
+}
+
+//same rotation as RotationMatrix(angle, dir)
+template<class T, class A>
+Quaternion<T> RotationQuaternion(T angle, const VectorExpr<T, 3, A> &dir)
+{
+    return Quaternion<T>(normalize(dir)*std::sin(angle/2), std::cos(angle/2));
+}
+
+template<class T>
+Quaternion<T> RotationQuaternion(T angle, T x, T y, T z)
+{
+    return RotationQuaternion(angle, Vector<T, 3>(x,y,z));
+}
+
+//the rotation of an orthonormal matrix, only the upper 3x3 is used
+template<class T, unsigned D, class A>
+Quaternion<T> RotationQuaternion(const MatrixExpr<T, D, D, A> &a)
+{
+    BOOST_STATIC_ASSERT(D==3 || D==4);
+    Matrix<T, D, D> m(a);
+    T trace = m(0,0) + m(1,1) + m(2,2);
+    Quaternion<T> q(uninitialized);
+    if(trace > 0)
+    {
+        T s = std::sqrt(trace + 1)*2;
+        q[0] = (m(2,1) - m(1,2))/s;
+        q[1] = (m(0,2) - m(2,0))/s;
+        q[2] = (m(1,0) - m(0,1))/s;
+        q[3] = s/4;
+    }
+    else if(m(0,0) > m(1,1) && m(0,0) > m(2,2))
+    {
+        T s = std::sqrt(1 + m(0,0) - m(1,1) - m(2,2))*2;
+        q[0] = s/4;
+        q[1] = (m(0,1) + m(1,0))/s;
+        q[2] = (m(0,2) + m(2,0))/s;
+        q[3] = (m(2,1) - m(1,2))/s;
+    }
+    else if(m(1,1) > m(2,2))
+    {
+        T s = std::sqrt(1 + m(1,1) - m(0,0) - m(2,2))*2;
+        q[0] = (m(0,1) + m(1,0))/s;
+        q[1] = s/4;
+        q[2] = (m(1,2) + m(2,1))/s;
+        q[3] = (m(0,2) - m(2,0))/s;
+    }
+    else
+    {
+        T s = std::sqrt(1 + m(2,2) - m(0,0) - m(1,1))*2;
+        q[0] = (m(0,2) + m(2,0))/s;
+        q[1] = (m(1,2) + m(2,1))/s;
+        q[2] = s/4;
+        q[3] = (m(1,0) - m(0,1))/s;
+    }
+    return q;
+}
+
+//writes the rotation of the unit quaternion q into the upper 3x3 of m
+template<class T, unsigned D>
+inline void SetRotation(Matrix<T, D, D> &m, const Quaternion<T> &q)
+{
+    T x = q[0], y = q[1], z = q[2], w = q[3];
+    T xx = x*x, yy = y*y, zz = z*z;
+    T xy = x*y, xz = x*z, yz = y*z;
+    T xw = x*w, yw = y*w, zw = z*w;
+    m(0,0) = 1-2*(yy+zz);
+    m(1,0) = 2*(xy+zw);
+    m(2,0) = 2*(xz-yw);
+    m(0,1) = 2*(xy-zw);
+    m(1,1) = 1-2*(xx+zz);
+    m(2,1) = 2*(yz+xw);
+    m(0,2) = 2*(xz+yw);
+    m(1,2) = 2*(yz-xw);
+    m(2,2) = 1-2*(xx+yy);
+}
+
+template<class T>
+Matrix<T, 4, 4> RotationMatrix(const Quaternion<T> &q)
+{
+    Matrix<T, 4, 4> res;
+    SetRotation(res, q);
+    res(3,3) = 1;
+    return res;
+}
+
+template<class T>
+Matrix<T, 3, 3> RotationMatrix3(const Quaternion<T> &q)
+{
+    Matrix<T, 3, 3> res(uninitialized);
+    SetRotation(res, q);
+    return res;
+}
+
+//a rotation followed by a translation
+template<class T>
+class DualQuaternion : public Vector<T, 8> {
+public:
+    //the identity transform
+    DualQuaternion() : Vector<T, 8>()
+    {
+        (*this)[3] = 1;
+    }
+
+    explicit DualQuaternion(Uninitialized u) : Vector<T, 8>(u)
+    { }
+
+    DualQuaternion(const Quaternion<T> &r, const Quaternion<T> &d)
+        : Vector<T, 8>(uninitialized)
+    {
+        for(unsigned i = 0; i<4; ++i)
+        {
+            (*this)[i] = r[i];
+            (*this)[i+4] = d[i];
+        }
+    }
+
+    //rotation r followed by the translation t
+    template<class A>
+    DualQuaternion(const Quaternion<T> &r, const VectorExpr<T, 3, A> &t)
+        : Vector<T, 8>(uninitialized)
+    {
+        Quaternion<T> d = Quaternion<T>(t, 0)*r;
+        for(unsigned i = 0; i<4; ++i)
+        {
+            (*this)[i] = r[i];
+            (*this)[i+4] = d[i]/2;
+        }
+    }
+
+    template<class A>
+    DualQuaternion(const VectorExpr<T, 8, A> &a) : Vector<T, 8>(a)
+    { }
+
+    template<class A>
+    DualQuaternion& operator=(const VectorExpr<T, 8, A> &a)
+    {
+        Vector<T, 8>::operator=(a);
+        return *this;
+    }
+
+    using Vector<T, 8>::operator*=;
+
+    DualQuaternion& operator*=(const DualQuaternion &b)
+    {
+        return *this = *this * b;
+    }
+
+    Quaternion<T> real() const
+    {
+        return Quaternion<T>((*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    }
+
+    Quaternion<T> dual() const
+    {
+        return Quaternion<T>((*this)[4], (*this)[5], (*this)[6], (*this)[7]);
+    }
+
+    Vector<T, 3> translation() const
+    {
+        return T(2)*(dual()*conjugate(real())).vector_part();
+    }
+};
+
+//a*b applies b first
+template<class T>
+inline DualQuaternion<T> operator*(const DualQuaternion<T> &a, const DualQuaternion<T> &b)
+{
+    Quaternion<T> ar = a.real(), br = b.real();
+    return DualQuaternion<T>(ar*br, Quaternion<T>(ar*b.dual() + a.dual()*br));
+}
+
+//transforms the point v
+template<class T, class A>
+inline Vector<T, 3> operator*(const DualQuaternion<T> &q, const VectorExpr<T, 3, A> &v)
+{
+    return q.real()*v + q.translation();
+}
+
+//inverse of a unit dual quaternion
+template<class T>
+inline DualQuaternion<T> conjugate(const DualQuaternion<T> &q)
+{
+    return DualQuaternion<T>(conjugate(q.real()), conjugate(q.dual()));
+}
+
+//makes the real part unit length and the dual part orthogonal to it,
+//used after blending (dual quaternion linear blending)
+template<class T>
+inline DualQuaternion<T> normalize(const DualQuaternion<T> &q)
+{
+    Quaternion<T> r = q.real(), d = q.dual();
+    T inv = 1/norm(r);
+    r *= inv;
+    d *= inv;
+    return DualQuaternion<T>(r, Quaternion<T>(d - dot(r, d)*r));
+}
+
+//the rigid transform of m, the upper 3x3 has to be a rotation
+template<class T>
+DualQuaternion<T> RigidDualQuaternion(const Matrix<T, 4, 4> &m)
+{
+    return DualQuaternion<T>(RotationQuaternion(m), Vector<T, 3>(m(0,3), m(1,3), m(2,3)));
+}
+
+template<class T>
+Matrix<T, 4, 4> RigidMatrix(const DualQuaternion<T> &q)
+{
+    Matrix<T, 4, 4> res = RotationMatrix(q.real());
+    Vector<T, 3> t = q.translation();
+    res(0,3) = t[0];
+    res(1,3) = t[1];
+    res(2,3) = t[2];
+    return res;
+}
+
+//shortest path interpolation with normalization, t=0 gives a
+template<class T>
+Quaternion<T> nlerp(const Quaternion<T> &a, const Quaternion<T> &b, T t)
+{
+    T s = dot(a, b) < 0 ? -t : t;
+    return normalize((1-t)*a + s*b);
+}
+
+//shortest path spherical linear interpolation, t=0 gives a
+template<class T>
+Quaternion<T> slerp(const Quaternion<T> &a, const Quaternion<T> &b, T t)
+{
+    T c = dot(a, b);
+    T sign = 1;
+    if(c < 0)
+    {
+        c = -c;
+        sign = -1;
+    }
+    //fall back to nlerp where sin(angle) gets too small
+    if(c > T(0.9995))
+        return nlerp(a, b, t);
+    T angle = std::acos(c);
+    T s = 1/std::sin(angle);
+    return std::sin((1-t)*angle)*s*a + sign*std::sin(t*angle)*s*b;
+}
+
+//a single value used for every element of an array expression
+template<class T>
+class ScalarArray : public ArrayExpr<T, 1, ScalarArray<T> > {
+public:
+    ScalarArray(const T &pv) : v(pv) { }
+    inline void get(size_t, T *r) const { r[0] = v; }
+private:
+    const T v;
+};
+
+//per element nlerp and slerp of arrays of quaternions with t either a
+//scalar or an array of scalars. The slerp evaluates the series of
+//sin(t*angle)/sin(angle) in cos(angle)-1 as in Eberly's "A Fast and
+//Accurate Algorithm for Computing SLERP", truncated after 12 terms with
+//a correction factor on the last one. It has no trigonometry or data
+//dependent branches and vectorizes, the error is around 1e-6.
+template<class T, class A, class B, class C, bool SLERP>
+class ArrQuatLerpExpr : public ArrayExpr<T, 4, ArrQuatLerpExpr<T, A, B, C, SLERP> > {
+public:
+    ArrQuatLerpExpr(const A& pa, const B& pb, const C& pc) : a(pa), b(pb), c(pc)
+    {
+        ArrayCheckSizes(a.size(), b.size());
+    }
+    size_t size() const { return a.size(); }
+    inline void get(size_t i, T *r) const
+    {
+        T x[4], y[4], t;
+        a.get(i, x);
+        b.get(i, y);
+        c.get(i, &t);
+        T cs = x[0]*y[0] + x[1]*y[1] + x[2]*y[2] + x[3]*y[3];
+        T sign = cs < 0 ? T(-1) : T(1);
+        T ca, cb;
+        if(SLERP)
+        {
+            const T mu = T(1.8938);
+            T xm1 = cs*sign - 1;
+            T d = 1-t;
+            T tt = t*t, dd = d*d;
+            T pt = 1, pd = 1;
+            for(int k = 12; k>=1; --k)
+            {
+                T u = T(1)/T(k*(2*k+1));
+                T v = T(k)/T(2*k+1);
+                if(k == 12)
+                {
+                    u *= mu;
+                    v *= mu;
+                }
+                pt = 1 + (u*tt - v)*xm1*pt;
+                pd = 1 + (u*dd - v)*xm1*pd;
+            }
+            ca = d*pd;
+            cb = sign*t*pt;
+        }
+        else
+        {
+            ca = 1-t;
+            cb = sign*t;
+        }
+        T n = 0;
+        for(unsigned d = 0; d<4; ++d)
+        {
+            r[d] = ca*x[d] + cb*y[d];
+            n += r[d]*r[d];
+        }
+        if(!SLERP)
+        {
+            n = 1/std::sqrt(n);
+            for(unsigned d = 0; d<4; ++d)
+                r[d] *= n;
+        }
+    }
+private:
+    typename expression_storage<A>::type a;
+    typename expression_storage<B>::type b;
+    typename expression_storage<C>::type c;
+};
+
+template<class T, class A, class B>
+inline ArrQuatLerpExpr<T, A, B, ScalarArray<T>, false>
+nlerp(const ArrayExpr<T, 4, A> &a, const ArrayExpr<T, 4, B> &b, const T &t)
+{
+    return ArrQuatLerpExpr<T, A, B, ScalarArray<T>, false>(a, b, ScalarArray<T>(t));
+}
+
+template<class T, class A, class B, class C>
+inline ArrQuatLerpExpr<T, A, B, C, false>
+nlerp(const ArrayExpr<T, 4, A> &a, const ArrayExpr<T, 4, B> &b, const ArrayExpr<T, 1, C> &t)
+{
+    const A& ao ( a );
+    const C& to ( t );
+    ArrayCheckSizes(ao.size(), to.size());
+    return ArrQuatLerpExpr<T, A, B, C, false>(a, b, t);
+}
+
+template<class T, class A, class B>
+inline ArrQuatLerpExpr<T, A, B, ScalarArray<T>, true>
+slerp(const ArrayExpr<T, 4, A> &a, const ArrayExpr<T, 4, B> &b, const T &t)
+{
+    return ArrQuatLerpExpr<T, A, B, ScalarArray<T>, true>(a, b, ScalarArray<T>(t));
+}
+
+template<class T, class A, class B, class C>
+inline ArrQuatLerpExpr<T, A, B, C, true>
+slerp(const ArrayExpr<T, 4, A> &a, const ArrayExpr<T, 4, B> &b, const ArrayExpr<T, 1, C> &t)
+{
+    const A& ao ( a );
+    const C& to ( t );
+    ArrayCheckSizes(ao.size(), to.size());
+    return ArrQuatLerpExpr<T, A, B, C, true>(a, b, t);
+}
+
+#endif
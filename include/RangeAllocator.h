@@ -0,0 +1,449 @@
+/*
+ * RangeAllocator.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * RangeAllocator.h hands out ranges of a fixed size address space, such
+ * as the bytes of one large GL buffer (see GLMeshPool.h). It never
+ * touches the memory itself, so the bookkeeping stays on the CPU:
+ *
+ *     RangeAllocator allocator(1 << 24);
+ *     unsigned h = allocator.allocate(bytes, sizeof(Vertex));
+ *     if(h != RangeAllocatorNone)
+ *         glBufferSubData(GL_ARRAY_BUFFER, allocator.offset(h), bytes, data);
+ *     allocator.free(h);
+ *
+ * Free ranges are kept in segregated lists like TLSF (Masmoudi et al.:
+ * TLSF: a New Dynamic Memory Allocator for Real-Time Systems): a first
+ * level per power of two and RangeAllocatorSubdivisions second level
+ * lists within it, with a bitmap over both. Allocation and free are
+ * O(1), neighbouring free ranges merge immediately.
+ *
+ * Handles stay valid while compact() moves allocations down, one per
+ * call, so the memory can be defragmented a few copies per frame until
+ * all free space is one range at the end.
+ */
+
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+//log2 of the second level lists per power of two
+const unsigned RangeAllocatorSubdivisions = 4;
+
+//no handle, returned if an allocation fails
+const unsigned RangeAllocatorNone = ~0u;
+
+struct RangeAllocatorStats {
+    size_t capacity;
+    size_t live_bytes, free_bytes;
+    size_t allocations, free_ranges;
+    size_t largest_free;
+
+    //0 if all free space is one range, close to 1 if it is scattered
+    double fragmentation() const
+    {
+        return free_bytes ? 1.0 - double(largest_free)/double(free_bytes) : 0.0;
+    }
+};
+
+class RangeAllocator {
+public:
+    explicit RangeAllocator(size_t capacity) : capacity_(capacity), live(0), count(0)
+    {
+        std::fill(sl_bitmap, sl_bitmap+first_levels, 0u);
+        std::fill(&heads[0][0], &heads[0][0]+first_levels*second_levels, RangeAllocatorNone);
+        fl_bitmap = 0;
+        if(capacity > 0)
+        {
+            unsigned b = new_block(0, capacity);
+            insert_free(b);
+            first = last = b;
+        }
+        else
+            first = last = RangeAllocatorNone;
+    }
+
+    //a range of size units starting at a multiple of alignment, none if
+    //no free range is large enough
+    unsigned allocate(size_t size, size_t alignment = 1)
+    {
+        size = std::max<size_t>(size, 1);
+        alignment = std::max<size_t>(alignment, 1);
+        size_t search = size + alignment - 1;
+        if(search < size)
+            return RangeAllocatorNone;
+        unsigned b = find_free(search);
+        if(b == RangeAllocatorNone)
+            return RangeAllocatorNone;
+        remove_free(b);
+        b = carve(b, (alignment - blocks[b].offset%alignment)%alignment, size);
+        blocks[b].alignment = alignment;
+        return attach_handle(b);
+    }
+
+    //returns the range of handle h
+    void free(unsigned h)
+    {
+        unsigned b = check(h);
+        handle_block[h] = RangeAllocatorNone;
+        free_handles.push_back(h);
+        live -= blocks[b].size;
+        --count;
+        release(b);
+    }
+
+    size_t offset(unsigned h) const { return blocks[check(h)].offset; }
+    size_t size(unsigned h) const { return blocks[check(h)].size; }
+
+    //moves one allocation down, h is its handle and from and to the old
+    //and new offsets. The last allocation goes into a free range below
+    //it if there is one large enough, otherwise the allocation after the
+    //lowest free range slides down into it, the old and new range may
+    //overlap then. Returns false once nothing can move down.
+    bool compact(unsigned &h, size_t &from, size_t &to)
+    {
+        unsigned u = last;
+        while(u != RangeAllocatorNone && blocks[u].free)
+            u = blocks[u].prev_phys;
+        if(u == RangeAllocatorNone)
+            return false;
+        size_t size = blocks[u].size, alignment = blocks[u].alignment;
+        unsigned f = find_free(size + alignment - 1);
+        if(f != RangeAllocatorNone && blocks[f].offset < blocks[u].offset)
+        {
+            h = blocks[u].handle;
+            from = blocks[u].offset;
+            remove_free(f);
+            unsigned n = carve(f, (alignment - blocks[f].offset%alignment)%alignment, size);
+            blocks[n].alignment = alignment;
+            blocks[n].handle = h;
+            handle_block[h] = n;
+            to = blocks[n].offset;
+            release(u);
+            return true;
+        }
+        for(f = first; f != RangeAllocatorNone; f = blocks[f].next_phys)
+        {
+            u = blocks[f].next_phys;
+            if(!blocks[f].free || u == RangeAllocatorNone)
+                continue;
+            size_t pad = (blocks[u].alignment - blocks[f].offset%blocks[u].alignment)%blocks[u].alignment;
+            if(pad >= blocks[f].size)
+                continue;
+            h = blocks[u].handle;
+            from = blocks[u].offset;
+            slide(f, u, pad);
+            to = blocks[u].offset;
+            return true;
+        }
+        return false;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    RangeAllocatorStats stats() const
+    {
+        RangeAllocatorStats s = { capacity_, live, 0, count, 0, 0 };
+        for(unsigned b = last; b != RangeAllocatorNone; b = blocks[b].prev_phys)
+            if(blocks[b].free)
+            {
+                s.free_bytes += blocks[b].size;
+                s.largest_free = std::max(s.largest_free, blocks[b].size);
+                ++s.free_ranges;
+            }
+        return s;
+    }
+
+private:
+    static const unsigned second_levels = 1u << RangeAllocatorSubdivisions;
+    static const unsigned first_levels = 64;
+
+    struct Block {
+        size_t offset, size, alignment;
+        unsigned prev_phys, next_phys;
+        unsigned prev_free, next_free;
+        unsigned handle;
+        bool free;
+    };
+
+    static unsigned floor_log2(size_t x)
+    {
+        unsigned l = 0;
+        while(x >>= 1)
+            ++l;
+        return l;
+    }
+
+    //the list a free range of size s belongs to
+    static void mapping(size_t s, unsigned &fl, unsigned &sl)
+    {
+        if(s < second_levels)
+        {
+            fl = 0;
+            sl = unsigned(s);
+            return;
+        }
+        unsigned l = floor_log2(s);
+        fl = l - RangeAllocatorSubdivisions + 1;
+        sl = unsigned(s >> (l - RangeAllocatorSubdivisions)) ^ second_levels;
+    }
+
+    static unsigned lowest_bit(std::uint64_t x)
+    {
+        unsigned b = 0;
+        while(!(x & 1))
+        {
+            x >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    //a free block of at least s units: the head of the first list whose
+    //ranges are all large enough, else the first fit in the list of s
+    unsigned find_free(size_t s) const
+    {
+        unsigned fl, sl;
+        size_t rounded = s;
+        if(s >= second_levels)
+            rounded += (size_t(1) << (floor_log2(s) - RangeAllocatorSubdivisions)) - 1;
+        if(rounded >= s)
+        {
+            mapping(rounded, fl, sl);
+            if(fl < first_levels)
+            {
+                std::uint64_t sl_map = sl_bitmap[fl] & (~std::uint64_t(0) << sl);
+                std::uint64_t fl_map = fl+1 < first_levels ? fl_bitmap & (~std::uint64_t(0) << (fl+1)) : 0;
+                if(!sl_map && fl_map)
+                {
+                    fl = lowest_bit(fl_map);
+                    sl_map = sl_bitmap[fl];
+                }
+                if(sl_map)
+                    return heads[fl][lowest_bit(sl_map)];
+            }
+        }
+        mapping(s, fl, sl);
+        for(unsigned b = heads[fl][sl]; b != RangeAllocatorNone; b = blocks[b].next_free)
+            if(blocks[b].size >= s)
+                return b;
+        return RangeAllocatorNone;
+    }
+
+    void insert_free(unsigned b)
+    {
+        unsigned fl, sl;
+        mapping(blocks[b].size, fl, sl);
+        blocks[b].free = true;
+        blocks[b].prev_free = RangeAllocatorNone;
+        blocks[b].next_free = heads[fl][sl];
+        if(heads[fl][sl] != RangeAllocatorNone)
+            blocks[heads[fl][sl]].prev_free = b;
+        heads[fl][sl] = b;
+        sl_bitmap[fl] |= 1u << sl;
+        fl_bitmap |= std::uint64_t(1) << fl;
+    }
+
+    void remove_free(unsigned b)
+    {
+        unsigned fl, sl;
+        mapping(blocks[b].size, fl, sl);
+        Block &block = blocks[b];
+        if(block.prev_free != RangeAllocatorNone)
+            blocks[block.prev_free].next_free = block.next_free;
+        else
+            heads[fl][sl] = block.next_free;
+        if(block.next_free != RangeAllocatorNone)
+            blocks[block.next_free].prev_free = block.prev_free;
+        if(heads[fl][sl] == RangeAllocatorNone)
+        {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if(!sl_bitmap[fl])
+                fl_bitmap &= ~(std::uint64_t(1) << fl);
+        }
+        block.free = false;
+    }
+
+    //splits the free block b (already removed from its list) into a
+    //free front of pad units, the used part and a free tail
+    unsigned carve(unsigned b, size_t pad, size_t size)
+    {
+        if(pad > 0)
+        {
+            unsigned front = b;
+            b = split(front, pad);
+            insert_free(front);
+        }
+        if(blocks[b].size > size)
+            insert_free(split(b, size));
+        blocks[b].free = false;
+        return b;
+    }
+
+    //cuts b after size units, returns the block of the rest
+    unsigned split(unsigned b, size_t size)
+    {
+        unsigned r = new_block(blocks[b].offset+size, blocks[b].size-size);
+        blocks[r].prev_phys = b;
+        blocks[r].next_phys = blocks[b].next_phys;
+        if(blocks[b].next_phys != RangeAllocatorNone)
+            blocks[blocks[b].next_phys].prev_phys = r;
+        else
+            last = r;
+        blocks[b].next_phys = r;
+        blocks[b].size = size;
+        return r;
+    }
+
+    //moves the used block u down into the free block f before it, f
+    //keeps pad units and the rest of it ends up behind u
+    void slide(unsigned f, unsigned u, size_t pad)
+    {
+        remove_free(f);
+        size_t moved = blocks[f].size - pad;
+        blocks[u].offset = blocks[f].offset + pad;
+        if(pad > 0)
+        {
+            blocks[f].size = pad;
+            insert_free(f);
+        }
+        else
+        {
+            blocks[u].prev_phys = blocks[f].prev_phys;
+            if(blocks[f].prev_phys != RangeAllocatorNone)
+                blocks[blocks[f].prev_phys].next_phys = u;
+            else
+                first = u;
+            free_blocks.push_back(f);
+        }
+        unsigned next = blocks[u].next_phys;
+        if(next != RangeAllocatorNone && blocks[next].free)
+        {
+            remove_free(next);
+            blocks[next].offset -= moved;
+            blocks[next].size += moved;
+            insert_free(next);
+            return;
+        }
+        size_t end = blocks[u].offset + blocks[u].size;
+        unsigned r = new_block(end, moved);
+        blocks[r].prev_phys = u;
+        blocks[r].next_phys = next;
+        if(next != RangeAllocatorNone)
+            blocks[next].prev_phys = r;
+        else
+            last = r;
+        blocks[u].next_phys = r;
+        insert_free(r);
+    }
+
+    //frees a used block and merges it with free neighbours
+    void release(unsigned b)
+    {
+        unsigned next = blocks[b].next_phys;
+        if(next != RangeAllocatorNone && blocks[next].free)
+        {
+            remove_free(next);
+            merge(b, next);
+        }
+        unsigned prev = blocks[b].prev_phys;
+        if(prev != RangeAllocatorNone && blocks[prev].free)
+        {
+            remove_free(prev);
+            merge(prev, b);
+            b = prev;
+        }
+        insert_free(b);
+    }
+
+    //appends the block r to its physical predecessor b
+    void merge(unsigned b, unsigned r)
+    {
+        blocks[b].size += blocks[r].size;
+        blocks[b].next_phys = blocks[r].next_phys;
+        if(blocks[r].next_phys != RangeAllocatorNone)
+            blocks[blocks[r].next_phys].prev_phys = b;
+        else
+            last = b;
+        free_blocks.push_back(r);
+    }
+
+    unsigned new_block(size_t offset, size_t size)
+    {
+        Block block = { offset, size, 1, RangeAllocatorNone, RangeAllocatorNone, RangeAllocatorNone, RangeAllocatorNone, RangeAllocatorNone, true };
+        if(!free_blocks.empty())
+        {
+            unsigned b = free_blocks.back();
+            free_blocks.pop_back();
+            blocks[b] = block;
+            return b;
+        }
+        blocks.push_back(block);
+        return unsigned(blocks.size()-1);
+    }
+
+    unsigned attach_handle(unsigned b)
+    {
+        unsigned h;
+        if(!free_handles.empty())
+        {
+            h = free_handles.back();
+            free_handles.pop_back();
+            handle_block[h] = b;
+        }
+        else
+        {
+            h = unsigned(handle_block.size());
+            handle_block.push_back(b);
+        }
+        blocks[b].handle = h;
+        live += blocks[b].size;
+        ++count;
+        return h;
+    }
+
+    unsigned check(unsigned h) const
+    {
+        if(h >= handle_block.size() || handle_block[h] == RangeAllocatorNone)
+            throw std::invalid_argument("RangeAllocator invalid handle");
+        return handle_block[h];
+    }
+
+    size_t capacity_;
+    size_t live, count;
+    std::vector<Block> blocks;
+    std::vector<unsigned> free_blocks;
+    std::vector<unsigned> handle_block;
+    std::vector<unsigned> free_handles;
+    unsigned first, last;
+    std::uint64_t fl_bitmap;
+    std::uint32_t sl_bitmap[first_levels];
+    unsigned heads[first_levels][second_levels];
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Skinning.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * Skinning.h builds matrix palettes for linear blend skinning. A
+ * Skeleton holds the bone hierarchy (parents before children) and the
+ * inverse bind matrices. BuildPalettes turns the local bone poses of
+ * many characters into one palette per character, each bone stored as
+ * the top 3 rows of global*inverse_bind in 12 consecutive floats. That
+ * layout is meant for an RGBA32F buffer texture (see
+ * GLSkinningPalette.h) with 3 texels per bone. SkinVertices is the
+ * matching CPU fallback.
+ */
+
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "MathSimd.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//characters per thread when building palettes
+const size_t PaletteGrain = 64;
+
+//vertices per thread in SkinVertices
+const size_t SkinningGrain = 16384;
+
+//floats per bone in a palette
+const unsigned PaletteBoneSize = 12;
+
+template<class T>
+class Skeleton {
+public:
+    //parent of the root bones
+    static const unsigned none = unsigned(-1);
+
+    //parent has to be none or an existing bone, returns the new bone
+    unsigned add(unsigned parent, const Matrix<T,4,4> &inverse_bind)
+    {
+        unsigned i = unsigned(parents.size());
+        if(parent != none && parent >= i)
+            throw std::invalid_argument("Skeleton parent does not exist");
+        parents.push_back(parent);
+        inverse_binds.push_back(inverse_bind);
+        return i;
+    }
+
+    size_t size() const { return parents.size(); }
+    unsigned parent(unsigned i) const { return parents[i]; }
+    const Matrix<T,4,4>& inverse_bind(unsigned i) const { return inverse_binds[i]; }
+
+private:
+    std::vector<unsigned> parents;
+    std::vector<Matrix<T,4,4> > inverse_binds;
+};
+
+//the top 3 rows of m as 12 consecutive values
+template<class T>
+inline void StorePaletteRows(const Matrix<T,4,4> &m, T *out)
+{
+    for(unsigned i = 0; i<3; ++i)
+        for(unsigned j = 0; j<4; ++j)
+            out[4*i+j] = m(i,j);
+}
+
+inline void StorePaletteRows(const Matrix<float,4,4> &m, float *out)
+{
+    simd::mat4_rows3(m.raw(), out);
+}
+
+//top 3 rows of global*inverse_bind, inverse_bind_t is the transpose of
+//inverse_bind
+template<class T>
+inline void StoreSkinRows(const Matrix<T,4,4> &global, const Matrix<T,4,4> &inverse_bind_t, T *out)
+{
+    StorePaletteRows(Matrix<T,4,4>(global*Transpose(inverse_bind_t)), out);
+}
+
+inline void StoreSkinRows(const Matrix<float,4,4> &global, const Matrix<float,4,4> &inverse_bind_t, float *out)
+{
+    simd::mat4_mul_rows3(global.raw(), inverse_bind_t.raw(), out);
+}
+
+//local holds size() bone poses relative to their parents for each of
+//count characters, palettes receives PaletteBoneSize*size() values per
+//character. Characters are split across threads.
+template<class T>
+void BuildPalettes(const Skeleton<T> &skeleton, const Matrix<T,4,4> *local,
+                   size_t count, T *palettes, size_t grain = PaletteGrain)
+{
+    const size_t bones = skeleton.size();
+    std::vector<unsigned> parents(bones);
+    std::vector<Matrix<T,4,4> > inverse_binds_t(bones);
+    for(unsigned b = 0; b<bones; ++b)
+    {
+        parents[b] = skeleton.parent(b);
+        inverse_binds_t[b] = Transpose(skeleton.inverse_bind(b));
+    }
+    glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+        //locals instead of the captured references, which the compiler
+        //would reload after every store to palettes
+        const unsigned n = unsigned(bones);
+        const unsigned *parent = parents.data();
+        const Matrix<T,4,4> *inverse_bind_t = inverse_binds_t.data();
+        std::vector<Matrix<T,4,4> > globals(n);
+        Matrix<T,4,4> *global = globals.data();
+        for(size_t c = begin; c<end; ++c)
+        {
+            const Matrix<T,4,4> *pose = local+c*n;
+            T *out = palettes+c*n*PaletteBoneSize;
+            for(unsigned b = 0; b<n; ++b)
+            {
+                if(parent[b] == Skeleton<T>::none)
+                    global[b] = pose[b];
+                else
+                    global[b] = global[parent[b]]*pose[b];
+                StoreSkinRows(global[b], inverse_bind_t[b], out+b*PaletteBoneSize);
+            }
+        }
+    });
+}
+
+//linear blend skinning on the CPU with 4 influences per vertex. bones
+//and weights may be any integer and float/Norm vectors, weights are
+//expected to sum up to one.
+template<class TB, class TW, class TP, class TN>
+void SkinVertices(const float *palette,
+                  const StridedVectorArray<TB,4> &bones,
+                  const StridedVectorArray<TW,4> &weights,
+                  const StridedVectorArray<TP,3> &positions,
+                  const StridedVectorArray<TN,3> &normals,
+                  const StridedVectorArray<float,3> &positions_out,
+                  const StridedVectorArray<float,3> &normals_out,
+                  size_t grain = SkinningGrain)
+{
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TP>::type, float>::value));
+    BOOST_STATIC_ASSERT((boost::is_same<typename boost::remove_const<TN>::type, float>::value));
+    size_t n = std::min(positions.size(), positions_out.size());
+    bool skin_normals = normals.size() >= n && normals_out.size() >= n;
+    glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i<end; ++i)
+        {
+            unsigned b[4];
+            float w[4];
+            for(unsigned k = 0; k<4; ++k)
+            {
+                b[k] = unsigned(bones.ptr(i)[k]);
+                w[k] = float(weights.ptr(i)[k]);
+            }
+            simd::skin4(palette, b, w, positions.ptr(i),
+                        skin_normals ? normals.ptr(i) : 0,
+                        positions_out.ptr(i),
+                        skin_normals ? normals_out.ptr(i) : 0);
+        }
+    });
+}
+
+//positions only
+template<class TB, class TW, class TP>
+void SkinVertices(const float *palette,
+                  const StridedVectorArray<TB,4> &bones,
+                  const StridedVectorArray<TW,4> &weights,
+                  const StridedVectorArray<TP,3> &positions,
+                  const StridedVectorArray<float,3> &positions_out,
+                  size_t grain = SkinningGrain)
+{
+    StridedVectorArray<const float,3> none(0, 0);
+    SkinVertices(palette, bones, weights, positions, none,
+                 positions_out, StridedVectorArray<float,3>(0, 0), grain);
+}
+
+#endif
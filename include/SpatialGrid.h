@@ -0,0 +1,774 @@
+/*
+ * SpatialGrid.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * SpatialGrid.h indexes points by the cubic cell they fall into for
+ * radius and k nearest neighbour queries, for example over particle
+ * positions:
+ *
+ *     SpatialGrid<float,3> grid(radius, AttributeArray<0>(particles));
+ *     grid.radius(p, radius, [&](unsigned i, float dist2) { ... });
+ *
+ * Cells either map to buckets through a hash of their coordinates
+ * (HashedCells, unbounded) or form a dense grid over the bounds of the
+ * points (UniformCells). In the dense grid neighbouring cells along x
+ * are neighbouring buckets, so a row of cells is one contiguous range.
+ *
+ * build() sorts the points into buckets with a parallel radix sort
+ * (a few counting sort passes over the bucket index) and keeps a copy
+ * of the positions in that order, so a query walks consecutive memory
+ * per cell. update() moves a subset of points: points that stay in
+ * their bucket are updated in place, the others go to a small sorted
+ * overflow list until it grows past size()/SpatialGridRebuildRatio and
+ * everything is rebuilt.
+ */
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+
+#include "MathVector.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//points per thread when building
+const size_t SpatialGridGrain = 16384;
+
+//queries per thread for batched queries
+const size_t SpatialQueryGrain = 1024;
+
+//largest number of dense cells per point, the cells get larger beyond it
+const unsigned SpatialGridCellsPerPoint = 4;
+
+//bits of the bucket index sorted per counting sort pass
+const unsigned SpatialGridRadixBits = 11;
+
+//update() rebuilds once more than size()/SpatialGridRebuildRatio points
+//are out of place
+const unsigned SpatialGridRebuildRatio = 8;
+
+enum HashedCells { hashed_cells };
+enum UniformCells { uniform_cells };
+
+template<class T, unsigned D, class Cells = HashedCells>
+class SpatialGrid {
+    BOOST_STATIC_ASSERT((boost::is_same<Cells, HashedCells>::value ||
+                         boost::is_same<Cells, UniformCells>::value));
+    static const bool dense = boost::is_same<Cells, UniformCells>::value;
+public:
+    //point of empty k nearest slots
+    static const unsigned none = unsigned(-1);
+
+    explicit SpatialGrid(T cell_size) : cell(cell_size), cell_(cell_size), holes(0)
+    { }
+
+    template<class TP>
+    SpatialGrid(T cell_size, const StridedVectorArray<TP,D> &positions,
+                size_t grain = SpatialGridGrain)
+        : cell(cell_size), cell_(cell_size), holes(0)
+    {
+        build(positions, grain);
+    }
+
+    template<class TP>
+    void build(const StridedVectorArray<TP,D> &positions, size_t grain = SpatialGridGrain)
+    {
+        size_t n = positions.size();
+        overflow.clear();
+        holes = 0;
+        cell_ = cell;
+        inv_cell = T(1)/cell_;
+        points_.resize(n);
+        index_.resize(n);
+        slot_.resize(n);
+        compute_bounds(positions, grain);
+        if(dense)
+            fit_cells(n);
+
+        size_t buckets = dense ? dense_buckets() : hashed_buckets(n);
+        mask = unsigned(buckets-1);
+        keys.resize(n);
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                keys[i] = bucket(load(positions, i));
+                index_[i] = unsigned(i);
+            }
+        });
+        radix_sort(buckets, grain);
+
+        //bucket b starts at the first key not below b
+        starts.resize(buckets+1);
+        glp::parallel_for(0, n, grain, [&](size_t begin, size_t end) {
+            for(size_t s = begin; s<end; ++s)
+            {
+                unsigned b0 = s ? keys[s-1]+1 : 0;
+                for(unsigned b = b0; b<=keys[s]; ++b)
+                    starts[b] = unsigned(s);
+                points_[s] = load(positions, index_[s]);
+                slot_[index_[s]] = unsigned(s);
+            }
+        });
+        unsigned b0 = n ? keys[n-1]+1 : 0;
+        std::fill(starts.begin()+b0, starts.end(), unsigned(n));
+    }
+
+    //moves the points listed in moved (each at most once) to their new
+    //positions, positions holds all points as in build()
+    template<class TP>
+    void update(const StridedVectorArray<TP,D> &positions,
+                const unsigned *moved, size_t count, size_t grain = SpatialGridGrain)
+    {
+        const size_t n = index_.size();
+        if(positions.size() != slot_.size())
+            throw std::invalid_argument("SpatialGrid::update point count changed");
+        if(dense)
+            for(size_t m = 0; m<count; ++m)
+                if(!inside(load(positions, moved[m])))
+                {
+                    build(positions, grain);
+                    return;
+                }
+
+        //points that stay in their bucket are done here, the others
+        //leave a hole and get their new bucket in moves. Hashed bounds
+        //only grow on the serial path below.
+        std::vector<unsigned> moves(count);
+        glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+            for(size_t m = begin; m<end; ++m)
+            {
+                unsigned i = moved[m], s = slot_[i];
+                Vector<T,D> p = load(positions, i);
+                unsigned b = bucket(p);
+                moves[m] = none;
+                if(s < n && bucket(points_[s]) == b && inside(p))
+                {
+                    points_[s] = p;
+                    continue;
+                }
+                if(s < n)
+                    index_[s] = none;
+                else
+                    overflow[s-n].index = none;
+                moves[m] = b;
+            }
+        });
+
+        size_t removed = 0;
+        for(size_t m = 0; m<count; ++m)
+        {
+            if(moves[m] == none)
+                continue;
+            unsigned i = moved[m];
+            if(slot_[i] < n)
+                ++holes;
+            else
+                ++removed;
+            Overflow o = { moves[m], i, load(positions, i) };
+            overflow.push_back(o);
+            if(!dense)
+                grow_bounds(o.p);
+        }
+        if(removed)
+            overflow.erase(std::remove_if(overflow.begin(), overflow.end(), is_removed),
+                           overflow.end());
+        //every point in overflow left a hole
+        if(holes > n/SpatialGridRebuildRatio)
+        {
+            build(positions, grain);
+            return;
+        }
+        std::sort(overflow.begin(), overflow.end(), overflow_less);
+        spill.assign((buckets()+31)/32, 0);
+        for(size_t o = 0; o<overflow.size(); ++o)
+        {
+            slot_[overflow[o].index] = unsigned(n+o);
+            spill[overflow[o].bucket/32] |= 1u << (overflow[o].bucket%32);
+        }
+    }
+
+    //calls f(index, squared distance) for every point within r of p
+    template<class F>
+    void radius(const Vector<T,D> &p, T r, F f) const
+    {
+        int lo[D], hi[D];
+        for(unsigned k = 0; k<D; ++k)
+        {
+            lo[k] = std::max(coord(p[k]-r), cell_lo[k]);
+            hi[k] = std::min(coord(p[k]+r), cell_hi[k]);
+            if(lo[k] > hi[k] || index_.empty())
+                return;
+        }
+        Query query = { p, r*r };
+        auto found = [&f](unsigned i, const Vector<T,D>&, T d2) { f(i, d2); };
+        //radii much larger than the cells are cheaper as a plain scan
+        if(cells(lo, hi) > points())
+        {
+            visit_buckets(0, unsigned(buckets()), query, found);
+            return;
+        }
+        int c[D];
+        std::copy(lo, lo+D, c);
+        do {
+            visit_row(c, lo[0], hi[0], query, found);
+        } while(next_row(c, lo, hi));
+    }
+
+    size_t radius(const Vector<T,D> &p, T r, std::vector<unsigned> &result) const
+    {
+        size_t before = result.size();
+        radius(p, r, [&result](unsigned i, T) { result.push_back(i); });
+        return result.size()-before;
+    }
+
+    //the k nearest points sorted by distance, returns how many were
+    //found. Unused entries of result are none, dist2 may be null.
+    unsigned nearest(const Vector<T,D> &p, unsigned k, unsigned *result, T *dist2 = 0) const
+    {
+        std::vector<Candidate> heap;
+        return nearest(p, k, result, dist2, heap);
+    }
+
+    //k nearest points of every query, k entries per query
+    template<class TP>
+    void nearest(const StridedVectorArray<TP,D> &queries, unsigned k,
+                 unsigned *result, T *dist2 = 0, size_t grain = SpatialQueryGrain) const
+    {
+        glp::parallel_for(0, queries.size(), grain, [&](size_t begin, size_t end) {
+            std::vector<Candidate> heap;
+            for(size_t q = begin; q<end; ++q)
+                nearest(load(queries, q), k, result+q*k, dist2 ? dist2+q*k : 0, heap);
+        });
+    }
+
+    //neighbours within r of every indexed point, excluding the point
+    //itself. The neighbours of i are list[offsets[i]] to
+    //list[offsets[i+1]-1].
+    void neighbours(T r, std::vector<size_t> &offsets, std::vector<unsigned> &list,
+                    size_t grain = SpatialQueryGrain) const
+    {
+        const size_t n = index_.size(), total = n+overflow.size();
+        offsets.assign(slot_.size()+1, 0);
+        //walking the points in bucket order keeps the queries local
+        glp::parallel_for(0, total, grain, [&](size_t begin, size_t end) {
+            for(size_t s = begin; s<end; ++s)
+            {
+                unsigned i = s<n ? index_[s] : overflow[s-n].index;
+                if(i == none)
+                    continue;
+                size_t found = 0;
+                radius(s<n ? points_[s] : overflow[s-n].p, r,
+                       [&found, i](unsigned j, T) { found += j != i; });
+                offsets[i] = found;
+            }
+        });
+        size_t sum = 0;
+        for(size_t i = 0; i<offsets.size(); ++i)
+        {
+            size_t c = offsets[i];
+            offsets[i] = sum;
+            sum += c;
+        }
+        list.resize(sum);
+        glp::parallel_for(0, total, grain, [&](size_t begin, size_t end) {
+            for(size_t s = begin; s<end; ++s)
+            {
+                unsigned i = s<n ? index_[s] : overflow[s-n].index;
+                if(i == none)
+                    continue;
+                unsigned *out = list.data()+offsets[i];
+                radius(s<n ? points_[s] : overflow[s-n].p, r,
+                       [&out, i](unsigned j, T) { if(j != i) *out++ = j; });
+            }
+        });
+    }
+
+    //number of points
+    size_t size() const { return slot_.size(); }
+
+    //edge length of the cells, larger than requested if a dense grid
+    //would have had too many cells
+    T cell_size() const { return cell_; }
+
+    size_t buckets() const { return starts.empty() ? 0 : starts.size()-1; }
+
+    //point indices in bucket order as of the last build, none for points
+    //that moved out since. Reordering per point data the same way keeps
+    //neighbours close in memory.
+    const std::vector<unsigned>& order() const { return index_; }
+
+private:
+    struct Overflow {
+        unsigned bucket;
+        unsigned index;
+        Vector<T,D> p;
+    };
+
+    //position and largest squared distance of a query
+    struct Query {
+        Vector<T,D> p;
+        T limit;
+    };
+
+    //squared distance and point, ordered for a max heap
+    typedef std::pair<T, unsigned> Candidate;
+
+    template<class TP>
+    static Vector<T,D> load(const StridedVectorArray<TP,D> &positions, size_t i)
+    {
+        const TP *p = positions.ptr(i);
+        Vector<T,D> v(uninitialized);
+        for(unsigned k = 0; k<D; ++k)
+            v[k] = T(p[k]);
+        return v;
+    }
+
+    static T dist2(const Vector<T,D> &a, const Vector<T,D> &b)
+    {
+        T d2 = 0;
+        for(unsigned k = 0; k<D; ++k)
+            d2 += (a[k]-b[k])*(a[k]-b[k]);
+        return d2;
+    }
+
+    static bool is_removed(const Overflow &o) { return o.index == none; }
+
+    static bool overflow_less(const Overflow &a, const Overflow &b)
+    {
+        return a.bucket < b.bucket || (a.bucket == b.bucket && a.index < b.index);
+    }
+
+    static bool overflow_bucket_less(const Overflow &a, unsigned b) { return a.bucket < b; }
+
+    //cell coordinate, clamped so far away points don't overflow
+    int coord(T x) const
+    {
+        const T limit = T(1 << 30);
+        T c = std::floor(x*inv_cell);
+        return int(std::max(-limit, std::min(limit, c)));
+    }
+
+    bool inside(const Vector<T,D> &p) const
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            int c = coord(p[k]);
+            if(c < cell_lo[k] || c > cell_hi[k])
+                return false;
+        }
+        return true;
+    }
+
+    unsigned bucket(const int *c) const
+    {
+        if(dense)
+        {
+            size_t b = 0;
+            for(unsigned k = D; k-- > 0;)
+                b = b*size_t(cell_hi[k]-cell_lo[k]+1) + size_t(c[k]-cell_lo[k]);
+            return unsigned(b);
+        }
+        //rows along x stay consecutive buckets
+        unsigned h = 0;
+        for(unsigned k = 1; k<D; ++k)
+            h = (h ^ unsigned(c[k]))*0x9E3779B1u;
+        return ((h ^ (h >> 16))+unsigned(c[0])) & mask;
+    }
+
+    unsigned bucket(const Vector<T,D> &p) const
+    {
+        int c[D];
+        for(unsigned k = 0; k<D; ++k)
+            c[k] = coord(p[k]);
+        return bucket(c);
+    }
+
+    template<class TP>
+    void compute_bounds(const StridedVectorArray<TP,D> &positions, size_t grain)
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            bounds_lo[k] = std::numeric_limits<T>::max();
+            bounds_hi[k] = -std::numeric_limits<T>::max();
+        }
+        std::mutex merge;
+        glp::parallel_for(0, positions.size(), grain, [&](size_t begin, size_t end) {
+            T l[D], h[D];
+            for(unsigned k = 0; k<D; ++k)
+            {
+                l[k] = std::numeric_limits<T>::max();
+                h[k] = -std::numeric_limits<T>::max();
+            }
+            for(size_t i = begin; i<end; ++i)
+            {
+                const TP *p = positions.ptr(i);
+                for(unsigned k = 0; k<D; ++k)
+                {
+                    l[k] = std::min(l[k], T(p[k]));
+                    h[k] = std::max(h[k], T(p[k]));
+                }
+            }
+            std::lock_guard<std::mutex> lock(merge);
+            for(unsigned k = 0; k<D; ++k)
+            {
+                bounds_lo[k] = std::min(bounds_lo[k], l[k]);
+                bounds_hi[k] = std::max(bounds_hi[k], h[k]);
+            }
+        });
+        if(positions.size() == 0)
+            for(unsigned k = 0; k<D; ++k)
+                bounds_lo[k] = bounds_hi[k] = 0;
+        cell_bounds();
+    }
+
+    //dense grids get a border of one cell so points moving a little
+    //don't force a rebuild in update()
+    void cell_bounds()
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            cell_lo[k] = coord(bounds_lo[k])-dense;
+            cell_hi[k] = coord(bounds_hi[k])+dense;
+        }
+    }
+
+    void grow_bounds(const Vector<T,D> &p)
+    {
+        for(unsigned k = 0; k<D; ++k)
+        {
+            cell_lo[k] = std::min(cell_lo[k], coord(p[k]));
+            cell_hi[k] = std::max(cell_hi[k], coord(p[k]));
+        }
+    }
+
+    //grows the dense cells until there are few enough of them
+    void fit_cells(size_t n)
+    {
+        const double limit = double(SpatialGridCellsPerPoint)*double(std::max<size_t>(n, 16));
+        for(;;)
+        {
+            double count = cells(cell_lo, cell_hi);
+            if(count <= limit)
+                return;
+            cell_ *= T(std::pow(count/limit, 1.0/D)*1.01);
+            inv_cell = T(1)/cell_;
+            cell_bounds();
+        }
+    }
+
+    size_t dense_buckets() const
+    {
+        size_t cells = 1;
+        for(unsigned k = 0; k<D; ++k)
+            cells *= size_t(cell_hi[k]-cell_lo[k]+1);
+        return cells;
+    }
+
+    //twice the points or the cells in the bounds, whichever is less, as
+    //larger tables only spread the points further
+    size_t hashed_buckets(size_t n) const
+    {
+        double limit = 2*std::min(double(n), cells(cell_lo, cell_hi));
+        size_t buckets = 1;
+        while(double(buckets) < limit)
+            buckets *= 2;
+        return buckets;
+    }
+
+    //stable LSD radix sort of index_ by keys, one counting sort per
+    //SpatialGridRadixBits of the keys. Each pass counts the digits of
+    //blocks of grain keys in parallel and scatters them in parallel to
+    //the offsets of their block.
+    void radix_sort(size_t buckets, size_t grain)
+    {
+        const unsigned radix = 1u << SpatialGridRadixBits;
+        const size_t n = keys.size();
+        grain = std::max<size_t>(grain, 1);
+        size_t blocks = (n+grain-1)/grain;
+        std::vector<unsigned> offsets(blocks*radix);
+        std::vector<unsigned> keys2(n);
+        scratch.resize(n);
+        for(unsigned shift = 0; (size_t(1) << shift) < buckets; shift += SpatialGridRadixBits)
+        {
+            glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+                for(size_t b = begin; b<end; ++b)
+                {
+                    unsigned *count = &offsets[b*radix];
+                    std::fill(count, count+radix, 0u);
+                    for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                        ++count[(keys[i] >> shift) & (radix-1)];
+                }
+            });
+            unsigned sum = 0;
+            for(unsigned d = 0; d<radix; ++d)
+                for(size_t b = 0; b<blocks; ++b)
+                {
+                    unsigned c = offsets[b*radix+d];
+                    offsets[b*radix+d] = sum;
+                    sum += c;
+                }
+            glp::parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+                for(size_t b = begin; b<end; ++b)
+                {
+                    unsigned *offset = &offsets[b*radix];
+                    for(size_t i = b*grain; i<std::min(n, (b+1)*grain); ++i)
+                    {
+                        unsigned s = offset[(keys[i] >> shift) & (radix-1)]++;
+                        keys2[s] = keys[i];
+                        scratch[s] = index_[i];
+                    }
+                }
+            });
+            keys.swap(keys2);
+            index_.swap(scratch);
+        }
+    }
+
+    //true if any of the buckets b0 to b1-1 has points in overflow
+    bool spilled(unsigned b0, unsigned b1) const
+    {
+        for(unsigned b = b0; b<b1; ++b)
+            if(spill[b/32] & (1u << (b%32)))
+                return true;
+        return false;
+    }
+
+    //number of points including those in overflow
+    size_t points() const { return index_.size()+overflow.size(); }
+
+    //number of cells in [lo, hi]
+    static double cells(const int *lo, const int *hi)
+    {
+        double count = 1;
+        for(unsigned k = 0; k<D; ++k)
+            count *= double(hi[k]-lo[k]+1);
+        return count;
+    }
+
+    //advances c to the next row of cells in [lo, hi] along axes 1 to D-1
+    static bool next_row(int *c, const int *lo, const int *hi)
+    {
+        for(unsigned k = 1; k<D; ++k)
+        {
+            if(c[k] < hi[k])
+            {
+                ++c[k];
+                return true;
+            }
+            c[k] = lo[k];
+        }
+        return false;
+    }
+
+    //calls f(index, position, squared distance) for the points of the
+    //cells x0 to x1 in the row c[1..D-1] within the query distance.
+    //Rows are one range of buckets, hashed rows may wrap around and
+    //skip points of colliding cells.
+    template<class F>
+    void visit_row(int *c, int x0, int x1, const Query &query, F f) const
+    {
+        if(dense)
+        {
+            c[0] = x0;
+            unsigned b0 = bucket(c);
+            visit_buckets(b0, b0+unsigned(x1-x0)+1, query, f);
+            return;
+        }
+        c[0] = x0;
+        unsigned b0 = bucket(c), b1 = b0+unsigned(x1-x0)+1;
+        //only points that passed the distance test are checked
+        auto checked = [&](unsigned i, const Vector<T,D> &q, T d2) {
+            int x = coord(q[0]);
+            if(x < x0 || x > x1)
+                return;
+            for(unsigned k = 1; k<D; ++k)
+                if(coord(q[k]) != c[k])
+                    return;
+            f(i, q, d2);
+        };
+        //rows longer than the table or wrapping around its end
+        if(b1-b0 > mask)
+            visit_buckets(0, mask+1, query, checked);
+        else if(b1 > mask+1)
+        {
+            visit_buckets(b0, mask+1, query, checked);
+            visit_buckets(0, b1-(mask+1), query, checked);
+        }
+        else
+            visit_buckets(b0, b1, query, checked);
+    }
+
+    template<class F>
+    void visit_buckets(unsigned b0, unsigned b1, const Query &query, F f) const
+    {
+        for(unsigned s = starts[b0]; s<starts[b1]; ++s)
+        {
+            T d2 = dist2(query.p, points_[s]);
+            if(d2 <= query.limit && index_[s] != none)
+                f(index_[s], points_[s], d2);
+        }
+        if(overflow.empty() || !spilled(b0, b1))
+            return;
+        typename std::vector<Overflow>::const_iterator o =
+            std::lower_bound(overflow.begin(), overflow.end(), b0, overflow_bucket_less);
+        for(; o != overflow.end() && o->bucket < b1; ++o)
+        {
+            T d2 = dist2(query.p, o->p);
+            if(d2 <= query.limit)
+                f(o->index, o->p, d2);
+        }
+    }
+
+    //searches rings of cells around the cell of p until no closer
+    //point can be outside the rings searched so far
+    unsigned nearest(const Vector<T,D> &p, unsigned k, unsigned *result, T *dist2_out,
+                     std::vector<Candidate> &heap) const
+    {
+        heap.clear();
+        if(k == 0)
+            return 0;
+        int c[D];
+        //distance from p to the walls of its own cell
+        T margin = cell_;
+        int first = 0, last = 0;
+        for(unsigned a = 0; a<D; ++a)
+        {
+            c[a] = coord(p[a]);
+            T f = p[a]*inv_cell-std::floor(p[a]*inv_cell);
+            margin = std::min(margin, cell_*std::min(f, T(1)-f));
+            first = std::max(first, std::max(cell_lo[a]-c[a], c[a]-cell_hi[a]));
+            last = std::max(last, std::max(c[a]-cell_lo[a], cell_hi[a]-c[a]));
+        }
+        //the query distance shrinks to the k-th nearest once k are found
+        Query query = { p, std::numeric_limits<T>::max() };
+        auto insert = [&](unsigned i, const Vector<T,D>&, T d2) {
+            Candidate cand(d2, i);
+            if(heap.size() < k)
+            {
+                heap.push_back(cand);
+                std::push_heap(heap.begin(), heap.end());
+            }
+            else if(cand < heap.front())
+            {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = cand;
+                std::push_heap(heap.begin(), heap.end());
+            }
+            if(heap.size() == k)
+                query.limit = heap.front().first;
+        };
+        for(int s = first; s<=last && !index_.empty(); ++s)
+        {
+            //sparse points are cheaper to scan than many empty cells
+            int lo[D], hi[D];
+            for(unsigned a = 0; a<D; ++a)
+            {
+                lo[a] = std::max(c[a]-s, cell_lo[a]);
+                hi[a] = std::min(c[a]+s, cell_hi[a]);
+            }
+            if(cells(lo, hi) > points())
+            {
+                heap.clear();
+                query.limit = std::numeric_limits<T>::max();
+                visit_buckets(0, unsigned(buckets()), query, insert);
+                break;
+            }
+            visit_ring(c, s, query, insert);
+            T reach = T(s)*cell_+margin;
+            if(heap.size() == k && heap.front().first <= reach*reach)
+                break;
+        }
+        std::sort_heap(heap.begin(), heap.end());
+        for(unsigned j = 0; j<k; ++j)
+        {
+            result[j] = j<heap.size() ? heap[j].second : none;
+            if(dist2_out)
+                dist2_out[j] = j<heap.size() ? heap[j].first : std::numeric_limits<T>::max();
+        }
+        return unsigned(heap.size());
+    }
+
+    //visits the cells at Chebyshev distance s from center that lie
+    //within the bounds
+    template<class F>
+    void visit_ring(const int *center, int s, const Query &query, F f) const
+    {
+        int lo[D], hi[D], c[D];
+        for(unsigned k = 0; k<D; ++k)
+        {
+            lo[k] = std::max(center[k]-s, cell_lo[k]);
+            hi[k] = std::min(center[k]+s, cell_hi[k]);
+            if(lo[k] > hi[k])
+                return;
+        }
+        std::copy(lo, lo+D, c);
+        do {
+            bool edge = s == 0;
+            for(unsigned k = 1; k<D; ++k)
+                edge = edge || c[k] == center[k]-s || c[k] == center[k]+s;
+            if(edge)
+                visit_row(c, lo[0], hi[0], query, f);
+            else
+            {
+                if(center[0]-s >= cell_lo[0])
+                    visit_row(c, center[0]-s, center[0]-s, query, f);
+                if(center[0]+s <= cell_hi[0])
+                    visit_row(c, center[0]+s, center[0]+s, query, f);
+            }
+        } while(next_row(c, lo, hi));
+    }
+
+    T cell, cell_, inv_cell;
+    //bounds of the points and of their cells
+    T bounds_lo[D], bounds_hi[D];
+    int cell_lo[D], cell_hi[D];
+    unsigned mask;
+
+    //positions and indices in bucket order, holes have index none
+    std::vector<Vector<T,D> > points_;
+    std::vector<unsigned> index_;
+    //bucket i is points_[starts[i]] to points_[starts[i+1]-1]
+    std::vector<unsigned> starts;
+    //buckets of the points in index_ order and sort buffer, kept for
+    //the next build
+    std::vector<unsigned> keys, scratch;
+    //position of each point in points_, or size()+position in overflow
+    std::vector<unsigned> slot_;
+    std::vector<Overflow> overflow;
+    //one bit per bucket with points in overflow
+    std::vector<unsigned> spill;
+    size_t holes;
+};
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * StaticBatch.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * StaticBatch.h merges many instances of static meshes into one vertex
+ * and one index array with the world matrices baked into the vertices,
+ * so a level of props is drawn with a few calls instead of one per prop:
+ *
+ *     StaticBatchBuilder<Vertex> builder;
+ *     unsigned rock = builder.add_mesh(rock_vertices, rock_indices);
+ *     for(...)
+ *         builder.add_instance(rock, material, world);
+ *     builder.build<0,1>(32.0f);   //positions in 0, normals in 1
+ *
+ * Instances are sorted by material and then by the cell of a grid with
+ * the given cell size their center falls into (in Morton order, so
+ * consecutive chunks are close). Every run of instances with the same
+ * material and cell becomes a chunk with its own bounding box for
+ * culling, split further once it exceeds chunk_vertices. Chunk indices
+ * are relative to the first vertex of the chunk, so with the default
+ * limit they fit 16 bit and every chunk is one glDrawElementsBaseVertex
+ * (see GLStaticBatch.h).
+ *
+ * Positions are transformed with the MathSimd.h kernels of
+ * BatchTransform.h, normals with the inverse transpose, tangents as
+ * directions. Mirroring matrices flip the triangle winding and the
+ * handedness in w of 4 component tangents. The price is memory: every
+ * instance gets its own copy of the vertices, stats() compares that to
+ * the meshes drawn one by one.
+ */
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "BatchTransform.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+#include "VectorArray.h"
+
+//instances per task when baking
+const size_t StaticBatchGrain = 64;
+
+//vertices per chunk, chunks larger than this only hold one instance
+const size_t StaticBatchChunkVertices = 65536;
+
+//a draw call of a built batch
+struct StaticBatchChunk {
+    unsigned material;
+    //range in the indices, values are relative to base
+    size_t first, count;
+    //range in the vertices
+    size_t base, vertices;
+};
+
+struct StaticBatchStats {
+    size_t instances, draws, materials;
+    //vertex and index bytes of the meshes drawn one by one
+    size_t source_bytes;
+    //vertex and index bytes of the batch, 16 bit indices if they fit
+    size_t batched_bytes;
+
+    double draw_reduction() const { return draws ? double(instances)/double(draws) : 1.0; }
+    double memory_ratio() const { return source_bytes ? double(batched_bytes)/double(source_bytes) : 1.0; }
+};
+
+//transforms the optional normals (N) and tangents (T) of one instance,
+//-1 if the vertices have none
+template<int N>
+struct StaticBatchNormals {
+    template<class B>
+    static void transform(B &in, B &out, size_t src, size_t dst, size_t n,
+                          const Matrix<float,4,4> &world)
+    {
+        StridedVectorArray<float,3> from = AttributeArray<N>(in), to = AttributeArray<N>(out);
+        TransformNormals(world, MakeStridedArray<3>(from.ptr(src), n, from.stride()),
+                         MakeStridedArray<3>(to.ptr(dst), n, to.stride()), n);
+    }
+};
+
+template<>
+struct StaticBatchNormals<-1> {
+    template<class B>
+    static void transform(B&, B&, size_t, size_t, size_t, const Matrix<float,4,4>&) { }
+};
+
+template<int T>
+struct StaticBatchTangents {
+    template<class B>
+    static void transform(B &in, B &out, size_t src, size_t dst, size_t n,
+                          const Matrix<float,4,4> &world, bool mirror)
+    {
+        auto from = AttributeArray<T>(in);
+        auto to = AttributeArray<T>(out);
+        typedef decltype(to) tangent_array;
+        BOOST_STATIC_ASSERT(tangent_array::Dim == 3 || tangent_array::Dim == 4);
+        StridedVectorArray<float,3> t = MakeStridedArray<3>(to.ptr(dst), n, to.stride());
+        TransformDirections(world, MakeStridedArray<3>(from.ptr(src), n, from.stride()), t, n);
+        NormalizeVectors(t, t, exact_precision, n);
+        if(tangent_array::Dim == 4 && mirror)
+            for(size_t i = 0; i<n; ++i)
+                to.ptr(dst+i)[tangent_array::Dim-1] *= -1.0f;
+    }
+};
+
+template<>
+struct StaticBatchTangents<-1> {
+    template<class B>
+    static void transform(B&, B&, size_t, size_t, size_t, const Matrix<float,4,4>&, bool) { }
+};
+
+//interleaves the low 21 bits of x, y and z
+inline std::uint64_t StaticBatchMorton(std::uint64_t x, std::uint64_t y, std::uint64_t z)
+{
+    std::uint64_t key = 0;
+    for(unsigned b = 0; b<21; ++b)
+        key |= ((x >> b & 1) << 3*b) | ((y >> b & 1) << (3*b+1)) | ((z >> b & 1) << (3*b+2));
+    return key;
+}
+
+template<class V>
+class StaticBatchBuilder {
+public:
+    typedef V vertex_type;
+
+    StaticBatchBuilder() : materials(0)
+    { }
+
+    //copies a mesh and returns its id for add_instance
+    unsigned add_mesh(const V *vertices, size_t vertex_count, const unsigned *indices, size_t index_count)
+    {
+        for(size_t i = 0; i<index_count; ++i)
+            if(indices[i] >= vertex_count)
+                throw std::out_of_range("StaticBatchBuilder index out of range");
+        Mesh mesh;
+        mesh.vertices.assign(vertices, vertices+vertex_count);
+        mesh.indices.assign(indices, indices+index_count-index_count%3);
+        meshes.push_back(mesh);
+        return unsigned(meshes.size()-1);
+    }
+
+    unsigned add_mesh(const std::vector<V> &vertices, const std::vector<unsigned> &indices)
+    {
+        return add_mesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+
+    void add_instance(unsigned mesh, unsigned material, const Matrix<float,4,4> &world)
+    {
+        if(mesh >= meshes.size())
+            throw std::out_of_range("StaticBatchBuilder mesh out of range");
+        Instance instance = { mesh, material, world };
+        instances.push_back(instance);
+    }
+
+    //removes all meshes, instances and the batch
+    void clear()
+    {
+        meshes.clear();
+        instances.clear();
+        vertices_.clear();
+        indices_.clear();
+        chunks_.clear();
+        lo_.resize(0);
+        hi_.resize(0);
+        materials = 0;
+    }
+
+    //bakes and merges all instances, P is the position attribute, N and
+    //T the optional normal and tangent attributes
+    template<int P, int N = -1, int T = -1>
+    void build(float cell, size_t chunk_vertices = StaticBatchChunkVertices,
+               size_t grain = StaticBatchGrain)
+    {
+        if(!(cell > 0))
+            throw std::invalid_argument("StaticBatchBuilder cell size must be positive");
+        const size_t count = instances.size();
+
+        //local bounding box centers of the meshes
+        std::vector<Vector<float,3> > centers(meshes.size());
+        for(size_t m = 0; m<meshes.size(); ++m)
+        {
+            StridedVectorArray<float,3> positions = AttributeArray<P>(meshes[m].vertices);
+            Vector<float,3> lo(0, 0, 0), hi(0, 0, 0);
+            for(size_t i = 0; i<positions.size(); ++i)
+            {
+                Vector<float,3> p = positions[i];
+                lo = i ? Vector<float,3>(min(lo, p)) : p;
+                hi = i ? Vector<float,3>(max(hi, p)) : p;
+            }
+            centers[m] = (lo+hi)*0.5f;
+        }
+
+        //sort key: material, then the Morton code of the cell
+        std::vector<std::uint64_t> keys(count);
+        glp::parallel_for(0, count, 4*grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i<end; ++i)
+            {
+                const Instance &instance = instances[i];
+                Vector<float,4> c = instance.world*Vector<float,4>(centers[instance.mesh][0],
+                                                                   centers[instance.mesh][1],
+                                                                   centers[instance.mesh][2], 1.0f);
+                std::uint64_t code[3];
+                for(unsigned d = 0; d<3; ++d)
+                {
+                    double x = std::floor(double(c[d])/double(cell)) + double(1 << 20);
+                    code[d] = std::uint64_t(std::max(0.0, std::min(double((1 << 21)-1), x)));
+                }
+                keys[i] = StaticBatchMorton(code[0], code[1], code[2]);
+            }
+        });
+        std::vector<unsigned> order(count);
+        for(size_t i = 0; i<count; ++i)
+            order[i] = unsigned(i);
+        std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+            if(instances[a].material != instances[b].material)
+                return instances[a].material < instances[b].material;
+            if(keys[a] != keys[b])
+                return keys[a] < keys[b];
+            return a < b;
+        });
+
+        //chunks and the offsets of every instance in them
+        std::vector<size_t> vertex_offsets(count), index_offsets(count), chunk_of(count);
+        chunks_.clear();
+        materials = 0;
+        size_t vertex_total = 0, index_total = 0;
+        for(size_t s = 0; s<count; ++s)
+        {
+            const Instance &instance = instances[order[s]];
+            const Mesh &mesh = meshes[instance.mesh];
+            bool split = s == 0 ||
+                instance.material != instances[order[s-1]].material ||
+                keys[order[s]] != keys[order[s-1]] ||
+                chunks_.back().vertices + mesh.vertices.size() > chunk_vertices;
+            if(s == 0 || instance.material != instances[order[s-1]].material)
+                ++materials;
+            if(split)
+            {
+                StaticBatchChunk chunk = { instance.material, index_total, 0, vertex_total, 0 };
+                chunks_.push_back(chunk);
+            }
+            vertex_offsets[s] = vertex_total;
+            index_offsets[s] = index_total;
+            chunk_of[s] = chunks_.size()-1;
+            chunks_.back().vertices += mesh.vertices.size();
+            chunks_.back().count += mesh.indices.size();
+            vertex_total += mesh.vertices.size();
+            index_total += mesh.indices.size();
+        }
+
+        //bake every instance and its bounding box
+        vertices_.resize(vertex_total);
+        indices_.resize(index_total);
+        VectorArray<float,3> instance_lo(count), instance_hi(count);
+        glp::parallel_for(0, count, grain, [&](size_t begin, size_t end) {
+            for(size_t s = begin; s<end; ++s)
+            {
+                const Instance &instance = instances[order[s]];
+                Mesh &mesh = meshes[instance.mesh];
+                const size_t n = mesh.vertices.size(), dst = vertex_offsets[s];
+                std::copy(mesh.vertices.begin(), mesh.vertices.end(), vertices_.begin()+dst);
+
+                StridedVectorArray<float,3> from = AttributeArray<P>(mesh.vertices);
+                StridedVectorArray<float,3> to = AttributeArray<P>(vertices_);
+                StridedVectorArray<float,3> baked = MakeStridedArray<3>(to.ptr(dst), n, to.stride());
+                TransformPoints(instance.world, MakeStridedArray<3>(from.ptr(0), n, from.stride()), baked, n);
+                const Matrix<float,4,4> &m = instance.world;
+                float det = m(0,0)*(m(1,1)*m(2,2) - m(1,2)*m(2,1))
+                          - m(0,1)*(m(1,0)*m(2,2) - m(1,2)*m(2,0))
+                          + m(0,2)*(m(1,0)*m(2,1) - m(1,1)*m(2,0));
+                bool mirror = det < 0;
+                StaticBatchNormals<N>::transform(mesh.vertices, vertices_, 0, dst, n, m);
+                StaticBatchTangents<T>::transform(mesh.vertices, vertices_, 0, dst, n, m, mirror);
+
+                Vector<float,3> lo(0, 0, 0), hi(0, 0, 0);
+                for(size_t i = 0; i<n; ++i)
+                {
+                    Vector<float,3> p = baked[i];
+                    lo = i ? Vector<float,3>(min(lo, p)) : p;
+                    hi = i ? Vector<float,3>(max(hi, p)) : p;
+                }
+                instance_lo.set(s, lo);
+                instance_hi.set(s, hi);
+
+                unsigned offset = unsigned(dst - chunks_[chunk_of[s]].base);
+                unsigned *out = &indices_[0]+index_offsets[s];
+                const unsigned *in = mesh.indices.data();
+                for(size_t i = 0; i<mesh.indices.size(); i += 3)
+                {
+                    out[i] = in[i] + offset;
+                    out[i+1] = in[mirror ? i+2 : i+1] + offset;
+                    out[i+2] = in[mirror ? i+1 : i+2] + offset;
+                }
+            }
+        });
+
+        //chunk bounds, the instances of a chunk are consecutive
+        std::vector<size_t> chunk_start(chunks_.size()+1, count);
+        for(size_t s = count; s-->0;)
+            chunk_start[chunk_of[s]] = s;
+        lo_.resize(chunks_.size());
+        hi_.resize(chunks_.size());
+        glp::parallel_for(0, chunks_.size(), 4*grain, [&](size_t begin, size_t end) {
+            for(size_t c = begin; c<end; ++c)
+            {
+                Vector<float,3> lo = instance_lo.at(chunk_start[c]), hi = instance_hi.at(chunk_start[c]);
+                for(size_t s = chunk_start[c]+1; s<chunk_start[c+1]; ++s)
+                {
+                    lo = min(lo, instance_lo.at(s));
+                    hi = max(hi, instance_hi.at(s));
+                }
+                lo_.set(c, lo);
+                hi_.set(c, hi);
+            }
+        });
+    }
+
+    //the baked vertices and the chunk relative indices
+    const std::vector<V>& vertices() const { return vertices_; }
+    const std::vector<unsigned>& indices() const { return indices_; }
+
+    //draws sorted by material
+    const std::vector<StaticBatchChunk>& chunks() const { return chunks_; }
+
+    //bounding boxes of the chunks, for CullBoxes
+    const VectorArray<float,3>& chunk_lo() const { return lo_; }
+    const VectorArray<float,3>& chunk_hi() const { return hi_; }
+
+    //most vertices in one chunk, decides the index type
+    size_t max_chunk_vertices() const
+    {
+        size_t n = 0;
+        for(size_t c = 0; c<chunks_.size(); ++c)
+            n = std::max(n, chunks_[c].vertices);
+        return n;
+    }
+
+    //draw calls and memory of the last build compared to drawing every
+    //instance on its own
+    StaticBatchStats stats() const
+    {
+        StaticBatchStats stats = { instances.size(), chunks_.size(), materials, 0, 0 };
+        for(size_t m = 0; m<meshes.size(); ++m)
+            stats.source_bytes += meshes[m].vertices.size()*sizeof(V) +
+                meshes[m].indices.size()*(meshes[m].vertices.size() <= 0x10000 ? 2 : 4);
+        stats.batched_bytes = vertices_.size()*sizeof(V) +
+            indices_.size()*(max_chunk_vertices() <= 0x10000 ? 2 : 4);
+        return stats;
+    }
+
+private:
+    struct Mesh {
+        std::vector<V> vertices;
+        std::vector<unsigned> indices;
+    };
+
+    struct Instance {
+        unsigned mesh;
+        unsigned material;
+        Matrix<float,4,4> world;
+    };
+
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+
+    std::vector<V> vertices_;
+    std::vector<unsigned> indices_;
+    std::vector<StaticBatchChunk> chunks_;
+    VectorArray<float,3> lo_, hi_;
+    size_t materials;
+};
+
+#endif
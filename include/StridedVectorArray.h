@@ -0,0 +1,170 @@
+/*
+ * StridedVectorArray.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * StridedVectorArray.h provides views of vectors inside interleaved
+ * data such as a mapped glp::VertexBuffer. The views take part in the
+ * array expressions of VectorArray.h, which makes them the gather and
+ * scatter step between simulation data and vertex data:
+ *
+ *     VectorArray<float,3> pos = AttributeArray<0>(vertices);  //gather
+ *     AttributeArray<0>(vertices) = pos + vel*dt;              //scatter
+ */
+
+#ifndef STRIDED_VECTOR_ARRAY_H
+#define STRIDED_VECTOR_ARRAY_H
+
+#include <cstddef>
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/value_at.hpp>
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits.hpp>
+
+#include "MathVector.h"
+#include "VectorArray.h"
+#include "vector_traits.h"
+
+//view of count vectors of dimension D that start every stride bytes,
+//assigning an array expression writes through the view
+template<class T, unsigned D>
+class StridedVectorArray : public ArrayExpr<typename boost::remove_const<T>::type, D,
+                                            StridedVectorArray<T,D> > {
+public:
+    static const unsigned Dim = D;
+    typedef T Type;
+    typedef typename boost::remove_const<T>::type value_type;
+    typedef typename boost::mpl::if_c<boost::is_const<T>::value,
+                const char, char>::type byte_type;
+    typedef typename boost::mpl::if_c<boost::is_const<T>::value,
+                const InPlaceVector<value_type, D>,
+                InPlaceVector<value_type, D> >::type reference;
+
+    StridedVectorArray(T *b, size_t count, size_t stride = D*sizeof(T))
+        : base(reinterpret_cast<byte_type*>(b)), count_(count), stride_(stride)
+    { }
+
+    StridedVectorArray(const StridedVectorArray &a)
+        : base(a.base), count_(a.count_), stride_(a.stride_)
+    { }
+
+    //non const arrays can be read through const ones
+    template<class T2>
+    StridedVectorArray(const StridedVectorArray<T2, D> &a)
+        : base(a.bytes()), count_(a.size()), stride_(a.stride())
+    { }
+
+    //copies elements, like InPlaceVector the view itself isn't reseated,
+    //the sizes have to match
+    StridedVectorArray& operator=(const StridedVectorArray &a)
+    {
+        return operator=<StridedVectorArray>(a);
+    }
+
+    template<class A>
+    StridedVectorArray& operator=(const ArrayExpr<value_type, D, A> &a)
+    {
+        const A& ao ( a );
+        ArrayCheckSizes(count_, ao.size());
+        ArrayAssign<value_type, D>(*this, ao, count_);
+        return *this;
+    }
+
+    T* ptr(size_t i) const {
+        return reinterpret_cast<T*>(base+i*stride_);
+    }
+
+    reference operator[](size_t i) const {
+        return reference(const_cast<value_type*>(ptr(i)));
+    }
+
+    StridedVectorArray slice(size_t begin, size_t end) const {
+        return StridedVectorArray(ptr(begin), end-begin, stride_);
+    }
+
+    byte_type* bytes() const { return base; }
+    size_t size() const { return count_; }
+    size_t stride() const { return stride_; }
+
+    inline void get(size_t i, value_type *r) const
+    {
+        const T *p = ptr(i);
+        for(unsigned d = 0; d<D; ++d)
+            r[d] = p[d];
+    }
+
+    inline void put(size_t i, const value_type *r) const
+    {
+        T *p = ptr(i);
+        for(unsigned d = 0; d<D; ++d)
+            p[d] = r[d];
+    }
+
+private:
+    byte_type *base;
+    size_t count_;
+    size_t stride_;
+};
+
+template<unsigned D, class T>
+StridedVectorArray<T,D> MakeStridedArray(T *p, size_t count, size_t stride = D*sizeof(T))
+{
+    return StridedVectorArray<T,D>(p, count, stride);
+}
+
+//element type and number of elements an attribute is stored in. This
+//differs from vector_traits::dimension for packed types such as
+//PackedNormal which hold several components in one element.
+template<class A>
+struct attribute_storage {
+    typedef typename vector_traits<A>::element_type element_type;
+    static const unsigned dimension = sizeof(A)/sizeof(element_type);
+};
+
+//the N-th attribute of every vertex in a container of fusion vertices,
+//like a mapped glp::VertexBuffer or a std::vector
+template<int N, class B>
+StridedVectorArray<
+    typename attribute_storage<
+        typename boost::fusion::result_of::value_at_c<typename B::value_type, N>::type
+    >::element_type,
+    attribute_storage<
+        typename boost::fusion::result_of::value_at_c<typename B::value_type, N>::type
+    >::dimension
+>
+AttributeArray(B &buffer)
+{
+    typedef typename B::value_type vertex_type;
+    typedef typename boost::fusion::result_of::value_at_c<vertex_type, N>::type attribute_type;
+    typedef typename attribute_storage<attribute_type>::element_type element_type;
+    const unsigned dim = attribute_storage<attribute_type>::dimension;
+
+    if(buffer.size() == 0)
+        return StridedVectorArray<element_type, dim>(0, 0, sizeof(vertex_type));
+    vertex_type &first = *buffer.data();
+    return StridedVectorArray<element_type, dim>(
+        reinterpret_cast<element_type*>(&boost::fusion::at_c<N>(first)),
+        buffer.size(), sizeof(vertex_type));
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * GLP OpenGL Wrappers - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * TaskScheduler.h is a small work stealing job system. Every worker
+ * thread owns a deque of tasks: it pushes and pops at the back, idle
+ * workers steal from the front of the others. Threads that are not
+ * workers (such as the render thread) share one more deque. Threads
+ * waiting for a TaskGroup run queued tasks instead of blocking, so
+ * tasks may spawn and wait for tasks themselves.
+ *
+ *     glp::TaskGroup group;
+ *     glp::Task *load = group.run([&]() { ... });
+ *     glp::Task *skin = group.run([&]() { ... });
+ *     glp::Task *deps[] = { load, skin };
+ *     group.run([&]() { ... }, deps, 2);
+ *     group.wait();
+ *
+ * glp::parallel_for (ParallelFor.h) runs on TaskScheduler::instance().
+ */
+
+#ifndef GLP_TASK_SCHEDULER_H
+#define GLP_TASK_SCHEDULER_H
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+namespace glp {
+
+class TaskGroup;
+class TaskScheduler;
+
+//a function of a TaskGroup that runs after all its dependencies
+//finished, valid until the group is waited for
+class Task : boost::noncopyable {
+private:
+    friend class TaskGroup;
+    friend class TaskScheduler;
+
+    Task(const std::function<void()> &w, TaskGroup *g, size_t dependencies)
+        : work(w), group(g), waiting(dependencies), done(false)
+    { }
+
+    std::function<void()> work;
+    TaskGroup *group;
+    //unfinished dependencies
+    std::atomic<size_t> waiting;
+    std::mutex lock;
+    bool done;
+    std::vector<Task*> successors;
+};
+
+class TaskScheduler : boost::noncopyable {
+public:
+    //threads counts the calling thread, 0 uses all hardware threads
+    explicit TaskScheduler(unsigned threads = 0)
+        : stop(false), queued(0), sleepers(0)
+    {
+        start(threads);
+    }
+
+    ~TaskScheduler()
+    {
+        halt();
+    }
+
+    //the scheduler of parallel_for, started on first use
+    static TaskScheduler& instance()
+    {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    //worker threads plus the calling thread
+    unsigned threads() const { return unsigned(queues.size()); }
+
+    //restarts with a different number of threads, no tasks may be queued
+    //or running
+    void set_threads(unsigned threads)
+    {
+        halt();
+        start(threads);
+    }
+
+    //runs one queued task on the calling thread, false if there was none
+    bool run_one()
+    {
+        size_t own = queue_index();
+        Task *task = pop(own, false);
+        for(size_t i = 1; !task && i<queues.size(); ++i)
+            task = pop((own+i)%queues.size(), true);
+        if(!task)
+            return false;
+        execute(task);
+        return true;
+    }
+
+private:
+    friend class TaskGroup;
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    //scheduler and queue of the current thread
+    struct Worker {
+        TaskScheduler *scheduler;
+        size_t queue;
+    };
+
+    static Worker& current()
+    {
+        static thread_local Worker worker = { 0, 0 };
+        return worker;
+    }
+
+    //threads that aren't workers of this scheduler share queue 0
+    size_t queue_index() const
+    {
+        return current().scheduler == this ? current().queue : 0;
+    }
+
+    void start(unsigned threads)
+    {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        queues.clear();
+        for(unsigned q = 0; q<threads; ++q)
+            queues.push_back(std::unique_ptr<Queue>(new Queue));
+        for(unsigned q = 1; q<threads; ++q)
+            workers.push_back(std::thread([this, q]() { work(q); }));
+    }
+
+    void halt()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for(size_t w = 0; w<workers.size(); ++w)
+            workers[w].join();
+        workers.clear();
+        stop = false;
+    }
+
+    void submit(Task *task)
+    {
+        Queue &q = *queues[queue_index()];
+        {
+            std::lock_guard<std::mutex> lock(q.lock);
+            q.tasks.push_back(task);
+        }
+        queued.fetch_add(1);
+        if(sleepers.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            wake.notify_one();
+        }
+    }
+
+    //own tasks come from the back, stolen ones from the front
+    Task* pop(size_t q, bool steal)
+    {
+        Queue &queue = *queues[q];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if(queue.tasks.empty())
+            return 0;
+        Task *task;
+        if(steal)
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        queued.fetch_sub(1);
+        return task;
+    }
+
+    void execute(Task *task);
+
+    void work(size_t q)
+    {
+        Worker &self = current();
+        self.scheduler = this;
+        self.queue = q;
+        for(;;)
+        {
+            if(run_one())
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_lock);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            if(stop)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stop;
+    std::atomic<size_t> queued;
+    std::atomic<unsigned> sleepers;
+};
+
+//tasks that are waited for together. Exceptions thrown by tasks are
+//rethrown by wait(), successors of a failed task still run.
+class TaskGroup : boost::noncopyable {
+public:
+    explicit TaskGroup(TaskScheduler &s = TaskScheduler::instance())
+        : scheduler(s), pending(0)
+    { }
+
+    ~TaskGroup()
+    {
+        try { wait(); }
+        catch(...) { }
+    }
+
+    template<class F>
+    Task* run(F f)
+    {
+        return run(f, 0, 0);
+    }
+
+    template<class F>
+    Task* run(F f, Task *dependency)
+    {
+        return run(f, &dependency, 1);
+    }
+
+    //runs f once the count tasks in dependencies finished, they may
+    //belong to other groups that haven't been waited for yet
+    template<class F>
+    Task* run(F f, Task *const *dependencies, size_t count)
+    {
+        //the extra dependency keeps the task back until all are added
+        Task *task = new Task(f, this, count+1);
+        pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(tasks_lock);
+            tasks.push_back(task);
+        }
+        for(size_t d = 0; d<count; ++d)
+        {
+            Task &dependency = *dependencies[d];
+            std::lock_guard<std::mutex> lock(dependency.lock);
+            if(dependency.done)
+                task->waiting.fetch_sub(1);
+            else
+                dependency.successors.push_back(task);
+        }
+        if(task->waiting.fetch_sub(1) == 1)
+            scheduler.submit(task);
+        return task;
+    }
+
+    //runs queued tasks until all tasks of the group finished
+    void wait()
+    {
+        while(pending.load() > 0)
+            if(!scheduler.run_one())
+                std::this_thread::yield();
+        for(size_t t = 0; t<tasks.size(); ++t)
+            delete tasks[t];
+        tasks.clear();
+        if(error)
+        {
+            std::exception_ptr e = error;
+            error = std::exception_ptr();
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    friend class TaskScheduler;
+
+    void fail(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(tasks_lock);
+        if(!error)
+            error = e;
+    }
+
+    TaskScheduler &scheduler;
+    std::atomic<size_t> pending;
+    std::mutex tasks_lock;
+    std::vector<Task*> tasks;
+    std::exception_ptr error;
+};
+
+inline void TaskScheduler::execute(Task *task)
+{
+    try { task->work(); }
+    catch(...) { task->group->fail(std::current_exception()); }
+    task->work = std::function<void()>();
+
+    std::vector<Task*> ready;
+    {
+        std::lock_guard<std::mutex> lock(task->lock);
+        task->done = true;
+        ready.swap(task->successors);
+    }
+    for(size_t s = 0; s<ready.size(); ++s)
+        if(ready[s]->waiting.fetch_sub(1) == 1)
+            ready[s]->group->scheduler.submit(ready[s]);
+    //the group may be gone right after this
+    task->group->pending.fetch_sub(1);
+}
+
+}
+
+#endif
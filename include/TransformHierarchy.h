@@ -0,0 +1,279 @@
+/*
+ * TransformHierarchy.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * TransformHierarchy.h keeps a scene graph of local translation,
+ * rotation and scale transforms in flat arrays. Parents always come
+ * before their children, so dirty flags propagate in a single pass and
+ * update() only recomputes the world matrices of nodes that changed
+ * and of their descendants. Dirty nodes of the same depth don't depend
+ * on each other and are recomputed in parallel.
+ *
+ * Recomputed world matrices are remembered until they are written to
+ * a per instance vertex buffer with write_instances:
+ *
+ *     glp::VertexBuffer<InstanceTransform<float>::type> instances(nodes);
+ *     instances.setBaseAttrib(3);    //mat4 attribute at location 3
+ *     instances.setDivisor(1);
+ *     vao.attach(instances);
+ *     ...
+ *     scene.update();
+ *     instances.map(GL_MAP_WRITE_BIT);   //keep unchanged matrices
+ *     scene.write_instances<0>(instances);
+ *     instances.unmap();
+ */
+
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/fusion/include/vector.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "Quaternion.h"
+#include "ParallelFor.h"
+#include "StridedVectorArray.h"
+
+//levels with fewer dirty nodes than this are updated on the calling thread
+const size_t TransformHierarchyGrain = 4096;
+
+//per instance vertex layout of a world matrix, one column per attribute
+template<class T>
+struct InstanceTransform {
+    typedef boost::fusion::vector<
+                Vector<T,4>, Vector<T,4>, Vector<T,4>, Vector<T,4>
+            > type;
+};
+
+//translation*rotation*scale
+template<class T>
+Matrix<T, 4, 4> TRSMatrix(const Vector<T, 3> &t, const Quaternion<T> &r, const Vector<T, 3> &s)
+{
+    Matrix<T, 4, 4> res;
+    SetRotation(res, r);
+    for(unsigned j = 0; j<3; ++j)
+    {
+        for(unsigned i = 0; i<3; ++i)
+            res(i,j) *= s[j];
+        res(j,3) = t[j];
+    }
+    res(3,3) = 1;
+    return res;
+}
+
+template<class T>
+class TransformHierarchy {
+public:
+    //parent of root nodes
+    static const unsigned none = unsigned(-1);
+
+    TransformHierarchy() : max_depth(0)
+    { }
+
+    //adds a node with identity transform below parent, which has to be
+    //none or an existing node. Returns the index of the new node.
+    unsigned add(unsigned parent = none)
+    {
+        unsigned i = unsigned(parents.size());
+        if(parent != none && parent >= i)
+            throw std::invalid_argument("TransformHierarchy parent does not exist");
+        unsigned d = parent == none ? 0 : depths[parent]+1;
+        max_depth = std::max(max_depth, d);
+        parents.push_back(parent);
+        depths.push_back(d);
+        translations.push_back(Vector<T,3>());
+        rotations.push_back(Quaternion<T>());
+        scales.push_back(Vector<T,3>(1, 1, 1));
+        worlds.push_back(Matrix<T,4,4>());
+        dirty.push_back(1);
+        pending.push_back(0);
+        return i;
+    }
+
+    unsigned add(unsigned parent, const Vector<T,3> &t, const Quaternion<T> &r,
+                 const Vector<T,3> &s = Vector<T,3>(1, 1, 1))
+    {
+        unsigned i = add(parent);
+        set_local(i, t, r, s);
+        return i;
+    }
+
+    size_t size() const { return parents.size(); }
+    unsigned parent(unsigned i) const { return parents[i]; }
+    unsigned depth(unsigned i) const { return depths[i]; }
+
+    const Vector<T,3>& translation(unsigned i) const { return translations[i]; }
+    const Quaternion<T>& rotation(unsigned i) const { return rotations[i]; }
+    const Vector<T,3>& scale(unsigned i) const { return scales[i]; }
+
+    void set_translation(unsigned i, const Vector<T,3> &t)
+    {
+        translations[i] = t;
+        dirty[i] = 1;
+    }
+
+    void set_rotation(unsigned i, const Quaternion<T> &r)
+    {
+        rotations[i] = r;
+        dirty[i] = 1;
+    }
+
+    void set_scale(unsigned i, const Vector<T,3> &s)
+    {
+        scales[i] = s;
+        dirty[i] = 1;
+    }
+
+    void set_local(unsigned i, const Vector<T,3> &t, const Quaternion<T> &r,
+                   const Vector<T,3> &s)
+    {
+        translations[i] = t;
+        rotations[i] = r;
+        scales[i] = s;
+        dirty[i] = 1;
+    }
+
+    Matrix<T,4,4> local(unsigned i) const
+    {
+        return TRSMatrix(translations[i], rotations[i], scales[i]);
+    }
+
+    //valid after update()
+    const Matrix<T,4,4>& world(unsigned i) const { return worlds[i]; }
+
+    bool is_dirty(unsigned i) const { return dirty[i] != 0; }
+
+    //recomputes the world matrices of all dirty nodes and their
+    //descendants. Returns the number of recomputed matrices.
+    size_t update(size_t grain = TransformHierarchyGrain)
+    {
+        //propagate and bucket the dirty nodes by depth
+        std::vector<size_t> level_end(max_depth+1, 0);
+        size_t count = 0;
+        for(size_t i = 0; i<parents.size(); ++i)
+        {
+            if(parents[i] != none)
+                dirty[i] |= dirty[parents[i]];
+            if(dirty[i])
+            {
+                ++level_end[depths[i]];
+                ++count;
+            }
+        }
+        if(count == 0)
+            return 0;
+        for(unsigned d = 1; d<=max_depth; ++d)
+            level_end[d] += level_end[d-1];
+        order.resize(count);
+        std::vector<size_t> next(level_end.size(), 0);
+        for(unsigned d = 1; d<=max_depth; ++d)
+            next[d] = level_end[d-1];
+        for(size_t i = 0; i<parents.size(); ++i)
+            if(dirty[i])
+                order[next[depths[i]]++] = unsigned(i);
+
+        size_t begin = 0;
+        for(unsigned d = 0; d<=max_depth; ++d)
+        {
+            glp::parallel_for(begin, level_end[d], grain, [&](size_t b, size_t e) {
+                for(size_t k = b; k<e; ++k)
+                {
+                    unsigned i = order[k];
+                    if(parents[i] == none)
+                        worlds[i] = local(i);
+                    else
+                        worlds[i] = worlds[parents[i]]*local(i);
+                }
+            });
+            begin = level_end[d];
+        }
+
+        for(size_t k = 0; k<count; ++k)
+        {
+            unsigned i = order[k];
+            dirty[i] = 0;
+            if(!pending[i])
+            {
+                pending[i] = 1;
+                changes.push_back(i);
+            }
+        }
+        return count;
+    }
+
+    //nodes whose world matrix was recomputed since the last
+    //write_instances or clear_changes
+    const std::vector<unsigned>& changed() const { return changes; }
+
+    void clear_changes()
+    {
+        for(size_t k = 0; k<changes.size(); ++k)
+            pending[changes[k]] = 0;
+        changes.clear();
+    }
+
+    //writes the changed world matrices of node i to instance i of a
+    //mapped per instance buffer. The columns go to the 4 consecutive
+    //vec4 attributes starting at attribute N (see InstanceTransform).
+    template<int N, class B>
+    void write_instances(B &buffer, size_t grain = TransformHierarchyGrain)
+    {
+        StridedVectorArray<T,4> columns[4] = {
+            AttributeArray<N>(buffer), AttributeArray<N+1>(buffer),
+            AttributeArray<N+2>(buffer), AttributeArray<N+3>(buffer)
+        };
+        size_t n = std::min(buffer.size(), parents.size());
+        glp::parallel_for(0, changes.size(), grain, [&](size_t b, size_t e) {
+            for(size_t k = b; k<e; ++k)
+            {
+                unsigned i = changes[k];
+                if(i >= n)
+                    continue;
+                const T *m = worlds[i].raw();
+                for(unsigned j = 0; j<4; ++j)
+                    std::copy(m+4*j, m+4*j+4, columns[j].ptr(i));
+            }
+        });
+        clear_changes();
+    }
+
+private:
+    std::vector<unsigned> parents;
+    std::vector<unsigned> depths;
+    std::vector<Vector<T,3> > translations;
+    std::vector<Quaternion<T> > rotations;
+    std::vector<Vector<T,3> > scales;
+    std::vector<Matrix<T,4,4> > worlds;
+    std::vector<char> dirty;
+    std::vector<char> pending;
+    std::vector<unsigned> changes;
+    std::vector<unsigned> order;
+    unsigned max_depth;
+};
+
+#endif
@@ -3,6 +3,9 @@
 
 #define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
+
+#include "PackedTypes.h"
+
 namespace glp {
     
 template<class T>
@@ -32,6 +35,26 @@ struct TypeToGLConstant<GLint> { static const GLenum value = GL_INT; };
 template<>
 struct TypeToGLConstant<GLuint> { static const GLenum value = GL_UNSIGNED_INT; };
 
+template<>
+struct TypeToGLConstant<Half> { static const GLenum value = GL_HALF_FLOAT; };
+
+template<class I>
+struct TypeToGLConstant< Norm<I> > { static const GLenum value = TypeToGLConstant<I>::value; };
+
+template<>
+struct TypeToGLConstant<PackedNormal> { static const GLenum value = GL_INT_2_10_10_10_REV; };
+
+// fixed point vertex attributes that are read as floats in [-1, 1]
+// or [0, 1]
+template<class T>
+struct TypeIsNormalized { static const bool value = false; };
+
+template<class I>
+struct TypeIsNormalized< Norm<I> > { static const bool value = true; };
+
+template<>
+struct TypeIsNormalized<PackedNormal> { static const bool value = true; };
+
 GLenum uint2attachment(GLuint i)
 {
 #define GLPUINT2ATTACHMENT_MACRO(arg) case arg: return GL_COLOR_ATTACHMENT##arg ;
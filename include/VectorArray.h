@@ -0,0 +1,522 @@
+/*
+ * VectorArray.h - Copyright (c) 2012 Jakob Progsch
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ */
+
+/*
+ * VectorArray.h provides a structure of arrays container for large
+ * numbers of vectors together with expression templates that work on
+ * whole arrays. An expression like a + b*dt is evaluated in a single
+ * loop over all elements without temporaries.
+ */
+
+#ifndef VECTOR_ARRAY_H
+#define VECTOR_ARRAY_H
+
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits.hpp>
+
+#include "MathVector.h"
+#include "ParallelFor.h"
+
+//arrays smaller than this are evaluated on the calling thread
+const size_t VectorArrayGrain = 65536;
+
+//alignment of every component lane in bytes
+const size_t VectorArrayAlignment = 64;
+
+#if defined(__clang__)
+    #define GLP_VECTORIZE_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+    #define GLP_VECTORIZE_LOOP _Pragma("GCC ivdep")
+#else
+    #define GLP_VECTORIZE_LOOP
+#endif
+
+template<class T, unsigned D> class VectorArray;
+
+template<class T, unsigned D>
+struct expression_storage< VectorArray<T,D> > { typedef const VectorArray<T,D>& type; };
+
+//base class for all array expression templates
+//get(i, r) writes the D components of element i to r
+template<class T, unsigned D, class A>
+class ArrayExpr {
+public:
+    static const unsigned Dim = D;
+    typedef T Type;
+
+    inline operator const A&() const
+    {
+        return *static_cast<const A*>(this);
+    }
+};
+
+//evaluates a into dst element by element, every element is computed
+//completely before it is stored so dst may appear in a.
+//gcc vectorizes the loop at -O3.
+template<class T, unsigned D, class Dst, class A>
+void ArrayAssign(Dst &dst, const A &a, size_t n)
+{
+    glp::parallel_for(0, n, VectorArrayGrain, [&](size_t begin, size_t end) {
+        GLP_VECTORIZE_LOOP
+        for(size_t i = begin; i<end; ++i)
+        {
+            T r[D];
+            a.get(i, r);
+            dst.put(i, r);
+        }
+    });
+}
+
+//operands of binary expressions have to be of the same size, checked
+//once when the expression is built instead of per element
+inline void ArrayCheckSizes(size_t a, size_t b)
+{
+    if(a != b)
+        throw std::length_error("VectorArray expression operand sizes differ");
+}
+
+#define MAKE_ARR_ARR_EXPRESSION(NAME, EXPR, FUNCTION)                   \
+template<class T, unsigned D, class A, class B>                         \
+class NAME : public ArrayExpr<T, D, NAME<T, D, A, B> > {                \
+public:                                                                 \
+    NAME(const A& pa, const B& pb) : a(pa), b(pb)                       \
+    {                                                                   \
+        ArrayCheckSizes(a.size(), b.size());                                \
+    }                                                                   \
+    size_t size() const { return a.size(); }                            \
+    inline void get(size_t i, T *r) const                               \
+    {                                                                   \
+        T x[D], y[D];                                                   \
+        a.get(i, x);                                                    \
+        b.get(i, y);                                                    \
+        for(unsigned d = 0; d<D; ++d)                                   \
+            r[d] = EXPR;                                                \
+    }                                                                   \
+private:                                                                \
+    typename expression_storage<A>::type a;                             \
+    typename expression_storage<B>::type b;                             \
+};                                                                      \
+                                                                        \
+template<class T, unsigned D, class A, class B>                         \
+inline NAME<T,D,A,B>                                                    \
+FUNCTION(const ArrayExpr<T,D,A> &a, const ArrayExpr<T,D,B> &b)          \
+{                                                                       \
+    return NAME<T,D,A,B>(a, b);                                         \
+}
+
+//second operand is an array of scalars (like the result of dot)
+#define MAKE_ARR_SARR_EXPRESSION(NAME, EXPR, FUNCTION)                  \
+template<class T, unsigned D, class A, class B>                         \
+class NAME : public ArrayExpr<T, D, NAME<T, D, A, B> > {                \
+public:                                                                 \
+    NAME(const A& pa, const B& pb) : a(pa), b(pb)                       \
+    {                                                                   \
+        ArrayCheckSizes(a.size(), b.size());                                \
+    }                                                                   \
+    size_t size() const { return a.size(); }                            \
+    inline void get(size_t i, T *r) const                               \
+    {                                                                   \
+        T x[D], y[1];                                                   \
+        a.get(i, x);                                                    \
+        b.get(i, y);                                                    \
+        for(unsigned d = 0; d<D; ++d)                                   \
+            r[d] = EXPR;                                                \
+    }                                                                   \
+private:                                                                \
+    typename expression_storage<A>::type a;                             \
+    typename expression_storage<B>::type b;                             \
+};                                                                      \
+                                                                        \
+template<class T, unsigned D, class A, class B>                         \
+inline NAME<T,D,A,B>                                                    \
+FUNCTION(const ArrayExpr<T,D,A> &a, const ArrayExpr<T,1,B> &b)          \
+{                                                                       \
+    return NAME<T,D,A,B>(a, b);                                         \
+}
+
+#define MAKE_ARR_SCAL_EXPRESSION(NAME, EXPR, FUNCTION)                  \
+template<class T, unsigned D, class A>                                  \
+class NAME : public ArrayExpr<T, D, NAME<T, D, A> > {                   \
+public:                                                                 \
+    NAME(const A& pa, const T& pb) : a(pa), b(pb)   { }                 \
+    size_t size() const { return a.size(); }                            \
+    inline void get(size_t i, T *r) const                               \
+    {                                                                   \
+        T x[D];                                                         \
+        a.get(i, x);                                                    \
+        for(unsigned d = 0; d<D; ++d)                                   \
+            r[d] = EXPR;                                                \
+    }                                                                   \
+private:                                                                \
+    typename expression_storage<A>::type a;                             \
+    const T b;                                                          \
+};                                                                      \
+                                                                        \
+template<class T, unsigned D, class A>                                  \
+inline NAME<T,D,A>                                                      \
+FUNCTION(const ArrayExpr<T,D,A> &a, const T &b)                         \
+{                                                                       \
+    return NAME<T,D,A>(a, b);                                           \
+}
+
+#define MAKE_SCAL_ARR_EXPRESSION(NAME, EXPR, FUNCTION)                  \
+template<class T, unsigned D, class A>                                  \
+class NAME : public ArrayExpr<T, D, NAME<T, D, A> > {                   \
+public:                                                                 \
+    NAME(const T& pa, const A& pb) : a(pa), b(pb)   { }                 \
+    size_t size() const { return b.size(); }                            \
+    inline void get(size_t i, T *r) const                               \
+    {                                                                   \
+        T y[D];                                                         \
+        b.get(i, y);                                                    \
+        for(unsigned d = 0; d<D; ++d)                                   \
+            r[d] = EXPR;                                                \
+    }                                                                   \
+private:                                                                \
+    const T a;                                                          \
+    typename expression_storage<A>::type b;                             \
+};                                                                      \
+                                                                        \
+template<class T, unsigned D, class A>                                  \
+inline NAME<T,D,A>                                                      \
+FUNCTION(const T &a, const ArrayExpr<T,D,A> &b)                         \
+{                                                                       \
+    return NAME<T,D,A>(a, b);                                           \
+}
+
+#define MAKE_ARR_EXPRESSION(NAME, EXPR, FUNCTION)                       \
+template<class T, unsigned D, class A>                                  \
+class NAME : public ArrayExpr<T, D, NAME<T, D, A> > {                   \
+public:                                                                 \
+    NAME(const A& pa) : a(pa)   { }                                     \
+    size_t size() const { return a.size(); }                            \
+    inline void get(size_t i, T *r) const                               \
+    {                                                                   \
+        T x[D];                                                         \
+        a.get(i, x);                                                    \
+        for(unsigned d = 0; d<D; ++d)                                   \
+            r[d] = EXPR;                                                \
+    }                                                                   \
+private:                                                                \
+    typename expression_storage<A>::type a;                             \
+};                                                                      \
+                                                                        \
+template<class T, unsigned D, class A>                                  \
+inline NAME<T,D,A>                                                      \
+FUNCTION(const ArrayExpr<T,D,A> &a)                                     \
+{                                                                       \
+    return NAME<T,D,A>(a);                                              \
+}
+
+//create actual functions and operators
+MAKE_ARR_ARR_EXPRESSION (ArrEMulExpr, x[d] * y[d],  multiply_elements)
+MAKE_ARR_ARR_EXPRESSION (ArrEDivExpr, x[d] / y[d],  divide_elements)
+MAKE_ARR_ARR_EXPRESSION (ArrAddExpr,  x[d] + y[d],  operator+)
+MAKE_ARR_ARR_EXPRESSION (ArrSubExpr,  x[d] - y[d],  operator-)
+MAKE_ARR_ARR_EXPRESSION (ArrEMaxExpr, std::max(x[d], y[d]), max)
+MAKE_ARR_ARR_EXPRESSION (ArrEMinExpr, std::min(x[d], y[d]), min)
+MAKE_ARR_SARR_EXPRESSION(ArrSMulExpr, x[d] * y[0],  operator*)
+MAKE_ARR_SARR_EXPRESSION(ArrSDivExpr, x[d] / y[0],  operator/)
+MAKE_ARR_SCAL_EXPRESSION(ArrDivExpr,  x[d] / b,     operator/)
+MAKE_ARR_SCAL_EXPRESSION(ArrMulExpr1, x[d] * b,     operator*)
+MAKE_SCAL_ARR_EXPRESSION(ArrMulExpr2, a * y[d],     operator*)
+MAKE_ARR_EXPRESSION     (ArrNegExpr,  -x[d],        operator-)
+
+//per element reductions, the results are arrays of scalars
+template<class T, unsigned D, class A, class B>
+class ArrDotExpr : public ArrayExpr<T, 1, ArrDotExpr<T, D, A, B> > {
+public:
+    ArrDotExpr(const A& pa, const B& pb) : a(pa), b(pb)
+    {
+        ArrayCheckSizes(a.size(), b.size());
+    }
+    size_t size() const { return a.size(); }
+    inline void get(size_t i, T *r) const
+    {
+        T x[D], y[D];
+        a.get(i, x);
+        b.get(i, y);
+        T res = 0;
+        for(unsigned d = 0; d<D; ++d)
+            res += x[d]*y[d];
+        r[0] = res;
+    }
+private:
+    typename expression_storage<A>::type a;
+    typename expression_storage<B>::type b;
+};
+
+template<class T, unsigned D, class A, class B>
+inline ArrDotExpr<T,D,A,B>
+dot(const ArrayExpr<T,D,A> &a, const ArrayExpr<T,D,B> &b)
+{
+    return ArrDotExpr<T,D,A,B>(a, b);
+}
+
+template<class T, unsigned D, class A, class P = ExactPrecision>
+class ArrNormExpr : public ArrayExpr<T, 1, ArrNormExpr<T, D, A, P> > {
+public:
+    ArrNormExpr(const A& pa, bool s) : a(pa), squared(s) { }
+    size_t size() const { return a.size(); }
+    inline void get(size_t i, T *r) const
+    {
+        T x[D];
+        a.get(i, x);
+        T res = 0;
+        for(unsigned d = 0; d<D; ++d)
+            res += x[d]*x[d];
+        r[0] = squared ? res : precision_sqrt(res, P());
+    }
+private:
+    typename expression_storage<A>::type a;
+    const bool squared;
+};
+
+template<class T, unsigned D, class A>
+inline ArrNormExpr<T,D,A>
+squared_norm(const ArrayExpr<T,D,A> &a)
+{
+    return ArrNormExpr<T,D,A>(a, true);
+}
+
+template<class T, unsigned D, class A>
+inline ArrNormExpr<T,D,A>
+norm(const ArrayExpr<T,D,A> &a)
+{
+    return ArrNormExpr<T,D,A>(a, false);
+}
+
+template<class T, unsigned D, class A, class P>
+inline ArrNormExpr<T,D,A,P>
+norm(const ArrayExpr<T,D,A> &a, P)
+{
+    return ArrNormExpr<T,D,A,P>(a, false);
+}
+
+template<class T, unsigned D, class A, class P = ExactPrecision>
+class ArrNormalizeExpr : public ArrayExpr<T, D, ArrNormalizeExpr<T, D, A, P> > {
+public:
+    ArrNormalizeExpr(const A& pa) : a(pa) { }
+    size_t size() const { return a.size(); }
+    inline void get(size_t i, T *r) const
+    {
+        T x[D];
+        a.get(i, x);
+        T res = 0;
+        for(unsigned d = 0; d<D; ++d)
+            res += x[d]*x[d];
+        T inv = rsqrt(res, P());
+        for(unsigned d = 0; d<D; ++d)
+            r[d] = x[d]*inv;
+    }
+private:
+    typename expression_storage<A>::type a;
+};
+
+template<class T, unsigned D, class A>
+inline ArrNormalizeExpr<T,D,A>
+normalize(const ArrayExpr<T,D,A> &a)
+{
+    return ArrNormalizeExpr<T,D,A>(a);
+}
+
+template<class T, unsigned D, class A, class P>
+inline ArrNormalizeExpr<T,D,A,P>
+normalize(const ArrayExpr<T,D,A> &a, P)
+{
+    return ArrNormalizeExpr<T,D,A,P>(a);
+}
+
+//the actual container, component d of element i is lane(d)[i]
+template<class T, unsigned D>
+class VectorArray : public ArrayExpr<T, D, VectorArray<T,D> > {
+public:
+    BOOST_STATIC_ASSERT(boost::is_arithmetic<T>::value);
+
+    static const unsigned Dim = D;
+    typedef T Type;
+
+    VectorArray() : data(0), count(0), lane_stride(0)
+    { }
+
+    explicit VectorArray(size_t n) : data(0)
+    {
+        allocate(n);
+        std::fill(data, data+D*lane_stride, T());
+    }
+
+    VectorArray(size_t n, Uninitialized) : data(0)
+    {
+        allocate(n);
+    }
+
+    VectorArray(const VectorArray &a) : data(0)
+    {
+        allocate(a.count);
+        std::copy(a.data, a.data+D*lane_stride, data);
+    }
+
+    VectorArray(VectorArray &&a)
+        : data(a.data), count(a.count), lane_stride(a.lane_stride)
+    {
+        a.data = 0;
+        a.count = a.lane_stride = 0;
+    }
+
+    template<class A>
+    VectorArray(const ArrayExpr<T, D, A> &a) : data(0)
+    {
+        const A& ao ( a );
+        allocate(ao.size());
+        ArrayAssign<T,D>(*this, ao, count);
+    }
+
+    ~VectorArray()
+    {
+        boost::alignment::aligned_free(data);
+    }
+
+    void swap(VectorArray &a)
+    {
+        std::swap(data, a.data);
+        std::swap(count, a.count);
+        std::swap(lane_stride, a.lane_stride);
+    }
+
+    VectorArray& operator=(VectorArray a)
+    {
+        swap(a);
+        return *this;
+    }
+
+    template<class A>
+    VectorArray& operator=(const ArrayExpr<T, D, A> &a)
+    {
+        const A& ao ( a );
+        if(ao.size() != count)
+        {
+            VectorArray tmp(ao);
+            swap(tmp);
+        }
+        else
+        {
+            ArrayAssign<T,D>(*this, ao, count);
+        }
+        return *this;
+    }
+
+    template<class A>
+    VectorArray& operator+=(const ArrayExpr<T, D, A> &a)
+    {
+        return *this = *this + a;
+    }
+
+    template<class A>
+    VectorArray& operator-=(const ArrayExpr<T, D, A> &a)
+    {
+        return *this = *this - a;
+    }
+
+    VectorArray& operator*=(const T &b)
+    {
+        return *this = *this * b;
+    }
+
+    VectorArray& operator/=(const T &b)
+    {
+        return *this = *this / b;
+    }
+
+    //keeps the first min(n, size()) elements, new elements are zero
+    void resize(size_t n)
+    {
+        VectorArray tmp(n);
+        size_t m = std::min(n, count);
+        for(unsigned d = 0; d<D; ++d)
+            std::copy(lane(d), lane(d)+m, tmp.lane(d));
+        swap(tmp);
+    }
+
+    size_t size() const { return count; }
+
+    T* lane(unsigned d) { return data+d*lane_stride; }
+    const T* lane(unsigned d) const { return data+d*lane_stride; }
+
+    Vector<T,D> at(size_t i) const
+    {
+        Vector<T,D> res(uninitialized);
+        get(i, res.raw());
+        return res;
+    }
+
+    template<class A>
+    void set(size_t i, const VectorExpr<T, D, A> &a)
+    {
+        Vector<T,D> tmp(a);
+        put(i, tmp.raw());
+    }
+
+    inline void get(size_t i, T *r) const
+    {
+        for(unsigned d = 0; d<D; ++d)
+            r[d] = data[d*lane_stride+i];
+    }
+
+    inline void put(size_t i, const T *r)
+    {
+        for(unsigned d = 0; d<D; ++d)
+            data[d*lane_stride+i] = r[d];
+    }
+
+private:
+    void allocate(size_t n)
+    {
+        const size_t per_line = VectorArrayAlignment/sizeof(T);
+        count = n;
+        lane_stride = (n+per_line-1)/per_line*per_line;
+        if(lane_stride == 0)
+            return;
+        data = static_cast<T*>(boost::alignment::aligned_alloc(
+                    VectorArrayAlignment, D*lane_stride*sizeof(T)));
+        if(!data)
+            throw std::bad_alloc();
+    }
+
+    T *data;
+    size_t count;
+    size_t lane_stride;
+};
+
+#undef MAKE_ARR_ARR_EXPRESSION
+#undef MAKE_ARR_SARR_EXPRESSION
+#undef MAKE_ARR_SCAL_EXPRESSION
+#undef MAKE_SCAL_ARR_EXPRESSION
+#undef MAKE_ARR_EXPRESSION
+
+#endif
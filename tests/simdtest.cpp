@@ -0,0 +1,367 @@
+// checks that the MathSimd.h kernels behind dense float vectors and
+// 4x4 matrices agree with the generic element wise code paths of
+// MathVector.h and MathMatrix.h on random input:
+//
+//   product, transpose, dot, cross  - bit exact, or within a few ulp of
+//                                     the magnitude of the summed terms
+//                                     where the compiler contracts to fma
+//   normalize                       - within 4 ulp
+//   inverse, affine inverse         - within a relative error of 2^-16
+//   StaticBatch normals             - within 4 ulp of the inverse
+//                                     transpose, under non uniform scales
+//
+// Exits with 1 and prints the failing ops if a bound is exceeded.
+// Build once normally and once with -DGLP_NO_SIMD, where both paths
+// are the same code and everything has to match exactly:
+//
+//   g++ -O3 -march=native -std=c++11 -pthread -Iinclude tests/simdtest.cpp
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/fusion/include/vector.hpp>
+
+#include "MathVector.h"
+#include "MathMatrix.h"
+#include "GraphicsMatrices.h"
+#include "StaticBatch.h"
+
+const unsigned trials = 100000;
+
+std::mt19937 rng(12345);
+std::uniform_real_distribution<float> uniform(-4.0f, 4.0f);
+
+struct Check {
+    std::string op;
+    double max_error, bound;
+};
+
+std::vector<Check> checks;
+
+//worst error of a over all trials, in multiples of the unit
+void record(const std::string &op, double error, double bound)
+{
+    for(size_t i = 0; i<checks.size(); ++i)
+        if(checks[i].op == op)
+        {
+            checks[i].max_error = std::max(checks[i].max_error, error);
+            return;
+        }
+    Check c = { op, error, bound };
+    checks.push_back(c);
+}
+
+//distance in representable floats, +0 and -0 are the same
+double ulps(float a, float b)
+{
+    if(a == b)
+        return 0;
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, 4);
+    std::memcpy(&ib, &b, 4);
+    if(ia < 0) ia = std::numeric_limits<int32_t>::min()-ia;
+    if(ib < 0) ib = std::numeric_limits<int32_t>::min()-ib;
+    return std::fabs(double(ia)-double(ib));
+}
+
+//error of a against the reference b in ulp of scale
+double scaled_ulps(float a, float b, float scale)
+{
+    return std::fabs(double(a)-double(b))/(double(scale)*std::numeric_limits<float>::epsilon());
+}
+
+template<class V>
+void randomize(V &v, unsigned n)
+{
+    for(unsigned i = 0; i<n; ++i)
+        v.raw()[i] = uniform(rng);
+}
+
+template<class A, class B>
+void reference(const MatMatMulExpr<float, 4, 4, A, B> &e, float *out)
+{
+    MatMatMulAssignLoop<float, 4, 4, A, B>::run(out, e);
+}
+
+template<class A, class B>
+void reference(const MatVecMulExpr<float, 4, 4, A, B> &e, float *out)
+{
+    MatVecMulAssignLoop<float, 4, 4, A, B>::run(out, e);
+}
+
+template<class A>
+void reference(const TransExpr<float, 4, 4, A> &e, float *out)
+{
+    MatrixAssignLoop<float, 4, 4, TransExpr<float, 4, 4, A> >::run(out, e);
+}
+
+//the terms summed for out(i,j) of a*b, scaled by their magnitude
+float product_scale(const float *a, const float *b, unsigned i, unsigned j)
+{
+    float s = 0;
+    for(unsigned k = 0; k<4; ++k)
+        s += std::fabs(a[i+4*k]*b[k+4*j]);
+    return s;
+}
+
+void check_products()
+{
+    Matrix<float,4,4> a, b, c;
+    Vector<float,4> v, w;
+    float buffer[32];
+    InPlaceMatrix<float,4,4> ia(buffer), ib(buffer+16);
+    for(unsigned t = 0; t<trials; ++t)
+    {
+        randomize(a, 16);
+        randomize(b, 16);
+        randomize(v, 4);
+        for(unsigned i = 0; i<16; ++i)
+        {
+            buffer[i] = a.raw()[i];
+            buffer[16+i] = b.raw()[i];
+        }
+
+        float r[16];
+        double e = 0;
+        c = a*b;
+        reference(a*b, r);
+        for(unsigned j = 0; j<4; ++j)
+            for(unsigned i = 0; i<4; ++i)
+                e = std::max(e, scaled_ulps(c(i,j), r[i+4*j], product_scale(a.raw(), b.raw(), i, j)));
+        record("Matrix*Matrix", e, 4);
+
+        e = 0;
+        c = ia*ib;
+        reference(ia*ib, r);
+        for(unsigned j = 0; j<4; ++j)
+            for(unsigned i = 0; i<4; ++i)
+                e = std::max(e, scaled_ulps(c(i,j), r[i+4*j], product_scale(a.raw(), b.raw(), i, j)));
+        record("InPlaceMatrix*InPlaceMatrix", e, 4);
+
+        e = 0;
+        w = a*v;
+        reference(a*v, r);
+        for(unsigned i = 0; i<4; ++i)
+            e = std::max(e, scaled_ulps(w[i], r[i], product_scale(a.raw(), v.raw(), i, 0)));
+        record("Matrix*Vector", e, 4);
+
+        e = 0;
+        c = Transpose(a);
+        reference(Transpose(a), r);
+        for(unsigned i = 0; i<16; ++i)
+            e = std::max(e, ulps(c.raw()[i], r[i]));
+        record("Transpose", e, 0);
+
+        //top 3 rows of the product as stored in skinning palettes
+        e = 0;
+        float rows[12];
+        c = Transpose(b);
+        simd::mat4_mul_rows3(a.raw(), c.raw(), rows);
+        reference(a*b, r);
+        for(unsigned i = 0; i<3; ++i)
+            for(unsigned j = 0; j<4; ++j)
+                e = std::max(e, scaled_ulps(rows[4*i+j], r[i+4*j], product_scale(a.raw(), b.raw(), i, j)));
+        record("mat4_mul_rows3", e, 4);
+
+        //a 4x4 result with an inner dimension of 3 stays on the loops
+        e = 0;
+        Matrix<float,4,3> n;
+        Matrix<float,3,4> m;
+        randomize(n, 12);
+        randomize(m, 12);
+        c = n*m;
+        for(unsigned j = 0; j<4; ++j)
+            for(unsigned i = 0; i<4; ++i)
+            {
+                float s = 0, scale = 0;
+                for(unsigned k = 0; k<3; ++k)
+                {
+                    s += n(i,k)*m(k,j);
+                    scale += std::fabs(n(i,k)*m(k,j));
+                }
+                e = std::max(e, scaled_ulps(c(i,j), s, scale));
+            }
+        record("Matrix4x3*Matrix3x4", e, 4);
+
+        //in place, the kernels have to read all input before writing
+        e = 0;
+        c = a;
+        c = c*b;
+        reference(a*b, r);
+        for(unsigned j = 0; j<4; ++j)
+            for(unsigned i = 0; i<4; ++i)
+                e = std::max(e, scaled_ulps(c(i,j), r[i+4*j], product_scale(a.raw(), b.raw(), i, j)));
+        record("Matrix*=Matrix aliased", e, 4);
+    }
+}
+
+template<unsigned D>
+void check_vectors()
+{
+    const std::string suffix = D == 3 ? "3" : "4";
+    Vector<float,D> a, b;
+    for(unsigned t = 0; t<trials; ++t)
+    {
+        randomize(a, D);
+        randomize(b, D);
+
+        float s = dot(a, b);
+        float r = VectorKernel<float, D, false>::dot(a, b);
+        float scale = 0;
+        for(unsigned i = 0; i<D; ++i)
+            scale += std::fabs(a[i]*b[i]);
+        record("dot"+suffix, scaled_ulps(s, r, scale), 4);
+
+        Vector<float,D> n = normalize(a, exact_precision);
+        Vector<float,D> rn = VectorKernel<float, D, false>::normalize(a, exact_precision);
+        double e = 0;
+        for(unsigned i = 0; i<D; ++i)
+            e = std::max(e, scaled_ulps(n[i], rn[i], 1));
+        record("normalize"+suffix, e, 4);
+    }
+}
+
+void check_cross()
+{
+    Vector<float,3> a, b;
+    for(unsigned t = 0; t<trials; ++t)
+    {
+        randomize(a, 3);
+        randomize(b, 3);
+        Vector<float,3> c = cross(a, b);
+        Vector<float,3> r = VectorKernel<float, 3, false>::cross(a, b);
+        double e = 0;
+        for(unsigned i = 0; i<3; ++i)
+        {
+            unsigned j = (i+1)%3, k = (i+2)%3;
+            e = std::max(e, scaled_ulps(c[i], r[i], std::fabs(a[j]*b[k])+std::fabs(a[k]*b[j])));
+        }
+        record("cross", e, 4);
+    }
+}
+
+void check_inverse()
+{
+    Matrix<float,4,4> m;
+    for(unsigned t = 0; t<trials; ++t)
+    {
+        //diagonally dominant, so the inverse is well conditioned
+        randomize(m, 16);
+        for(unsigned i = 0; i<4; ++i)
+            m(i,i) += 20*(m(i,i) < 0 ? -1 : 1);
+        Matrix<float,4,4> inv = Inverse(m);
+        float r[16];
+        Mat4InverseLoop<float>::inverse(m.raw(), r);
+        float scale = 0;
+        for(unsigned i = 0; i<16; ++i)
+            scale = std::max(scale, std::fabs(r[i]));
+        double e = 0;
+        for(unsigned i = 0; i<16; ++i)
+            e = std::max(e, std::fabs(double(inv.raw()[i])-r[i])/scale);
+        record("Inverse", e*65536, 1);
+    }
+}
+
+void check_affine_inverse()
+{
+    Matrix<float,4,4> m;
+    for(unsigned t = 0; t<trials; ++t)
+    {
+        randomize(m, 16);
+        for(unsigned i = 0; i<3; ++i)
+            m(i,i) += 20*(m(i,i) < 0 ? -1 : 1);
+        m(3,0) = m(3,1) = m(3,2) = 0;
+        m(3,3) = 1;
+        Matrix<float,4,4> inv = AffineInverse(m), r;
+        AffineInverseLoop<float>::inverse(m, r);
+        float scale = 0;
+        for(unsigned i = 0; i<16; ++i)
+            scale = std::max(scale, std::fabs(r.raw()[i]));
+        double e = 0;
+        for(unsigned i = 0; i<16; ++i)
+            e = std::max(e, std::fabs(double(inv.raw()[i])-r.raw()[i])/scale);
+        record("AffineInverse", e*65536, 1);
+    }
+}
+
+//normals baked under a non uniform scale bend away from the stretched
+//axis, n/s renormalized, computed in double
+void check_static_batch_normals()
+{
+    typedef boost::fusion::vector<Vector<float,3>, Vector<float,3> > Vertex;
+    std::uniform_real_distribution<float> scales(0.25f, 4.0f);
+    for(unsigned t = 0; t<trials/100; ++t)
+    {
+        Vector<float,3> n;
+        randomize(n, 3);
+        n = normalize(n);
+        std::vector<Vertex> vertices(3, Vertex(Vector<float,3>(0, 0, 0), n));
+        std::vector<unsigned> indices = { 0, 1, 2 };
+        float s[3] = { scales(rng), scales(rng), scales(rng) };
+        if(t == 0)
+        {
+            //(1,1,0)/sqrt(2) under a scale of y by 2 has to come out as (2,1,0)/sqrt(5)
+            n = normalize(Vector<float,3>(1, 1, 0));
+            vertices.assign(3, Vertex(Vector<float,3>(0, 0, 0), n));
+            s[0] = 1;
+            s[1] = 2;
+            s[2] = 1;
+        }
+
+        StaticBatchBuilder<Vertex> builder;
+        builder.add_instance(builder.add_mesh(vertices, indices), 0, ScaleMatrix(s[0], s[1], s[2]));
+        builder.build<0,1>(1.0f);
+
+        double r[3], length = 0;
+        for(unsigned i = 0; i<3; ++i)
+        {
+            r[i] = double(n[i])/s[i];
+            length += r[i]*r[i];
+        }
+        double e = 0;
+        for(unsigned v = 0; v<3; ++v)
+        {
+            const Vector<float,3> &out = boost::fusion::at_c<1>(builder.vertices()[v]);
+            for(unsigned i = 0; i<3; ++i)
+                e = std::max(e, std::fabs(out[i]-r[i]/std::sqrt(length))/std::numeric_limits<float>::epsilon());
+        }
+        record("StaticBatch normals", e, 4);
+    }
+}
+
+int main()
+{
+    check_products();
+    check_vectors<3>();
+    check_vectors<4>();
+    check_cross();
+    check_inverse();
+    check_affine_inverse();
+    check_static_batch_normals();
+
+#ifdef GLP_SIMD_SSE
+    std::cout << "simd kernels: sse";
+#ifdef GLP_SIMD_AVX
+    std::cout << ", avx";
+#endif
+    std::cout << '\n';
+#else
+    std::cout << "simd kernels: none\n";
+#endif
+
+    bool failed = false;
+    for(size_t i = 0; i<checks.size(); ++i)
+    {
+        bool ok = checks[i].max_error <= checks[i].bound;
+        failed = failed || !ok;
+        std::cout << (ok ? "ok   " : "FAIL ") << checks[i].op << ": max error "
+                  << checks[i].max_error << ", bound " << checks[i].bound << '\n';
+    }
+    return failed ? 1 : 0;
+}